@@ -0,0 +1,112 @@
+#include "AllocationTracker.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+// plain globals rather than function statics, operator new can be called before main and statics would allocate a guard
+static std::thread::id trackedThread;
+static std::atomic<bool> tracking(false);
+static unsigned int frameAllocations = 0;
+static unsigned long long frameBytes = 0;
+static unsigned int totalAllocations = 0;
+static unsigned long long totalBytes = 0;
+
+static void CountAllocation(size_t bytes_)
+{
+    // only the tracked thread ever writes the counters, so they dont need to be atomic
+    if (tracking.load(std::memory_order_relaxed) && std::this_thread::get_id() == trackedThread)
+    {
+        ++frameAllocations;
+        frameBytes += bytes_;
+        ++totalAllocations;
+        totalBytes += bytes_;
+    }
+}
+
+static void* Allocate(size_t bytes_)
+{
+    CountAllocation(bytes_);
+    void* memory = std::malloc(bytes_ > 0 ? bytes_ : 1);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new(size_t bytes_)
+{
+    return Allocate(bytes_);
+}
+
+void* operator new[](size_t bytes_)
+{
+    return Allocate(bytes_);
+}
+
+void* operator new(size_t bytes_, const std::nothrow_t&) throw()
+{
+    CountAllocation(bytes_);
+    return std::malloc(bytes_ > 0 ? bytes_ : 1);
+}
+
+void* operator new[](size_t bytes_, const std::nothrow_t&) throw()
+{
+    CountAllocation(bytes_);
+    return std::malloc(bytes_ > 0 ? bytes_ : 1);
+}
+
+void operator delete(void* memory_) throw()
+{
+    std::free(memory_);
+}
+
+void operator delete[](void* memory_) throw()
+{
+    std::free(memory_);
+}
+
+void operator delete(void* memory_, const std::nothrow_t&) throw()
+{
+    std::free(memory_);
+}
+
+void operator delete[](void* memory_, const std::nothrow_t&) throw()
+{
+    std::free(memory_);
+}
+
+void AllocationTracker::trackCurrentThread()
+{
+    tracking = false;
+    trackedThread = std::this_thread::get_id();
+    frameAllocations = 0;
+    frameBytes = 0;
+    totalAllocations = 0;
+    totalBytes = 0;
+    tracking = true;
+}
+
+void AllocationTracker::beginFrame()
+{
+    frameAllocations = 0;
+    frameBytes = 0;
+}
+
+AllocationTracker::Counts AllocationTracker::getFrameCounts()
+{
+    Counts counts;
+    counts.allocations = frameAllocations;
+    counts.bytes = frameBytes;
+    return counts;
+}
+
+AllocationTracker::Counts AllocationTracker::getTotalCounts()
+{
+    Counts counts;
+    counts.allocations = totalAllocations;
+    counts.bytes = totalBytes;
+    return counts;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#ifndef ALLOCATION_TRACKER_HPP
+#define ALLOCATION_TRACKER_HPP
+
+/*
+counts calls to the global operator new (and the bytes asked for) made by the render thread.
+
+AllocationTracker.cpp replaces the global new and delete, so this only sees allocations that go through them,
+the gl driver and the crt's own mallocs are invisible to it. only one thread is counted at a time, the simulation
+and worker threads are free to allocate.
+*/
+class AllocationTracker
+{
+public:
+
+    struct Counts
+    {
+        unsigned int allocations;
+        unsigned long long bytes;
+    };
+
+    // from now on only allocations made by the calling thread are counted
+    static void trackCurrentThread();
+
+    // zeroes the counters, call at the start of the region being measured
+    static void beginFrame();
+
+    // what the tracked thread allocated since beginFrame
+    static Counts getFrameCounts();
+
+    // since trackCurrentThread
+    static Counts getTotalCounts();
+};
+
+#endif //ALLOCATION_TRACKER_HPP
@@ -0,0 +1,118 @@
+#include "CameraLatch.hpp"
+#include "CpuTimer.hpp"
+#include "GpuMemory.hpp"
+
+#include <cstring>
+
+// the fences should have long passed, this only stops a lost context hanging the frame
+static const GLuint64 kWaitNanoseconds = 100000000;
+
+CameraLatch::CameraLatch() : buffer(0),
+    memory(nullptr),
+    slot(0)
+{
+    for (int i = 0; i < kFramesInFlight; ++i)
+    {
+        fences[i] = 0;
+    }
+    stats.latches = 0;
+    stats.fenceWaits = 0;
+    stats.waitMilliseconds = 0.0;
+    stats.persistentlyMapped = false;
+}
+
+CameraLatch::~CameraLatch()
+{
+}
+
+void CameraLatch::createBuffer()
+{
+    deleteBuffer();
+
+    stats.persistentlyMapped = false;
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+    if (GpuMemory::hasBufferStorage())
+    {
+        const GLsizeiptr bytes = sizeof(Camera) * kFramesInFlight;
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        GpuMemory::track(GpuMemory::kBuffer, buffer, GpuMemory::kShaderStorage, "camera_latch");
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glBufferStorage(GL_COPY_READ_BUFFER, bytes, NULL, flags);
+        GpuMemory::bufferStorage(buffer, bytes);
+        memory = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, bytes, flags));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        stats.persistentlyMapped = memory != nullptr;
+    }
+#endif
+    slot = 0;
+}
+
+void CameraLatch::deleteBuffer()
+{
+    for (int i = 0; i < kFramesInFlight; ++i)
+    {
+        if (fences[i] != 0)
+        {
+            glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+    }
+    if (buffer != 0)
+    {
+        // deleting it unmaps it as well
+        glDeleteBuffers(1, &buffer);
+        GpuMemory::release(GpuMemory::kBuffer, buffer);
+        buffer = 0;
+    }
+    memory = nullptr;
+    stats.persistentlyMapped = false;
+}
+
+void CameraLatch::latch(const glm::mat4& projectionView_, const glm::vec3& position_, GLuint target_)
+{
+    Camera camera;
+    camera.projectionView = projectionView_;
+    camera.position = position_;
+    camera.padding = 0.f;
+    ++stats.latches;
+
+    if (memory == nullptr)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, target_);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(Camera), &camera);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return;
+    }
+
+    // the copy out of this slot kFramesInFlight latches ago has to have happened before it is written again
+    if (fences[slot] != 0)
+    {
+        if (glClientWaitSync(fences[slot], 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            const double begin = CpuTimeSeconds();
+            glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, kWaitNanoseconds);
+            stats.waitMilliseconds += (CpuTimeSeconds() - begin) * 1000.0;
+            ++stats.fenceWaits;
+        }
+        glDeleteSync(fences[slot]);
+        fences[slot] = 0;
+    }
+
+    // coherent, so the write is there for the copy without a flush
+    std::memcpy(memory + slot * sizeof(Camera), &camera, sizeof(Camera));
+
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, target_);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, slot * sizeof(Camera), 0, sizeof(Camera));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    slot = (slot + 1) % kFramesInFlight;
+}
+
+const CameraLatch::Stats& CameraLatch::getStats() const
+{
+    return stats;
+}
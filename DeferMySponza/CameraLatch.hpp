@@ -0,0 +1,67 @@
+#pragma once
+#ifndef CAMERA_LATCH_HPP
+#define CAMERA_LATCH_HPP
+
+#include <tgl/tgl.h>
+#include <glm/glm.hpp>
+
+/*
+swaps a newer camera into the frame after most of it has been recorded.
+
+the frame starts out with whatever camera the snapshot had, that is what it culls and draws the shadows with. just
+before the gbuffer is drawn the newest camera is written into a slot of a buffer that stays mapped, and a copy from
+the slot over the camera at the start of the render buffer goes in ahead of the gbuffer's draws, so everything from
+the gbuffer on sees it. there is a slot for each frame in flight with a fence after its copy, the cpu only waits on
+it if the gpu is a whole ring behind.
+
+without buffer storage (gl 4.4 or ARB_buffer_storage) the camera is written straight over the render buffer's, which
+is just as late but leaves the driver to keep it from racing the gpu.
+*/
+class CameraLatch
+{
+public:
+
+    static const int kFramesInFlight = 3;
+
+    struct Stats
+    {
+        unsigned int latches;
+        unsigned int fenceWaits; // the gpu was still reading the slot
+        double waitMilliseconds;
+        bool persistentlyMapped;
+    };
+
+    CameraLatch();
+    ~CameraLatch();
+
+    void createBuffer();
+    void deleteBuffer();
+
+    // laid out like the start of BufferRender, target_ has to be at least that big
+    void latch(const glm::mat4& projectionView_, const glm::vec3& position_, GLuint target_);
+
+    const Stats& getStats() const;
+
+protected:
+
+    // std140, the vec3 is padded out to a vec4
+    struct Camera
+    {
+        glm::mat4 projectionView;
+        glm::vec3 position;
+        float padding;
+    };
+
+    GLuint buffer;
+    unsigned char* memory;
+    GLsync fences[kFramesInFlight];
+    unsigned int slot;
+    Stats stats;
+
+private:
+
+    CameraLatch(const CameraLatch&);
+    CameraLatch& operator=(const CameraLatch&);
+};
+
+#endif //CAMERA_LATCH_HPP
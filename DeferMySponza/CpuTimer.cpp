@@ -0,0 +1,39 @@
+#include "CpuTimer.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+static long long QueryFrequency()
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return frequency.QuadPart;
+}
+
+long long CpuTimeNanoseconds()
+{
+    static const long long frequency = QueryFrequency();
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    // split the conversion so the multiply cant overflow after a long uptime
+    const long long seconds = counter.QuadPart / frequency;
+    const long long remainder = counter.QuadPart % frequency;
+    return seconds * 1000000000LL + (remainder * 1000000000LL) / frequency;
+}
+#else
+#include <chrono>
+
+long long CpuTimeNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+double CpuTimeSeconds()
+{
+    return CpuTimeNanoseconds() / 1000000000.0;
+}
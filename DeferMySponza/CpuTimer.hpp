@@ -0,0 +1,16 @@
+#pragma once
+#ifndef CPU_TIMER_HPP
+#define CPU_TIMER_HPP
+
+/*
+high resolution wall clock. std::chrono's clocks only tick every millisecond or so on the vs2013 runtime,
+so on windows this goes through QueryPerformanceCounter instead
+*/
+
+// seconds since some fixed point, only differences mean anything
+double CpuTimeSeconds();
+
+// same clock in whole nanoseconds
+long long CpuTimeNanoseconds();
+
+#endif //CPU_TIMER_HPP
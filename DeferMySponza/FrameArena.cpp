@@ -0,0 +1,80 @@
+#include "FrameArena.hpp"
+
+#include <cassert>
+
+FrameArena::FrameArena() : block(nullptr), capacity(0), used(0), highWater(0), overflowBytes(0)
+{
+
+}
+
+FrameArena::~FrameArena()
+{
+    reset();
+    delete[] block;
+}
+
+void FrameArena::reserve(size_t bytes_)
+{
+    if (bytes_ <= capacity)
+    {
+        return;
+    }
+    assert(used == 0 && "the arena can only grow between frames");
+    delete[] block;
+    block = new char[bytes_];
+    capacity = bytes_;
+}
+
+void FrameArena::reset()
+{
+    for (unsigned int i = 0; i < overflow.size(); ++i)
+    {
+        delete[] overflow[i];
+    }
+    overflow.clear();
+
+    // last frame didnt fit, make room for all of it so the steady state never touches the heap
+    const size_t wanted = used + overflowBytes;
+    highWater = wanted > highWater ? wanted : highWater;
+    used = 0;
+    overflowBytes = 0;
+    if (highWater > capacity)
+    {
+        reserve(highWater + highWater / 4);
+    }
+}
+
+void* FrameArena::allocate(size_t bytes_, size_t alignment_)
+{
+    assert((alignment_ & (alignment_ - 1)) == 0);
+
+    // block comes from new[] so it is aligned for anything, only the offset needs rounding up
+    size_t offset = (used + alignment_ - 1) & ~(alignment_ - 1);
+    if (offset + bytes_ <= capacity)
+    {
+        used = offset + bytes_;
+        return block + offset;
+    }
+
+    // over budget for this frame, keep going off the heap and remember how much we needed
+    char* memory = new char[bytes_ + alignment_];
+    overflow.push_back(memory);
+    overflowBytes += bytes_ + alignment_;
+    size_t address = reinterpret_cast<size_t>(memory);
+    return memory + (((address + alignment_ - 1) & ~(alignment_ - 1)) - address);
+}
+
+size_t FrameArena::getBytesUsed() const
+{
+    return used + overflowBytes;
+}
+
+size_t FrameArena::getCapacity() const
+{
+    return capacity;
+}
+
+size_t FrameArena::getHighWater() const
+{
+    return highWater;
+}
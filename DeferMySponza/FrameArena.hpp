@@ -0,0 +1,55 @@
+#pragma once
+#ifndef FRAME_ARENA_HPP
+#define FRAME_ARENA_HPP
+
+#include <cstddef>
+#include <vector>
+
+/*
+linear allocator for scratch memory that only has to live for one frame.
+
+allocations just bump a pointer and nothing is freed individually, reset() at the start of the frame hands the whole
+block back. if a frame asks for more than the block holds the extra comes from the heap, and the next reset grows
+the block to the high water mark so it only happens while the scene is settling.
+*/
+class FrameArena
+{
+public:
+
+    FrameArena();
+    ~FrameArena();
+
+    void reserve(size_t bytes_);
+
+    // everything allocated since the last reset is invalid after this
+    void reset();
+
+    void* allocate(size_t bytes_, size_t alignment_ = 16);
+
+    // uninitialised, only meant for plain data
+    template<typename T>
+    T* allocateArray(size_t count_)
+    {
+        return static_cast<T*>(allocate(sizeof(T) * count_, __alignof(T) > 16 ? __alignof(T) : 16));
+    }
+
+    size_t getBytesUsed() const;
+    size_t getCapacity() const;
+    size_t getHighWater() const;
+
+protected:
+
+    char* block;
+    size_t capacity;
+    size_t used;
+    size_t highWater;
+
+    // anything that didnt fit this frame, freed on reset
+    std::vector<char*> overflow;
+    size_t overflowBytes;
+
+    FrameArena(const FrameArena&);
+    FrameArena& operator=(const FrameArena&);
+};
+
+#endif //FRAME_ARENA_HPP
@@ -0,0 +1,367 @@
+#include "FrameCapture.hpp"
+#include "CpuTimer.hpp"
+#include "TraceCapture.hpp"
+#include "GpuMemory.hpp"
+
+#include <png.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+    const char* const kThreadNames[FrameCapture::kMaxThreads] =
+    {
+        "capture 0", "capture 1", "capture 2", "capture 3"
+    };
+
+    // how long stop waits on a fence at a time, it keeps waiting until the copy is done
+    const GLuint64 kStopWaitNanoseconds = 100000000;
+}
+
+FrameCapture::FrameCapture() : slotCount(0),
+    quitting(false),
+    written(0),
+    failed(0),
+    bytesWritten(0),
+    encodeTotal(0.0),
+    nextFrame(0)
+{
+    for (int i = 0; i < kMaxSlots; ++i)
+    {
+        slots[i].buffer = 0;
+        slots[i].fence = 0;
+        slots[i].bytes = 0;
+        slots[i].width = 0;
+        slots[i].height = 0;
+        slots[i].frame = 0;
+        slots[i].pixels = nullptr;
+        slots[i].state = kFree;
+    }
+
+    stats.framesRead = 0;
+    stats.framesWritten = 0;
+    stats.framesDropped = 0;
+    stats.framesFailed = 0;
+    stats.slots = 0;
+    stats.inFlight = 0;
+    stats.maxInFlight = 0;
+    stats.queued = 0;
+    stats.maxQueued = 0;
+    stats.bytesWritten = 0;
+    stats.encodeMilliseconds = 0.0;
+}
+
+FrameCapture::~FrameCapture()
+{
+    // stop needs the context, by now it should already have been called
+    assert(threads.empty());
+}
+
+void FrameCapture::start(const std::string& prefix_, unsigned int threadCount_)
+{
+    if (isRunning())
+    {
+        return;
+    }
+
+    prefix = prefix_;
+    quitting = false;
+
+    for (int i = slotCount; i < kInitialSlots; ++i)
+    {
+        glGenBuffers(1, &slots[i].buffer);
+        GpuMemory::track(GpuMemory::kBuffer, slots[i].buffer, GpuMemory::kReadback, "capture_readback");
+    }
+    slotCount = std::max(slotCount, kInitialSlots);
+
+    if (threadCount_ == 0)
+    {
+        const unsigned int hardware = std::thread::hardware_concurrency();
+        threadCount_ = hardware > 3 ? hardware - 2 : 1;
+    }
+    threadCount_ = std::min(threadCount_, static_cast<unsigned int>(kMaxThreads));
+    for (unsigned int t = 0; t < threadCount_; ++t)
+    {
+        threads.push_back(std::thread(&FrameCapture::run, this, t));
+    }
+}
+
+void FrameCapture::stop()
+{
+    if (!isRunning())
+    {
+        return;
+    }
+
+    // the readbacks still going have to land before the workers can be told to finish
+    for (int i = 0; i < slotCount; ++i)
+    {
+        Slot& slot = slots[i];
+        if (slot.state != kReading)
+        {
+            continue;
+        }
+        while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, kStopWaitNanoseconds) == GL_TIMEOUT_EXPIRED)
+        {
+        }
+    }
+    update();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quitting = true;
+    }
+    wake.notify_all();
+    for (unsigned int t = 0; t < threads.size(); ++t)
+    {
+        threads[t].join();
+    }
+    threads.clear();
+
+    // unmaps what the workers wrote, then the ring goes
+    update();
+    for (int i = 0; i < slotCount; ++i)
+    {
+        assert(slots[i].state == kFree);
+        glDeleteBuffers(1, &slots[i].buffer);
+        GpuMemory::release(GpuMemory::kBuffer, slots[i].buffer);
+        slots[i].buffer = 0;
+        slots[i].bytes = 0;
+    }
+    slotCount = 0;
+    stats.slots = 0;
+}
+
+bool FrameCapture::isRunning() const
+{
+    return !threads.empty();
+}
+
+void FrameCapture::capture(int width_, int height_)
+{
+    TRACE_SCOPE("capture_readback");
+    assert(isRunning());
+
+    int slotIndex = -1;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < slotCount && slotIndex < 0; ++i)
+        {
+            if (slots[i].state == kFree)
+            {
+                slotIndex = i;
+            }
+        }
+    }
+
+    if (slotIndex < 0)
+    {
+        if (slotCount == kMaxSlots)
+        {
+            // waiting here is exactly what this is meant to avoid
+            ++stats.framesDropped;
+            ++nextFrame;
+            return;
+        }
+        slotIndex = slotCount++;
+        glGenBuffers(1, &slots[slotIndex].buffer);
+        GpuMemory::track(GpuMemory::kBuffer, slots[slotIndex].buffer, GpuMemory::kReadback, "capture_readback");
+    }
+
+    // nothing else touches a free slot, the workers only look at queued ones
+    Slot& slot = slots[slotIndex];
+    const unsigned int bytes = width_ * height_ * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (slot.bytes != bytes)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+        GpuMemory::bufferStorage(slot.buffer, bytes);
+        slot.bytes = bytes;
+    }
+
+    // rgba rows are always four byte aligned, which is what the pack alignment defaults to
+    glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, TGL_BUFFER_OFFSET(0));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = width_;
+    slot.height = height_;
+    slot.frame = nextFrame++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slot.state = kReading;
+    }
+    ++stats.framesRead;
+}
+
+void FrameCapture::update()
+{
+    if (slotCount == 0)
+    {
+        return;
+    }
+    TRACE_SCOPE("capture_update");
+
+    bool queuedAny = false;
+    for (int i = 0; i < slotCount; ++i)
+    {
+        Slot& slot = slots[i];
+
+        SlotState state;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            state = slot.state;
+        }
+
+        if (state == kWritten)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            slot.pixels = nullptr;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            slot.state = kFree;
+        }
+        else if (state == kReading)
+        {
+            // never waits, a copy that hasnt finished is looked at again next frame
+            if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            {
+                continue;
+            }
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            slot.pixels = static_cast<const unsigned char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.bytes, GL_MAP_READ_BIT));
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (slot.pixels != nullptr)
+            {
+                slot.state = kQueued;
+                queue.push_back(i);
+                queuedAny = true;
+            }
+            else
+            {
+                slot.state = kFree;
+                ++failed;
+            }
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (queuedAny)
+    {
+        wake.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.inFlight = 0;
+    for (int i = 0; i < slotCount; ++i)
+    {
+        stats.inFlight += slots[i].state != kFree ? 1 : 0;
+    }
+    stats.maxInFlight = std::max(stats.maxInFlight, stats.inFlight);
+    stats.queued = queue.size();
+    stats.maxQueued = std::max(stats.maxQueued, stats.queued);
+    stats.slots = slotCount;
+    stats.framesWritten = written;
+    stats.framesFailed = failed;
+    stats.bytesWritten = bytesWritten;
+    stats.encodeMilliseconds = written > 0 ? encodeTotal / written : 0.0;
+}
+
+const FrameCapture::Stats& FrameCapture::getStats() const
+{
+    return stats;
+}
+
+void FrameCapture::run(unsigned int thread_)
+{
+    TraceCapture::nameCurrentThread(kThreadNames[thread_]);
+
+    for (;;)
+    {
+        int index = -1;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return quitting || !queue.empty(); });
+            // whatever is queued is still written before quitting
+            if (queue.empty())
+            {
+                return;
+            }
+            index = queue.front();
+            queue.pop_front();
+            slots[index].state = kWriting;
+        }
+
+        // the slot is this thread's until it is marked written
+        const Slot& slot = slots[index];
+        std::ostringstream path;
+        path << prefix << std::setw(5) << std::setfill('0') << slot.frame << ".png";
+
+        const double begin = CpuTimeSeconds();
+        unsigned long long bytes = 0;
+        bool ok;
+        {
+            TRACE_SCOPE("encode_frame");
+            ok = writePng(path.str().c_str(), slot, bytes);
+        }
+        const double milliseconds = (CpuTimeSeconds() - begin) * 1000.0;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        slots[index].state = kWritten;
+        if (ok)
+        {
+            ++written;
+            bytesWritten += bytes;
+            encodeTotal += milliseconds;
+        }
+        else
+        {
+            ++failed;
+        }
+    }
+}
+
+bool FrameCapture::writePng(const char* path_, const Slot& slot_, unsigned long long& bytes_)
+{
+    FILE* file = std::fopen(path_, "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png != NULL ? png_create_info_struct(png) : NULL;
+    if (info == NULL || setjmp(png_jmpbuf(png)))
+    {
+        png_destroy_write_struct(&png, &info);
+        std::fclose(file);
+        return false;
+    }
+
+    png_init_io(png, file);
+
+    // speed over size, the workers have to keep up with the frame rate
+    png_set_compression_level(png, 1);
+    png_set_IHDR(png, info, slot_.width, slot_.height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+
+    // the alpha is dropped as the rows go in, and they go in top first straight out of the mapping
+    png_set_filler(png, 0, PNG_FILLER_AFTER);
+    const unsigned int stride = slot_.width * 4;
+    for (int y = slot_.height - 1; y >= 0; --y)
+    {
+        png_write_row(png, const_cast<png_bytep>(slot_.pixels + y * stride));
+    }
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &info);
+
+    bytes_ = std::ftell(file);
+    return std::fclose(file) == 0;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#ifndef FRAME_CAPTURE_HPP
+#define FRAME_CAPTURE_HPP
+
+#include <tgl/tgl.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+writes every frame out as a png without the render thread ever waiting for the gpu, the compression or the disk.
+
+each frame is read back into one of a ring of pixel buffers with a fence after it, so glReadPixels only queues the
+copy. once a fence has passed the render thread maps that buffer and hands the mapped memory straight to the worker
+threads, nothing is copied on the cpu. a worker compresses and writes the image and marks the slot written, and the
+render thread unmaps it on a later frame so it can be used again. gl calls all stay on the render thread.
+
+the ring starts small and grows when every slot is still busy, up to kMaxSlots. past that the frame is dropped and
+counted rather than waited for, the stats say how deep things got so the slot count or threads can be tuned.
+*/
+class FrameCapture
+{
+public:
+
+    static const int kMaxSlots = 12;
+    static const int kInitialSlots = 3;
+    static const int kMaxThreads = 4;
+
+    struct Stats
+    {
+        unsigned int framesRead; // readbacks issued
+        unsigned int framesWritten;
+        unsigned int framesDropped; // every slot was busy
+        unsigned int framesFailed; // the file couldnt be written
+        unsigned int slots; // pixel buffers in the ring
+        unsigned int inFlight; // slots being read back, waiting for a worker or being written
+        unsigned int maxInFlight;
+        unsigned int queued; // mapped and waiting for a worker
+        unsigned int maxQueued;
+        unsigned long long bytesWritten;
+        double encodeMilliseconds; // per frame, averaged over everything written
+    };
+
+    FrameCapture();
+    ~FrameCapture();
+
+    // the frames go to prefix_ followed by the frame number and .png. threadCount_ of 0 leaves a couple of the
+    // hardware's threads for the render and simulation threads
+    void start(const std::string& prefix_, unsigned int threadCount_ = 0);
+
+    // waits for everything in flight to be written, the context has to be current
+    void stop();
+
+    bool isRunning() const;
+
+    // reads the colour of the bound read framebuffer into a free slot, or drops the frame if there isnt one
+    void capture(int width_, int height_);
+
+    // maps the slots the gpu has finished with and unmaps the ones the workers have written, once a frame
+    void update();
+
+    const Stats& getStats() const;
+
+protected:
+
+    enum SlotState
+    {
+        kFree,
+        kReading, // the gpu is copying into it
+        kQueued, // mapped, waiting for a worker
+        kWriting,
+        kWritten // still mapped, the render thread unmaps it
+    };
+
+    struct Slot
+    {
+        GLuint buffer;
+        GLsync fence;
+        unsigned int bytes;
+        int width, height;
+        unsigned int frame;
+        const unsigned char* pixels; // the mapping, bottom row first
+        SlotState state;
+    };
+
+    // the states and the queue are shared with the workers, the rest of a slot is only touched by whoever owns it
+    Slot slots[kMaxSlots];
+    int slotCount;
+    std::deque<int> queue;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool quitting;
+
+    // what the workers have done, copied into the stats by update
+    unsigned int written, failed;
+    unsigned long long bytesWritten;
+    double encodeTotal; // milliseconds
+
+    std::string prefix;
+    unsigned int nextFrame;
+    Stats stats;
+
+    void run(unsigned int thread_);
+
+    // true if the file was written
+    static bool writePng(const char* path_, const Slot& slot_, unsigned long long& bytes_);
+
+private:
+
+    FrameCapture(const FrameCapture&);
+    FrameCapture& operator=(const FrameCapture&);
+};
+
+#endif //FRAME_CAPTURE_HPP
@@ -0,0 +1,695 @@
+#include "FrameGraph.hpp"
+#include "GpuMemory.hpp"
+#include "GpuTimer.hpp"
+#include "TraceCapture.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+    // the background colour the passes used to clear to by hand
+    const GLfloat kClearColour[4] = { 0.f, 0.f, 0.25f, 0.f };
+
+    void SetCapability(GLenum capability_, bool enabled_)
+    {
+        if (enabled_)
+        {
+            glEnable(capability_);
+        }
+        else
+        {
+            glDisable(capability_);
+        }
+    }
+}
+
+FrameGraph::State::State() : depthTest(false),
+    depthWrite(true),
+    depthFunc(GL_LEQUAL),
+    stencilTest(false),
+    stencilFunc(GL_ALWAYS),
+    stencilRef(0),
+    stencilReadMask(~0u),
+    stencilWriteMask(~0u),
+    stencilFail(GL_KEEP),
+    stencilDepthFail(GL_KEEP),
+    stencilPass(GL_KEEP),
+    blend(false),
+    blendSource(GL_ONE),
+    blendDestination(GL_ZERO),
+    cullFace(false),
+    cullMode(GL_BACK),
+    colourWrite(true)
+{
+}
+
+FrameGraph::FrameGraph() : compiled(false)
+{
+    stats.passes = 0;
+    stats.passesCulled = 0;
+    stats.targets = 0;
+    stats.textures = 0;
+    stats.targetBytes = 0;
+    stats.textureBytes = 0;
+    stats.framebufferBinds = 0;
+    stats.stateChanges = 0;
+    stats.passesSkipped = 0;
+}
+
+FrameGraph::~FrameGraph()
+{
+}
+
+void FrameGraph::reset()
+{
+    targets.clear();
+    passes.clear();
+    compiled = false;
+}
+
+FrameGraph::Handle FrameGraph::createTarget(const char* name_, GLenum format_, int width_, int height_, int samples_)
+{
+    Target target;
+    target.name = name_;
+    target.format = format_;
+    target.width = width_;
+    target.height = height_;
+    target.samples = samples_;
+    target.backbuffer = false;
+    target.persistent = false;
+    target.firstPass = -1;
+    target.lastPass = -1;
+    target.texture = -1;
+    targets.push_back(target);
+    return targets.size() - 1;
+}
+
+FrameGraph::Handle FrameGraph::importBackbuffer(int width_, int height_)
+{
+    const Handle handle = createTarget("backbuffer", GL_RGBA8, width_, height_);
+    targets[handle].backbuffer = true;
+    return handle;
+}
+
+int FrameGraph::addPass(const char* name_, const State& state_, const Execute& execute_)
+{
+    Pass pass;
+    pass.name = name_;
+    pass.state = state_;
+    pass.execute = execute_;
+    pass.colourCount = 0;
+    std::copy(kClearColour, kClearColour + 4, pass.clearColour);
+    pass.depthStencil = kNone;
+    pass.depthStencilLoad = kLoad;
+    pass.culled = false;
+    pass.kept = false;
+    pass.groups = 0;
+    pass.framebuffer = 0;
+    passes.push_back(pass);
+    return passes.size() - 1;
+}
+
+void FrameGraph::keep(int pass_)
+{
+    passes[pass_].kept = true;
+}
+
+void FrameGraph::setGroups(int pass_, unsigned int groups_)
+{
+    passes[pass_].groups = groups_;
+}
+
+void FrameGraph::persist(Handle target_)
+{
+    assert(!targets[target_].backbuffer);
+    targets[target_].persistent = true;
+}
+
+void FrameGraph::write(int pass_, Handle target_, Load load_)
+{
+    Pass& pass = passes[pass_];
+    if (isDepthFormat(targets[target_].format))
+    {
+        assert(pass.depthStencil == kNone);
+        pass.depthStencil = target_;
+        pass.depthStencilLoad = load_;
+    }
+    else
+    {
+        assert(pass.colourCount < kMaxColourTargets);
+        pass.colour[pass.colourCount] = target_;
+        pass.colourLoad[pass.colourCount] = load_;
+        ++pass.colourCount;
+    }
+}
+
+void FrameGraph::read(int pass_, Handle target_)
+{
+    passes[pass_].reads.push_back(target_);
+}
+
+void FrameGraph::setClearColour(int pass_, GLfloat red_, GLfloat green_, GLfloat blue_, GLfloat alpha_)
+{
+    GLfloat* colour = passes[pass_].clearColour;
+    colour[0] = red_;
+    colour[1] = green_;
+    colour[2] = blue_;
+    colour[3] = alpha_;
+}
+
+void FrameGraph::compile()
+{
+    cullPasses();
+    computeLifetimes();
+    assignTextures();
+
+    // the old framebuffers may have attachments that have been deleted or moved to other targets
+    for (unsigned int f = 0; f < framebuffers.size(); ++f)
+    {
+        glDeleteFramebuffers(1, &framebuffers[f].name);
+        GpuMemory::release(GpuMemory::kFramebuffer, framebuffers[f].name);
+    }
+    framebuffers.clear();
+
+    for (unsigned int p = 0; p < passes.size(); ++p)
+    {
+        Pass& pass = passes[p];
+        if (pass.culled || (pass.colourCount == 0 && pass.depthStencil == kNone))
+        {
+            continue;
+        }
+        pass.framebuffer = getFramebuffer(pass.colour, pass.colourCount, pass.depthStencil);
+    }
+
+    stats.passes = passes.size();
+    stats.passesCulled = 0;
+    for (unsigned int p = 0; p < passes.size(); ++p)
+    {
+        stats.passesCulled += passes[p].culled ? 1 : 0;
+    }
+    compiled = true;
+}
+
+void FrameGraph::execute(GpuTimer& timer_, unsigned int skipGroups_)
+{
+    assert(compiled);
+    stats.framebufferBinds = 0;
+    stats.stateChanges = 0;
+    stats.passesSkipped = 0;
+
+    // the code before the graph could have left anything bound and set, so the first pass sets everything
+    bool first = true;
+    GLuint bound = 0;
+    for (unsigned int p = 0; p < passes.size(); ++p)
+    {
+        const Pass& pass = passes[p];
+        if (pass.culled)
+        {
+            continue;
+        }
+        if ((pass.groups & skipGroups_) != 0)
+        {
+            ++stats.passesSkipped;
+            continue;
+        }
+
+        TRACE_SCOPE(pass.name);
+        timer_.beginPass(pass.name);
+
+        // a pass that draws into nothing leaves whatever is bound
+        const bool draws = pass.colourCount > 0 || pass.depthStencil != kNone;
+        if (draws && (first || pass.framebuffer != bound))
+        {
+            const Handle sizeFrom = pass.depthStencil != kNone ? pass.depthStencil : pass.colour[0];
+            glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+            glViewport(0, 0, targets[sizeFrom].width, targets[sizeFrom].height);
+            bound = pass.framebuffer;
+            ++stats.framebufferBinds;
+        }
+
+        clearTargets(pass, first);
+        applyState(pass.state, first);
+        first = false;
+
+        pass.execute();
+
+        timer_.endPass();
+    }
+
+    applyState(State(), false);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void FrameGraph::deleteObjects()
+{
+    for (unsigned int f = 0; f < framebuffers.size(); ++f)
+    {
+        glDeleteFramebuffers(1, &framebuffers[f].name);
+        GpuMemory::release(GpuMemory::kFramebuffer, framebuffers[f].name);
+    }
+    framebuffers.clear();
+
+    for (unsigned int t = 0; t < textures.size(); ++t)
+    {
+        glDeleteTextures(1, &textures[t].name);
+        GpuMemory::release(GpuMemory::kTexture, textures[t].name);
+    }
+    textures.clear();
+    compiled = false;
+}
+
+bool FrameGraph::isCompiled() const
+{
+    return compiled;
+}
+
+GLuint FrameGraph::getTexture(Handle target_) const
+{
+    const Target& target = targets[target_];
+    return target.texture >= 0 ? textures[target.texture].name : 0;
+}
+
+GLuint FrameGraph::getFramebuffer(const Handle* colour_, int colourCount_, Handle depthStencil_)
+{
+    // the backbuffer cant be attached to anything else
+    if ((colourCount_ > 0 && targets[colour_[0]].backbuffer) || (depthStencil_ != kNone && targets[depthStencil_].backbuffer))
+    {
+        return 0;
+    }
+
+    GLuint attachments[kMaxColourTargets + 1] = {};
+    for (int c = 0; c < colourCount_; ++c)
+    {
+        attachments[c] = getTexture(colour_[c]);
+    }
+    attachments[kMaxColourTargets] = depthStencil_ != kNone ? getTexture(depthStencil_) : 0;
+
+    const GLuint existing = findFramebuffer(attachments);
+    if (existing != 0)
+    {
+        return existing;
+    }
+
+    Framebuffer framebuffer;
+    std::copy(attachments, attachments + kMaxColourTargets + 1, framebuffer.attachments);
+    glGenFramebuffers(1, &framebuffer.name);
+    GpuMemory::track(GpuMemory::kFramebuffer, framebuffer.name, GpuMemory::kObjects, "frame_graph");
+
+    // made on the read binding so whatever is being drawn into stays bound, the draw buffers are set on the first
+    // bind to the draw binding instead
+    GLint previousRead = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer.name);
+
+    GLenum drawBuffers[kMaxColourTargets];
+    for (int c = 0; c < colourCount_; ++c)
+    {
+        const Target& target = targets[colour_[c]];
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + c,
+            target.samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_RECTANGLE, attachments[c], 0);
+        drawBuffers[c] = GL_COLOR_ATTACHMENT0 + c;
+    }
+    if (depthStencil_ != kNone)
+    {
+        const Target& target = targets[depthStencil_];
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+            target.samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_RECTANGLE, attachments[kMaxColourTargets], 0);
+    }
+    glReadBuffer(colourCount_ > 0 ? GL_COLOR_ATTACHMENT0 : GL_NONE);
+
+    if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        tglDebugMessage(GL_DEBUG_SEVERITY_HIGH, "frame graph framebuffer not complete");
+    }
+
+    // draw buffers belong to the framebuffer but can only be set through the draw binding
+    GLint previousDraw = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer.name);
+    if (colourCount_ > 0)
+    {
+        glDrawBuffers(colourCount_, drawBuffers);
+    }
+    else
+    {
+        glDrawBuffer(GL_NONE);
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDraw);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+
+    framebuffers.push_back(framebuffer);
+    return framebuffer.name;
+}
+
+const FrameGraph::Stats& FrameGraph::getStats() const
+{
+    return stats;
+}
+
+bool FrameGraph::isDepthFormat(GLenum format_)
+{
+    switch (format_)
+    {
+    case GL_DEPTH_COMPONENT16:
+    case GL_DEPTH_COMPONENT24:
+    case GL_DEPTH_COMPONENT32F:
+    case GL_DEPTH24_STENCIL8:
+    case GL_DEPTH32F_STENCIL8:
+        return true;
+    default:
+        return false;
+    }
+}
+
+unsigned long long FrameGraph::targetBytes(GLenum format_, int width_, int height_, int samples_)
+{
+    return static_cast<unsigned long long>(width_) * height_ * samples_ * GpuMemory::formatBytes(format_);
+}
+
+void FrameGraph::cullPasses()
+{
+    // walking backwards from the backbuffer, a pass is kept if it writes something a later kept pass needs. a pass
+    // that throws away what was in a target ends the need for earlier passes to have written it
+    needed.assign(targets.size(), 0);
+    for (unsigned int t = 0; t < targets.size(); ++t)
+    {
+        needed[t] = targets[t].backbuffer ? 1 : 0;
+    }
+
+    for (int p = passes.size() - 1; p >= 0; --p)
+    {
+        Pass& pass = passes[p];
+        bool live = pass.kept || (pass.depthStencil != kNone && needed[pass.depthStencil]);
+        for (int c = 0; c < pass.colourCount; ++c)
+        {
+            live |= needed[pass.colour[c]] != 0;
+        }
+        pass.culled = !live;
+        if (!live)
+        {
+            continue;
+        }
+
+        for (int c = 0; c < pass.colourCount; ++c)
+        {
+            needed[pass.colour[c]] = pass.colourLoad[c] == kLoad ? 1 : 0;
+        }
+        if (pass.depthStencil != kNone)
+        {
+            needed[pass.depthStencil] = pass.depthStencilLoad == kLoad ? 1 : 0;
+        }
+        for (unsigned int r = 0; r < pass.reads.size(); ++r)
+        {
+            needed[pass.reads[r]] = 1;
+        }
+    }
+}
+
+void FrameGraph::computeLifetimes()
+{
+    for (unsigned int t = 0; t < targets.size(); ++t)
+    {
+        targets[t].firstPass = -1;
+        targets[t].lastPass = -1;
+    }
+
+    for (unsigned int p = 0; p < passes.size(); ++p)
+    {
+        const Pass& pass = passes[p];
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        // gathered into order just to walk them all the same way
+        order.clear();
+        order.insert(order.end(), pass.colour, pass.colour + pass.colourCount);
+        order.insert(order.end(), pass.reads.begin(), pass.reads.end());
+        if (pass.depthStencil != kNone)
+        {
+            order.push_back(pass.depthStencil);
+        }
+        for (unsigned int i = 0; i < order.size(); ++i)
+        {
+            Target& target = targets[order[i]];
+            if (target.firstPass < 0)
+            {
+                target.firstPass = p;
+            }
+            target.lastPass = p;
+        }
+    }
+
+    // a persistent target's texture cant be handed on to anything else, whichever passes run
+    for (unsigned int t = 0; t < targets.size(); ++t)
+    {
+        if (targets[t].persistent && targets[t].firstPass >= 0)
+        {
+            targets[t].firstPass = 0;
+            targets[t].lastPass = passes.size() - 1;
+        }
+    }
+}
+
+void FrameGraph::assignTextures()
+{
+    for (unsigned int t = 0; t < textures.size(); ++t)
+    {
+        textures[t].used = false;
+        textures[t].lastPass = -1;
+    }
+
+    // earliest first, so each target can take a texture whose last user has already finished
+    order.clear();
+    for (unsigned int t = 0; t < targets.size(); ++t)
+    {
+        targets[t].texture = -1;
+        if (!targets[t].backbuffer && targets[t].firstPass >= 0)
+        {
+            order.push_back(t);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [this](int a_, int b_)
+    {
+        return targets[a_].firstPass < targets[b_].firstPass;
+    });
+
+    stats.targets = 0;
+    stats.targetBytes = 0;
+    for (unsigned int i = 0; i < order.size(); ++i)
+    {
+        Target& target = targets[order[i]];
+        ++stats.targets;
+        stats.targetBytes += targetBytes(target.format, target.width, target.height, target.samples);
+
+        for (unsigned int t = 0; t < textures.size() && target.texture < 0; ++t)
+        {
+            const Texture& texture = textures[t];
+            if (texture.format == target.format
+                && texture.width == target.width
+                && texture.height == target.height
+                && texture.samples == target.samples
+                && texture.lastPass < target.firstPass)
+            {
+                target.texture = t;
+            }
+        }
+
+        if (target.texture < 0)
+        {
+            Texture texture;
+            texture.format = target.format;
+            texture.width = target.width;
+            texture.height = target.height;
+            texture.samples = target.samples;
+
+            glGenTextures(1, &texture.name);
+            GpuMemory::track(GpuMemory::kTexture, texture.name, GpuMemory::kRenderTargets, target.name);
+            if (target.samples > 1)
+            {
+                glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture.name);
+                glTexStorage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, target.samples, target.format, target.width, target.height, GL_TRUE);
+                glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+            }
+            else
+            {
+                glBindTexture(GL_TEXTURE_RECTANGLE, texture.name);
+                glTexStorage2D(GL_TEXTURE_RECTANGLE, 1, target.format, target.width, target.height);
+                glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+            }
+            GpuMemory::textureStorage(texture.name, target.format, target.width, target.height, 1, target.samples);
+
+            target.texture = textures.size();
+            textures.push_back(texture);
+        }
+
+        textures[target.texture].used = true;
+        textures[target.texture].lastPass = target.lastPass;
+    }
+
+    // anything this graph doesnt use goes, the msaa targets for one are only around while it is on
+    stats.textures = 0;
+    stats.textureBytes = 0;
+    unsigned int kept = 0;
+    for (unsigned int t = 0; t < textures.size(); ++t)
+    {
+        if (!textures[t].used)
+        {
+            glDeleteTextures(1, &textures[t].name);
+            GpuMemory::release(GpuMemory::kTexture, textures[t].name);
+            continue;
+        }
+
+        for (unsigned int i = 0; i < targets.size(); ++i)
+        {
+            if (targets[i].texture == static_cast<int>(t))
+            {
+                targets[i].texture = kept;
+            }
+        }
+        ++stats.textures;
+        stats.textureBytes += targetBytes(textures[t].format, textures[t].width, textures[t].height, textures[t].samples);
+        textures[kept++] = textures[t];
+    }
+    textures.resize(kept);
+}
+
+GLuint FrameGraph::findFramebuffer(const GLuint* attachments_)
+{
+    for (unsigned int f = 0; f < framebuffers.size(); ++f)
+    {
+        if (std::equal(attachments_, attachments_ + kMaxColourTargets + 1, framebuffers[f].attachments))
+        {
+            return framebuffers[f].name;
+        }
+    }
+    return 0;
+}
+
+void FrameGraph::clearTargets(const Pass& pass_, bool force_)
+{
+    GLenum invalidate[kMaxColourTargets + 1];
+    int invalidateCount = 0;
+    bool clearing = false;
+    for (int c = 0; c < pass_.colourCount; ++c)
+    {
+        clearing |= pass_.colourLoad[c] == kClear;
+        if (pass_.colourLoad[c] == kDontCare && !targets[pass_.colour[c]].backbuffer)
+        {
+            invalidate[invalidateCount++] = GL_COLOR_ATTACHMENT0 + c;
+        }
+    }
+    if (pass_.depthStencil != kNone)
+    {
+        clearing |= pass_.depthStencilLoad == kClear;
+        if (pass_.depthStencilLoad == kDontCare)
+        {
+            invalidate[invalidateCount++] = GL_DEPTH_STENCIL_ATTACHMENT;
+        }
+    }
+
+    // lets the driver skip loading whatever an aliased target's texture last held
+    if (invalidateCount > 0)
+    {
+        glInvalidateFramebuffer(GL_FRAMEBUFFER, invalidateCount, invalidate);
+    }
+
+    if (!clearing)
+    {
+        return;
+    }
+
+    // clears go through the write masks, so they have to be open first. on the first pass of the frame current is
+    // only what the graph last set, the code outside it could have closed a mask since, so they are set regardless
+    State open = current;
+    open.depthWrite = true;
+    open.stencilWriteMask = ~0u;
+    open.colourWrite = true;
+    applyState(open, force_);
+
+    for (int c = 0; c < pass_.colourCount; ++c)
+    {
+        if (pass_.colourLoad[c] == kClear)
+        {
+            glClearBufferfv(GL_COLOR, c, pass_.clearColour);
+        }
+    }
+    if (pass_.depthStencil != kNone && pass_.depthStencilLoad == kClear)
+    {
+        glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.f, 0);
+    }
+}
+
+void FrameGraph::applyState(const State& state_, bool force_)
+{
+    if (force_ || state_.depthTest != current.depthTest)
+    {
+        SetCapability(GL_DEPTH_TEST, state_.depthTest);
+        ++stats.stateChanges;
+    }
+    if (force_ || state_.depthWrite != current.depthWrite)
+    {
+        glDepthMask(state_.depthWrite ? GL_TRUE : GL_FALSE);
+        ++stats.stateChanges;
+    }
+    if (force_ || state_.depthFunc != current.depthFunc)
+    {
+        glDepthFunc(state_.depthFunc);
+        ++stats.stateChanges;
+    }
+
+    if (force_ || state_.stencilTest != current.stencilTest)
+    {
+        SetCapability(GL_STENCIL_TEST, state_.stencilTest);
+        ++stats.stateChanges;
+    }
+    if (force_ || state_.stencilFunc != current.stencilFunc || state_.stencilRef != current.stencilRef || state_.stencilReadMask != current.stencilReadMask)
+    {
+        glStencilFunc(state_.stencilFunc, state_.stencilRef, state_.stencilReadMask);
+        ++stats.stateChanges;
+    }
+    if (force_ || state_.stencilWriteMask != current.stencilWriteMask)
+    {
+        glStencilMask(state_.stencilWriteMask);
+        ++stats.stateChanges;
+    }
+    if (force_ || state_.stencilFail != current.stencilFail || state_.stencilDepthFail != current.stencilDepthFail || state_.stencilPass != current.stencilPass)
+    {
+        glStencilOp(state_.stencilFail, state_.stencilDepthFail, state_.stencilPass);
+        ++stats.stateChanges;
+    }
+
+    if (force_ || state_.blend != current.blend)
+    {
+        SetCapability(GL_BLEND, state_.blend);
+        ++stats.stateChanges;
+    }
+    if (force_ || state_.blendSource != current.blendSource || state_.blendDestination != current.blendDestination)
+    {
+        glBlendFunc(state_.blendSource, state_.blendDestination);
+        ++stats.stateChanges;
+    }
+
+    if (force_ || state_.cullFace != current.cullFace)
+    {
+        SetCapability(GL_CULL_FACE, state_.cullFace);
+        ++stats.stateChanges;
+    }
+    if (force_ || state_.cullMode != current.cullMode)
+    {
+        glCullFace(state_.cullMode);
+        ++stats.stateChanges;
+    }
+
+    if (force_ || state_.colourWrite != current.colourWrite)
+    {
+        const GLboolean write = state_.colourWrite ? GL_TRUE : GL_FALSE;
+        glColorMask(write, write, write, write);
+        ++stats.stateChanges;
+    }
+
+    current = state_;
+}
@@ -0,0 +1,203 @@
+#pragma once
+#ifndef FRAME_GRAPH_HPP
+#define FRAME_GRAPH_HPP
+
+#include <tgl/tgl.h>
+#include <functional>
+#include <vector>
+
+class GpuTimer;
+
+/*
+the screen sized passes of the frame and the targets they draw into.
+
+passes are added in the order they run and say which targets they draw into and which they read. compile culls the
+passes whose output nothing goes on to read, works out the first and last pass each target is used in, and gives
+every target a texture. targets with the same format and size whose lifetimes dont overlap share one, gl 4.3 has no
+way to place two textures in the same memory so sharing the texture object is as close as it gets. the textures are
+kept from one compile to the next if they still fit.
+
+execute binds each pass's framebuffer, clears or invalidates what the pass asked for and changes only the fixed
+function state that differs from the pass before, then calls the pass. a pass can change state while it draws but
+has to put it back the way it declared it. afterwards the defaults are put back for the code outside the graph.
+
+a frame that has nothing new to draw for some of the passes can skip them by group, the targets they fill have to
+be persistent so what they drew last time is still there for the passes that do run.
+
+the passes and targets only need building again when something about them changes, not every frame.
+*/
+class FrameGraph
+{
+public:
+
+    typedef int Handle;
+    static const Handle kNone = -1;
+    static const int kMaxColourTargets = 4;
+
+    // what a pass wants in a target it draws into before it starts
+    enum Load
+    {
+        kLoad, // whatever an earlier pass left
+        kClear, // colour to the pass's clear colour, depth to 1 and stencil to 0
+        kDontCare // the pass covers every pixel it cares about, the old contents are thrown away
+    };
+
+    // the fixed function state a pass draws with, the defaults are gl's own apart from the depth func
+    struct State
+    {
+        bool depthTest;
+        bool depthWrite;
+        GLenum depthFunc;
+        bool stencilTest;
+        GLenum stencilFunc;
+        GLint stencilRef;
+        GLuint stencilReadMask;
+        GLuint stencilWriteMask;
+        GLenum stencilFail, stencilDepthFail, stencilPass;
+        bool blend;
+        GLenum blendSource, blendDestination;
+        bool cullFace;
+        GLenum cullMode;
+        bool colourWrite;
+
+        State();
+    };
+
+    typedef std::function<void()> Execute;
+
+    struct Stats
+    {
+        unsigned int passes;
+        unsigned int passesCulled;
+        unsigned int targets; // not counting the backbuffer
+        unsigned int textures; // what the targets ended up sharing
+        unsigned long long targetBytes; // if every target had a texture to itself
+        unsigned long long textureBytes;
+        unsigned int framebufferBinds; // by the last execute
+        unsigned int stateChanges;
+        unsigned int passesSkipped;
+    };
+
+    FrameGraph();
+    ~FrameGraph();
+
+    // forgets the passes and targets, the textures stay for the next compile to reuse
+    void reset();
+
+    Handle createTarget(const char* name_, GLenum format_, int width_, int height_, int samples_ = 1);
+    Handle importBackbuffer(int width_, int height_);
+
+    int addPass(const char* name_, const State& state_, const Execute& execute_);
+
+    // depth and stencil formats are attached as the depth stencil, anything else as the next colour attachment. a
+    // target the pass only tests against is still written, with kLoad
+    void write(int pass_, Handle target_, Load load_ = kLoad);
+
+    // sampled or blitted from
+    void read(int pass_, Handle target_);
+
+    // never culled, for a pass whose results go somewhere other than a target, like a readback. it can draw into
+    // nothing and only read
+    void keep(int pass_);
+
+    // a mask of whatever groups the caller sorts its passes into, execute can skip groups of passes
+    void setGroups(int pass_, unsigned int groups_);
+
+    // the target keeps a texture to itself and what was drawn into it stays from one execute to the next, until the
+    // graph is compiled again. for targets a frame can reuse when the passes that fill them are skipped
+    void persist(Handle target_);
+
+    // for the colour targets the pass clears, the background colour unless it is set
+    void setClearColour(int pass_, GLfloat red_, GLfloat green_, GLfloat blue_, GLfloat alpha_);
+
+    void compile();
+    // the passes in any of skipGroups_ are left out, along with whatever they would have drawn
+    void execute(GpuTimer& timer_, unsigned int skipGroups_ = 0);
+
+    // deletes every texture and framebuffer, the graph has to be compiled again before it is used
+    void deleteObjects();
+
+    bool isCompiled() const;
+
+    // only once compiled
+    GLuint getTexture(Handle target_) const;
+
+    // a framebuffer with the targets attached, for blitting from. made the first time it is asked for
+    GLuint getFramebuffer(const Handle* colour_, int colourCount_, Handle depthStencil_);
+
+    const Stats& getStats() const;
+
+protected:
+
+    struct Target
+    {
+        const char* name;
+        GLenum format;
+        int width, height, samples;
+        bool backbuffer;
+        bool persistent;
+        int firstPass, lastPass; // -1 when no pass that survived culling uses it
+        int texture;
+    };
+
+    struct Pass
+    {
+        const char* name;
+        State state;
+        Execute execute;
+        Handle colour[kMaxColourTargets];
+        Load colourLoad[kMaxColourTargets];
+        int colourCount;
+        GLfloat clearColour[4];
+        Handle depthStencil;
+        Load depthStencilLoad;
+        std::vector<Handle> reads;
+        bool culled;
+        bool kept;
+        unsigned int groups;
+        GLuint framebuffer;
+    };
+
+    struct Texture
+    {
+        GLuint name;
+        GLenum format;
+        int width, height, samples;
+        int lastPass;
+        bool used;
+    };
+
+    struct Framebuffer
+    {
+        GLuint attachments[kMaxColourTargets + 1]; // texture names, the depth stencil last
+        GLuint name;
+    };
+
+    std::vector<Target> targets;
+    std::vector<Pass> passes;
+    std::vector<Texture> textures;
+    std::vector<Framebuffer> framebuffers;
+    std::vector<unsigned char> needed;
+    std::vector<int> order;
+    bool compiled;
+
+    State current;
+    Stats stats;
+
+    static bool isDepthFormat(GLenum format_);
+    static unsigned long long targetBytes(GLenum format_, int width_, int height_, int samples_);
+
+    void cullPasses();
+    void computeLifetimes();
+    void assignTextures();
+    GLuint findFramebuffer(const GLuint* attachments_);
+    void clearTargets(const Pass& pass_, bool force_);
+    void applyState(const State& state_, bool force_);
+
+private:
+
+    FrameGraph(const FrameGraph&);
+    FrameGraph& operator=(const FrameGraph&);
+};
+
+#endif //FRAME_GRAPH_HPP
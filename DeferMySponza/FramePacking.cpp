@@ -0,0 +1,74 @@
+#include "FramePacking.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <cassert>
+#include <cstring>
+
+void PackRenderBuffer(const glm::mat4& projectViewMat_,
+    const glm::vec3& camPos_,
+    GLuint buffer_,
+    FrameArena& arena_,
+    UploadSink& sink_)
+{
+    // so since glMapBufferRange does not work, i am going to create a temporary buffer for the per model data, and then copy the full buffer straight into the shaders buffer
+    unsigned int bufferSize = sizeof(projectViewMat_) + sizeof(camPos_);
+    char* buffer = arena_.allocateArray<char>(bufferSize);
+    unsigned int index = 0;
+
+    //projection matrix first!
+    memcpy(buffer + index, glm::value_ptr(projectViewMat_), sizeof(glm::mat4));
+    index += sizeof(projectViewMat_);
+
+    // camera position next!
+    memcpy(buffer + index, glm::value_ptr(camPos_), sizeof(camPos_));
+
+    sink_.writeBuffer(GL_SHADER_STORAGE_BUFFER, buffer_, buffer, bufferSize);
+}
+
+void PackRenderViews(const glm::mat4* projectViewMats_,
+    const glm::vec3* camPositions_,
+    unsigned int count_,
+    unsigned int stride_,
+    GLuint buffer_,
+    FrameArena& arena_,
+    UploadSink& sink_)
+{
+    assert(stride_ >= sizeof(glm::mat4) + sizeof(glm::vec3));
+    unsigned int bufferSize = count_ * stride_;
+    char* buffer = arena_.allocateArray<char>(bufferSize);
+    memset(buffer, 0, bufferSize);
+
+    for (unsigned int i = 0; i < count_; ++i)
+    {
+        char* view = buffer + i * stride_;
+        memcpy(view, glm::value_ptr(projectViewMats_[i]), sizeof(glm::mat4));
+        memcpy(view + sizeof(glm::mat4), glm::value_ptr(camPositions_[i]), sizeof(glm::vec3));
+    }
+
+    sink_.writeBuffer(GL_SHADER_STORAGE_BUFFER, buffer_, buffer, bufferSize);
+}
+
+void GatherLights(const std::vector<LightData>& sceneLights_,
+    const std::vector<LightData>& extraLights_,
+    bool replaceSceneLights_,
+    std::vector<LightData>& allLights_)
+{
+    allLights_.clear();
+    if (!replaceSceneLights_)
+    {
+        allLights_.assign(sceneLights_.begin(), sceneLights_.end());
+    }
+    allLights_.insert(allLights_.end(), extraLights_.begin(), extraLights_.end());
+}
+
+LightData* GatherVisibleLights(const std::vector<LightData>& allLights_,
+    const std::vector<unsigned int>& visibleLights_,
+    FrameArena& arena_)
+{
+    LightData* lights = arena_.allocateArray<LightData>(visibleLights_.size());
+    for (unsigned int i = 0; i < visibleLights_.size(); ++i)
+    {
+        lights[i] = allLights_[visibleLights_[i]];
+    }
+    return lights;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef FRAME_PACKING_HPP
+#define FRAME_PACKING_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "RenderTypes.hpp"
+#include "FrameArena.hpp"
+#include "UploadSink.hpp"
+
+/*
+the per frame cpu work that feeds the buffers, pulled out of MyView so it can be benchmarked without gl.
+scratch comes from the frame arena and the uploads go through whatever sink is passed in.
+*/
+
+// fills BufferRender, the projection view matrix followed by the camera position
+void PackRenderBuffer(const glm::mat4& projectViewMat_,
+    const glm::vec3& camPos_,
+    GLuint buffer_,
+    FrameArena& arena_,
+    UploadSink& sink_);
+
+// fills BufferRender with several cameras at once, each laid out like PackRenderBuffer's and stride_ bytes apart
+void PackRenderViews(const glm::mat4* projectViewMats_,
+    const glm::vec3* camPositions_,
+    unsigned int count_,
+    unsigned int stride_,
+    GLuint buffer_,
+    FrameArena& arena_,
+    UploadSink& sink_);
+
+// every light for the frame, the scene's own (unless replaced) followed by the extra ones
+void GatherLights(const std::vector<LightData>& sceneLights_,
+    const std::vector<LightData>& extraLights_,
+    bool replaceSceneLights_,
+    std::vector<LightData>& allLights_);
+
+// copies the lights that survived culling into arena memory in the order given, ready to upload
+LightData* GatherVisibleLights(const std::vector<LightData>& allLights_,
+    const std::vector<unsigned int>& visibleLights_,
+    FrameArena& arena_);
+
+#endif //FRAME_PACKING_HPP
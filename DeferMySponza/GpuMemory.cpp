@@ -0,0 +1,288 @@
+#include "GpuMemory.hpp"
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    // a few hundred objects at most, a linear search is fine and finding one doesnt allocate
+    std::vector<GpuMemory::Resource>& Resources()
+    {
+        static std::vector<GpuMemory::Resource> resources;
+        return resources;
+    }
+
+    GpuMemory::Resource* Find(GpuMemory::Kind kind_, GLuint name_)
+    {
+        std::vector<GpuMemory::Resource>& resources = Resources();
+        for (unsigned int i = 0; i < resources.size(); ++i)
+        {
+            if (resources[i].kind == kind_ && resources[i].name == name_)
+            {
+                return &resources[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void PrintMegabytes(std::ostream& out_, unsigned long long bytes_)
+    {
+        out_ << std::fixed << std::setprecision(2) << bytes_ / (1024.0 * 1024.0) << "MB";
+        out_.unsetf(std::ios_base::floatfield);
+    }
+
+    void PrintResource(std::ostream& out_, const GpuMemory::Resource& resource_)
+    {
+        out_ << "    " << GpuMemory::getKindName(resource_.kind) << " " << resource_.name
+            << " " << (resource_.label != nullptr ? resource_.label : "?")
+            << " [" << GpuMemory::getCategoryName(resource_.category) << "]";
+        if (resource_.width > 0)
+        {
+            out_ << " " << resource_.width << "x" << resource_.height;
+            if (resource_.layers > 1)
+            {
+                out_ << "x" << resource_.layers;
+            }
+            if (resource_.samples > 1)
+            {
+                out_ << " " << resource_.samples << " samples";
+            }
+            out_ << " format 0x" << std::hex << resource_.format << std::dec;
+        }
+        out_ << " ";
+        PrintMegabytes(out_, resource_.bytes);
+        out_ << std::endl;
+    }
+}
+
+void GpuMemory::track(Kind kind_, GLuint name_, Category category_, const char* label_)
+{
+    Resource* resource = Find(kind_, name_);
+    if (resource == nullptr)
+    {
+        Resource blank;
+        Resources().push_back(blank);
+        resource = &Resources().back();
+    }
+    resource->kind = kind_;
+    resource->name = name_;
+    resource->category = category_;
+    resource->label = label_;
+    resource->format = 0;
+    resource->width = 0;
+    resource->height = 0;
+    resource->layers = 0;
+    resource->samples = 0;
+    resource->bytes = 0;
+}
+
+void GpuMemory::release(Kind kind_, GLuint name_)
+{
+    std::vector<Resource>& resources = Resources();
+    for (unsigned int i = 0; i < resources.size(); ++i)
+    {
+        if (resources[i].kind == kind_ && resources[i].name == name_)
+        {
+            resources[i] = resources.back();
+            resources.pop_back();
+            return;
+        }
+    }
+}
+
+void GpuMemory::bufferStorage(GLuint buffer_, unsigned long long bytes_)
+{
+    Resource* resource = Find(kBuffer, buffer_);
+    if (resource != nullptr)
+    {
+        resource->bytes = bytes_;
+    }
+}
+
+void GpuMemory::textureStorage(GLuint texture_, GLenum internalFormat_, int width_, int height_, int layers_, int samples_)
+{
+    Resource* resource = Find(kTexture, texture_);
+    if (resource != nullptr)
+    {
+        resource->format = internalFormat_;
+        resource->width = width_;
+        resource->height = height_;
+        resource->layers = layers_;
+        resource->samples = samples_;
+        resource->bytes = static_cast<unsigned long long>(width_) * height_ * layers_ * samples_ * formatBytes(internalFormat_);
+    }
+}
+
+void GpuMemory::renderbufferStorage(GLuint renderbuffer_, GLenum internalFormat_, int width_, int height_, int samples_)
+{
+    Resource* resource = Find(kRenderbuffer, renderbuffer_);
+    if (resource != nullptr)
+    {
+        resource->format = internalFormat_;
+        resource->width = width_;
+        resource->height = height_;
+        resource->layers = 1;
+        resource->samples = samples_;
+        resource->bytes = static_cast<unsigned long long>(width_) * height_ * samples_ * formatBytes(internalFormat_);
+    }
+}
+
+bool GpuMemory::hasBufferStorage()
+{
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 4))
+    {
+        return true;
+    }
+
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+    {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension != nullptr && std::strcmp(extension, "GL_ARB_buffer_storage") == 0)
+        {
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
+unsigned int GpuMemory::formatBytes(GLenum internalFormat_)
+{
+    switch (internalFormat_)
+    {
+    case GL_R8:
+        return 1;
+    case GL_RG8:
+    case GL_R16F:
+        return 2;
+    case GL_RGB8:
+        return 3;
+    case GL_RGBA8:
+    case GL_RG16F:
+    case GL_R32F:
+    case GL_R32UI:
+    case GL_R11F_G11F_B10F:
+    case GL_DEPTH_COMPONENT24:
+    case GL_DEPTH_COMPONENT32F:
+    case GL_DEPTH24_STENCIL8:
+        return 4;
+    case GL_RGBA16F:
+    case GL_RG32F:
+    case GL_DEPTH32F_STENCIL8:
+        return 8;
+    case GL_RGB32F:
+        return 12;
+    case GL_RGBA32F:
+        return 16;
+    }
+    return 0;
+}
+
+unsigned long long GpuMemory::getTotalBytes()
+{
+    unsigned long long total = 0;
+    const std::vector<Resource>& resources = Resources();
+    for (unsigned int i = 0; i < resources.size(); ++i)
+    {
+        total += resources[i].bytes;
+    }
+    return total;
+}
+
+unsigned long long GpuMemory::getCategoryBytes(Category category_)
+{
+    unsigned long long total = 0;
+    const std::vector<Resource>& resources = Resources();
+    for (unsigned int i = 0; i < resources.size(); ++i)
+    {
+        if (resources[i].category == category_)
+        {
+            total += resources[i].bytes;
+        }
+    }
+    return total;
+}
+
+unsigned int GpuMemory::getResourceCount()
+{
+    return Resources().size();
+}
+
+const GpuMemory::Resource& GpuMemory::getResource(unsigned int index_)
+{
+    return Resources()[index_];
+}
+
+const char* GpuMemory::getKindName(Kind kind_)
+{
+    static const char* names[kKindCount] = { "buffer", "texture", "renderbuffer", "framebuffer", "vertex_array", "program" };
+    return names[kind_];
+}
+
+const char* GpuMemory::getCategoryName(Category category_)
+{
+    static const char* names[kCategoryCount] = { "render_targets", "shadow_maps", "geometry", "instances", "shader_storage", "objects", "readback" };
+    return names[category_];
+}
+
+void GpuMemory::report(std::ostream& out_, bool listAll_)
+{
+    const std::vector<Resource>& resources = Resources();
+    out_ << "gpu memory: ";
+    PrintMegabytes(out_, getTotalBytes());
+    out_ << " in " << resources.size() << " objects" << std::endl;
+
+    for (int c = 0; c < kCategoryCount; ++c)
+    {
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < resources.size(); ++i)
+        {
+            if (resources[i].category == c)
+            {
+                ++count;
+            }
+        }
+
+        out_ << "  " << getCategoryName(static_cast<Category>(c)) << ": ";
+        PrintMegabytes(out_, getCategoryBytes(static_cast<Category>(c)));
+        out_ << " (" << count << ")" << std::endl;
+
+        if (!listAll_)
+        {
+            continue;
+        }
+        for (unsigned int i = 0; i < resources.size(); ++i)
+        {
+            if (resources[i].category == c)
+            {
+                PrintResource(out_, resources[i]);
+            }
+        }
+    }
+}
+
+unsigned int GpuMemory::reportLeaks(std::ostream& out_)
+{
+    const std::vector<Resource>& resources = Resources();
+    if (resources.empty())
+    {
+        return 0;
+    }
+
+    out_ << "gpu memory: " << resources.size() << " objects were not deleted, ";
+    PrintMegabytes(out_, getTotalBytes());
+    out_ << std::endl;
+    for (unsigned int i = 0; i < resources.size(); ++i)
+    {
+        PrintResource(out_, resources[i]);
+    }
+    return resources.size();
+}
@@ -0,0 +1,85 @@
+#pragma once
+#ifndef GPU_MEMORY_HPP
+#define GPU_MEMORY_HPP
+
+#include <tgl/tgl.h>
+#include <iosfwd>
+
+/*
+book keeping for every gl object the renderer creates, and roughly how much video memory is behind it.
+
+the gl calls are made as normal and this is told about them alongside, track when the name is generated, one of the
+storage calls whenever the data store is (re)specified, and release when it is deleted. sizes are worked out from
+the internal format and dimensions so they are what was asked for, drivers pad and compress as they like.
+anything still tracked when the view stops is reported as a leak.
+
+only the render thread should call these.
+*/
+class GpuMemory
+{
+public:
+
+    enum Kind
+    {
+        kBuffer,
+        kTexture,
+        kRenderbuffer,
+        kFramebuffer,
+        kVertexArray,
+        kProgram,
+        kKindCount
+    };
+
+    enum Category
+    {
+        kRenderTargets,
+        kShadowMaps,
+        kGeometry,
+        kInstances,
+        kShaderStorage,
+        kObjects, // framebuffers, vertex arrays and programs, nothing to size but they can still leak
+        kReadback,
+        kCategoryCount
+    };
+
+    struct Resource
+    {
+        Kind kind;
+        GLuint name;
+        Category category;
+        const char* label;
+        GLenum format; // internal format for textures and renderbuffers, 0 for the rest
+        int width, height, layers, samples;
+        unsigned long long bytes;
+    };
+
+    // label has to outlive the resource, string literals are what it is meant for
+    static void track(Kind kind_, GLuint name_, Category category_, const char* label_);
+    static void release(Kind kind_, GLuint name_);
+
+    // after glBufferData, glTexImage* or glRenderbufferStorage
+    static void bufferStorage(GLuint buffer_, unsigned long long bytes_);
+    static void textureStorage(GLuint texture_, GLenum internalFormat_, int width_, int height_, int layers_ = 1, int samples_ = 1);
+    static void renderbufferStorage(GLuint renderbuffer_, GLenum internalFormat_, int width_, int height_, int samples_ = 1);
+
+    // bytes per texel for the formats the renderer uses, 0 if it doesnt know the format
+    static unsigned int formatBytes(GLenum internalFormat_);
+
+    // whether buffers can be given immutable storage and stay mapped, gl 4.4 or ARB_buffer_storage
+    static bool hasBufferStorage();
+
+    static unsigned long long getTotalBytes();
+    static unsigned long long getCategoryBytes(Category category_);
+    static unsigned int getResourceCount();
+    static const Resource& getResource(unsigned int index_);
+    static const char* getKindName(Kind kind_);
+    static const char* getCategoryName(Category category_);
+
+    // totals by category, with every resource listed underneath when listAll_ is set
+    static void report(std::ostream& out_, bool listAll_);
+
+    // prints whatever is still tracked and returns how many there were
+    static unsigned int reportLeaks(std::ostream& out_);
+};
+
+#endif //GPU_MEMORY_HPP
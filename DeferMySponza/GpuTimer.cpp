@@ -0,0 +1,188 @@
+#include "GpuTimer.hpp"
+#include "CpuTimer.hpp"
+
+#include <cassert>
+
+GpuTimer::GpuTimer() : currentFrame(0), frameNumber(0), inPass(false), created(false), resultCount(0), resultFrame(0), resultsValid(false)
+{
+    for (int f = 0; f < kFrameLatency; ++f)
+    {
+        frames[f].passCount = 0;
+        frames[f].number = 0;
+        frames[f].pending = false;
+    }
+}
+
+GpuTimer::~GpuTimer()
+{
+
+}
+
+void GpuTimer::createQueries()
+{
+    for (int f = 0; f < kFrameLatency; ++f)
+    {
+        glGenQueries(kMaxPasses * 2, frames[f].queries);
+        frames[f].passCount = 0;
+        frames[f].pending = false;
+    }
+    created = true;
+}
+
+void GpuTimer::deleteQueries()
+{
+    if (!created)
+    {
+        return;
+    }
+    created = false;
+    for (int f = 0; f < kFrameLatency; ++f)
+    {
+        glDeleteQueries(kMaxPasses * 2, frames[f].queries);
+    }
+}
+
+void GpuTimer::readFrame(Frame& frame_)
+{
+    frame_.pending = false;
+    if (frame_.passCount == 0)
+    {
+        return;
+    }
+
+    // after kFrameLatency frames these are long done, GL_QUERY_RESULT only waits if the gpu is that far behind
+    for (int p = 0; p < frame_.passCount; ++p)
+    {
+        glGetQueryObjectui64v(frame_.queries[p * 2], GL_QUERY_RESULT, &resultBegin[p]);
+        glGetQueryObjectui64v(frame_.queries[p * 2 + 1], GL_QUERY_RESULT, &resultEnd[p]);
+        resultNames[p] = frame_.names[p];
+    }
+    resultCount = frame_.passCount;
+    resultFrame = frame_.number;
+    resultsValid = true;
+}
+
+void GpuTimer::beginFrame()
+{
+    if (!created)
+    {
+        return;
+    }
+
+    currentFrame = (currentFrame + 1) % kFrameLatency;
+    Frame& frame = frames[currentFrame];
+    if (frame.pending)
+    {
+        readFrame(frame);
+    }
+    frame.passCount = 0;
+    frame.number = ++frameNumber;
+}
+
+void GpuTimer::endFrame()
+{
+    if (!created)
+    {
+        return;
+    }
+
+    assert(!inPass);
+    frames[currentFrame].pending = true;
+}
+
+void GpuTimer::beginPass(const char* name_)
+{
+    Frame& frame = frames[currentFrame];
+    if (!created || frame.passCount == kMaxPasses)
+    {
+        return;
+    }
+
+    assert(!inPass);
+    inPass = true;
+    frame.names[frame.passCount] = name_;
+    glQueryCounter(frame.queries[frame.passCount * 2], GL_TIMESTAMP);
+}
+
+void GpuTimer::endPass()
+{
+    Frame& frame = frames[currentFrame];
+    if (!created || !inPass)
+    {
+        return;
+    }
+
+    inPass = false;
+    glQueryCounter(frame.queries[frame.passCount * 2 + 1], GL_TIMESTAMP);
+    ++frame.passCount;
+}
+
+bool GpuTimer::hasResults() const
+{
+    return resultsValid;
+}
+
+int GpuTimer::getPassCount() const
+{
+    return resultCount;
+}
+
+const char* GpuTimer::getPassName(int pass_) const
+{
+    return resultNames[pass_];
+}
+
+double GpuTimer::getPassMilliseconds(int pass_) const
+{
+    return (resultEnd[pass_] - resultBegin[pass_]) / 1000000.0;
+}
+
+GLuint64 GpuTimer::getPassBegin(int pass_) const
+{
+    return resultBegin[pass_];
+}
+
+GLuint64 GpuTimer::getPassEnd(int pass_) const
+{
+    return resultEnd[pass_];
+}
+
+double GpuTimer::getFrameMilliseconds() const
+{
+    if (resultCount == 0)
+    {
+        return 0;
+    }
+    return (resultEnd[resultCount - 1] - resultBegin[0]) / 1000000.0;
+}
+
+unsigned int GpuTimer::getCurrentFrame() const
+{
+    return frameNumber;
+}
+
+unsigned int GpuTimer::getResultFrame() const
+{
+    return resultFrame;
+}
+
+long long GpuTimer::measureClockOffset() const
+{
+    // take the tightest of a few reads, the cpu time either side bounds when the gl clock was actually sampled
+    long long offset = 0;
+    long long tightest = -1;
+    for (int i = 0; i < 8; ++i)
+    {
+        const long long before = CpuTimeNanoseconds();
+        GLint64 gpuTime = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+        const long long after = CpuTimeNanoseconds();
+
+        if (tightest < 0 || after - before < tightest)
+        {
+            tightest = after - before;
+            offset = before + (after - before) / 2 - gpuTime;
+        }
+    }
+    return offset;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef GPU_TIMER_HPP
+#define GPU_TIMER_HPP
+
+#include <tgl/tgl.h>
+
+/*
+times each render pass on the gpu with timestamp queries.
+
+queries are kept for kFrameLatency frames before being read back so reading them doesnt stall, which means the
+results always describe a frame from a few frames ago. passes cant be nested.
+*/
+class GpuTimer
+{
+public:
+
+    static const int kMaxPasses = 24;
+    static const int kFrameLatency = 4;
+
+    GpuTimer();
+    ~GpuTimer();
+
+    void createQueries();
+    void deleteQueries();
+
+    // picks up the results of the oldest frame in flight, then starts recording this one
+    void beginFrame();
+    void endFrame();
+
+    // the name has to outlive the frame, string literals are what it is meant for
+    void beginPass(const char* name_);
+    void endPass();
+
+    bool hasResults() const;
+    int getPassCount() const;
+    const char* getPassName(int pass_) const;
+    double getPassMilliseconds(int pass_) const;
+    // raw GL_TIMESTAMP values in nanoseconds, for lining the passes up against other clocks
+    GLuint64 getPassBegin(int pass_) const;
+    GLuint64 getPassEnd(int pass_) const;
+    // first pass begin to last pass end
+    double getFrameMilliseconds() const;
+    // frames are numbered from 1 as beginFrame is called, the results are from getResultFrame
+    unsigned int getCurrentFrame() const;
+    unsigned int getResultFrame() const;
+
+    // nanoseconds to add to a GL_TIMESTAMP to put it on CpuTimeNanoseconds, reads the gl clock directly so it
+    // waits for the commands queued so far to reach the gpu, only for occasional use
+    long long measureClockOffset() const;
+
+protected:
+
+    struct Frame
+    {
+        GLuint queries[kMaxPasses * 2];
+        const char* names[kMaxPasses];
+        int passCount;
+        unsigned int number;
+        bool pending;
+    };
+
+    Frame frames[kFrameLatency];
+    int currentFrame;
+    unsigned int frameNumber;
+    bool inPass;
+    bool created;
+
+    const char* resultNames[kMaxPasses];
+    GLuint64 resultBegin[kMaxPasses];
+    GLuint64 resultEnd[kMaxPasses];
+    int resultCount;
+    unsigned int resultFrame;
+    bool resultsValid;
+
+    void readFrame(Frame& frame_);
+};
+
+#endif //GPU_TIMER_HPP
@@ -0,0 +1,1062 @@
+#include "InstanceBvh.hpp"
+#include "CpuTimer.hpp"
+
+#include <emmintrin.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cfloat>
+#include <deque>
+#include <thread>
+
+namespace
+{
+    // cost of visiting a node compared to testing a leaf, which tests all its instances at once
+    const float kTraversalCost = 0.5f;
+    // below these sizes it isnt worth starting threads, for the binning of one node and for a whole build
+    const unsigned int kParallelBinThreshold = 32768;
+    const unsigned int kParallelBuildThreshold = 4096;
+    // enough subtrees that a thread that draws a big one doesnt hold everyone else up
+    const unsigned int kTasksPerThread = 4;
+    const unsigned int kNoParent = ~0u;
+    const int kStackSize = 128;
+
+    float SurfaceArea(const glm::vec3& min_, const glm::vec3& max_)
+    {
+        const glm::vec3 size = glm::max(max_ - min_, glm::vec3(0.f));
+        return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    float SurfaceArea(const InstanceBvh::Node& node_)
+    {
+        return SurfaceArea(glm::vec3(node_.min[0], node_.min[1], node_.min[2]), glm::vec3(node_.max[0], node_.max[1], node_.max[2]));
+    }
+
+    // leaves are tested kMaxLeafSize instances at a time
+    float LeafTests(unsigned int count_)
+    {
+        return static_cast<float>(count_) / InstanceBvh::kMaxLeafSize;
+    }
+
+    struct BuildRef
+    {
+        glm::vec3 min, max;
+        glm::vec3 centroid;
+        unsigned int instance;
+    };
+
+    struct BuildNode
+    {
+        glm::vec3 min, max;
+        BuildNode* children[2];
+        unsigned int first, count;
+    };
+
+    struct Bins
+    {
+        glm::vec3 min[3][InstanceBvh::kBinCount];
+        glm::vec3 max[3][InstanceBvh::kBinCount];
+        unsigned int count[3][InstanceBvh::kBinCount];
+
+        void clear()
+        {
+            for (int a = 0; a < 3; ++a)
+            {
+                for (int b = 0; b < InstanceBvh::kBinCount; ++b)
+                {
+                    min[a][b] = glm::vec3(FLT_MAX);
+                    max[a][b] = glm::vec3(-FLT_MAX);
+                    count[a][b] = 0;
+                }
+            }
+        }
+
+        void merge(const Bins& other_)
+        {
+            for (int a = 0; a < 3; ++a)
+            {
+                for (int b = 0; b < InstanceBvh::kBinCount; ++b)
+                {
+                    min[a][b] = glm::min(min[a][b], other_.min[a][b]);
+                    max[a][b] = glm::max(max[a][b], other_.max[a][b]);
+                    count[a][b] += other_.count[a][b];
+                }
+            }
+        }
+    };
+
+    // runs function_(begin, end, chunk) over count_ items split evenly between the threads, on the caller alone when
+    // there arent enough items to be worth it
+    template<typename Function>
+    void ParallelChunks(unsigned int count_, unsigned int threads_, Function function_)
+    {
+        if (threads_ <= 1 || count_ < kParallelBinThreshold)
+        {
+            function_(0u, count_, 0u);
+            return;
+        }
+
+        const unsigned int chunk = (count_ + threads_ - 1) / threads_;
+        std::vector<std::thread> workers;
+        for (unsigned int t = 1; t < threads_; ++t)
+        {
+            const unsigned int begin = std::min(count_, t * chunk);
+            const unsigned int end = std::min(count_, begin + chunk);
+            workers.push_back(std::thread(function_, begin, end, t));
+        }
+        function_(0u, std::min(count_, chunk), 0u);
+        for (unsigned int t = 0; t < workers.size(); ++t)
+        {
+            workers[t].join();
+        }
+    }
+
+    class Builder
+    {
+    public:
+
+        Builder(std::vector<BuildRef>& refs_, unsigned int threads_) : refs(refs_), threads(std::max(1u, threads_)), taskThreshold(0)
+        {
+        }
+
+        BuildNode* build()
+        {
+            const unsigned int count = refs.size();
+            if (threads == 1 || count < kParallelBuildThreshold)
+            {
+                threads = 1;
+                top.pool.push_back(BuildNode());
+                buildRecursive(top, &top.pool.back(), 0, count);
+                return &top.pool.front();
+            }
+
+            // split serially (binning in parallel) until there are enough subtrees to hand out, then build those
+            // on every thread at once
+            taskThreshold = std::max<unsigned int>(InstanceBvh::kMaxLeafSize, count / (threads * kTasksPerThread));
+            top.pool.push_back(BuildNode());
+            buildTop(&top.pool.back(), 0, count);
+
+            std::sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b)
+            {
+                return a.count > b.count;
+            });
+
+            workers.resize(threads);
+            std::atomic<unsigned int> next(0);
+            auto worker = [this, &next](unsigned int thread_)
+            {
+                for (unsigned int i = next++; i < tasks.size(); i = next++)
+                {
+                    buildRecursive(workers[thread_], tasks[i].node, tasks[i].first, tasks[i].count);
+                }
+            };
+
+            std::vector<std::thread> running;
+            for (unsigned int t = 1; t < threads; ++t)
+            {
+                running.push_back(std::thread(worker, t));
+            }
+            worker(0);
+            for (unsigned int t = 0; t < running.size(); ++t)
+            {
+                running[t].join();
+            }
+            return &top.pool.front();
+        }
+
+        unsigned int getThreads() const
+        {
+            return threads;
+        }
+
+    protected:
+
+        struct Task
+        {
+            BuildNode* node;
+            unsigned int first, count;
+        };
+
+        // everything one thread needs to build, so nothing is allocated per node
+        struct Worker
+        {
+            std::deque<BuildNode> pool; // a deque so the nodes dont move as they are added
+            std::vector<glm::vec3> bounds;
+            std::vector<Bins> bins;
+        };
+
+        std::vector<BuildRef>& refs;
+        unsigned int threads;
+        unsigned int taskThreshold;
+        Worker top;
+        std::vector<Worker> workers;
+        std::vector<Task> tasks;
+
+        void buildTop(BuildNode* node_, unsigned int first_, unsigned int count_)
+        {
+            if (count_ <= taskThreshold)
+            {
+                Task task;
+                task.node = node_;
+                task.first = first_;
+                task.count = count_;
+                tasks.push_back(task);
+                return;
+            }
+
+            unsigned int mid;
+            if (!split(top, node_, first_, count_, threads, mid))
+            {
+                return;
+            }
+            top.pool.push_back(BuildNode());
+            node_->children[0] = &top.pool.back();
+            top.pool.push_back(BuildNode());
+            node_->children[1] = &top.pool.back();
+            buildTop(node_->children[0], first_, mid - first_);
+            buildTop(node_->children[1], mid, first_ + count_ - mid);
+        }
+
+        void buildRecursive(Worker& worker_, BuildNode* node_, unsigned int first_, unsigned int count_)
+        {
+            unsigned int mid;
+            if (!split(worker_, node_, first_, count_, 1, mid))
+            {
+                return;
+            }
+            worker_.pool.push_back(BuildNode());
+            node_->children[0] = &worker_.pool.back();
+            worker_.pool.push_back(BuildNode());
+            node_->children[1] = &worker_.pool.back();
+            buildRecursive(worker_, node_->children[0], first_, mid - first_);
+            buildRecursive(worker_, node_->children[1], mid, first_ + count_ - mid);
+        }
+
+        // fills in the node's bounds, then either leaves it as a leaf (returns false) or partitions its refs and
+        // hands back where the second child starts
+        bool split(Worker& worker_, BuildNode* node_, unsigned int first_, unsigned int count_, unsigned int binThreads_, unsigned int& mid_)
+        {
+            node_->first = first_;
+            node_->count = count_;
+            node_->children[0] = nullptr;
+            node_->children[1] = nullptr;
+
+            BuildRef* range = refs.data() + first_;
+            const unsigned int chunks = (binThreads_ > 1 && count_ >= kParallelBinThreshold) ? binThreads_ : 1;
+
+            // bounds of the boxes and of their centres
+            std::vector<glm::vec3>& partials = worker_.bounds;
+            partials.resize(chunks * 4);
+            ParallelChunks(count_, chunks, [range, &partials](unsigned int begin_, unsigned int end_, unsigned int chunk_)
+            {
+                glm::vec3 min(FLT_MAX), max(-FLT_MAX), centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+                for (unsigned int i = begin_; i < end_; ++i)
+                {
+                    min = glm::min(min, range[i].min);
+                    max = glm::max(max, range[i].max);
+                    centroidMin = glm::min(centroidMin, range[i].centroid);
+                    centroidMax = glm::max(centroidMax, range[i].centroid);
+                }
+                partials[chunk_ * 4 + 0] = min;
+                partials[chunk_ * 4 + 1] = max;
+                partials[chunk_ * 4 + 2] = centroidMin;
+                partials[chunk_ * 4 + 3] = centroidMax;
+            });
+
+            glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+            node_->min = glm::vec3(FLT_MAX);
+            node_->max = glm::vec3(-FLT_MAX);
+            for (unsigned int c = 0; c < chunks; ++c)
+            {
+                node_->min = glm::min(node_->min, partials[c * 4 + 0]);
+                node_->max = glm::max(node_->max, partials[c * 4 + 1]);
+                centroidMin = glm::min(centroidMin, partials[c * 4 + 2]);
+                centroidMax = glm::max(centroidMax, partials[c * 4 + 3]);
+            }
+
+            // a leaf this size is one four wide test, splitting it can only add to that
+            if (count_ <= static_cast<unsigned int>(InstanceBvh::kMaxLeafSize))
+            {
+                return false;
+            }
+
+            const glm::vec3 extent = centroidMax - centroidMin;
+            const int largestAxis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+            if (extent[largestAxis] <= 0.f)
+            {
+                // everything is in the same place, there is nothing to choose between so just halve it
+                mid_ = first_ + count_ / 2;
+                return true;
+            }
+
+            // every axis is binned in the one pass over the refs
+            glm::vec3 binScale;
+            for (int a = 0; a < 3; ++a)
+            {
+                binScale[a] = extent[a] > 0.f ? InstanceBvh::kBinCount * 0.9999f / extent[a] : 0.f;
+            }
+
+            std::vector<Bins>& bins = worker_.bins;
+            bins.resize(chunks);
+            ParallelChunks(count_, chunks, [range, &bins, &centroidMin, &binScale](unsigned int begin_, unsigned int end_, unsigned int chunk_)
+            {
+                Bins& local = bins[chunk_];
+                local.clear();
+                for (unsigned int i = begin_; i < end_; ++i)
+                {
+                    for (int a = 0; a < 3; ++a)
+                    {
+                        const int b = static_cast<int>((range[i].centroid[a] - centroidMin[a]) * binScale[a]);
+                        local.min[a][b] = glm::min(local.min[a][b], range[i].min);
+                        local.max[a][b] = glm::max(local.max[a][b], range[i].max);
+                        ++local.count[a][b];
+                    }
+                }
+            });
+            for (unsigned int c = 1; c < chunks; ++c)
+            {
+                bins[0].merge(bins[c]);
+            }
+            const Bins& merged = bins[0];
+
+            // sweep from the right to get the area and count to the right of every boundary, then from the left
+            const float nodeArea = SurfaceArea(node_->min, node_->max);
+            float bestCost = FLT_MAX;
+            int bestAxis = -1;
+            int bestBin = 0;
+            for (int a = 0; a < 3; ++a)
+            {
+                if (extent[a] <= 0.f)
+                {
+                    continue;
+                }
+
+                float rightArea[InstanceBvh::kBinCount];
+                unsigned int rightCount[InstanceBvh::kBinCount];
+                glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+                unsigned int count = 0;
+                for (int b = InstanceBvh::kBinCount - 1; b > 0; --b)
+                {
+                    min = glm::min(min, merged.min[a][b]);
+                    max = glm::max(max, merged.max[a][b]);
+                    count += merged.count[a][b];
+                    rightArea[b] = SurfaceArea(min, max);
+                    rightCount[b] = count;
+                }
+
+                min = glm::vec3(FLT_MAX);
+                max = glm::vec3(-FLT_MAX);
+                count = 0;
+                for (int b = 1; b < InstanceBvh::kBinCount; ++b)
+                {
+                    min = glm::min(min, merged.min[a][b - 1]);
+                    max = glm::max(max, merged.max[a][b - 1]);
+                    count += merged.count[a][b - 1];
+                    if (count == 0 || rightCount[b] == 0)
+                    {
+                        continue;
+                    }
+
+                    const float cost = kTraversalCost + (SurfaceArea(min, max) * LeafTests(count) + rightArea[b] * LeafTests(rightCount[b])) / nodeArea;
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = a;
+                        bestBin = b;
+                    }
+                }
+            }
+
+            if (bestAxis >= 0)
+            {
+                const float scale = binScale[bestAxis];
+                const float origin = centroidMin[bestAxis];
+                const int axis = bestAxis;
+                const int bin = bestBin;
+                BuildRef* middle = std::partition(range, range + count_, [axis, scale, origin, bin](const BuildRef& ref_)
+                {
+                    return static_cast<int>((ref_.centroid[axis] - origin) * scale) < bin;
+                });
+                mid_ = first_ + static_cast<unsigned int>(middle - range);
+                if (mid_ != first_ && mid_ != first_ + count_)
+                {
+                    return true;
+                }
+            }
+
+            // the bins couldnt separate them, fall back to halving along the widest axis
+            std::nth_element(range, range + count_ / 2, range + count_, [largestAxis](const BuildRef& a_, const BuildRef& b_)
+            {
+                return a_.centroid[largestAxis] < b_.centroid[largestAxis];
+            });
+            mid_ = first_ + count_ / 2;
+            return true;
+        }
+    };
+
+    // depth first, the first child goes straight after its parent
+    unsigned int Flatten(const BuildNode* node_,
+        std::vector<InstanceBvh::Node>& nodes_,
+        std::vector<float>& areas_,
+        unsigned int nodeOffset_,
+        unsigned int primitiveOffset_,
+        unsigned int depth_,
+        unsigned int& maxDepth_)
+    {
+        const unsigned int index = nodes_.size();
+        maxDepth_ = std::max(maxDepth_, depth_);
+
+        InstanceBvh::Node node;
+        for (int a = 0; a < 3; ++a)
+        {
+            node.min[a] = node_->min[a];
+            node.max[a] = node_->max[a];
+        }
+        node.offset = 0;
+        node.count = 0;
+        nodes_.push_back(node);
+        areas_.push_back(SurfaceArea(node_->min, node_->max));
+
+        if (node_->children[0] == nullptr)
+        {
+            nodes_[index].offset = primitiveOffset_ + node_->first;
+            nodes_[index].count = node_->count;
+        }
+        else
+        {
+            Flatten(node_->children[0], nodes_, areas_, nodeOffset_, primitiveOffset_, depth_ + 1, maxDepth_);
+            nodes_[index].offset = nodeOffset_ + Flatten(node_->children[1], nodes_, areas_, nodeOffset_, primitiveOffset_, depth_ + 1, maxDepth_);
+        }
+        return index;
+    }
+
+    BuildRef MakeRef(const glm::vec3& min_, const glm::vec3& max_, unsigned int instance_)
+    {
+        BuildRef ref;
+        ref.min = min_;
+        ref.max = max_;
+        ref.centroid = (min_ + max_) * 0.5f;
+        ref.instance = instance_;
+        return ref;
+    }
+
+    float HorizontalMax3(__m128 v_)
+    {
+        __m128 m = _mm_max_ss(v_, _mm_shuffle_ps(v_, v_, _MM_SHUFFLE(1, 1, 1, 1)));
+        m = _mm_max_ss(m, _mm_shuffle_ps(v_, v_, _MM_SHUFFLE(2, 2, 2, 2)));
+        return _mm_cvtss_f32(m);
+    }
+
+    float HorizontalMin3(__m128 v_)
+    {
+        __m128 m = _mm_min_ss(v_, _mm_shuffle_ps(v_, v_, _MM_SHUFFLE(1, 1, 1, 1)));
+        m = _mm_min_ss(m, _mm_shuffle_ps(v_, v_, _MM_SHUFFLE(2, 2, 2, 2)));
+        return _mm_cvtss_f32(m);
+    }
+
+    float HorizontalSum3(__m128 v_)
+    {
+        __m128 s = _mm_add_ss(v_, _mm_shuffle_ps(v_, v_, _MM_SHUFFLE(1, 1, 1, 1)));
+        s = _mm_add_ss(s, _mm_shuffle_ps(v_, v_, _MM_SHUFFLE(2, 2, 2, 2)));
+        return _mm_cvtss_f32(s);
+    }
+
+    __m128 Abs(__m128 v_)
+    {
+        return _mm_and_ps(v_, _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF)));
+    }
+}
+
+InstanceBvh::InstanceBvh()
+{
+    stats.nodes = 0;
+    stats.leaves = 0;
+    stats.depth = 0;
+    stats.threads = 0;
+    stats.sahCost = 0;
+    stats.milliseconds = 0;
+}
+
+InstanceBvh::~InstanceBvh()
+{
+
+}
+
+void InstanceBvh::setPrimitive(unsigned int slot_, const InstanceBounds& bounds_)
+{
+    const glm::vec3 centre = (bounds_.min + bounds_.max) * 0.5f;
+    const glm::vec3 extent = (bounds_.max - bounds_.min) * 0.5f;
+    primCentreX[slot_] = centre.x;
+    primCentreY[slot_] = centre.y;
+    primCentreZ[slot_] = centre.z;
+    primExtentX[slot_] = extent.x;
+    primExtentY[slot_] = extent.y;
+    primExtentZ[slot_] = extent.z;
+}
+
+void InstanceBvh::build(const std::vector<InstanceBounds>& bounds_, unsigned int threadCount_)
+{
+    const double begin = CpuTimeSeconds();
+    const unsigned int count = bounds_.size();
+
+    nodes.clear();
+    buildAreas.clear();
+    order.resize(count);
+    slotOf.resize(count);
+
+    // three extra lanes so the last leaf can load four at once
+    const unsigned int padded = count + 3;
+    primCentreX.assign(padded, 0.f);
+    primCentreY.assign(padded, 0.f);
+    primCentreZ.assign(padded, 0.f);
+    primExtentX.assign(padded, 0.f);
+    primExtentY.assign(padded, 0.f);
+    primExtentZ.assign(padded, 0.f);
+
+    stats.threads = 0;
+    if (count > 0)
+    {
+        std::vector<BuildRef> refs(count);
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            refs[i] = MakeRef(bounds_[i].min, bounds_[i].max, i);
+        }
+
+        Builder builder(refs, threadCount_ != 0 ? threadCount_ : std::max(1u, std::thread::hardware_concurrency()));
+        const BuildNode* root = builder.build();
+        stats.threads = builder.getThreads();
+
+        nodes.reserve(count * 2);
+        buildAreas.reserve(count * 2);
+        stats.depth = 0;
+        Flatten(root, nodes, buildAreas, 0, 0, 0, stats.depth);
+
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            order[i] = refs[i].instance;
+            slotOf[refs[i].instance] = i;
+            setPrimitive(i, bounds_[refs[i].instance]);
+        }
+    }
+
+    finishBuild();
+
+    // cost of the whole tree relative to testing everything in the root
+    stats.sahCost = 0;
+    if (!nodes.empty())
+    {
+        const float rootArea = std::max(SurfaceArea(nodes[0]), FLT_MIN);
+        for (unsigned int i = 0; i < nodes.size(); ++i)
+        {
+            const float area = SurfaceArea(nodes[i]) / rootArea;
+            stats.sahCost += nodes[i].count == 0 ? area * kTraversalCost : area;
+        }
+    }
+    stats.milliseconds = (CpuTimeSeconds() - begin) * 1000.0;
+}
+
+void InstanceBvh::finishBuild()
+{
+    parents.assign(nodes.size(), kNoParent);
+    leafOf.resize(order.size());
+    stats.nodes = nodes.size();
+    stats.leaves = 0;
+    for (unsigned int i = 0; i < nodes.size(); ++i)
+    {
+        const Node& node = nodes[i];
+        if (node.count == 0)
+        {
+            parents[i + 1] = i;
+            parents[node.offset] = i;
+        }
+        else
+        {
+            ++stats.leaves;
+            for (unsigned int s = node.offset; s < node.offset + node.count; ++s)
+            {
+                leafOf[s] = i;
+            }
+        }
+    }
+}
+
+void InstanceBvh::refitLeaf(unsigned int node_)
+{
+    Node& node = nodes[node_];
+    glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+    for (unsigned int s = node.offset; s < node.offset + node.count; ++s)
+    {
+        const glm::vec3 centre(primCentreX[s], primCentreY[s], primCentreZ[s]);
+        const glm::vec3 extent(primExtentX[s], primExtentY[s], primExtentZ[s]);
+        min = glm::min(min, centre - extent);
+        max = glm::max(max, centre + extent);
+    }
+    for (int a = 0; a < 3; ++a)
+    {
+        node.min[a] = min[a];
+        node.max[a] = max[a];
+    }
+}
+
+bool InstanceBvh::refitInterior(unsigned int node_)
+{
+    Node& node = nodes[node_];
+    const Node& left = nodes[node_ + 1];
+    const Node& right = nodes[node.offset];
+    bool changed = false;
+    for (int a = 0; a < 3; ++a)
+    {
+        const float min = std::min(left.min[a], right.min[a]);
+        const float max = std::max(left.max[a], right.max[a]);
+        changed |= min != node.min[a] || max != node.max[a];
+        node.min[a] = min;
+        node.max[a] = max;
+    }
+    return changed;
+}
+
+void InstanceBvh::refit(const std::vector<InstanceBounds>& bounds_, const std::vector<unsigned int>& changed_)
+{
+    assert(bounds_.size() == order.size());
+
+    // past a point walking up from every leaf costs more than just redoing every node once
+    if (changed_.size() * 8 > order.size())
+    {
+        refitAll(bounds_);
+        return;
+    }
+
+    for (unsigned int i = 0; i < changed_.size(); ++i)
+    {
+        const unsigned int slot = slotOf[changed_[i]];
+        setPrimitive(slot, bounds_[changed_[i]]);
+
+        const unsigned int leaf = leafOf[slot];
+        refitLeaf(leaf);
+        // stop as soon as a parent comes out the same, nothing above it can change either
+        for (unsigned int node = parents[leaf]; node != kNoParent && refitInterior(node); node = parents[node])
+        {
+        }
+    }
+}
+
+void InstanceBvh::refitAll(const std::vector<InstanceBounds>& bounds_)
+{
+    assert(bounds_.size() == order.size());
+
+    for (unsigned int s = 0; s < order.size(); ++s)
+    {
+        setPrimitive(s, bounds_[order[s]]);
+    }
+
+    // children always come after their parents so going backwards does every child first
+    for (unsigned int i = nodes.size(); i-- > 0;)
+    {
+        if (nodes[i].count > 0)
+        {
+            refitLeaf(i);
+        }
+        else
+        {
+            refitInterior(i);
+        }
+    }
+}
+
+unsigned int InstanceBvh::subtreeEnd(unsigned int node_) const
+{
+    // the last node of a subtree is its rightmost leaf
+    while (nodes[node_].count == 0)
+    {
+        node_ = nodes[node_].offset;
+    }
+    return node_ + 1;
+}
+
+unsigned int InstanceBvh::rebuildDegraded(float growth_)
+{
+    if (nodes.empty())
+    {
+        return 0;
+    }
+
+    // the highest degraded nodes, nothing below one of them is looked at since it is about to be rebuilt anyway
+    degradedNodes.clear();
+    unsigned int stack[kStackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const unsigned int index = stack[--top];
+        const Node& node = nodes[index];
+        if (node.count > 0)
+        {
+            continue;
+        }
+        if (SurfaceArea(node) > growth_ * buildAreas[index])
+        {
+            degradedNodes.push_back(index);
+            continue;
+        }
+        assert(top + 2 <= kStackSize);
+        stack[top++] = node.offset;
+        stack[top++] = index + 1;
+    }
+
+    // from the back so splicing one subtree in doesnt move the ones still to do
+    std::sort(degradedNodes.begin(), degradedNodes.end());
+    for (unsigned int i = degradedNodes.size(); i-- > 0;)
+    {
+        rebuildSubtree(degradedNodes[i]);
+    }
+
+    if (!degradedNodes.empty())
+    {
+        finishBuild();
+    }
+    return degradedNodes.size();
+}
+
+void InstanceBvh::rebuildSubtree(unsigned int node_)
+{
+    // a subtree owns a contiguous run of nodes and of primitives
+    unsigned int leftmost = node_;
+    while (nodes[leftmost].count == 0)
+    {
+        ++leftmost;
+    }
+    const unsigned int end = subtreeEnd(node_);
+    const unsigned int firstSlot = nodes[leftmost].offset;
+    const unsigned int lastSlot = nodes[end - 1].offset + nodes[end - 1].count;
+
+    std::vector<BuildRef> refs(lastSlot - firstSlot);
+    for (unsigned int s = firstSlot; s < lastSlot; ++s)
+    {
+        const glm::vec3 centre(primCentreX[s], primCentreY[s], primCentreZ[s]);
+        const glm::vec3 extent(primExtentX[s], primExtentY[s], primExtentZ[s]);
+        refs[s - firstSlot] = MakeRef(centre - extent, centre + extent, order[s]);
+    }
+
+    Builder builder(refs, std::max(1u, std::thread::hardware_concurrency()));
+    const BuildNode* root = builder.build();
+
+    std::vector<Node> subtree;
+    std::vector<float> subtreeAreas;
+    unsigned int depth = 0;
+    Flatten(root, subtree, subtreeAreas, node_, firstSlot, 0, depth);
+
+    for (unsigned int i = 0; i < refs.size(); ++i)
+    {
+        const unsigned int slot = firstSlot + i;
+        order[slot] = refs[i].instance;
+        slotOf[refs[i].instance] = slot;
+        primCentreX[slot] = refs[i].centroid.x;
+        primCentreY[slot] = refs[i].centroid.y;
+        primCentreZ[slot] = refs[i].centroid.z;
+        primExtentX[slot] = (refs[i].max.x - refs[i].min.x) * 0.5f;
+        primExtentY[slot] = (refs[i].max.y - refs[i].min.y) * 0.5f;
+        primExtentZ[slot] = (refs[i].max.z - refs[i].min.z) * 0.5f;
+    }
+
+    // the new subtree can have a different number of nodes, so everything pointing past it shifts
+    const int delta = static_cast<int>(subtree.size()) - static_cast<int>(end - node_);
+    if (delta != 0)
+    {
+        for (unsigned int i = 0; i < nodes.size(); ++i)
+        {
+            if ((i < node_ || i >= end) && nodes[i].count == 0 && nodes[i].offset >= end)
+            {
+                nodes[i].offset += delta;
+            }
+        }
+    }
+    nodes.erase(nodes.begin() + node_, nodes.begin() + end);
+    nodes.insert(nodes.begin() + node_, subtree.begin(), subtree.end());
+    buildAreas.erase(buildAreas.begin() + node_, buildAreas.begin() + end);
+    buildAreas.insert(buildAreas.begin() + node_, subtreeAreas.begin(), subtreeAreas.end());
+}
+
+void InstanceBvh::appendSubtree(unsigned int node_, std::vector<unsigned int>& out_) const
+{
+    unsigned int leftmost = node_;
+    while (nodes[leftmost].count == 0)
+    {
+        ++leftmost;
+    }
+    const Node& last = nodes[subtreeEnd(node_) - 1];
+    for (unsigned int s = nodes[leftmost].offset; s < last.offset + last.count; ++s)
+    {
+        out_.push_back(order[s]);
+    }
+}
+
+void InstanceBvh::queryFrustum(const glm::vec4* planes_, int planeCount_, std::vector<unsigned int>& out_) const
+{
+    assert(planeCount_ <= kMaxPlanes);
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    // structure of arrays planes, padded out with ones that everything is in front of
+    float planeData[7][kMaxPlanes];
+    for (int p = 0; p < kMaxPlanes; ++p)
+    {
+        const glm::vec4 plane = p < planeCount_ ? planes_[p] : glm::vec4(0.f, 0.f, 0.f, FLT_MAX);
+        planeData[0][p] = plane.x;
+        planeData[1][p] = plane.y;
+        planeData[2][p] = plane.z;
+        planeData[3][p] = plane.w;
+        planeData[4][p] = std::abs(plane.x);
+        planeData[5][p] = std::abs(plane.y);
+        planeData[6][p] = std::abs(plane.z);
+    }
+    const int groups = planeCount_ > 4 ? 2 : 1;
+    __m128 nx[2], ny[2], nz[2], nw[2], ax[2], ay[2], az[2];
+    for (int g = 0; g < 2; ++g)
+    {
+        nx[g] = _mm_loadu_ps(&planeData[0][g * 4]);
+        ny[g] = _mm_loadu_ps(&planeData[1][g * 4]);
+        nz[g] = _mm_loadu_ps(&planeData[2][g * 4]);
+        nw[g] = _mm_loadu_ps(&planeData[3][g * 4]);
+        ax[g] = _mm_loadu_ps(&planeData[4][g * 4]);
+        ay[g] = _mm_loadu_ps(&planeData[5][g * 4]);
+        az[g] = _mm_loadu_ps(&planeData[6][g * 4]);
+    }
+
+    unsigned int stack[kStackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const unsigned int index = stack[--top];
+        const Node& node = nodes[index];
+
+        // one box against every plane, distance of the centre against the projected half size
+        const __m128 cx = _mm_set1_ps((node.min[0] + node.max[0]) * 0.5f);
+        const __m128 cy = _mm_set1_ps((node.min[1] + node.max[1]) * 0.5f);
+        const __m128 cz = _mm_set1_ps((node.min[2] + node.max[2]) * 0.5f);
+        const __m128 ex = _mm_set1_ps((node.max[0] - node.min[0]) * 0.5f);
+        const __m128 ey = _mm_set1_ps((node.max[1] - node.min[1]) * 0.5f);
+        const __m128 ez = _mm_set1_ps((node.max[2] - node.min[2]) * 0.5f);
+
+        int outside = 0;
+        int inside = 0xFF;
+        for (int g = 0; g < groups; ++g)
+        {
+            const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[g], cx), _mm_mul_ps(ny[g], cy)), _mm_add_ps(_mm_mul_ps(nz[g], cz), nw[g]));
+            const __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[g], ex), _mm_mul_ps(ay[g], ey)), _mm_mul_ps(az[g], ez));
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(d, _mm_sub_ps(_mm_setzero_ps(), r)));
+            inside &= (_mm_movemask_ps(_mm_cmpgt_ps(d, r)) << (g * 4)) | ~(0xF << (g * 4));
+        }
+        if (outside != 0)
+        {
+            continue;
+        }
+        if (inside == 0xFF)
+        {
+            appendSubtree(index, out_);
+            continue;
+        }
+
+        if (node.count == 0)
+        {
+            assert(top + 2 <= kStackSize);
+            stack[top++] = node.offset;
+            stack[top++] = index + 1;
+            continue;
+        }
+
+        // the leaf's instances four at a time, one plane after another
+        const unsigned int first = node.offset;
+        const __m128 px = _mm_loadu_ps(&primCentreX[first]);
+        const __m128 py = _mm_loadu_ps(&primCentreY[first]);
+        const __m128 pz = _mm_loadu_ps(&primCentreZ[first]);
+        const __m128 qx = _mm_loadu_ps(&primExtentX[first]);
+        const __m128 qy = _mm_loadu_ps(&primExtentY[first]);
+        const __m128 qz = _mm_loadu_ps(&primExtentZ[first]);
+        __m128 culled = _mm_setzero_ps();
+        for (int p = 0; p < planeCount_; ++p)
+        {
+            const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planeData[0][p]), px), _mm_mul_ps(_mm_set1_ps(planeData[1][p]), py)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planeData[2][p]), pz), _mm_set1_ps(planeData[3][p])));
+            const __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planeData[4][p]), qx), _mm_mul_ps(_mm_set1_ps(planeData[5][p]), qy)),
+                _mm_mul_ps(_mm_set1_ps(planeData[6][p]), qz));
+            culled = _mm_or_ps(culled, _mm_cmplt_ps(d, _mm_sub_ps(_mm_setzero_ps(), r)));
+        }
+        const int visible = ~_mm_movemask_ps(culled) & ((1 << node.count) - 1);
+        for (unsigned int i = 0; i < node.count; ++i)
+        {
+            if (visible & (1 << i))
+            {
+                out_.push_back(order[first + i]);
+            }
+        }
+    }
+}
+
+void InstanceBvh::querySphere(const glm::vec3& centre_, float radius_, std::vector<unsigned int>& out_) const
+{
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    const __m128 centre = _mm_setr_ps(centre_.x, centre_.y, centre_.z, 0.f);
+    const float radiusSquared = radius_ * radius_;
+    const __m128 sx = _mm_set1_ps(centre_.x);
+    const __m128 sy = _mm_set1_ps(centre_.y);
+    const __m128 sz = _mm_set1_ps(centre_.z);
+    const __m128 r2 = _mm_set1_ps(radiusSquared);
+    const __m128 zero = _mm_setzero_ps();
+
+    unsigned int stack[kStackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const unsigned int index = stack[--top];
+        const Node& node = nodes[index];
+
+        // squared distance from the centre to the box, x y and z side by side
+        const __m128 min = _mm_setr_ps(node.min[0], node.min[1], node.min[2], 0.f);
+        const __m128 max = _mm_setr_ps(node.max[0], node.max[1], node.max[2], 0.f);
+        const __m128 d = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min, centre), _mm_sub_ps(centre, max)), zero);
+        if (HorizontalSum3(_mm_mul_ps(d, d)) > radiusSquared)
+        {
+            continue;
+        }
+
+        if (node.count == 0)
+        {
+            assert(top + 2 <= kStackSize);
+            stack[top++] = node.offset;
+            stack[top++] = index + 1;
+            continue;
+        }
+
+        const unsigned int first = node.offset;
+        const __m128 dx = _mm_max_ps(_mm_sub_ps(Abs(_mm_sub_ps(_mm_loadu_ps(&primCentreX[first]), sx)), _mm_loadu_ps(&primExtentX[first])), zero);
+        const __m128 dy = _mm_max_ps(_mm_sub_ps(Abs(_mm_sub_ps(_mm_loadu_ps(&primCentreY[first]), sy)), _mm_loadu_ps(&primExtentY[first])), zero);
+        const __m128 dz = _mm_max_ps(_mm_sub_ps(Abs(_mm_sub_ps(_mm_loadu_ps(&primCentreZ[first]), sz)), _mm_loadu_ps(&primExtentZ[first])), zero);
+        const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        const int hit = _mm_movemask_ps(_mm_cmple_ps(distance, r2)) & ((1 << node.count) - 1);
+        for (unsigned int i = 0; i < node.count; ++i)
+        {
+            if (hit & (1 << i))
+            {
+                out_.push_back(order[first + i]);
+            }
+        }
+    }
+}
+
+void InstanceBvh::queryRay(const glm::vec3& origin_, const glm::vec3& direction_, float maxDistance_, std::vector<RayHit>& out_) const
+{
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    // an axis the ray is parallel to would give 0 * inf, nudge it so the slab test still works
+    glm::vec3 inverse;
+    for (int a = 0; a < 3; ++a)
+    {
+        const float d = std::abs(direction_[a]) > 1e-12f ? direction_[a] : (direction_[a] < 0.f ? -1e-12f : 1e-12f);
+        inverse[a] = 1.f / d;
+    }
+
+    const __m128 origin = _mm_setr_ps(origin_.x, origin_.y, origin_.z, 0.f);
+    const __m128 inv = _mm_setr_ps(inverse.x, inverse.y, inverse.z, 0.f);
+    const __m128 ox = _mm_set1_ps(origin_.x), oy = _mm_set1_ps(origin_.y), oz = _mm_set1_ps(origin_.z);
+    const __m128 ix = _mm_set1_ps(inverse.x), iy = _mm_set1_ps(inverse.y), iz = _mm_set1_ps(inverse.z);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 farthest = _mm_set1_ps(maxDistance_);
+    const unsigned int firstHit = out_.size();
+
+    unsigned int stack[kStackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const unsigned int index = stack[--top];
+        const Node& node = nodes[index];
+
+        // slabs for all three axes at once
+        const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(node.min[0], node.min[1], node.min[2], 0.f), origin), inv);
+        const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(node.max[0], node.max[1], node.max[2], 0.f), origin), inv);
+        const float entry = std::max(HorizontalMax3(_mm_min_ps(t0, t1)), 0.f);
+        const float exit = std::min(HorizontalMin3(_mm_max_ps(t0, t1)), maxDistance_);
+        if (entry > exit)
+        {
+            continue;
+        }
+
+        if (node.count == 0)
+        {
+            assert(top + 2 <= kStackSize);
+            stack[top++] = node.offset;
+            stack[top++] = index + 1;
+            continue;
+        }
+
+        const unsigned int first = node.offset;
+        const __m128 cx = _mm_loadu_ps(&primCentreX[first]), ex = _mm_loadu_ps(&primExtentX[first]);
+        const __m128 cy = _mm_loadu_ps(&primCentreY[first]), ey = _mm_loadu_ps(&primExtentY[first]);
+        const __m128 cz = _mm_loadu_ps(&primCentreZ[first]), ez = _mm_loadu_ps(&primExtentZ[first]);
+        const __m128 ax = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(cx, ex), ox), ix), bx = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(cx, ex), ox), ix);
+        const __m128 ay = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(cy, ey), oy), iy), by = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(cy, ey), oy), iy);
+        const __m128 az = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(cz, ez), oz), iz), bz = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(cz, ez), oz), iz);
+        const __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(ax, bx), _mm_min_ps(ay, by)), _mm_max_ps(_mm_min_ps(az, bz), zero));
+        const __m128 leave = _mm_min_ps(_mm_min_ps(_mm_max_ps(ax, bx), _mm_max_ps(ay, by)), _mm_min_ps(_mm_max_ps(az, bz), farthest));
+        const int hit = _mm_movemask_ps(_mm_cmple_ps(enter, leave)) & ((1 << node.count) - 1);
+
+        float distances[4];
+        _mm_storeu_ps(distances, enter);
+        for (unsigned int i = 0; i < node.count; ++i)
+        {
+            if (hit & (1 << i))
+            {
+                RayHit rayHit;
+                rayHit.instance = order[first + i];
+                rayHit.distance = distances[i];
+                out_.push_back(rayHit);
+            }
+        }
+    }
+
+    std::sort(out_.begin() + firstHit, out_.end(), [](const RayHit& a, const RayHit& b)
+    {
+        return a.distance < b.distance;
+    });
+}
+
+unsigned int InstanceBvh::getInstanceCount() const
+{
+    return order.size();
+}
+
+const std::vector<InstanceBvh::Node>& InstanceBvh::getNodes() const
+{
+    return nodes;
+}
+
+const InstanceBvh::BuildStats& InstanceBvh::getBuildStats() const
+{
+    return stats;
+}
+
+void InstanceBvh::extractFrustumPlanes(const glm::mat4& projectionView_, glm::vec4 planes_[6])
+{
+    // gribb/hartmann, same as the light culling
+    for (int p = 0; p < 6; ++p)
+    {
+        const int row = p / 2;
+        const float sign = (p & 1) ? -1.f : 1.f;
+        for (int c = 0; c < 4; ++c)
+        {
+            planes_[p][c] = projectionView_[c][3] + sign * projectionView_[c][row];
+        }
+        planes_[p] = planes_[p] / glm::length(glm::vec3(planes_[p]));
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+#ifndef INSTANCE_BVH_HPP
+#define INSTANCE_BVH_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "RenderTypes.hpp"
+
+/*
+bounding volume hierarchy over the world space boxes of every instance, for culling and picking.
+
+the tree is built top down with binned SAH. the big nodes near the root have their binning split across threads,
+and once there are enough subtrees to go round they are built on their own threads. the result is flattened depth
+first into one array of 32 byte nodes, the first child of an interior node is always the next node so only the
+second has to be stored, and every subtree is a contiguous run of nodes and of primitives.
+
+when instances move the boxes can be refit without touching the structure, and subtrees that have grown too far
+past the size they were built at can be rebuilt on their own.
+
+queries test the nodes against all the planes at once with sse, and the instances in a leaf four at a time. they
+append instance indices (whatever order the bounds were passed to build in) to the caller's vector, which is never
+cleared so several queries can be gathered into one list.
+*/
+class InstanceBvh
+{
+public:
+
+    static const int kMaxLeafSize = 4;
+    static const int kBinCount = 16;
+    static const int kMaxPlanes = 8;
+
+    struct Node
+    {
+        float min[3];
+        unsigned int offset; // first primitive for a leaf, index of the second child otherwise
+        float max[3];
+        unsigned int count; // primitives in a leaf, 0 for an interior node
+    };
+
+    struct RayHit
+    {
+        unsigned int instance;
+        float distance; // where the ray enters the instance's box
+    };
+
+    struct BuildStats
+    {
+        unsigned int nodes;
+        unsigned int leaves;
+        unsigned int depth;
+        unsigned int threads;
+        float sahCost; // relative to the root, lower is better
+        double milliseconds;
+    };
+
+    InstanceBvh();
+    ~InstanceBvh();
+
+    // threadCount_ of 0 uses every hardware thread
+    void build(const std::vector<InstanceBounds>& bounds_, unsigned int threadCount_ = 0);
+
+    // the same instances in the same order as the build, with changed_ listing the ones that moved
+    void refit(const std::vector<InstanceBounds>& bounds_, const std::vector<unsigned int>& changed_);
+    void refitAll(const std::vector<InstanceBounds>& bounds_);
+
+    // rebuilds the subtrees whose surface area has grown past growth_ times what it was when they were built,
+    // returns how many were rebuilt
+    unsigned int rebuildDegraded(float growth_);
+
+    // planes point inwards, anything on the positive side of every plane is inside, at most kMaxPlanes
+    void queryFrustum(const glm::vec4* planes_, int planeCount_, std::vector<unsigned int>& out_) const;
+    void querySphere(const glm::vec3& centre_, float radius_, std::vector<unsigned int>& out_) const;
+    // every instance whose box the ray passes through, nearest first
+    void queryRay(const glm::vec3& origin_, const glm::vec3& direction_, float maxDistance_, std::vector<RayHit>& out_) const;
+
+    unsigned int getInstanceCount() const;
+    const std::vector<Node>& getNodes() const;
+    const BuildStats& getBuildStats() const;
+
+    // planes in world space for a projection * view matrix, normalised and pointing inwards
+    static void extractFrustumPlanes(const glm::mat4& projectionView_, glm::vec4 planes_[6]);
+
+protected:
+
+    std::vector<Node> nodes;
+    std::vector<unsigned int> parents;
+    std::vector<float> buildAreas; // surface area of each node when it was built, for deciding when to rebuild
+
+    // instances in leaf order, every leaf owns a contiguous run of these
+    std::vector<unsigned int> order;
+    std::vector<unsigned int> slotOf; // where each instance ended up in order
+    std::vector<unsigned int> leafOf; // the leaf node holding each slot
+
+    // instance boxes in leaf order as centre and half size, structure of arrays and padded so a leaf can always
+    // load four lanes
+    std::vector<float> primCentreX, primCentreY, primCentreZ;
+    std::vector<float> primExtentX, primExtentY, primExtentZ;
+
+    // scratch for rebuildDegraded, kept between calls
+    std::vector<unsigned int> degradedNodes;
+
+    BuildStats stats;
+
+    void setPrimitive(unsigned int slot_, const InstanceBounds& bounds_);
+    void refitLeaf(unsigned int node_);
+    bool refitInterior(unsigned int node_);
+    void finishBuild();
+    unsigned int subtreeEnd(unsigned int node_) const;
+    void appendSubtree(unsigned int node_, std::vector<unsigned int>& out_) const;
+    void rebuildSubtree(unsigned int node_);
+};
+
+#endif //INSTANCE_BVH_HPP
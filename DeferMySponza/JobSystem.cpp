@@ -0,0 +1,321 @@
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+    const char* const kThreadNames[JobSystem::kMaxThreads] =
+    {
+        "jobs 0", "jobs 1", "jobs 2", "jobs 3", "jobs 4", "jobs 5", "jobs 6", "jobs 7"
+    };
+
+    const unsigned int kJobMask = JobSystem::kMaxJobs - 1;
+}
+
+struct JobSystem::Job
+{
+    Invoke invoke;
+    const void* function;
+    unsigned int begin, end, grain;
+    Job* parent; // the job this was split off, it isnt finished until this is
+
+    std::atomic<int> unfinished; // itself and the pieces split off it
+    std::atomic<int> dependencies; // left to finish before it is queued, and one more until it is submitted
+
+    // the jobs waiting on this one, finished is set under the mutex so nothing is added after they have been let go
+    std::mutex mutex;
+    Job* dependents[kMaxDependents];
+    int dependentCount;
+    bool finished;
+};
+
+// the owner pushes and pops at the tail, thieves take from the head
+struct JobSystem::Queue
+{
+    std::mutex mutex;
+    Job* jobs[kMaxJobs];
+    unsigned int head, tail;
+};
+
+JobSystem::JobSystem() : jobs(new Job[kMaxJobs]),
+    nextJob(0),
+    queues(new Queue[kMaxThreads + 1]),
+    queueCount(0),
+    queued(0),
+    sleeping(0),
+    quitting(false),
+    nameThread(nullptr),
+    jobsRun(0),
+    jobsStolen(0)
+{
+    for (int i = 0; i < kMaxJobs; ++i)
+    {
+        jobs[i].unfinished = 0;
+        jobs[i].finished = true;
+    }
+    for (int q = 0; q <= kMaxThreads; ++q)
+    {
+        queues[q].head = 0;
+        queues[q].tail = 0;
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    stop();
+    delete[] queues;
+    delete[] jobs;
+}
+
+void JobSystem::start(unsigned int workerCount_, NameThread nameThread_)
+{
+    if (isRunning())
+    {
+        return;
+    }
+
+    if (workerCount_ == kDefaultThreads)
+    {
+        const unsigned int hardware = std::thread::hardware_concurrency();
+        workerCount_ = hardware > 3 ? hardware - 2 : 1;
+    }
+    workerCount_ = std::min(workerCount_, static_cast<unsigned int>(kMaxThreads));
+
+    quitting = false;
+    nameThread = nameThread_;
+    queueCount = workerCount_ + 1;
+    threadIds[workerCount_] = std::this_thread::get_id();
+    for (unsigned int t = 0; t < workerCount_; ++t)
+    {
+        threads.push_back(std::thread(&JobSystem::run, this, t));
+        threadIds[t] = threads.back().get_id();
+    }
+}
+
+void JobSystem::stop()
+{
+    if (!isRunning())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        quitting = true;
+    }
+    wake.notify_all();
+    for (unsigned int t = 0; t < threads.size(); ++t)
+    {
+        threads[t].join();
+    }
+    threads.clear();
+    queueCount = 0;
+}
+
+bool JobSystem::isRunning() const
+{
+    return queueCount > 0;
+}
+
+JobSystem::Job* JobSystem::allocate(Invoke invoke_, const void* function_, unsigned int begin_, unsigned int end_, unsigned int grain_)
+{
+    Job* job = &jobs[nextJob++ & kJobMask];
+    // the ring has come back round to a job that is still going, kMaxJobs needs to be bigger
+    assert(job->unfinished == 0 && job->finished);
+
+    job->invoke = invoke_;
+    job->function = function_;
+    job->begin = begin_;
+    job->end = end_;
+    job->grain = grain_;
+    job->parent = nullptr;
+    job->unfinished = 1;
+    job->dependencies = 1;
+    job->dependentCount = 0;
+    job->finished = false;
+    return job;
+}
+
+void JobSystem::addDependency(Job* job_, Job* dependency_)
+{
+    std::lock_guard<std::mutex> lock(dependency_->mutex);
+    if (dependency_->finished)
+    {
+        return;
+    }
+    assert(dependency_->dependentCount < kMaxDependents);
+    ++job_->dependencies;
+    dependency_->dependents[dependency_->dependentCount++] = job_;
+}
+
+void JobSystem::submit(Job* job_)
+{
+    release(job_);
+}
+
+void JobSystem::wait(Job* job_)
+{
+    const unsigned int queue = currentQueue();
+    while (job_->unfinished != 0)
+    {
+        Job* next = find(queue);
+        if (next != nullptr)
+        {
+            execute(queue, next);
+        }
+        else
+        {
+            // whatever is left is running on another thread
+            std::this_thread::yield();
+        }
+    }
+}
+
+JobSystem::Stats JobSystem::getStats() const
+{
+    Stats stats;
+    stats.threads = queueCount;
+    stats.jobsRun = jobsRun;
+    stats.jobsStolen = jobsStolen;
+    return stats;
+}
+
+unsigned int JobSystem::currentQueue() const
+{
+    const std::thread::id id = std::this_thread::get_id();
+    for (unsigned int q = 0; q < queueCount; ++q)
+    {
+        if (threadIds[q] == id)
+        {
+            return q;
+        }
+    }
+    assert(!"only the thread that started the job system and its workers can use it");
+    return queueCount - 1;
+}
+
+void JobSystem::push(unsigned int queue_, Job* job_)
+{
+    Queue& queue = queues[queue_];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        assert(queue.tail - queue.head < static_cast<unsigned int>(kMaxJobs));
+        queue.jobs[queue.tail++ & kJobMask] = job_;
+    }
+
+    // a worker going to sleep counts itself before it looks at queued, so one of the two always sees the other
+    ++queued;
+    if (sleeping > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_one();
+    }
+}
+
+JobSystem::Job* JobSystem::find(unsigned int queue_)
+{
+    {
+        Queue& own = queues[queue_];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.tail != own.head)
+        {
+            --queued;
+            return own.jobs[--own.tail & kJobMask];
+        }
+    }
+
+    // starting from the next queue along, so the thieves dont all pile onto the same one
+    for (unsigned int i = 1; i < queueCount; ++i)
+    {
+        Queue& victim = queues[(queue_ + i) % queueCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tail != victim.head)
+        {
+            --queued;
+            ++jobsStolen;
+            return victim.jobs[victim.head++ & kJobMask];
+        }
+    }
+    return nullptr;
+}
+
+void JobSystem::execute(unsigned int queue_, Job* job_)
+{
+    // halves go to this thread's queue for the others to steal, this keeps the first half
+    while (job_->grain != 0 && job_->end - job_->begin > job_->grain)
+    {
+        const unsigned int middle = job_->begin + (job_->end - job_->begin) / 2;
+        Job* piece = allocate(job_->invoke, job_->function, middle, job_->end, job_->grain);
+        piece->parent = job_;
+        piece->dependencies = 0;
+        ++job_->unfinished;
+        job_->end = middle;
+        push(queue_, piece);
+    }
+
+    job_->invoke(job_->function, job_->begin, job_->end);
+    ++jobsRun;
+    finish(job_);
+}
+
+void JobSystem::finish(Job* job_)
+{
+    if (--job_->unfinished != 0)
+    {
+        return;
+    }
+
+    Job* dependents[kMaxDependents];
+    int dependentCount;
+    {
+        std::lock_guard<std::mutex> lock(job_->mutex);
+        job_->finished = true;
+        dependentCount = job_->dependentCount;
+        std::copy(job_->dependents, job_->dependents + dependentCount, dependents);
+    }
+    for (int i = 0; i < dependentCount; ++i)
+    {
+        release(dependents[i]);
+    }
+
+    if (job_->parent != nullptr)
+    {
+        finish(job_->parent);
+    }
+}
+
+void JobSystem::release(Job* job_)
+{
+    if (--job_->dependencies == 0)
+    {
+        push(currentQueue(), job_);
+    }
+}
+
+void JobSystem::run(unsigned int queue_)
+{
+    if (nameThread != nullptr)
+    {
+        nameThread(kThreadNames[queue_]);
+    }
+
+    for (;;)
+    {
+        Job* job = find(queue_);
+        if (job != nullptr)
+        {
+            execute(queue_, job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        ++sleeping;
+        wake.wait(lock, [this]() { return quitting || queued > 0; });
+        --sleeping;
+        if (quitting && queued == 0)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,142 @@
+#pragma once
+#ifndef JOB_SYSTEM_HPP
+#define JOB_SYSTEM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+a work stealing job system for the loops that are worth spreading over the cores.
+
+every worker has a queue of its own and so does the thread that called start, which helps run jobs while it waits
+rather than sitting idle. a thread runs the newest job in its own queue first while it is still warm in the cache, and
+when that is empty steals the oldest job from another queue, which is the biggest piece left. a range job halves
+itself each time it is picked up until the pieces are down to the grain, the halves going on the queue of whoever
+split them, so the work spreads out through the stealing rather than being divided up front.
+
+a job can depend on others and isnt queued until they have finished. waiting on a job includes the pieces split off
+it. the jobs come from a fixed ring and the queues are fixed size so nothing is allocated once it has started, which
+means a job has to have finished before the ring comes back round to it. kMaxJobs is far more than a frame uses.
+*/
+class JobSystem
+{
+public:
+
+    static const int kMaxThreads = 8; // workers, the thread that calls start is one more
+    static const int kMaxJobs = 4096;
+    static const int kMaxDependents = 8;
+    static const unsigned int kDefaultThreads = ~0u;
+
+    struct Job;
+
+    // called at the top of each worker with its name, for the trace. the job system itself doesnt depend on it so the
+    // benchmarks can use it without gl
+    typedef void (*NameThread)(const char* name_);
+
+    struct Stats
+    {
+        unsigned int threads; // workers and the thread that started it
+        unsigned long long jobsRun; // pieces of ranges included
+        unsigned long long jobsStolen;
+    };
+
+    JobSystem();
+    ~JobSystem();
+
+    // kDefaultThreads leaves a couple of the hardware's threads for the render and simulation threads, 0 workers
+    // runs everything on the calling thread as it waits
+    void start(unsigned int workerCount_ = kDefaultThreads, NameThread nameThread_ = nullptr);
+    void stop();
+    bool isRunning() const;
+
+    // function_(begin, end) is called for pieces of the range no bigger than grain_, or for all of it with a grain of
+    // 0. it is held by reference so it has to outlive the job. the job runs once it has been submitted and everything
+    // added as a dependency has finished
+    template<typename Function>
+    Job* create(const Function& function_, unsigned int begin_ = 0, unsigned int end_ = 1, unsigned int grain_ = 0);
+    void addDependency(Job* job_, Job* dependency_);
+    void submit(Job* job_);
+
+    // runs jobs from this thread's queue, or steals them, until the job is done. only from the thread that called
+    // start or from inside a job
+    void wait(Job* job_);
+
+    // splits the range over the threads and returns once all of it has run, small ranges are run straight away
+    template<typename Function>
+    void parallelFor(unsigned int begin_, unsigned int end_, unsigned int grain_, const Function& function_);
+
+    Stats getStats() const;
+
+protected:
+
+    typedef void (*Invoke)(const void* function_, unsigned int begin_, unsigned int end_);
+
+    struct Queue;
+
+    Job* jobs;
+    std::atomic<unsigned int> nextJob;
+
+    // one a worker and the calling thread's last, the thread ids say whose is whose
+    Queue* queues;
+    std::thread::id threadIds[kMaxThreads + 1];
+    unsigned int queueCount;
+
+    std::vector<std::thread> threads;
+    std::atomic<int> queued;
+    std::atomic<int> sleeping;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool quitting;
+    NameThread nameThread;
+
+    std::atomic<unsigned long long> jobsRun, jobsStolen;
+
+    Job* allocate(Invoke invoke_, const void* function_, unsigned int begin_, unsigned int end_, unsigned int grain_);
+    unsigned int currentQueue() const;
+    void push(unsigned int queue_, Job* job_);
+    Job* find(unsigned int queue_);
+    void execute(unsigned int queue_, Job* job_);
+    void finish(Job* job_);
+    void release(Job* job_);
+    void run(unsigned int queue_);
+
+    template<typename Function>
+    static void InvokeFunction(const void* function_, unsigned int begin_, unsigned int end_)
+    {
+        (*static_cast<const Function*>(function_))(begin_, end_);
+    }
+
+private:
+
+    JobSystem(const JobSystem&);
+    JobSystem& operator=(const JobSystem&);
+};
+
+template<typename Function>
+JobSystem::Job* JobSystem::create(const Function& function_, unsigned int begin_, unsigned int end_, unsigned int grain_)
+{
+    return allocate(&InvokeFunction<Function>, &function_, begin_, end_, grain_);
+}
+
+template<typename Function>
+void JobSystem::parallelFor(unsigned int begin_, unsigned int end_, unsigned int grain_, const Function& function_)
+{
+    if (begin_ >= end_)
+    {
+        return;
+    }
+    if (!isRunning() || end_ - begin_ <= grain_)
+    {
+        function_(begin_, end_);
+        return;
+    }
+
+    Job* job = create(function_, begin_, end_, grain_);
+    submit(job);
+    wait(job);
+}
+
+#endif //JOB_SYSTEM_HPP
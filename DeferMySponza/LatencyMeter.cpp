@@ -0,0 +1,128 @@
+#include "LatencyMeter.hpp"
+
+#include <algorithm>
+
+LatencyMeter::LatencyMeter() : frame(0),
+    clockOffset(0),
+    running(false)
+{
+    for (int i = 0; i < kFrameLatency; ++i)
+    {
+        pending[i].query = 0;
+        pending[i].inputTime = 0;
+        pending[i].issued = false;
+    }
+}
+
+LatencyMeter::~LatencyMeter()
+{
+}
+
+void LatencyMeter::createQueries()
+{
+    for (int i = 0; i < kFrameLatency; ++i)
+    {
+        glGenQueries(1, &pending[i].query);
+        pending[i].issued = false;
+    }
+}
+
+void LatencyMeter::deleteQueries()
+{
+    for (int i = 0; i < kFrameLatency; ++i)
+    {
+        glDeleteQueries(1, &pending[i].query);
+        pending[i].query = 0;
+        pending[i].issued = false;
+    }
+    running = false;
+}
+
+void LatencyMeter::start(long long clockOffset_)
+{
+    clockOffset = clockOffset_;
+    samples.clear();
+    for (int i = 0; i < kFrameLatency; ++i)
+    {
+        pending[i].issued = false;
+    }
+    running = true;
+}
+
+void LatencyMeter::stop()
+{
+    // waits for whatever is still in flight, only ever when the measuring stops
+    for (int i = 0; i < kFrameLatency; ++i)
+    {
+        if (pending[i].issued)
+        {
+            read(pending[i]);
+        }
+    }
+    running = false;
+}
+
+bool LatencyMeter::isRunning() const
+{
+    return running;
+}
+
+void LatencyMeter::endFrame(long long inputTime_)
+{
+    if (!running)
+    {
+        return;
+    }
+
+    Pending& slot = pending[frame % kFrameLatency];
+    ++frame;
+    if (slot.issued)
+    {
+        read(slot);
+    }
+    if (inputTime_ != 0)
+    {
+        glQueryCounter(slot.query, GL_TIMESTAMP);
+        slot.inputTime = inputTime_;
+        slot.issued = true;
+    }
+}
+
+void LatencyMeter::read(Pending& pending_)
+{
+    GLuint64 gpuTime = 0;
+    glGetQueryObjectui64v(pending_.query, GL_QUERY_RESULT, &gpuTime);
+    pending_.issued = false;
+
+    const long long presentTime = static_cast<long long>(gpuTime) + clockOffset;
+    if (samples.size() < kMaxSamples)
+    {
+        samples.push_back((presentTime - pending_.inputTime) / 1000000.0);
+    }
+}
+
+LatencyMeter::Summary LatencyMeter::summarise() const
+{
+    Summary summary;
+    summary.samples = samples.size();
+    summary.meanMilliseconds = 0.0;
+    summary.medianMilliseconds = 0.0;
+    summary.p95Milliseconds = 0.0;
+    summary.maxMilliseconds = 0.0;
+    if (samples.empty())
+    {
+        return summary;
+    }
+
+    std::vector<double> sorted(samples);
+    std::sort(sorted.begin(), sorted.end());
+    for (unsigned int i = 0; i < sorted.size(); ++i)
+    {
+        summary.meanMilliseconds += sorted[i];
+    }
+    summary.meanMilliseconds /= sorted.size();
+    summary.medianMilliseconds = sorted[sorted.size() / 2];
+    summary.p95Milliseconds = sorted[std::min(sorted.size() - 1, sorted.size() * 95 / 100)];
+    summary.maxMilliseconds = sorted.back();
+    return summary;
+}
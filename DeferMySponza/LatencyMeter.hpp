@@ -0,0 +1,72 @@
+#pragma once
+#ifndef LATENCY_METER_HPP
+#define LATENCY_METER_HPP
+
+#include <tgl/tgl.h>
+#include <vector>
+
+/*
+measures how long input takes to reach the screen.
+
+a frame that shows the first tick to have applied some input gets a timestamp query after its last command, and once
+that comes back the time from the input event to it is one sample. the gpu getting to the end of the frame stands in
+for the present, the swap itself happens outside the view. the queries are read kFrameLatency frames later so the
+cpu never waits on them, and the gl clock is put on the cpu's with an offset measured when the measuring starts.
+*/
+class LatencyMeter
+{
+public:
+
+    static const int kFrameLatency = 4;
+    static const unsigned int kMaxSamples = 4096;
+
+    struct Summary
+    {
+        unsigned int samples;
+        double meanMilliseconds;
+        double medianMilliseconds;
+        double p95Milliseconds;
+        double maxMilliseconds;
+    };
+
+    LatencyMeter();
+    ~LatencyMeter();
+
+    void createQueries();
+    void deleteQueries();
+
+    // clockOffset_ is what GpuTimer::measureClockOffset gives, starting throws away any earlier samples
+    void start(long long clockOffset_);
+    void stop();
+    bool isRunning() const;
+
+    // after the frame's last command. inputTime_ is the CpuTimeNanoseconds of the input it is the first to show,
+    // 0 if it shows none
+    void endFrame(long long inputTime_);
+
+    Summary summarise() const;
+
+protected:
+
+    struct Pending
+    {
+        GLuint query;
+        long long inputTime;
+        bool issued;
+    };
+
+    Pending pending[kFrameLatency];
+    unsigned int frame;
+    long long clockOffset;
+    bool running;
+    std::vector<double> samples; // milliseconds
+
+    void read(Pending& pending_);
+
+private:
+
+    LatencyMeter(const LatencyMeter&);
+    LatencyMeter& operator=(const LatencyMeter&);
+};
+
+#endif //LATENCY_METER_HPP
@@ -0,0 +1,267 @@
+#include "LightCulling.hpp"
+#include "JobSystem.hpp"
+
+#include <emmintrin.h>
+#include <algorithm>
+#include <cmath>
+
+static const float kPi = 3.14159265f;
+
+// screen radius in pixels below which a light's proxy drops to the next cheapest
+static const float kQuadRadius = 16.f;
+static const float kLowSphereRadius = 64.f;
+static const float kMediumSphereRadius = 256.f;
+
+// how much bigger than the light the camera has to stay (past the near plane) before it is drawn as a proxy rather
+// than full screen, covers the sphere proxies being pushed out to contain the light
+static const float kFullscreenMargin = 1.1f;
+
+// what proxies holds for a light that was culled for being too small, ones outside the frustum are left at kProxyCount
+static const unsigned char kCulledBySize = LightCulling::kProxyCount + 1;
+
+// blocks of four lights a job takes at a time when there is a job system to spread them over
+static const unsigned int kBlocksPerJob = 256;
+
+LightCulling::LightCulling() : minScreenRadius(1.f)
+{
+    stats.totalLights = 0;
+    stats.visibleLights = 0;
+    stats.culledByFrustum = 0;
+    stats.culledBySize = 0;
+
+    for (int p = 0; p < kProxyCount; ++p)
+    {
+        proxyBatches[p].first = 0;
+        proxyBatches[p].count = 0;
+    }
+}
+
+LightCulling::~LightCulling()
+{
+
+}
+
+void LightCulling::setMinScreenRadius(float pixels_)
+{
+    minScreenRadius = pixels_;
+}
+
+float LightCulling::getMinScreenRadius() const
+{
+    return minScreenRadius;
+}
+
+void LightCulling::cullLights(const std::vector<LightData>& lights_,
+    const glm::mat4& projectionView_,
+    const glm::mat4& projection_,
+    const glm::vec3& camPos_,
+    float viewportHeight_,
+    JobSystem* jobs_)
+{
+    const unsigned int count = lights_.size();
+    const unsigned int paddedCount = (count + 3) & ~3u;
+
+    lightX.resize(paddedCount);
+    lightY.resize(paddedCount);
+    lightZ.resize(paddedCount);
+    lightRadius.resize(paddedCount);
+    coverage.assign(count, 0.f);
+    proxies.assign(count, kProxyCount);
+
+    // frustum planes straight out of the matrix (gribb/hartmann), normalised so the distances are in world units
+    glm::vec4 planes[6];
+    for (int p = 0; p < 6; ++p)
+    {
+        const int row = p / 2;
+        const float sign = (p & 1) ? -1.f : 1.f;
+        for (int c = 0; c < 4; ++c)
+        {
+            planes[p][c] = projectionView_[c][3] + sign * projectionView_[c][row];
+        }
+        float length = glm::length(glm::vec3(planes[p]));
+        planes[p] = planes[p] / length;
+    }
+
+    // pixels per world unit at a distance of 1, the vertical scale of the projection times half the viewport
+    const float pixelScale = projection_[1][1] * 0.5f * viewportHeight_;
+    const float screenArea = viewportHeight_ * viewportHeight_ * (projection_[1][1] / projection_[0][0]);
+    // the near plane distance of a gl perspective projection
+    const float nearPlane = projection_[3][2] / (projection_[2][2] - 1.f);
+    const float minRadius = minScreenRadius;
+
+    // blocks of four lights, each only writes to its own lights' entries
+    auto cullBlocks = [&](unsigned int firstBlock_, unsigned int endBlock_)
+    {
+        for (unsigned int i = firstBlock_ * 4; i < endBlock_ * 4 && i < count; ++i)
+        {
+            lightX[i] = lights_[i].position.x;
+            lightY[i] = lights_[i].position.y;
+            lightZ[i] = lights_[i].position.z;
+            lightRadius[i] = lights_[i].range;
+        }
+        // the padding is a sphere that fails every plane so it never counts as visible
+        for (unsigned int i = std::max(count, firstBlock_ * 4); i < endBlock_ * 4; ++i)
+        {
+            lightX[i] = camPos_.x;
+            lightY[i] = camPos_.y;
+            lightZ[i] = camPos_.z;
+            lightRadius[i] = -1e30f;
+        }
+
+        const __m128 camX = _mm_set1_ps(camPos_.x);
+        const __m128 camY = _mm_set1_ps(camPos_.y);
+        const __m128 camZ = _mm_set1_ps(camPos_.z);
+        const __m128 scale = _mm_set1_ps(pixelScale);
+        const __m128 minDistance = _mm_set1_ps(1e-3f);
+
+        for (unsigned int i = firstBlock_ * 4; i < endBlock_ * 4; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(&lightX[i]);
+            const __m128 y = _mm_loadu_ps(&lightY[i]);
+            const __m128 z = _mm_loadu_ps(&lightZ[i]);
+            const __m128 r = _mm_loadu_ps(&lightRadius[i]);
+            const __m128 negR = _mm_sub_ps(_mm_setzero_ps(), r);
+
+            // inside unless the sphere is wholly on the wrong side of any plane
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                __m128 d = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes[p].x)), _mm_mul_ps(y, _mm_set1_ps(planes[p].y))),
+                    _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(planes[p].z)), _mm_set1_ps(planes[p].w)));
+                inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, negR));
+            }
+
+            // projected radius in pixels, r / distance scaled by the projection
+            __m128 dx = _mm_sub_ps(x, camX);
+            __m128 dy = _mm_sub_ps(y, camY);
+            __m128 dz = _mm_sub_ps(z, camZ);
+            __m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            __m128 dist = _mm_max_ps(_mm_sqrt_ps(distSq), minDistance);
+            __m128 screenRadius = _mm_div_ps(_mm_mul_ps(r, scale), dist);
+            __m128 cameraInside = _mm_cmplt_ps(distSq, _mm_mul_ps(r, r));
+
+            const int insideMask = _mm_movemask_ps(inside);
+            const int cameraInsideMask = _mm_movemask_ps(cameraInside);
+            float radii[4];
+            _mm_storeu_ps(radii, screenRadius);
+
+            for (unsigned int k = 0; k < 4 && i + k < count; ++k)
+            {
+                if (!(insideMask & (1 << k)))
+                {
+                    continue;
+                }
+
+                const bool containsCamera = (cameraInsideMask & (1 << k)) != 0;
+                if (!containsCamera && radii[k] < minRadius)
+                {
+                    proxies[i + k] = kCulledBySize;
+                    continue;
+                }
+
+                coverage[i + k] = containsCamera ? screenArea : std::min(kPi * radii[k] * radii[k], screenArea);
+
+                const float fullscreenDistance = lightRadius[i + k] * kFullscreenMargin + nearPlane;
+                const float lightDistanceSq = (lightX[i + k] - camPos_.x) * (lightX[i + k] - camPos_.x)
+                    + (lightY[i + k] - camPos_.y) * (lightY[i + k] - camPos_.y)
+                    + (lightZ[i + k] - camPos_.z) * (lightZ[i + k] - camPos_.z);
+                if (containsCamera || lightDistanceSq < fullscreenDistance * fullscreenDistance)
+                {
+                    proxies[i + k] = kProxyFullscreen;
+                }
+                else if (radii[k] < kQuadRadius)
+                {
+                    proxies[i + k] = kProxyQuad;
+                }
+                else if (radii[k] < kLowSphereRadius)
+                {
+                    proxies[i + k] = kProxySphereLow;
+                }
+                else if (radii[k] < kMediumSphereRadius)
+                {
+                    proxies[i + k] = kProxySphereMedium;
+                }
+                else
+                {
+                    proxies[i + k] = kProxySphereHigh;
+                }
+            }
+        }
+    };
+
+    if (jobs_ != nullptr)
+    {
+        jobs_->parallelFor(0, paddedCount / 4, kBlocksPerJob, cullBlocks);
+    }
+    else
+    {
+        cullBlocks(0, paddedCount / 4);
+    }
+
+    // in light order whoever tested them, so the sort below always sees the same input
+    visibleLights.clear();
+    stats.totalLights = count;
+    stats.culledByFrustum = 0;
+    stats.culledBySize = 0;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        if (proxies[i] < kProxyCount)
+        {
+            visibleLights.push_back(i);
+        }
+        else if (proxies[i] == kCulledBySize)
+        {
+            ++stats.culledBySize;
+        }
+        else
+        {
+            ++stats.culledByFrustum;
+        }
+    }
+
+    const std::vector<float>& lightCoverage = coverage;
+    const std::vector<unsigned char>& lightProxies = proxies;
+    std::sort(visibleLights.begin(), visibleLights.end(), [&lightCoverage, &lightProxies](unsigned int a, unsigned int b)
+    {
+        if (lightProxies[a] != lightProxies[b])
+        {
+            return lightProxies[a] < lightProxies[b];
+        }
+        return lightCoverage[a] > lightCoverage[b];
+    });
+
+    for (int p = 0; p < kProxyCount; ++p)
+    {
+        proxyBatches[p].first = 0;
+        proxyBatches[p].count = 0;
+    }
+    for (unsigned int v = visibleLights.size(); v-- > 0;)
+    {
+        ProxyBatch& batch = proxyBatches[proxies[visibleLights[v]]];
+        batch.first = v;
+        ++batch.count;
+    }
+
+    stats.visibleLights = visibleLights.size();
+}
+
+const std::vector<unsigned int>& LightCulling::getVisibleLights() const
+{
+    return visibleLights;
+}
+
+const LightCulling::ProxyBatch& LightCulling::getProxyBatch(int proxy_) const
+{
+    return proxyBatches[proxy_];
+}
+
+const std::vector<float>& LightCulling::getCoverage() const
+{
+    return coverage;
+}
+
+const LightCulling::FrameStats& LightCulling::getFrameStats() const
+{
+    return stats;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#ifndef LIGHT_CULLING_HPP
+#define LIGHT_CULLING_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "RenderTypes.hpp"
+
+class JobSystem;
+
+/*
+cpu culling for the point lights before they are uploaded.
+
+the light spheres are tested against the view frustum four at a time with sse, anything left that covers less than
+the minimum screen radius is dropped, and the survivors are sorted biggest first so the lights that matter most are at
+the front of the instance buffer (and the front of the queue for anything else with a budget, like shadow slots).
+
+each survivor also gets the proxy it should be drawn with, by its size on screen. the camera being inside a light
+gets it drawn full screen, a few pixels across gets a quad, and the rest get a sphere with more triangles the bigger
+it is. the visible lights are grouped by proxy (biggest first within a group) so each proxy is one instanced draw.
+
+given a job system the lights are tested in blocks spread over its threads, each light's result goes in its own
+place so the visible list comes out the same whichever thread tested what.
+*/
+class LightCulling
+{
+public:
+
+    // in the order the visible lights are grouped, which is near enough biggest first
+    enum Proxy
+    {
+        kProxyFullscreen,
+        kProxySphereHigh,
+        kProxySphereMedium,
+        kProxySphereLow,
+        kProxyQuad,
+        kProxyCount
+    };
+
+    // a run of the visible lights that all use the same proxy
+    struct ProxyBatch
+    {
+        unsigned int first;
+        unsigned int count;
+    };
+
+    struct FrameStats
+    {
+        int totalLights;
+        int visibleLights;
+        int culledByFrustum;
+        int culledBySize;
+    };
+
+    LightCulling();
+    ~LightCulling();
+
+    // lights smaller than this many pixels across (radius) are not worth drawing
+    void setMinScreenRadius(float pixels_);
+    float getMinScreenRadius() const;
+
+    void cullLights(const std::vector<LightData>& lights_,
+        const glm::mat4& projectionView_,
+        const glm::mat4& projection_,
+        const glm::vec3& camPos_,
+        float viewportHeight_,
+        JobSystem* jobs_ = nullptr);
+
+    // indices into the lights passed to cullLights, grouped by proxy and biggest on screen first within each
+    const std::vector<unsigned int>& getVisibleLights() const;
+    const ProxyBatch& getProxyBatch(int proxy_) const;
+
+    // approximate screen coverage in pixels for every light passed in, 0 for the ones that were culled
+    const std::vector<float>& getCoverage() const;
+
+    const FrameStats& getFrameStats() const;
+
+protected:
+
+    float minScreenRadius;
+
+    // structure of arrays copy of the light spheres, padded to a multiple of 4
+    std::vector<float> lightX, lightY, lightZ, lightRadius;
+
+    std::vector<unsigned int> visibleLights;
+    std::vector<float> coverage;
+    std::vector<unsigned char> proxies;
+    ProxyBatch proxyBatches[kProxyCount];
+
+    FrameStats stats;
+};
+
+#endif //LIGHT_CULLING_HPP
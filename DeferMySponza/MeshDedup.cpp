@@ -0,0 +1,197 @@
+#include "MeshDedup.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// how far a transformed vertex can land from its match, against the size of the mesh
+static const float kPositionTolerance = 1e-4f;
+// the cosine between a transformed normal and its match
+static const float kNormalTolerance = 0.999f;
+// below this, against the cube of the longest span from the first vertex, four vertices are taken to lie on a plane
+static const float kFlatVolume = 1e-6f;
+
+static unsigned long long HashBytes(const void* bytes_, size_t count_, unsigned long long hash_)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(bytes_);
+    for (size_t i = 0; i < count_; ++i)
+    {
+        hash_ = (hash_ ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash_;
+}
+
+static const unsigned long long kHashSeed = 14695981039346656037ull;
+
+unsigned int WeldVertices(std::vector<Vertex>& vertices_, std::vector<unsigned int>& elements_)
+{
+    const unsigned int vertexCount = vertices_.size();
+    if (vertexCount == 0)
+    {
+        return 0;
+    }
+
+    unsigned int tableSize = 1;
+    while (tableSize < vertexCount * 2)
+    {
+        tableSize <<= 1;
+    }
+    std::vector<unsigned int> table(tableSize, ~0u);
+    std::vector<unsigned int> remap(vertexCount);
+
+    unsigned int kept = 0;
+    for (unsigned int v = 0; v < vertexCount; ++v)
+    {
+        unsigned int slot = static_cast<unsigned int>(HashBytes(&vertices_[v], sizeof(Vertex), kHashSeed)) & (tableSize - 1);
+        while (table[slot] != ~0u && std::memcmp(&vertices_[table[slot]], &vertices_[v], sizeof(Vertex)) != 0)
+        {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if (table[slot] == ~0u)
+        {
+            // the kept vertices are moved down in place, nothing below kept is looked at again through the table
+            vertices_[kept] = vertices_[v];
+            table[slot] = kept;
+            ++kept;
+        }
+        remap[v] = table[slot];
+    }
+
+    for (size_t e = 0; e < elements_.size(); ++e)
+    {
+        elements_[e] = remap[elements_[e]];
+    }
+    vertices_.resize(kept);
+    return vertexCount - kept;
+}
+
+unsigned long long TopologyHash(const std::vector<Vertex>& vertices_, const std::vector<unsigned int>& elements_)
+{
+    const unsigned int vertexCount = vertices_.size();
+    unsigned long long hash = HashBytes(&vertexCount, sizeof(vertexCount), kHashSeed);
+    if (!elements_.empty())
+    {
+        hash = HashBytes(elements_.data(), elements_.size() * sizeof(unsigned int), hash);
+    }
+    return hash;
+}
+
+// the vertex of the mesh furthest from the point, the line or the plane through the ones chosen so far
+static unsigned int FurthestVertex(const std::vector<Vertex>& vertices_, const glm::vec3* chosen_, int chosenCount_, float& distance_)
+{
+    unsigned int furthest = 0;
+    distance_ = -1.f;
+    for (unsigned int v = 0; v < vertices_.size(); ++v)
+    {
+        const glm::vec3 d = vertices_[v].position - chosen_[0];
+        float distance;
+        if (chosenCount_ == 1)
+        {
+            distance = glm::dot(d, d);
+        }
+        else if (chosenCount_ == 2)
+        {
+            const glm::vec3 c = glm::cross(chosen_[1] - chosen_[0], d);
+            distance = glm::dot(c, c);
+        }
+        else
+        {
+            distance = std::abs(glm::dot(glm::cross(chosen_[1] - chosen_[0], chosen_[2] - chosen_[0]), d));
+        }
+        if (distance > distance_)
+        {
+            distance_ = distance;
+            furthest = v;
+        }
+    }
+    return furthest;
+}
+
+// off the plane of the three by the square root of their parallelogram, so it moves like a length would
+static glm::vec3 OffPlane(const glm::vec3& a_, const glm::vec3& b_, const glm::vec3& c_)
+{
+    const glm::vec3 normal = glm::cross(b_ - a_, c_ - a_);
+    return a_ + normal / std::sqrt(glm::length(normal));
+}
+
+bool MatchMeshGeometry(const std::vector<Vertex>& a_, const std::vector<Vertex>& b_, glm::mat4& transform_)
+{
+    if (a_.size() != b_.size() || a_.empty())
+    {
+        return false;
+    }
+    if (std::memcmp(a_.data(), b_.data(), a_.size() * sizeof(Vertex)) == 0)
+    {
+        transform_ = glm::mat4(1.f);
+        return true;
+    }
+
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (size_t v = 0; v < b_.size(); ++v)
+    {
+        boundsMin = glm::min(boundsMin, b_[v].position);
+        boundsMax = glm::max(boundsMax, b_[v].position);
+    }
+    const float size = std::max(glm::length(boundsMax - boundsMin), 1e-6f);
+
+    // four of a's vertices as far apart as they go, and the same four of b. a line or a point could have been
+    // turned any way about itself
+    unsigned int picks[4] = { 0, 0, 0, 0 };
+    glm::vec3 basisA[4], basisB[4];
+    basisA[0] = a_[0].position;
+    float distances[4] = { 0.f, 0.f, 0.f, 0.f };
+    for (int p = 1; p < 4; ++p)
+    {
+        picks[p] = FurthestVertex(a_, basisA, p, distances[p]);
+        basisA[p] = a_[picks[p]].position;
+    }
+    if (distances[1] <= 0.f || distances[2] <= 0.f)
+    {
+        return false;
+    }
+    for (int p = 0; p < 4; ++p)
+    {
+        basisB[p] = b_[picks[p]].position;
+    }
+    const float spanA = std::sqrt(distances[1]);
+    if (distances[3] <= kFlatVolume * spanA * spanA * spanA)
+    {
+        basisA[3] = OffPlane(basisA[0], basisA[1], basisA[2]);
+        basisB[3] = OffPlane(basisB[0], basisB[1], basisB[2]);
+    }
+
+    const glm::mat3 edgesA(basisA[1] - basisA[0], basisA[2] - basisA[0], basisA[3] - basisA[0]);
+    const glm::mat3 edgesB(basisB[1] - basisB[0], basisB[2] - basisB[0], basisB[3] - basisB[0]);
+    if (std::abs(glm::determinant(edgesA)) <= 0.f)
+    {
+        return false;
+    }
+    const glm::mat3 linear = edgesB * glm::inverse(edgesA);
+    if (std::abs(glm::determinant(linear)) <= 1e-12f)
+    {
+        // flattened, there is no matrix for its normals
+        return false;
+    }
+    const glm::vec3 translation = basisB[0] - linear * basisA[0];
+    const glm::mat3 normalMatrix = glm::transpose(glm::inverse(linear));
+
+    const float tolerance = kPositionTolerance * size;
+    for (size_t v = 0; v < a_.size(); ++v)
+    {
+        if (glm::length(linear * a_[v].position + translation - b_[v].position) > tolerance)
+        {
+            return false;
+        }
+        const glm::vec3 normal = normalMatrix * a_[v].normal;
+        const float lengths = glm::length(normal) * glm::length(b_[v].normal);
+        if (lengths > 0.f && glm::dot(normal, b_[v].normal) < kNormalTolerance * lengths)
+        {
+            return false;
+        }
+    }
+
+    transform_ = glm::mat4(linear);
+    transform_[3] = glm::vec4(translation, 1.f);
+    return true;
+}
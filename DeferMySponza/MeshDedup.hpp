@@ -0,0 +1,29 @@
+#pragma once
+#ifndef MESH_DEDUP_HPP
+#define MESH_DEDUP_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "RenderTypes.hpp"
+
+/*
+finds geometry that is stored more than once, nothing in here touches gl.
+
+welding merges the vertices of a mesh that are the same to the byte. matching compares two welded meshes with the
+same elements, vertex for vertex, either byte for byte or through the affine transform that takes four of the first
+one's vertices onto the second's. a flat mesh has no fourth vertex off its plane, so one is made from the cross
+product of the other three, which finds the transforms that dont shear it.
+*/
+
+// the elements are remapped onto the first of each run of identical vertices, returns how many were removed
+unsigned int WeldVertices(std::vector<Vertex>& vertices_, std::vector<unsigned int>& elements_);
+
+// the same for any two meshes that could match, made from the elements and the vertex count
+unsigned long long TopologyHash(const std::vector<Vertex>& vertices_, const std::vector<unsigned int>& elements_);
+
+// true when b's vertices are a's through transform_, b = transform_ * a. the elements have to be the same already,
+// which the topology hash is for. identity when they are identical
+bool MatchMeshGeometry(const std::vector<Vertex>& a_, const std::vector<Vertex>& b_, glm::mat4& transform_);
+
+#endif //MESH_DEDUP_HPP
@@ -0,0 +1,242 @@
+#include "MeshletCuller.hpp"
+#include "GpuMemory.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+// DrawElementsIndirectCommand, the layout glMultiDrawElementsIndirect reads
+struct DrawCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// the most workgroups gl promises in one dimension, more chunks than this go into rows
+static const unsigned int kMaxGroupsX = 65535;
+
+static void GrowBuffer(GLuint buffer_, unsigned int bytes_, unsigned int& capacity_, unsigned int elementBytes_)
+{
+    if (bytes_ <= capacity_ * elementBytes_)
+    {
+        return;
+    }
+    capacity_ = bytes_ / elementBytes_ + bytes_ / elementBytes_ / 2;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity_ * elementBytes_, NULL, GL_DYNAMIC_DRAW);
+    GpuMemory::bufferStorage(buffer_, capacity_ * elementBytes_);
+}
+
+MeshletCuller::MeshletCuller() : meshletBuffer(0),
+    chunkBuffer(0),
+    commandBuffer(0),
+    meshletCount(0),
+    chunkCapacity(0),
+    commandCapacity(0),
+    frame(0)
+{
+    for (int i = 0; i < kStatsLatency; ++i)
+    {
+        counterBuffers[i] = 0;
+        pendingIssued[i] = false;
+    }
+    for (int b = 0; b < kBucketCount; ++b)
+    {
+        bucketCommands[b] = 0;
+    }
+    stats.meshletsTested = 0;
+    stats.meshletsDrawn = 0;
+    stats.trianglesSubmitted = 0;
+    stats.trianglesInView = 0;
+}
+
+MeshletCuller::~MeshletCuller()
+{
+}
+
+void MeshletCuller::createBuffers()
+{
+    glGenBuffers(1, &meshletBuffer);
+    GpuMemory::track(GpuMemory::kBuffer, meshletBuffer, GpuMemory::kGeometry, "meshlets");
+    glGenBuffers(1, &chunkBuffer);
+    GpuMemory::track(GpuMemory::kBuffer, chunkBuffer, GpuMemory::kShaderStorage, "meshlet_chunks");
+    glGenBuffers(1, &commandBuffer);
+    GpuMemory::track(GpuMemory::kBuffer, commandBuffer, GpuMemory::kShaderStorage, "meshlet_commands");
+
+    glGenBuffers(kStatsLatency, counterBuffers);
+    for (int i = 0; i < kStatsLatency; ++i)
+    {
+        GpuMemory::track(GpuMemory::kBuffer, counterBuffers[i], GpuMemory::kReadback, "meshlet_counters");
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Counters), NULL, GL_DYNAMIC_READ);
+        GpuMemory::bufferStorage(counterBuffers[i], sizeof(Counters));
+        pendingIssued[i] = false;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    meshletCount = 0;
+    chunkCapacity = 0;
+    commandCapacity = 0;
+}
+
+void MeshletCuller::deleteBuffers()
+{
+    GLuint* buffers[3] = { &meshletBuffer, &chunkBuffer, &commandBuffer };
+    for (int i = 0; i < 3; ++i)
+    {
+        glDeleteBuffers(1, buffers[i]);
+        GpuMemory::release(GpuMemory::kBuffer, *buffers[i]);
+        *buffers[i] = 0;
+    }
+    for (int i = 0; i < kStatsLatency; ++i)
+    {
+        glDeleteBuffers(1, &counterBuffers[i]);
+        GpuMemory::release(GpuMemory::kBuffer, counterBuffers[i]);
+        counterBuffers[i] = 0;
+    }
+    meshletCount = 0;
+}
+
+void MeshletCuller::setMeshlets(const std::vector<Meshlet>& meshlets_)
+{
+    meshletCount = meshlets_.size();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshletBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, meshlets_.size() * sizeof(Meshlet), meshlets_.data(), GL_STATIC_DRAW);
+    GpuMemory::bufferStorage(meshletBuffer, meshlets_.size() * sizeof(Meshlet));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void MeshletCuller::beginFrame()
+{
+    chunks.clear();
+    for (int b = 0; b < kBucketCount; ++b)
+    {
+        bucketCommands[b] = 0;
+    }
+
+    // what this slot counted kStatsLatency frames ago has long since come back
+    const unsigned int slot = frame % kStatsLatency;
+    if (pendingIssued[slot])
+    {
+        Counters counters;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffers[slot]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Counters), &counters);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        stats = pending[slot];
+        for (int b = 0; b < kBucketCount; ++b)
+        {
+            stats.meshletsDrawn += counters.commandCount[b];
+            stats.trianglesInView += counters.trianglesInView[b];
+        }
+        pendingIssued[slot] = false;
+    }
+
+    FrameStats& frameStats = pending[slot];
+    frameStats.meshletsTested = 0;
+    frameStats.meshletsDrawn = 0;
+    frameStats.trianglesSubmitted = 0;
+    frameStats.trianglesInView = 0;
+}
+
+void MeshletCuller::addDraw(unsigned int bucket_, const Mesh& mesh_, unsigned int firstInstance_, unsigned int instanceCount_)
+{
+    assert(bucket_ < static_cast<unsigned int>(kBucketCount));
+    // the buckets are ranges of the command buffer one after the other, so they have to be added in order
+    assert(bucket_ == kBucketCount - 1 || bucketCommands[bucket_ + 1] == 0);
+
+    for (unsigned int i = 0; i < instanceCount_; ++i)
+    {
+        for (int m = 0; m < mesh_.meshletCount; m += kGroupSize)
+        {
+            Chunk chunk;
+            chunk.instance = firstInstance_ + i;
+            chunk.firstMeshlet = mesh_.firstMeshlet + m;
+            chunk.meshletCount = std::min(mesh_.meshletCount - m, kGroupSize) | (bucket_ << 16);
+            chunk.baseVertex = mesh_.startVerticeIndex;
+            chunks.push_back(chunk);
+        }
+    }
+
+    FrameStats& frameStats = pending[frame % kStatsLatency];
+    bucketCommands[bucket_] += instanceCount_ * mesh_.meshletCount;
+    frameStats.meshletsTested += instanceCount_ * mesh_.meshletCount;
+    frameStats.trianglesSubmitted += static_cast<unsigned long long>(instanceCount_) * (mesh_.element_count / 3);
+}
+
+void MeshletCuller::cull(GLuint packedInstances_)
+{
+    const unsigned int slot = frame % kStatsLatency;
+    ++frame;
+    pendingIssued[slot] = true;
+
+    Counters counters;
+    GLuint commandTotal = 0;
+    for (int b = 0; b < kBucketCount; ++b)
+    {
+        counters.commandBase[b] = commandTotal;
+        counters.commandCount[b] = 0;
+        counters.trianglesInView[b] = 0;
+        commandTotal += bucketCommands[b];
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffers[slot]);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Counters), &counters);
+
+    if (chunks.empty())
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return;
+    }
+
+    GrowBuffer(chunkBuffer, chunks.size() * sizeof(Chunk), chunkCapacity, sizeof(Chunk));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunkBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, chunks.size() * sizeof(Chunk), chunks.data());
+
+    // everything past what the shader appends has to be a draw of nothing
+    GrowBuffer(commandBuffer, commandTotal * sizeof(DrawCommand), commandCapacity, sizeof(DrawCommand));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, commandTotal * sizeof(DrawCommand), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // the chunks are bound to exactly how many there are, the shader takes its count from the length
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, meshletBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, packedInstances_);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 8, chunkBuffer, 0, chunks.size() * sizeof(Chunk));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, counterBuffers[slot]);
+
+    const unsigned int groups = chunks.size();
+    const unsigned int groupsX = std::min(groups, kMaxGroupsX);
+    glDispatchCompute(groupsX, (groups + groupsX - 1) / groupsX, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void MeshletCuller::draw(unsigned int bucket_)
+{
+    if (bucketCommands[bucket_] == 0)
+    {
+        return;
+    }
+
+    unsigned int first = 0;
+    for (unsigned int b = 0; b < bucket_; ++b)
+    {
+        first += bucketCommands[b];
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, TGL_BUFFER_OFFSET(first * sizeof(DrawCommand)), bucketCommands[bucket_], 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+bool MeshletCuller::hasMeshlets() const
+{
+    return meshletCount > 0;
+}
+
+const MeshletCuller::FrameStats& MeshletCuller::getFrameStats() const
+{
+    return stats;
+}
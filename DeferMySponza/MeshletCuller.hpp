@@ -0,0 +1,102 @@
+#pragma once
+#ifndef MESHLET_CULLER_HPP
+#define MESHLET_CULLER_HPP
+
+#include <tgl/tgl.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "RenderTypes.hpp"
+
+/*
+culls the gbuffer's meshlets on the gpu, for the big meshes where culling a whole instance keeps far too much.
+
+the instances that survive the cpu's culling are handed over as they are packed, each one split into chunks of up to
+kGroupSize meshlets. a compute shader runs a workgroup per chunk and an invocation per meshlet, tests its sphere
+against the frustum and, when the gbuffer culls back faces, its normal cone against the camera, and appends a draw
+command for each one that is left. the commands of a bucket are compacted at the start of its range and the rest of
+the range is cleared to draws of no instances, so a multi draw over the whole range needs nothing back from the gpu.
+
+how many triangles were left is counted alongside and read back kStatsLatency frames later so it never waits.
+*/
+class MeshletCuller
+{
+public:
+
+    static const int kGroupSize = 64; // local_size_x in meshlet_cull_cs.glsl
+    static const int kBucketCount = 2; // drawn one after another, the gbuffer's diffuse and specular
+    static const int kStatsLatency = 4;
+
+    struct FrameStats
+    {
+        unsigned int meshletsTested;
+        unsigned int meshletsDrawn;
+        unsigned long long trianglesSubmitted; // what drawing the instances whole would have
+        unsigned long long trianglesInView;
+    };
+
+    MeshletCuller();
+    ~MeshletCuller();
+
+    void createBuffers();
+    void deleteBuffers();
+
+    // every mesh's meshlets, their first elements are into the whole element buffer
+    void setMeshlets(const std::vector<Meshlet>& meshlets_);
+
+    void beginFrame();
+    // instanceCount_ instances of the mesh from firstInstance_ in the packed instance buffer, buckets in order
+    void addDraw(unsigned int bucket_, const Mesh& mesh_, unsigned int firstInstance_, unsigned int instanceCount_);
+
+    // uploads the chunks and dispatches them with whatever compute program is in use, which has its frustum and
+    // camera set already. the packed instances have to be uploaded by now
+    void cull(GLuint packedInstances_);
+
+    // the bucket's commands, with the vao and program to draw them with bound
+    void draw(unsigned int bucket_);
+
+    bool hasMeshlets() const;
+    const FrameStats& getFrameStats() const;
+
+protected:
+
+    struct Chunk
+    {
+        GLuint instance;
+        GLuint firstMeshlet;
+        GLuint meshletCount; // with the bucket above the low 16 bits
+        GLuint baseVertex;
+    };
+
+    // laid out like BufferMeshletCounters
+    struct Counters
+    {
+        GLuint commandBase[kBucketCount];
+        GLuint commandCount[kBucketCount];
+        GLuint trianglesInView[kBucketCount];
+    };
+
+    GLuint meshletBuffer;
+    GLuint chunkBuffer;
+    GLuint commandBuffer;
+    GLuint counterBuffers[kStatsLatency];
+    unsigned int meshletCount;
+    unsigned int chunkCapacity, commandCapacity;
+
+    std::vector<Chunk> chunks;
+    unsigned int bucketCommands[kBucketCount];
+
+    // the counters written by each of the last few frames and what the cpu knew about them, read back when the slot
+    // comes round again
+    unsigned int frame;
+    FrameStats pending[kStatsLatency];
+    bool pendingIssued[kStatsLatency];
+    FrameStats stats;
+
+private:
+
+    MeshletCuller(const MeshletCuller&);
+    MeshletCuller& operator=(const MeshletCuller&);
+};
+
+#endif //MESHLET_CULLER_HPP
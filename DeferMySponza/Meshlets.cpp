@@ -0,0 +1,169 @@
+#include "Meshlets.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+
+// below this the normals spread over more than a hemisphere, near enough, and the cone could never cull
+static const float kMinConeDot = 0.1f;
+
+// spreads the low 10 bits out to every third bit
+static unsigned int ExpandBits(unsigned int v_)
+{
+    v_ = (v_ * 0x00010001u) & 0xFF0000FFu;
+    v_ = (v_ * 0x00000101u) & 0x0F00F00Fu;
+    v_ = (v_ * 0x00000011u) & 0xC30C30C3u;
+    v_ = (v_ * 0x00000005u) & 0x49249249u;
+    return v_;
+}
+
+static unsigned int MortonCode(const glm::vec3& unit_)
+{
+    const glm::vec3 scaled = glm::min(glm::max(unit_ * 1024.f, glm::vec3(0.f)), glm::vec3(1023.f));
+    return (ExpandBits(static_cast<unsigned int>(scaled.x)) << 2)
+        | (ExpandBits(static_cast<unsigned int>(scaled.y)) << 1)
+        | ExpandBits(static_cast<unsigned int>(scaled.z));
+}
+
+static void FinishMeshlet(const std::vector<Vertex>& vertices_, const std::vector<unsigned int>& elements_, Meshlet& meshlet_)
+{
+    const unsigned int first = meshlet_.firstElement;
+    const unsigned int last = first + meshlet_.triangleCount * 3;
+
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (unsigned int e = first; e < last; ++e)
+    {
+        boundsMin = glm::min(boundsMin, vertices_[elements_[e]].position);
+        boundsMax = glm::max(boundsMax, vertices_[elements_[e]].position);
+    }
+    const glm::vec3 centre = (boundsMin + boundsMax) * 0.5f;
+    float radius = 0.f;
+    for (unsigned int e = first; e < last; ++e)
+    {
+        radius = std::max(radius, glm::distance(centre, vertices_[elements_[e]].position));
+    }
+    meshlet_.sphere = glm::vec4(centre, radius);
+
+    // the axis is the average of the face normals and the cone is as wide as the one furthest from it
+    glm::vec3 normals[kMeshletMaxTriangles];
+    unsigned int normalCount = 0;
+    glm::vec3 axis(0.f);
+    for (unsigned int e = first; e < last; e += 3)
+    {
+        const glm::vec3& a = vertices_[elements_[e]].position;
+        const glm::vec3 normal = glm::cross(vertices_[elements_[e + 1]].position - a, vertices_[elements_[e + 2]].position - a);
+        const float length = glm::length(normal);
+        if (length > 0.f)
+        {
+            normals[normalCount] = normal / length;
+            axis += normals[normalCount];
+            ++normalCount;
+        }
+    }
+
+    meshlet_.cone = glm::vec4(0.f, 0.f, 1.f, 1.f);
+    const float axisLength = glm::length(axis);
+    if (normalCount == 0 || axisLength < 1e-6f)
+    {
+        return;
+    }
+    axis /= axisLength;
+
+    float minDot = 1.f;
+    for (unsigned int n = 0; n < normalCount; ++n)
+    {
+        minDot = std::min(minDot, glm::dot(axis, normals[n]));
+    }
+    if (minDot >= kMinConeDot)
+    {
+        // the sine of the cone's half angle, how far off the axis the camera can be before one of them faces it
+        meshlet_.cone = glm::vec4(axis, std::sqrt(1.f - minDot * minDot));
+    }
+}
+
+void BuildMeshlets(const std::vector<Vertex>& vertices_,
+    std::vector<unsigned int>& elements_,
+    std::vector<Meshlet>& meshlets_)
+{
+    const unsigned int triangleCount = elements_.size() / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (unsigned int e = 0; e < triangleCount * 3; ++e)
+    {
+        boundsMin = glm::min(boundsMin, vertices_[elements_[e]].position);
+        boundsMax = glm::max(boundsMax, vertices_[elements_[e]].position);
+    }
+    const glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(1e-6f));
+
+    std::vector< std::pair<unsigned int, unsigned int> > order(triangleCount);
+    for (unsigned int t = 0; t < triangleCount; ++t)
+    {
+        const glm::vec3 centre = (vertices_[elements_[t * 3]].position
+            + vertices_[elements_[t * 3 + 1]].position
+            + vertices_[elements_[t * 3 + 2]].position) / 3.f;
+        order[t] = std::make_pair(MortonCode((centre - boundsMin) / extent), t);
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<unsigned int> sorted(triangleCount * 3);
+    for (unsigned int t = 0; t < triangleCount; ++t)
+    {
+        const unsigned int source = order[t].second * 3;
+        sorted[t * 3] = elements_[source];
+        sorted[t * 3 + 1] = elements_[source + 1];
+        sorted[t * 3 + 2] = elements_[source + 2];
+    }
+    sorted.insert(sorted.end(), elements_.begin() + triangleCount * 3, elements_.end());
+    elements_.swap(sorted);
+
+    // which meshlet last took each vertex, so a vertex shared inside one is only counted once
+    std::vector<unsigned int> owner(vertices_.size(), ~0u);
+    const unsigned int firstMeshlet = meshlets_.size();
+    Meshlet meshlet;
+    meshlet.firstElement = 0;
+    meshlet.triangleCount = 0;
+    meshlet.vertexCount = 0;
+    meshlet.padding = 0;
+    for (unsigned int t = 0; t < triangleCount; ++t)
+    {
+        const unsigned int* triangle = &elements_[t * 3];
+        unsigned int current = meshlets_.size() - firstMeshlet;
+        unsigned int added = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            const bool repeated = (i > 0 && triangle[i] == triangle[0]) || (i > 1 && triangle[i] == triangle[1]);
+            added += (owner[triangle[i]] != current && !repeated) ? 1 : 0;
+        }
+
+        if (meshlet.triangleCount == kMeshletMaxTriangles || meshlet.vertexCount + added > kMeshletMaxVertices)
+        {
+            FinishMeshlet(vertices_, elements_, meshlet);
+            meshlets_.push_back(meshlet);
+
+            meshlet.firstElement = t * 3;
+            meshlet.triangleCount = 0;
+            meshlet.vertexCount = 0;
+            ++current;
+            added = 0;
+            for (int i = 0; i < 3; ++i)
+            {
+                const bool repeated = (i > 0 && triangle[i] == triangle[0]) || (i > 1 && triangle[i] == triangle[1]);
+                added += repeated ? 0 : 1;
+            }
+        }
+
+        for (int i = 0; i < 3; ++i)
+        {
+            owner[triangle[i]] = current;
+        }
+        meshlet.vertexCount += added;
+        ++meshlet.triangleCount;
+    }
+    FinishMeshlet(vertices_, elements_, meshlet);
+    meshlets_.push_back(meshlet);
+}
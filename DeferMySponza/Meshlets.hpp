@@ -0,0 +1,29 @@
+#pragma once
+#ifndef MESHLETS_HPP
+#define MESHLETS_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "RenderTypes.hpp"
+
+/*
+splits a mesh into meshlets, small enough pieces that the gpu can cull them one by one where a whole instance would
+be too coarse. done when a mesh is decoded, nothing in here touches gl.
+
+the triangles are put in morton order of their centres first so each meshlet is a tight clump, then cut greedily
+into runs that stay under the vertex and triangle limits. each run is contiguous in the mesh's elements so a meshlet
+is drawn as a plain range of them. the normal cone is made from the face normals by their winding, counter clockwise
+being the front like gl's default.
+*/
+
+static const unsigned int kMeshletMaxVertices = 64;
+static const unsigned int kMeshletMaxTriangles = 124;
+
+// reorders the mesh's elements and appends its meshlets, their first elements are relative to the mesh like the
+// elements themselves are
+void BuildMeshlets(const std::vector<Vertex>& vertices_,
+    std::vector<unsigned int>& elements_,
+    std::vector<Meshlet>& meshlets_);
+
+#endif //MESHLETS_HPP
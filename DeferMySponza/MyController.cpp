@@ -4,8 +4,17 @@
 #include <tygra/Window.hpp>
 #include <iostream>
 
+#include "CpuTimer.hpp"
+#include "TraceCapture.hpp"
+
+// scene updates per second, independent of the frame rate
+static const double kSimulationRate = 120.0;
+// frames in a trace capture and where it goes
+static const int kTraceFrames = 60;
+static const char* kTracePath = "trace.json";
+
 MyController::
-MyController() : camera_turn_mode_(false)
+MyController() : camera_turn_mode_(false), stress_requested_(false)
 {
     camera_move_speed_[0] = 0;
     camera_move_speed_[1] = 0;
@@ -14,8 +23,10 @@ MyController() : camera_turn_mode_(false)
     camera_rotate_speed_[0] = 0;
     camera_rotate_speed_[1] = 0;
     scene_ = std::make_shared<SceneModel::Context>();
+    simulation_ = std::make_shared<SceneSimulation>(scene_);
     view_ = std::make_shared<MyView>();
     view_->setScene(scene_);
+    view_->setSimulation(simulation_);
 }
 
 MyController::
@@ -23,6 +34,25 @@ MyController::
 {
 }
 
+void MyController::
+startStressBenchmark()
+{
+    // the view has no gl resources until the window starts, so just remember it until the first frame
+    stress_requested_ = true;
+}
+
+bool MyController::
+stressBenchmarkFinished() const
+{
+    return stress_benchmark_.isFinished();
+}
+
+bool MyController::
+stressBenchmarkFailed() const
+{
+    return stress_benchmark_.hasFailed();
+}
+
 void MyController::
 windowControlWillStart(std::shared_ptr<tygra::Window> window)
 {
@@ -30,21 +60,45 @@ windowControlWillStart(std::shared_ptr<tygra::Window> window)
     window->setTitle("Real-Time Graphics :: DeferMySponza");
     std::cout << "Real-Time Graphics :: DeferMySponza" << std::endl;
     std::cout << "  Press F2 to toggle an animated camera" << std::endl;
+    std::cout << "  Press F3 to toggle shadows" << std::endl;
+    std::cout << "  Press F4 to print the renderer stats" << std::endl;
+    std::cout << "  Press F5 to toggle point light shadows" << std::endl;
+    std::cout << "  Press F6 to run the stress benchmark" << std::endl;
+    std::cout << "  Press F7 to toggle the visibility buffer" << std::endl;
+    std::cout << "  Press F8 to capture a trace of the next " << kTraceFrames << " frames" << std::endl;
+    std::cout << "  Press F9 to list the gpu memory in use" << std::endl;
+    std::cout << "  Press F10 to toggle occlusion culling" << std::endl;
+    std::cout << "  Press F11 to toggle msaa" << std::endl;
+    std::cout << "  Press F12 to toggle half resolution point lights" << std::endl;
+    std::cout << "  Press C to toggle writing every frame to disk" << std::endl;
+    std::cout << "  Press M to toggle meshlet culling" << std::endl;
+    std::cout << "  Press L to toggle late latching the camera" << std::endl;
+    std::cout << "  Press P to start or stop measuring input to present latency" << std::endl;
+    std::cout << "  Press B to benchmark drawing probe views in one layered pass against one at a time" << std::endl;
 }
 
 void MyController::
 windowControlDidStop(std::shared_ptr<tygra::Window> window)
 {
+    simulation_->stop();
     window->setView(nullptr);
 }
 
 void MyController::
 windowControlViewWillRender(std::shared_ptr<tygra::Window> window)
 {
-    scene_->update();
-    if (camera_turn_mode_) {
-        scene_->getCamera().setRotationalVelocity(glm::vec2(0, 0));
+    TRACE_SCOPE("controller_will_render");
+
+    // the view has read what it needs from the scene by now, from here on only the simulation thread touches it
+    if (!simulation_->isRunning()) {
+        simulation_->start(kSimulationRate);
+    }
+
+    if (stress_requested_) {
+        stress_requested_ = false;
+        stress_benchmark_.start(*view_);
     }
+    stress_benchmark_.update(*view_);
 }
 
 void MyController::
@@ -58,8 +112,8 @@ windowControlMouseMoved(std::shared_ptr<tygra::Window> window,
         int dx = x - prev_x;
         int dy = y - prev_y;
         const float mouse_speed = 0.6f;
-        scene_->getCamera().setRotationalVelocity(
-            glm::vec2(-dx * mouse_speed, -dy * mouse_speed));
+        simulation_->addCameraRotation(
+            glm::vec2(-dx * mouse_speed, -dy * mouse_speed), CpuTimeNanoseconds());
     }
     prev_x = x;
     prev_y = y;
@@ -87,6 +141,9 @@ windowControlKeyboardChanged(std::shared_ptr<tygra::Window> window,
                              int key_index,
                              bool down)
 {
+    TRACE_SCOPE("controller_keyboard");
+
+    const float previous_speed[4] = { camera_move_speed_[0], camera_move_speed_[1], camera_move_speed_[2], camera_move_speed_[3] };
     switch (key_index) {
     case tygra::kWindowKeyLeft:
     case 'A':
@@ -106,7 +163,12 @@ windowControlKeyboardChanged(std::shared_ptr<tygra::Window> window,
         break;
     }
 
-    updateCameraTranslation();
+    // key repeats and the other keys arent input as far as the latency measurement goes
+    bool moved = false;
+    for (int i = 0; i < 4; ++i) {
+        moved = moved || camera_move_speed_[i] != previous_speed[i];
+    }
+    updateCameraTranslation(moved ? CpuTimeNanoseconds() : 0);
 
     if (!down)
         return;
@@ -114,7 +176,55 @@ windowControlKeyboardChanged(std::shared_ptr<tygra::Window> window,
     switch (key_index)
     {
     case tygra::kWindowKeyF2:
-        scene_->toggleCameraAnimation();
+        simulation_->toggleCameraAnimation(CpuTimeNanoseconds());
+        break;
+    case tygra::kWindowKeyF3:
+        view_->toggleShadows();
+        break;
+    case tygra::kWindowKeyF4:
+        view_->reportStats();
+        break;
+    case tygra::kWindowKeyF5:
+        view_->togglePointShadows();
+        break;
+    case tygra::kWindowKeyF6:
+        if (!stress_benchmark_.isRunning()) {
+            startStressBenchmark();
+        }
+        break;
+    case tygra::kWindowKeyF7:
+        view_->toggleVisibilityBuffer();
+        break;
+    case tygra::kWindowKeyF8:
+        TraceCapture::requestCapture(kTraceFrames, kTracePath);
+        std::cout << "trace: capturing " << kTraceFrames << " frames" << std::endl;
+        break;
+    case tygra::kWindowKeyF9:
+        view_->reportGpuMemory();
+        break;
+    case tygra::kWindowKeyF10:
+        view_->toggleOcclusionCulling();
+        break;
+    case tygra::kWindowKeyF11:
+        view_->toggleMsaa();
+        break;
+    case tygra::kWindowKeyF12:
+        view_->toggleHalfResolutionLights();
+        break;
+    case 'B':
+        view_->startViewBatchBenchmark();
+        break;
+    case 'C':
+        view_->toggleCapture();
+        break;
+    case 'M':
+        view_->toggleMeshletCulling();
+        break;
+    case 'L':
+        view_->toggleLateLatch();
+        break;
+    case 'P':
+        view_->toggleLatencyMeasurement();
         break;
     }
 }
@@ -163,9 +273,9 @@ windowControlGamepadAxisMoved(std::shared_ptr<tygra::Window> window,
         else {
             camera_rotate_speed_[0] = 0.f;
         }
-        scene_->getCamera().setRotationalVelocity(
+        simulation_->setCameraRotationalVelocity(
             glm::vec2(camera_rotate_speed_[0] * rotate_speed,
-            camera_rotate_speed_[1] * rotate_speed));
+            camera_rotate_speed_[1] * rotate_speed), CpuTimeNanoseconds());
         break;
     case tygra::kWindowGamepadAxisRightThumbY:
         if (pos < -deadzone || pos > deadzone) {
@@ -174,13 +284,13 @@ windowControlGamepadAxisMoved(std::shared_ptr<tygra::Window> window,
         else {
             camera_rotate_speed_[1] = 0.f;
         }
-        scene_->getCamera().setRotationalVelocity(
+        simulation_->setCameraRotationalVelocity(
             glm::vec2(camera_rotate_speed_[0] * rotate_speed,
-            camera_rotate_speed_[1] * rotate_speed));
+            camera_rotate_speed_[1] * rotate_speed), CpuTimeNanoseconds());
         break;
     }
 
-    updateCameraTranslation();
+    updateCameraTranslation(CpuTimeNanoseconds());
 }
 
 void MyController::
@@ -192,13 +302,13 @@ windowControlGamepadButtonChanged(std::shared_ptr<tygra::Window> window,
 }
 
 void MyController::
-updateCameraTranslation()
+updateCameraTranslation(long long input_time)
 {
     const float key_speed = 100.f;
     const float sideward_speed = -key_speed * camera_move_speed_[0]
         + key_speed * camera_move_speed_[1];
     const float forward_speed = key_speed * camera_move_speed_[2]
         - key_speed * camera_move_speed_[3];
-    scene_->getCamera().setLinearVelocity(
-        glm::vec3(sideward_speed, 0, forward_speed));
+    simulation_->setCameraLinearVelocity(
+        glm::vec3(sideward_speed, 0, forward_speed), input_time);
 }
@@ -2,6 +2,9 @@
 #include <tygra/WindowControlDelegate.hpp>
 #include <SceneModel/SceneModel_fwd.hpp>
 
+#include "StressBenchmark.hpp"
+#include "SceneSimulation.hpp"
+
 class MyView;
 
 class MyController : public tygra::WindowControlDelegate
@@ -12,6 +15,16 @@ public:
 
     ~MyController();
 
+    // runs the light and instance sweep once the window is up, results go to stress_results.csv
+    void
+    startStressBenchmark();
+
+    bool
+    stressBenchmarkFinished() const;
+
+    bool
+    stressBenchmarkFailed() const;
+
 private:
 
     void
@@ -55,12 +68,16 @@ private:
                                       bool down) override;
 
     void
-    updateCameraTranslation();
+    updateCameraTranslation(long long input_time);
 
     std::shared_ptr<MyView> view_;
     std::shared_ptr<SceneModel::Context> scene_;
+    std::shared_ptr<SceneSimulation> simulation_;
 
     bool camera_turn_mode_;
     float camera_move_speed_[4];
     float camera_rotate_speed_[2];
+
+    StressBenchmark stress_benchmark_;
+    bool stress_requested_;
 };
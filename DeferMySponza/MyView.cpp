@@ -7,14 +7,259 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 #include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
 
 #include <map>
 
+#include "CpuTimer.hpp"
+#include "SceneAssembly.hpp"
+#include "FramePacking.hpp"
+#include "Meshlets.hpp"
+#include "MeshDedup.hpp"
+#include "TraceCapture.hpp"
+#include "GpuMemory.hpp"
+
 glm::vec3 ConvVec3(tsl::Vector3 &vec_);
 
+// camera projection, the shadow cascades split the same range so they have to agree
+static const float kFieldOfView = 75.f;
+static const float kNearPlane = 1.f;
+static const float kFarPlane = 1000.f;
+// added to the field of view the cpu culls with while the camera is late latched, it can turn this far by then
+static const float kLateLatchCullMargin = 10.f;
+// the occlusion buffer only holds for the position it was drawn from, a latched camera further from that than this
+// draws everything in the frustum instead
+static const float kLateLatchOcclusionSlack = 0.25f;
+
+static const int kShadowResolution = 2048;
+// how many point lights can have their shadow maps redrawn in a single frame
+static const int kPointShadowBudget = 4;
+
+// how far a refit bvh node's surface area can grow past what it was built at before its subtree is rebuilt
+static const float kBvhRebuildGrowth = 2.f;
+
+// slices around each of the light proxy spheres, indexed by LightCulling::Proxy from kProxySphereHigh
+static const int kLightSphereSegments[3] = { 24, 12, 6 };
+
+// where the captured frames go, followed by the frame number
+static const char* kCapturePrefix = "capture_";
+
+// the frame graph's pass groups for incremental rendering. a lighting frame skips the geometry group, a skipped frame
+// skips both and only presents
+static const unsigned int kPassGroupGeometry = 1;
+static const unsigned int kPassGroupLighting = 2;
+
+// the view batch benchmark's probes, square and a quarter turn wide like a cube map face
+static const int kViewBatchProbeSize = 512;
+static const float kViewBatchProbeFieldOfView = 90.f;
+static const int kViewBatchBenchmarkFrames = 240; // half batched, half one at a time
+static const unsigned int kViewBatchWarmup = 8; // timed batches thrown away after each switch
+
+// stencil values, the gbuffer writes kStencilGeometry wherever there is geometry, with kStencilSpecular as well where
+// the material is shiny, and the msaa classify pass adds kStencilEdge to the pixels whose samples are not all the same
+// surface. tests that dont care about the specular bit leave it out of their read mask
+static const GLint kStencilGeometry = 0x3F;
+static const GLint kStencilSpecular = 0x40;
+static const GLint kStencilEdge = 0x80;
+
+// the lighting shaders' permutations, bit i of a variant's key defines kShaderFeatures[i]
+static const unsigned int kFeatureSpecular = 1;
+static const unsigned int kFeatureShadows = 2;
+static const unsigned int kFeatureMsaa = 4;
+static const unsigned int kFeatureGBufferCompact = 8;
+static const unsigned int kFeatureVisibility = 16;
+static const char* const kShaderFeatures[] = { "HAS_SPECULAR", "SHADOWS", "MSAA", "GBUFFER_COMPACT", "VISIBILITY_BUFFER" };
+static const int kShaderFeatureCount = 5;
+
+static const int kMsaaSamples = 4;
+
+// occluders are picked by how big they look, radius over distance, and stop once their triangles pass the budget
+static const float kMinOccluderSize = 0.1f;
+static const unsigned int kOccluderTriangleBudget = 32768;
+
+// bytes of mesh data copied to the gpu a frame while the scene is streaming in
+static const unsigned int kStreamingBudget = 2 * 1024 * 1024;
+
+// how much of a loop each job takes, anything smaller than this is run straight away on the render thread
+static const unsigned int kInstanceMeshesPerJob = 4;
+static const unsigned int kLightsPerJob = 4096;
+
+// delete the object and take it out of the gpu memory registry
+static void DeleteBuffer(GLuint& buffer_)
+{
+    glDeleteBuffers(1, &buffer_);
+    GpuMemory::release(GpuMemory::kBuffer, buffer_);
+    buffer_ = 0;
+}
+
+static void DeleteVertexArray(GLuint& vao_)
+{
+    glDeleteVertexArrays(1, &vao_);
+    GpuMemory::release(GpuMemory::kVertexArray, vao_);
+    vao_ = 0;
+}
+
+// gives the buffer a bigger store with what was at the start of the old one, it keeps its name so the vaos and
+// bindings that use it dont have to change
+static void GrowBuffer(GLuint buffer_, GLsizeiptr usedBytes_, GLsizeiptr newBytes_)
+{
+    GLuint scratch;
+    glGenBuffers(1, &scratch);
+    GpuMemory::track(GpuMemory::kBuffer, scratch, GpuMemory::kGeometry, "grow_scratch");
+    glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+    glBufferData(GL_COPY_WRITE_BUFFER, usedBytes_, NULL, GL_STREAM_COPY);
+    GpuMemory::bufferStorage(scratch, usedBytes_);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer_);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes_);
+    glBufferData(GL_COPY_READ_BUFFER, newBytes_, NULL, GL_STATIC_DRAW);
+    GpuMemory::bufferStorage(buffer_, newBytes_);
+    glCopyBufferSubData(GL_COPY_WRITE_BUFFER, GL_COPY_READ_BUFFER, 0, 0, usedBytes_);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    DeleteBuffer(scratch);
+}
+
+// appends a unit sphere for the light proxies and returns how much it has to be scaled by so its faces sit outside
+// the sphere rather than cutting inside it
+static float AppendLightSphere(int segments_, std::vector<Vertex>& vertices_, std::vector<unsigned int>& elements_, Mesh& mesh_)
+{
+    tsl::IndexedMesh mesh;
+    tsl::CreateSphere(1.f, segments_, &mesh);
+    tsl::ConvertPolygonsToTriangles(&mesh);
+
+    mesh_.startVerticeIndex = vertices_.size();
+    mesh_.startElementIndex = elements_.size();
+
+    for (unsigned int j = 0; j < mesh.vertex_array.size(); ++j)
+    {
+        vertices_.push_back(Vertex(
+            ConvVec3(mesh.vertex_array[j]),
+            ConvVec3(mesh.normal_array[j])
+            ));
+    }
+    for (unsigned int j = 0; j < mesh.index_array.size(); ++j)
+    {
+        elements_.push_back(mesh.index_array[j]);
+    }
+
+    mesh_.endVerticeIndex = vertices_.size() - 1;
+    mesh_.endElementIndex = elements_.size() - 1;
+    mesh_.verticeCount = mesh_.endVerticeIndex - mesh_.startVerticeIndex;
+    mesh_.element_count = mesh_.endElementIndex - mesh_.startElementIndex + 1;
+
+    // each face is at most half a slice off the surface both ways round
+    const float inset = std::cos(3.14159265f / segments_);
+    return 1.f / (inset * inset);
+}
+
+// appends a quad from -1 to 1 in x and y, the small light and full screen proxies place it in the vertex shader
+static void AppendLightQuad(std::vector<Vertex>& vertices_, std::vector<unsigned int>& elements_, Mesh& mesh_)
+{
+    mesh_.startVerticeIndex = vertices_.size();
+    mesh_.startElementIndex = elements_.size();
+
+    vertices_.push_back(Vertex(glm::vec3(-1, -1, 0), glm::vec3(0, 0, 1)));
+    vertices_.push_back(Vertex(glm::vec3(1, -1, 0), glm::vec3(0, 0, 1)));
+    vertices_.push_back(Vertex(glm::vec3(1, 1, 0), glm::vec3(0, 0, 1)));
+    vertices_.push_back(Vertex(glm::vec3(-1, 1, 0), glm::vec3(0, 0, 1)));
+
+    const unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+    elements_.insert(elements_.end(), quad, quad + 6);
+
+    mesh_.endVerticeIndex = vertices_.size() - 1;
+    mesh_.endElementIndex = elements_.size() - 1;
+    mesh_.verticeCount = mesh_.endVerticeIndex - mesh_.startVerticeIndex;
+    mesh_.element_count = mesh_.endElementIndex - mesh_.startElementIndex + 1;
+}
+
+static void PrintLatency(const LatencyMeter::Summary& summary_, bool lateLatch_)
+{
+    std::cout << "input to present: " << summary_.samples << " samples with late latch " << (lateLatch_ ? "on" : "off")
+        << ", mean " << summary_.meanMilliseconds << "ms"
+        << ", median " << summary_.medianMilliseconds << "ms"
+        << ", 95th percentile " << summary_.p95Milliseconds << "ms"
+        << ", max " << summary_.maxMilliseconds << "ms" << std::endl;
+}
+
 MyView::
-MyView()
+MyView() : snapshot(nullptr),
+    appliedInstanceVersion(0),
+    streamingMesh(nullptr),
+    geometryVertexCount(0),
+    geometryVertexCapacity(0),
+    geometryElementCount(0),
+    geometryElementCapacity(0),
+    dedupWeldedVertices(0),
+    dedupSharedMeshes(0),
+    dedupSharedBytes(0),
+    dedupDrawsBefore(0),
+    dedupDrawsAfter(0),
+    bvhSubtreesRebuilt(0),
+    occlusionEnabled(OcclusionCuller::isSupported()),
+    meshletVAO(0),
+    meshletCullingEnabled(true),
+    geometryCullsBackFaces(false),
+    packedInstanceVBO(0),
+    packedInstanceCapacity(0),
+    packedInstancesUploaded(0),
+    visibleLightCount(0),
+    gbufferSpecularDraw(0),
+    sceneHasSpecular(false),
+    shadowsEnabled(true),
+    pointShadowsEnabled(false),
+    stressDirty(false),
+    visibilityInstanceSSBO(0),
+    visibilityMeshSSBO(0),
+    visibilityTriangleBits(0),
+    visibilityBufferEnabled(false),
+    visibilityBufferFits(true),
+    msaaEdgeQuery(0),
+    msaaSamples(1),
+    msaaEdgeSamples(0),
+    msaaEdgeQueryIssued(false),
+    msaaEnabled(false),
+    halfResolutionLights(false),
+    graphWidth(0),
+    graphHeight(0),
+    graphMsaa(false),
+    graphVisibility(false),
+    graphHalfLights(false),
+    graphCapture(false),
+    graphIncremental(false),
+    graphDirty(true),
+    lateLatchEnabled(true),
+    frameLatched(false),
+    frameCameraTick(0),
+    latchTicksAhead(0),
+    latchOcclusionSkips(0),
+    incrementalRendering(true),
+    fullFrameNeeded(true),
+    lightingFrameNeeded(false),
+    captureEnabled(false),
+    batchWidth(0),
+    batchHeight(0),
+    batchOneAtATime(false),
+    batchRequested(false),
+    batchBenchmarkFrames(0),
+    batchBenchmarkSeen(0)
 {
+    for (int i = 0; i < 2; ++i)
+    {
+        batchBenchmarkTimed[i] = 0;
+        batchBenchmarkMilliseconds[i] = 0.0;
+        batchBenchmarkViews[i] = 0;
+    }
+
+    incrementalStats.fullFrames = 0;
+    incrementalStats.lightingFrames = 0;
+    incrementalStats.skippedFrames = 0;
+
+    gbufferBucketInstances[0] = gbufferBucketInstances[1] = 0;
 }
 
 MyView::
@@ -28,13 +273,458 @@ setScene(std::shared_ptr<const SceneModel::Context> scene)
     scene_ = scene;
 }
 
+void MyView::
+setSimulation(std::shared_ptr<SceneSimulation> simulation)
+{
+    simulation_ = simulation;
+}
+
+void MyView::
+toggleShadows()
+{
+    shadowsEnabled = !shadowsEnabled;
+    lightingFrameNeeded = true;
+}
+
+void MyView::
+togglePointShadows()
+{
+    pointShadowsEnabled = !pointShadowsEnabled;
+    lightingFrameNeeded = true;
+}
+
+void MyView::
+toggleVisibilityBuffer()
+{
+    visibilityBufferEnabled = !visibilityBufferEnabled;
+}
+
+void MyView::
+toggleMsaa()
+{
+    msaaEnabled = !msaaEnabled;
+}
+
+void MyView::
+setHalfResolutionLights(bool enabled)
+{
+    halfResolutionLights = enabled;
+}
+
+bool MyView::
+getHalfResolutionLights() const
+{
+    return halfResolutionLights;
+}
+
+void MyView::
+toggleHalfResolutionLights()
+{
+    halfResolutionLights = !halfResolutionLights;
+}
+
+void MyView::
+requestViewBatch(const std::vector<ViewBatch::View>& views, int width, int height, bool oneAtATime)
+{
+    assert(!views.empty() && views.size() <= ViewBatch::kMaxViews);
+    batchViews = views;
+    batchWidth = width;
+    batchHeight = height;
+    batchOneAtATime = oneAtATime;
+    batchRequested = true;
+}
+
+const ViewBatch::Stats& MyView::
+getViewBatchStats() const
+{
+    return viewBatch.getStats();
+}
+
+GLuint MyView::
+getViewBatchTexture() const
+{
+    return viewBatch.getColourTexture();
+}
+
+void MyView::
+startViewBatchBenchmark()
+{
+    batchBenchmarkFrames = kViewBatchBenchmarkFrames;
+    batchBenchmarkSeen = viewBatch.getStats().batchesTimed;
+    for (int i = 0; i < 2; ++i)
+    {
+        batchBenchmarkTimed[i] = 0;
+        batchBenchmarkMilliseconds[i] = 0.0;
+        batchBenchmarkViews[i] = 0;
+    }
+    std::cout << "view batch benchmark: " << ViewBatch::kMaxViews << " views at " << kViewBatchProbeSize << "x" << kViewBatchProbeSize
+        << " for " << kViewBatchBenchmarkFrames << " frames" << std::endl;
+}
+
+void MyView::
+setIncrementalRendering(bool enabled)
+{
+    incrementalRendering = enabled;
+}
+
+bool MyView::
+getIncrementalRendering() const
+{
+    return incrementalRendering;
+}
+
+const MyView::IncrementalStats& MyView::
+getIncrementalStats() const
+{
+    return incrementalStats;
+}
+
+void MyView::
+toggleCapture()
+{
+    captureEnabled = !captureEnabled;
+    std::cout << "capture: " << (captureEnabled ? "writing frames to " : "stopped writing to ") << kCapturePrefix << "*.png" << std::endl;
+}
+
+void MyView::
+toggleOcclusionCulling()
+{
+    occlusionEnabled = !occlusionEnabled;
+}
+
+void MyView::
+toggleMeshletCulling()
+{
+    meshletCullingEnabled = !meshletCullingEnabled;
+}
+
+void MyView::
+toggleLateLatch()
+{
+    lateLatchEnabled = !lateLatchEnabled;
+    std::cout << "late latch: " << (lateLatchEnabled ? "on" : "off") << std::endl;
+}
+
+void MyView::
+toggleLatencyMeasurement()
+{
+    if (!latencyMeter.isRunning())
+    {
+        // reads the gl clock once, which waits for what is queued so far
+        latencyMeter.start(gpuTimer.measureClockOffset());
+        std::cout << "latency: measuring input to present with late latch " << (lateLatchEnabled ? "on" : "off") << std::endl;
+        return;
+    }
+    latencyMeter.stop();
+    PrintLatency(latencyMeter.summarise(), lateLatchEnabled);
+}
+
+void MyView::
+reportGpuMemory() const
+{
+    GpuMemory::report(std::cout, true);
+}
+
+void MyView::
+reportStats() const
+{
+    const ShadowCascades::FrameStats& shadowStats = shadowCascades.getFrameStats();
+    std::cout << "shadows: " << (shadowsEnabled ? "on" : "off")
+        << ", cascades rendered " << shadowStats.cascadesRendered
+        << ", reused " << shadowStats.cascadesReused << std::endl;
+
+    const PointShadowAtlas::FrameStats& atlasStats = pointShadowAtlas.getFrameStats();
+    std::cout << "point shadows: " << (pointShadowsEnabled ? "on" : "off")
+        << ", slots in use " << atlasStats.slotsInUse
+        << ", maps rendered " << atlasStats.mapsRendered
+        << ", reused " << atlasStats.mapsReused
+        << ", pending " << atlasStats.mapsPending << std::endl;
+
+    const LightCulling::FrameStats& lightStats = lightCulling.getFrameStats();
+    std::cout << "lights: " << lightStats.visibleLights << " visible of " << lightStats.totalLights
+        << ", culled by frustum " << lightStats.culledByFrustum
+        << ", culled by size " << lightStats.culledBySize << std::endl;
+    std::cout << "light proxies: " << lightCulling.getProxyBatch(LightCulling::kProxyFullscreen).count << " full screen"
+        << ", spheres " << lightCulling.getProxyBatch(LightCulling::kProxySphereHigh).count
+        << "/" << lightCulling.getProxyBatch(LightCulling::kProxySphereMedium).count
+        << "/" << lightCulling.getProxyBatch(LightCulling::kProxySphereLow).count << " (high/medium/low)"
+        << ", quads " << lightCulling.getProxyBatch(LightCulling::kProxyQuad).count << std::endl;
+
+    unsigned int gbufferInstances = 0;
+    for (unsigned int d = 0; d < gbufferDraws.size(); ++d)
+    {
+        gbufferInstances += gbufferDraws[d].instanceCount;
+    }
+    std::cout << "instances: " << getInstanceCount() << ", " << gbufferInstances << " in the gbuffer" << std::endl;
+
+    const InstanceBvh::BuildStats& bvhStats = instanceBvh.getBuildStats();
+    std::cout << "instance bvh: " << bvhStats.nodes << " nodes, " << bvhStats.leaves << " leaves, depth " << bvhStats.depth
+        << ", sah cost " << bvhStats.sahCost
+        << ", built in " << bvhStats.milliseconds << "ms on " << bvhStats.threads << " threads"
+        << ", " << bvhSubtreesRebuilt << " subtrees rebuilt since" << std::endl;
+
+    const OcclusionCuller::FrameStats& occlusionStats = occlusionCuller.getFrameStats();
+    std::cout << "occlusion culling: " << (occlusionEnabled ? "on" : "off");
+    if (!OcclusionCuller::isSupported())
+    {
+        std::cout << ", no avx2 so nothing is culled";
+    }
+    std::cout << ", " << occlusionStats.occluders << " occluders"
+        << " (" << occlusionStats.triangles << " triangles)"
+        << ", culled " << occlusionStats.culled << " of " << occlusionStats.tested
+        << " (" << (occlusionStats.tested > 0 ? 100.0 * occlusionStats.culled / occlusionStats.tested : 0.0) << "%)"
+        << ", " << occlusionStats.milliseconds << "ms on its threads"
+        << ", waited " << occlusionStats.waitMilliseconds << "ms" << std::endl;
+
+    const MeshletCuller::FrameStats& meshletStats = meshletCuller.getFrameStats();
+    std::cout << "meshlet culling: " << (meshletCullingEnabled ? "on" : "off")
+        << ", " << meshlets.size() << " meshlets"
+        << ", drew " << meshletStats.meshletsDrawn << " of " << meshletStats.meshletsTested
+        << ", triangles in view " << meshletStats.trianglesInView << " of " << meshletStats.trianglesSubmitted << " submitted"
+        << " (" << (meshletStats.trianglesSubmitted > 0 ? 100.0 * meshletStats.trianglesInView / meshletStats.trianglesSubmitted : 0.0) << "%)"
+        << ", from " << MeshletCuller::kStatsLatency << " frames ago" << std::endl;
+
+    const CameraLatch::Stats& latchStats = cameraLatch.getStats();
+    std::cout << "late latch: " << (lateLatchEnabled ? "on" : "off")
+        << ", " << latchStats.latches << " frames drew a newer camera than they started with"
+        << " (" << (latchStats.latches > 0 ? static_cast<double>(latchTicksAhead) / latchStats.latches : 0.0) << " ticks newer on average)"
+        << ", " << latchOcclusionSkips << " moved too far to keep the occlusion culling"
+        << ", waited on the gpu " << latchStats.fenceWaits << " times for " << latchStats.waitMilliseconds << "ms"
+        << (latchStats.persistentlyMapped ? "" : ", not persistently mapped") << std::endl;
+    if (latencyMeter.isRunning())
+    {
+        PrintLatency(latencyMeter.summarise(), lateLatchEnabled);
+    }
+
+    std::cout << "geometry dedup: " << dedupWeldedVertices << " vertices welded"
+        << " (" << dedupWeldedVertices * sizeof(Vertex) / 1024 << "KB)"
+        << ", " << dedupSharedMeshes << " meshes share another's geometry"
+        << " (" << dedupSharedBytes / 1024 << "KB not uploaded)"
+        << ", draws " << dedupDrawsBefore << " -> " << dedupDrawsAfter << " with everything in view" << std::endl;
+
+    std::cout << "msaa: " << (msaaEnabled ? "on" : "off") << ", " << msaaSamples << " samples";
+    if (msaaEnabled && graphMsaa)
+    {
+        const unsigned int pixels = graphWidth * graphHeight;
+        std::cout << ", " << msaaEdgeSamples << " edge samples lit per sample"
+            << " (about " << 100.0 * msaaEdgeSamples / (static_cast<double>(pixels) * msaaSamples) << "% of them)";
+    }
+    std::cout << std::endl;
+
+    std::cout << "visibility buffer: " << (visibilityBufferEnabled ? "on" : "off")
+        << ", " << visibilityTriangleBits << " triangle bits";
+    if (visibilityBufferEnabled && msaaEnabled)
+    {
+        std::cout << ", msaa is on so the gbuffer is being used";
+    }
+    else if (visibilityBufferEnabled && !streamingLoader.isComplete())
+    {
+        std::cout << ", the scene is still streaming in so the gbuffer is being used";
+    }
+    else if (visibilityBufferEnabled && !visibilityBufferFits)
+    {
+        std::cout << ", too many instances to pack so the gbuffer is being used";
+    }
+    else if (graphVisibility)
+    {
+        // 12 position, 12 normal and 16 material, none of which are in the graph while the ids are
+        std::cout << ", 4 bytes a pixel against the gbuffer's 40, which isnt allocated";
+    }
+    std::cout << std::endl;
+
+    std::cout << "half resolution lights: " << (halfResolutionLights ? "on" : "off");
+    if (halfResolutionLights && msaaEnabled)
+    {
+        std::cout << ", msaa is on so they are full resolution";
+    }
+    std::cout << std::endl;
+
+    const ShaderProgram::VariantStats& variantStats = ShaderProgram::getVariantStats();
+    std::cout << "shader permutations: " << variantStats.variants << " compiled"
+        << " (" << globalLightPrograms.getVariantCount() << " global light, " << lightPrograms.getVariantCount() << " point light"
+        << ", " << batchGlobalLightPrograms.getVariantCount() + batchLightPrograms.getVariantCount() << " view batch)"
+        << " in " << variantStats.compileMilliseconds << "ms, " << variantStats.failed << " failed"
+        << ", gbuffer instances " << gbufferBucketInstances[0] << " diffuse, " << gbufferBucketInstances[1] << " specular" << std::endl;
+
+    const FrameGraph::Stats& graphStats = frameGraph.getStats();
+    std::cout << "incremental rendering: " << (incrementalRendering ? "on" : "off")
+        << ", " << incrementalStats.fullFrames << " full frames"
+        << ", " << incrementalStats.lightingFrames << " lighting only"
+        << ", " << incrementalStats.skippedFrames << " skipped"
+        << ", " << graphStats.passesSkipped << " passes skipped last frame" << std::endl;
+
+    const FrameCapture::Stats& captureStats = frameCapture.getStats();
+    std::cout << "capture: " << (captureEnabled ? "on" : "off")
+        << ", " << captureStats.framesWritten << " of " << captureStats.framesRead << " frames written"
+        << ", " << captureStats.framesDropped << " dropped, " << captureStats.framesFailed << " failed"
+        << ", queue depth " << captureStats.queued << " (max " << captureStats.maxQueued << ")"
+        << ", in flight " << captureStats.inFlight << " of " << captureStats.slots << " slots (max " << captureStats.maxInFlight << ")"
+        << ", encode " << captureStats.encodeMilliseconds << "ms a frame"
+        << ", " << captureStats.bytesWritten / (1024 * 1024) << "MB written" << std::endl;
+
+    const ViewBatch::Stats& batchStats = viewBatch.getStats();
+    if (batchStats.batchesTimed > 0)
+    {
+        std::cout << "view batch: " << batchStats.views << " views " << (batchStats.oneAtATime ? "one at a time" : "in one layered pass")
+            << " in " << batchStats.gpuMilliseconds << "ms, " << batchStats.viewsPerSecond << " views/s"
+            << ", " << batchStats.batchesTimed << " batches timed" << std::endl;
+    }
+
+    std::cout << "frame graph: " << graphStats.passes - graphStats.passesCulled << " passes"
+        << ", " << graphStats.passesCulled << " culled"
+        << ", " << graphStats.targets << " targets in " << graphStats.textures << " textures"
+        << ", render targets " << graphStats.textureBytes / (1024 * 1024) << "MB"
+        << " (" << graphStats.targetBytes / (1024 * 1024) << "MB without sharing)"
+        << ", " << graphStats.framebufferBinds << " framebuffer binds"
+        << ", " << graphStats.stateChanges << " state changes" << std::endl;
+
+    const StreamingLoader::Stats& streamingStats = streamingLoader.getStats();
+    std::cout << "streaming: " << streamingStats.meshesResident << " of " << streamingStats.meshCount << " meshes resident"
+        << ", " << streamingStats.meshesDecoded << " decoded"
+        << ", first frame after " << streamingStats.firstFrameMilliseconds << "ms";
+    if (streamingStats.residentMilliseconds >= 0.0)
+    {
+        std::cout << ", fully resident after " << streamingStats.residentMilliseconds << "ms";
+    }
+    std::cout << ", " << streamingStats.bytesUploaded / 1024 << "KB copied"
+        << (streamingStats.persistentlyMapped ? " through a persistently mapped buffer" : " through a mapped buffer")
+        << ", " << streamingStats.framesSkipped << " frames waited on the gpu" << std::endl;
+
+    const JobSystem::Stats jobStats = jobs.getStats();
+    std::cout << "jobs: " << jobStats.threads << " threads counting the render thread"
+        << ", " << jobStats.jobsRun << " run, " << jobStats.jobsStolen << " stolen" << std::endl;
+
+    std::cout << "frame allocations: " << frameAllocations.allocations
+        << " (" << frameAllocations.bytes << " bytes)"
+        << ", arena high water " << frameArena.getHighWater() << " bytes" << std::endl;
+
+    if (snapshot != nullptr)
+    {
+        std::cout << "simulation: drew tick " << snapshot->tick << ", which took " << snapshot->tickMilliseconds << "ms" << std::endl;
+    }
+
+    if (gpuTimer.hasResults())
+    {
+        std::cout << "gpu: " << gpuTimer.getFrameMilliseconds() << "ms";
+        for (int i = 0; i < gpuTimer.getPassCount(); ++i)
+        {
+            std::cout << ", " << gpuTimer.getPassName(i) << " " << gpuTimer.getPassMilliseconds(i) << "ms";
+        }
+        std::cout << std::endl;
+    }
+
+    GpuMemory::report(std::cout, false);
+}
+
+const LightCulling::FrameStats& MyView::
+getLightStats() const
+{
+    return lightCulling.getFrameStats();
+}
+
+void MyView::
+setStressConfig(const StressScene::Config& config)
+{
+    if (config != stressScene.getConfig())
+    {
+        stressScene.setConfig(config);
+        stressDirty = true;
+    }
+}
+
+const StressScene::Config& MyView::
+getStressConfig() const
+{
+    return stressScene.getConfig();
+}
+
+unsigned int MyView::
+getInstanceCount() const
+{
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < instanceData.size(); ++i)
+    {
+        count += instanceData[i].size();
+    }
+    return count;
+}
+
+const GpuTimer& MyView::
+getGpuTimer() const
+{
+    return gpuTimer;
+}
+
+const AllocationTracker::Counts& MyView::
+getFrameAllocations() const
+{
+    return frameAllocations;
+}
+
 void MyView::
 windowViewWillStart(std::shared_ptr<tygra::Window> window)
 {
     assert(scene_ != nullptr);
+    assert(simulation_ != nullptr);
+
+    const double loadStartTime = CpuTimeSeconds();
 
     SceneModel::GeometryBuilder builder = SceneModel::GeometryBuilder();
-    
+
+    // the meshes are decoded on the loader's threads while the shaders compile and then streamed in over the first
+    // frames, the decode function keeps its own copy of the list
+    std::shared_ptr< const std::vector<SceneModel::Mesh> > sourceMeshes = std::make_shared< const std::vector<SceneModel::Mesh> >(builder.getAllMeshes());
+    const std::vector<SceneModel::Mesh>& meshes = *sourceMeshes;
+    streamingLoader.start(meshes.size(), [sourceMeshes](unsigned int mesh_, StreamingLoader::DecodedMesh& decoded_)
+    {
+        DecodeMesh((*sourceMeshes)[mesh_], decoded_.vertices, decoded_.elements, decoded_.boundsMin, decoded_.boundsMax);
+        decoded_.weldedVertices = WeldVertices(decoded_.vertices, decoded_.elements);
+        decoded_.topologyHash = TopologyHash(decoded_.vertices, decoded_.elements);
+        BuildMeshlets(decoded_.vertices, decoded_.elements, decoded_.meshlets);
+    }, loadStartTime);
+    streamingMesh = nullptr;
+    meshPriorities.assign(meshes.size(), 0.f);
+
+    /*
+    generate a map which contains the MaterialID as the key, which leads to the index inside of my vector that the material is contained
+    */
+    // the material table and then the instances are gathered on the job system's threads while the shaders compile
+    // below, they only read the scene. each mesh's instances are gathered on their own and flattened afterwards
+    jobs.start(JobSystem::kDefaultThreads, &TraceCapture::nameCurrentThread);
+    auto mapMaterialIndex = std::map<SceneModel::MaterialId, unsigned int>();
+    auto buildMaterials = [&](unsigned int, unsigned int)
+    {
+        BuildMaterialTable(scene_->getAllMaterials(), mapMaterialIndex, materials);
+    };
+
+    instanceData.resize(meshes.size());
+    std::vector< std::vector<SceneModel::InstanceId> > meshInstanceIds(meshes.size());
+    auto buildInstances = [&](unsigned int begin_, unsigned int end_)
+    {
+        for (unsigned int i = begin_; i < end_; ++i)
+        {
+            meshInstanceIds[i] = scene_->getInstancesByMeshId(meshes[i].getId());
+            const std::vector<SceneModel::InstanceId>& ids = meshInstanceIds[i];
+
+            for (unsigned int j = 0; j < ids.size(); ++j)
+            {
+                const SceneModel::Instance& sceneInstance = scene_->getInstanceById(ids[j]);
+                auto material = mapMaterialIndex.find(sceneInstance.getMaterialId());
+
+                InstanceData instance;
+                instance.positionData = sceneInstance.getTransformationMatrix();
+                instance.materialDataIndex = static_cast<GLint>(material != mapMaterialIndex.end() ? material->second : 0);
+                instanceData[i].push_back(instance);
+            }
+        }
+    };
+
+    JobSystem::Job* materialJob = jobs.create(buildMaterials);
+    JobSystem::Job* instanceJob = jobs.create(buildInstances, 0, meshes.size(), kInstanceMeshesPerJob);
+    jobs.addDependency(instanceJob, materialJob);
+    jobs.submit(instanceJob);
+    jobs.submit(materialJob);
+
     {
         Shader vs, fs;
         vs.loadShader("firstpass_vs.glsl", GL_VERTEX_SHADER);
@@ -54,6 +744,29 @@ windowViewWillStart(std::shared_ptr<tygra::Window> window)
         firstPassProgram.useProgram();
     }
 
+    {
+        Shader vs, fs;
+        vs.loadShader("visibility_vs.glsl", GL_VERTEX_SHADER);
+        fs.loadShader("visibility_fs.glsl", GL_FRAGMENT_SHADER);
+
+        visibilityProgram.createProgram();
+        visibilityProgram.addShaderToProgram(&vs);
+        visibilityProgram.addShaderToProgram(&fs);
+
+        glBindFragDataLocation(visibilityProgram.getProgramID(), 0, "visibility");
+
+        visibilityProgram.linkProgram();
+    }
+
+    {
+        Shader cs;
+        cs.loadShader("meshlet_cull_cs.glsl", GL_COMPUTE_SHADER);
+
+        meshletCullProgram.createProgram();
+        meshletCullProgram.addShaderToProgram(&cs);
+        meshletCullProgram.linkProgram();
+    }
+
 	{
 		Shader vs, fs;
 		vs.loadShader("background_vs.glsl", GL_VERTEX_SHADER);
@@ -68,31 +781,75 @@ windowViewWillStart(std::shared_ptr<tygra::Window> window)
 		backgroundProgram.useProgram();
 	}
 
-    {
-        Shader vs, fs;
-        vs.loadShader("global_light_vs.glsl", GL_VERTEX_SHADER);
-        fs.loadShader("global_light_fs.glsl", GL_FRAGMENT_SHADER);
-
-        globalLightProgram.createProgram();
-        globalLightProgram.addShaderToProgram(&vs);
-        globalLightProgram.addShaderToProgram(&fs);
+    // the lighting is compiled a permutation at a time as the passes ask for them, gbuffer_fs.glsl reads whichever
+    // gbuffer the MSAA, GBUFFER_COMPACT and VISIBILITY_BUFFER features say
+    globalLightPrograms.setFeatures(kShaderFeatures, kShaderFeatureCount);
+    globalLightPrograms.addVariantSource("global_light_vs.glsl", GL_VERTEX_SHADER);
+    globalLightPrograms.addVariantSource("global_light_fs.glsl", GL_FRAGMENT_SHADER);
+    globalLightPrograms.addVariantSource("gbuffer_fs.glsl", GL_FRAGMENT_SHADER);
 
-        globalLightProgram.linkProgram();
+    lightPrograms.setFeatures(kShaderFeatures, kShaderFeatureCount);
+    lightPrograms.addVariantSource("light_vs.glsl", GL_VERTEX_SHADER);
+    lightPrograms.addVariantSource("light_fs.glsl", GL_FRAGMENT_SHADER);
+    lightPrograms.addVariantSource("gbuffer_fs.glsl", GL_FRAGMENT_SHADER);
 
-        globalLightProgram.useProgram();
+    {
+        // the view batch's, the same lighting reading a layer of the batch's gbuffer arrays
+        Shader layeredVs, layeredGs, firstPassFs;
+        layeredVs.loadShader("firstpass_layered_vs.glsl", GL_VERTEX_SHADER);
+        layeredGs.loadShader("firstpass_layered_gs.glsl", GL_GEOMETRY_SHADER);
+        firstPassFs.loadShader("firstpass_fs.glsl", GL_FRAGMENT_SHADER);
+
+        batchGeometryProgram.createProgram();
+        batchGeometryProgram.addShaderToProgram(&layeredVs);
+        batchGeometryProgram.addShaderToProgram(&layeredGs);
+        batchGeometryProgram.addShaderToProgram(&firstPassFs);
+        glBindFragDataLocation(batchGeometryProgram.getProgramID(), 0, "position");
+        glBindFragDataLocation(batchGeometryProgram.getProgramID(), 1, "normal");
+        glBindFragDataLocation(batchGeometryProgram.getProgramID(), 2, "material");
+        batchGeometryProgram.linkProgram();
+
+        batchGlobalLightPrograms.setFeatures(kShaderFeatures, kShaderFeatureCount);
+        batchGlobalLightPrograms.addVariantSource("global_light_vs.glsl", GL_VERTEX_SHADER);
+        batchGlobalLightPrograms.addVariantSource("global_light_fs.glsl", GL_FRAGMENT_SHADER);
+        batchGlobalLightPrograms.addVariantSource("gbuffer_layer_fs.glsl", GL_FRAGMENT_SHADER);
+
+        batchLightPrograms.setFeatures(kShaderFeatures, kShaderFeatureCount);
+        batchLightPrograms.addVariantSource("light_vs.glsl", GL_VERTEX_SHADER);
+        batchLightPrograms.addVariantSource("light_fs.glsl", GL_FRAGMENT_SHADER);
+        batchLightPrograms.addVariantSource("gbuffer_layer_fs.glsl", GL_FRAGMENT_SHADER);
     }
 
+    // the half resolution lights read the full resolution surface the same way, so they are permutations as well
+    lightDownsamplePrograms.setFeatures(kShaderFeatures, kShaderFeatureCount);
+    lightDownsamplePrograms.addVariantSource("global_light_vs.glsl", GL_VERTEX_SHADER);
+    lightDownsamplePrograms.addVariantSource("light_downsample_fs.glsl", GL_FRAGMENT_SHADER);
+    lightDownsamplePrograms.addVariantSource("gbuffer_fs.glsl", GL_FRAGMENT_SHADER);
+
+    lightUpsamplePrograms.setFeatures(kShaderFeatures, kShaderFeatureCount);
+    lightUpsamplePrograms.addVariantSource("global_light_vs.glsl", GL_VERTEX_SHADER);
+    lightUpsamplePrograms.addVariantSource("light_upsample_fs.glsl", GL_FRAGMENT_SHADER);
+    lightUpsamplePrograms.addVariantSource("gbuffer_fs.glsl", GL_FRAGMENT_SHADER);
+
     {
         Shader vs, fs;
-        vs.loadShader("light_vs.glsl", GL_VERTEX_SHADER);
-        fs.loadShader("light_fs.glsl", GL_FRAGMENT_SHADER);
+        vs.loadShader("global_light_vs.glsl", GL_VERTEX_SHADER);
+        fs.loadShader("edge_classify_fs.glsl", GL_FRAGMENT_SHADER);
 
-        lightProgram.createProgram();
-        lightProgram.addShaderToProgram(&vs);
-        lightProgram.addShaderToProgram(&fs);
-        lightProgram.linkProgram();
+        edgeClassifyProgram.createProgram();
+        edgeClassifyProgram.addShaderToProgram(&vs);
+        edgeClassifyProgram.addShaderToProgram(&fs);
+        glBindAttribLocation(edgeClassifyProgram.getProgramID(), 0, "vertex_position");
+        edgeClassifyProgram.linkProgram();
+    }
 
-        lightProgram.useProgram();
+    // as many samples as asked for, if the driver can do that many for float targets and depth
+    {
+        GLint maxSamples = 0, maxColourSamples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        glGetIntegerv(GL_MAX_COLOR_TEXTURE_SAMPLES, &maxColourSamples);
+        msaaSamples = std::min(kMsaaSamples, std::min(maxSamples, maxColourSamples));
+        glGenQueries(1, &msaaEdgeQuery);
     }
 
 	/*
@@ -114,44 +871,48 @@ windowViewWillStart(std::shared_ptr<tygra::Window> window)
 		postProcessProgram.useProgram();
 	}
 
-    /*
-    generate a map which contains the MaterialID as the key, which leads to the index inside of my vector that the material is contained
-    */
-    auto mapMaterialIndex = std::map<SceneModel::MaterialId, unsigned int>();
-
-    for (unsigned int i = 0; i < scene_->getAllMaterials().size(); ++i)
     {
-        mapMaterialIndex[scene_->getAllMaterials()[i].getId()] = materials.size();
+        Shader vs, fs;
+        vs.loadShader("shadow_vs.glsl", GL_VERTEX_SHADER);
+        fs.loadShader("shadow_fs.glsl", GL_FRAGMENT_SHADER);
 
-        MaterialData data;
-        data.colour = scene_->getAllMaterials()[i].getColour();
-        data.shininess = scene_->getAllMaterials()[i].getShininess();
-        materials.push_back(data);
-    }
+        shadowProgram.createProgram();
+        shadowProgram.addShaderToProgram(&vs);
+        shadowProgram.addShaderToProgram(&fs);
+        shadowProgram.linkProgram();
 
-    std::vector<SceneModel::Mesh> meshes = builder.getAllMeshes();
-    instanceData.resize(meshes.size());
+        shadowProgram.useProgram();
+    }
 
-    for (unsigned int i = 0; i < meshes.size(); ++i)
     {
+        Shader vs, fs;
+        vs.loadShader("paraboloid_vs.glsl", GL_VERTEX_SHADER);
+        fs.loadShader("paraboloid_fs.glsl", GL_FRAGMENT_SHADER);
 
-        std::vector<SceneModel::InstanceId> ids = scene_->getInstancesByMeshId(meshes[i].getId());
+        paraboloidProgram.createProgram();
+        paraboloidProgram.addShaderToProgram(&vs);
+        paraboloidProgram.addShaderToProgram(&fs);
+        paraboloidProgram.linkProgram();
 
-        for (unsigned int j = 0; j < ids.size(); ++j)
-        {
-            InstanceData instance;
-            instance.positionData = scene_->getInstanceById(ids[j]).getTransformationMatrix();
-            instance.materialDataIndex = static_cast<GLint>(mapMaterialIndex[scene_->getInstanceById(ids[j]).getMaterialId()]);
-            instanceData[i].push_back(instance);
+        paraboloidProgram.useProgram();
+    }
 
-        }
+    jobs.wait(instanceJob);
 
+    // same order as instanceData flattened, so the snapshot transforms line straight back up
+    std::vector<SceneModel::InstanceId> trackedIds;
+    for (unsigned int i = 0; i < meshes.size(); ++i)
+    {
+        trackedIds.insert(trackedIds.end(), meshInstanceIds[i].begin(), meshInstanceIds[i].end());
     }
+    simulation_->trackInstances(trackedIds);
 
     // setup material SSBO
     glGenBuffers(1, &bufferMaterials);
+    GpuMemory::track(GpuMemory::kBuffer, bufferMaterials, GpuMemory::kShaderStorage, "materials");
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferMaterials);
     glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(MaterialData)* materials.size(), &materials[0], GL_STREAM_DRAW);
+    GpuMemory::bufferStorage(bufferMaterials, sizeof(MaterialData)* materials.size());
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, bufferMaterials);
@@ -162,85 +923,49 @@ windowViewWillStart(std::shared_ptr<tygra::Window> window)
 
     // set up light SSBO
     glGenBuffers(1, &bufferRender);
+    GpuMemory::track(GpuMemory::kBuffer, bufferRender, GpuMemory::kShaderStorage, "render");
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferRender);
-    unsigned int size = sizeof(glm::mat4) + sizeof(glm::vec3); // since our buffer only has a projection matrix, camposition and single light source
+    // room for a view batch's cameras, the frame's own camera is the first of them
+    unsigned int size = ViewBatch::kMaxViews * ViewBatch::kViewStride;
     glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_STREAM_DRAW);
+    GpuMemory::bufferStorage(bufferRender, size);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-    // bind this buffer to both first pass program and light program since both require it
+    // bind this buffer to the first pass program, the lighting's permutations get it from their layout binding
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufferRender);
     glShaderStorageBlockBinding(
         firstPassProgram.getProgramID(),
         glGetUniformBlockIndex(firstPassProgram.getProgramID(), "BufferRender"),
         0);
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufferRender);
-    glShaderStorageBlockBinding(
-        lightProgram.getProgramID(),
-        glGetUniformBlockIndex(lightProgram.getProgramID(), "BufferRender"),
-        0);
-
-    //load scene meshes
+    // the scene's meshes have no geometry until they stream in, their instances are points till then
     std::vector<Vertex> vertices;
     std::vector< unsigned int > elements;
+    loadedMeshes.assign(meshes.size(), Mesh());
+    meshShape.resize(meshes.size());
+    meshShapeTransform.assign(meshes.size(), glm::mat4(1.f));
+    shapeVertices.resize(meshes.size());
+    shapeElements.resize(meshes.size());
     for (unsigned int i = 0; i < meshes.size(); ++i)
     {
-        Mesh mesh;
-        mesh.startVerticeIndex = vertices.size();
-        mesh.startElementIndex = elements.size();
-
-        // i store these temporarily since getPositionArray() will likely end up copying the whole array rather than passing the original
-        std::vector<glm::vec3> positionArray = meshes[i].getPositionArray();
-        std::vector<glm::vec3> normalArray = meshes[i].getNormalArray();
-
-        for (unsigned int j = 0; j < positionArray.size(); ++j)
-        {
-            vertices.push_back(Vertex(positionArray[j],
-                normalArray[j]));
-        }
-
-        // why is the element array a vector<InstanceId>?
-        std::vector<unsigned int> elementArray = meshes[i].getElementArray();
-        for (unsigned int j = 0; j < elementArray.size(); ++j)
-        {
-            elements.push_back(elementArray[j]);
-        }
-
-        mesh.endVerticeIndex = vertices.size() - 1;
-        mesh.endElementIndex = elements.size() - 1;
-        mesh.verticeCount = mesh.endVerticeIndex - mesh.startVerticeIndex;
-        mesh.element_count = mesh.endElementIndex - mesh.startElementIndex + 1;
-        loadedMeshes.push_back(mesh);
+        loadedMeshes[i].boundsMin = glm::vec3(0.f);
+        loadedMeshes[i].boundsMax = glm::vec3(0.f);
+        meshShape[i] = i;
     }
+    occlusionCuller.setGeometry(vertices, elements, loadedMeshes);
+    occlusionCuller.start();
 
-    // set up light mesh
+    // set up the light proxies, every one is drawn through the light mesh's vao
     {
-        tsl::IndexedMesh mesh;
-        tsl::CreateSphere(1.f, 12, &mesh);
-        tsl::ConvertPolygonsToTriangles(&mesh);
-
-        lightMesh.startVerticeIndex = vertices.size();
-        lightMesh.startElementIndex = elements.size();
-
-        for (unsigned int j = 0; j < mesh.vertex_array.size(); ++j)
-        {
-            vertices.push_back(Vertex(
-                ConvVec3(mesh.vertex_array[j]),
-                ConvVec3(mesh.normal_array[j])
-                ));
-        }
-
-        // why is the element array a vector<InstanceId>?
-        std::vector<int> elementArray = mesh.index_array;
-        for (unsigned int j = 0; j < elementArray.size(); ++j)
+        for (int i = 0; i < 3; ++i)
         {
-            elements.push_back(elementArray[j]);
+            const int proxy = LightCulling::kProxySphereHigh + i;
+            lightProxyScales[proxy] = AppendLightSphere(kLightSphereSegments[i], vertices, elements, lightProxyMeshes[proxy]);
         }
-
-        lightMesh.endVerticeIndex = vertices.size() - 1;
-        lightMesh.endElementIndex = elements.size() - 1;
-        lightMesh.verticeCount = lightMesh.endVerticeIndex - lightMesh.startVerticeIndex;
-        lightMesh.element_count = lightMesh.endElementIndex - lightMesh.startElementIndex + 1;
+        AppendLightQuad(vertices, elements, lightProxyMeshes[LightCulling::kProxyQuad]);
+        lightProxyMeshes[LightCulling::kProxyFullscreen] = lightProxyMeshes[LightCulling::kProxyQuad];
+        lightProxyScales[LightCulling::kProxyQuad] = 1.f;
+        lightProxyScales[LightCulling::kProxyFullscreen] = 1.f;
     }
 
 	// set up fullscreen quad
@@ -252,14 +977,17 @@ windowViewWillStart(std::shared_ptr<tygra::Window> window)
         vertices[3] = glm::vec2(-1, 1);
 
         glGenBuffers(1, &globalLightMesh.instanceVBO);
+        GpuMemory::track(GpuMemory::kBuffer, globalLightMesh.instanceVBO, GpuMemory::kGeometry, "fullscreen_quad");
         glBindBuffer(GL_ARRAY_BUFFER, globalLightMesh.instanceVBO);
         glBufferData(GL_ARRAY_BUFFER,
             vertices.size() * sizeof(glm::vec2),
             vertices.data(),
             GL_STATIC_DRAW);
+        GpuMemory::bufferStorage(globalLightMesh.instanceVBO, vertices.size() * sizeof(glm::vec2));
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
         glGenVertexArrays(1, &globalLightMesh.vao);
+        GpuMemory::track(GpuMemory::kVertexArray, globalLightMesh.vao, GpuMemory::kObjects, "fullscreen_quad");
         glBindVertexArray(globalLightMesh.vao);
         glBindBuffer(GL_ARRAY_BUFFER, globalLightMesh.instanceVBO);
         glEnableVertexAttribArray(0);
@@ -269,87 +997,81 @@ windowViewWillStart(std::shared_ptr<tygra::Window> window)
         glBindVertexArray(0);
     }
 
-    // set up vao
+    // set up vao, the buffers only hold the light proxies to begin with and grow as the scene streams in
     glGenBuffers(1, &vertexVBO);
+    GpuMemory::track(GpuMemory::kBuffer, vertexVBO, GpuMemory::kGeometry, "vertices");
     glBindBuffer(GL_ARRAY_BUFFER, vertexVBO);
     glBufferData(GL_ARRAY_BUFFER,
         vertices.size() * sizeof(Vertex),
         vertices.data(),
         GL_STATIC_DRAW);
+    GpuMemory::bufferStorage(vertexVBO, vertices.size() * sizeof(Vertex));
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     glGenBuffers(1, &elementVBO);
+    GpuMemory::track(GpuMemory::kBuffer, elementVBO, GpuMemory::kGeometry, "elements");
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
         elements.size() * sizeof(unsigned int),
         elements.data(),
         GL_STATIC_DRAW);
+    GpuMemory::bufferStorage(elementVBO, elements.size() * sizeof(unsigned int));
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
+    geometryVertexCount = geometryVertexCapacity = vertices.size();
+    geometryElementCount = geometryElementCapacity = elements.size();
+    streamingLoader.createStaging(kStreamingBudget);
+
     for (unsigned int i = 0; i < meshes.size(); ++i)
     {
         glGenBuffers(1, &loadedMeshes[i].instanceVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, loadedMeshes[i].instanceVBO);
-        glBufferData(GL_ARRAY_BUFFER,
-            instanceData[i].size() * sizeof(InstanceData),
-            instanceData[i].data(),
-            GL_STATIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-        unsigned int offset = 0;
-
-        glGenVertexArrays(1, &loadedMeshes[i].vao);
-        glBindVertexArray(loadedMeshes[i].vao);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexVBO);
-
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-            sizeof(Vertex), TGL_BUFFER_OFFSET(offset));
-        offset += sizeof(glm::vec3);
-
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-            sizeof(Vertex), TGL_BUFFER_OFFSET(offset));
-        offset += sizeof(glm::vec3);
+        GpuMemory::track(GpuMemory::kBuffer, loadedMeshes[i].instanceVBO, GpuMemory::kInstances, "mesh_instances");
+        loadedMeshes[i].vao = SetupMeshVAO(loadedMeshes[i].instanceVBO);
+    }
 
-        unsigned int instanceOffset = 0;
-        glBindBuffer(GL_ARRAY_BUFFER, loadedMeshes[i].instanceVBO);
+    // grows as needed, see UploadPackedInstances
+    glGenBuffers(1, &packedInstanceVBO);
+    GpuMemory::track(GpuMemory::kBuffer, packedInstanceVBO, GpuMemory::kInstances, "packed_instances");
 
-        for (int a = 2; a < 6; ++a)
-        {
-            glEnableVertexAttribArray(a);
-            glVertexAttribPointer(a, 3, GL_FLOAT, GL_FALSE,
-                sizeof(InstanceData), TGL_BUFFER_OFFSET(instanceOffset));
-            glVertexAttribDivisor(a, 1);
-            instanceOffset += sizeof(glm::vec3);
-        }
+    // filled by SetupVisibilityMeshes once every mesh is resident
+    {
+        visibilityTriangleBits = 0;
+        glGenBuffers(1, &visibilityMeshSSBO);
+        GpuMemory::track(GpuMemory::kBuffer, visibilityMeshSSBO, GpuMemory::kShaderStorage, "visibility_meshes");
 
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE,
-            sizeof(InstanceData), TGL_BUFFER_OFFSET(instanceOffset));
-        glVertexAttribDivisor(6, 1);
-        instanceOffset += sizeof(GLint);
+        // filled by RebuildInstances
+        glGenBuffers(1, &visibilityInstanceSSBO);
+        GpuMemory::track(GpuMemory::kBuffer, visibilityInstanceSSBO, GpuMemory::kShaderStorage, "visibility_instances");
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    for (unsigned int i = 0; i < meshes.size(); ++i)
+    {
+        loadedMeshes[i].packedVAO = SetupMeshVAO(packedInstanceVBO);
+    }
+    meshletVAO = SetupMeshVAO(packedInstanceVBO);
 
-        glBindVertexArray(0);
+    // filled as the meshes arrive
+    meshlets.clear();
+    meshletCuller.createBuffers();
 
-    }
+    // the scene's own instances are kept to one side so the stress scene can replace them and put them back
+    sceneInstanceData = instanceData;
+    RebuildInstances();
+    sceneSourceMin = sceneMin;
+    sceneSourceMax = sceneMax;
 
     // set up light vao since it uses a different channel layout
     {
         glGenBuffers(1, &lightMesh.instanceVBO);
+        GpuMemory::track(GpuMemory::kBuffer, lightMesh.instanceVBO, GpuMemory::kInstances, "light_instances");
         glBindBuffer(GL_ARRAY_BUFFER, lightMesh.instanceVBO);
-        glBufferData(GL_ARRAY_BUFFER,
-            lights.size() * sizeof(LightData),
-            lights.data(),
-            GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
         unsigned int offset = 0;
 
         glGenVertexArrays(1, &lightMesh.vao);
+        GpuMemory::track(GpuMemory::kVertexArray, lightMesh.vao, GpuMemory::kObjects, "light_mesh");
         glBindVertexArray(lightMesh.vao);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
         glBindBuffer(GL_ARRAY_BUFFER, vertexVBO);
@@ -379,22 +1101,30 @@ windowViewWillStart(std::shared_ptr<tygra::Window> window)
         glVertexAttribDivisor(3, 1);
         instanceOffset += sizeof(float);
 
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE,
+            sizeof(LightData), TGL_BUFFER_OFFSET(instanceOffset));
+        glVertexAttribDivisor(4, 1);
+        instanceOffset += sizeof(glm::vec4);
+
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
         glBindVertexArray(0);
 
     }
 
-    glGenFramebuffers(1, &gbufferFBO);
-    glGenRenderbuffers(1, &depthStencilRBO);
-    glGenTextures(3, gbufferTO);
-
-    glGenFramebuffers(1, &lbufferFBO);
-	glGenTextures(1, &lbufferTO);
-
-	glGenFramebuffers(1, &postProcessFBO);
-	glGenRenderbuffers(1, &postProcessColourRBO);
-
+    shadowCascades.createCascades(kShadowResolution);
+    pointShadowAtlas.createAtlas();
+    gpuTimer.createQueries();
+    cameraLatch.createBuffer();
+    latencyMeter.createQueries();
+
+    // enough for a few thousand visible lights before it has to grow
+    frameArena.reserve(1024 * 1024);
+    frameAllocations.allocations = 0;
+    frameAllocations.bytes = 0;
+    AllocationTracker::trackCurrentThread();
+    TraceCapture::nameCurrentThread("render");
 }
 
 void MyView::
@@ -405,370 +1135,2073 @@ int height)
     glViewport(0, 0, width, height);
     aspectRatio = static_cast<float>(width) / height;
 
+    // the targets are made again at the new size before the next frame draws
+    graphWidth = width;
+    graphHeight = height;
+    graphDirty = true;
+}
+
+void MyView::
+windowViewDidStop(std::shared_ptr<tygra::Window> window)
+{
+    occlusionCuller.stop();
+    streamingLoader.stop();
+    streamingLoader.deleteStaging();
+    streamingMesh = nullptr;
+    jobs.stop();
+
+    // the only place the render thread waits for the capture, so nothing in flight is lost
+    frameCapture.stop();
+
+    frameGraph.deleteObjects();
+    graphDirty = true;
+
+    DeleteBuffer(visibilityInstanceSSBO);
+    DeleteBuffer(visibilityMeshSSBO);
+
+    glDeleteQueries(1, &msaaEdgeQuery);
+    msaaEdgeQueryIssued = false;
+
+    shadowCascades.deleteCascades();
+    pointShadowAtlas.deleteAtlas();
+    gpuTimer.deleteQueries();
+    cameraLatch.deleteBuffer();
+    latencyMeter.deleteQueries();
+    DeleteBuffer(packedInstanceVBO);
+    meshletCuller.deleteBuffers();
+    DeleteVertexArray(meshletVAO);
+
+    for (unsigned int i = 0; i < loadedMeshes.size(); ++i)
     {
-        // gbuffer position texture
-        glBindTexture(GL_TEXTURE_RECTANGLE, gbufferTO[0]);
-        glTexImage2D(
-            GL_TEXTURE_RECTANGLE,
-            0,
-            GL_RGB32F,
-            width,
-            height,
-            0,
-            GL_RGB,
-            GL_FLOAT,
-            NULL
-            );
-        glBindTexture(GL_TEXTURE_RECTANGLE, 0);
-
-        // gbuffer normal texture
-        glBindTexture(GL_TEXTURE_RECTANGLE, gbufferTO[1]);
-        glTexImage2D(
-            GL_TEXTURE_RECTANGLE,
-            0,
-            GL_RGB32F,
-            width,
-            height,
-            0,
-            GL_RGB,
-            GL_FLOAT,
-            NULL
-            );
-        glBindTexture(GL_TEXTURE_RECTANGLE, 0);
-
-        // gbuffer material texture
-        glBindTexture(GL_TEXTURE_RECTANGLE, gbufferTO[2]);
-        glTexImage2D(
-            GL_TEXTURE_RECTANGLE,
-            0,
-            GL_RGBA32F,
-            width,
-            height,
-            0,
-            GL_RGBA,
-            GL_FLOAT,
-            NULL
-            );
-        glBindTexture(GL_TEXTURE_RECTANGLE, 0);
-
-        // gbuffer depth stencil buffer
-        glBindRenderbuffer(GL_RENDERBUFFER, depthStencilRBO);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
-        glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-        GLenum gbuffer_status = 0;
-        glBindFramebuffer(GL_FRAMEBUFFER, gbufferFBO);
-
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencilRBO); // attach depth stencil buffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_RECTANGLE, gbufferTO[0], 0); // attach position buffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_RECTANGLE, gbufferTO[1], 0); // attach normal buffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_RECTANGLE, gbufferTO[2], 0); // attach material buffer
-
-        gbuffer_status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-        if (gbuffer_status != GL_FRAMEBUFFER_COMPLETE)
-        {
-            tglDebugMessage(GL_DEBUG_SEVERITY_HIGH, "gbuffer not complete");
-        }
-
-        GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-        glDrawBuffers(3, buffers);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    }
-
-    {
-		//TODO: need to change to normal texture2D?
-		// So that we can do a post process effect, we draw into a texture again
-		glBindTexture(GL_TEXTURE_RECTANGLE, lbufferTO);
-		glTexImage2D(
-			GL_TEXTURE_RECTANGLE,
-			0,
-			GL_RGBA32F,
-			width,
-			height,
-			0,
-			GL_RGBA,
-			GL_FLOAT,
-			NULL
-			);
-		glBindTexture(GL_TEXTURE_RECTANGLE, 0);
-
-        GLenum lbuffer_status = 0;
-        glBindFramebuffer(GL_FRAMEBUFFER, lbufferFBO);
-
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_RECTANGLE, lbufferTO, 0); // attach position buffer
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencilRBO); // attach depth stencil buffer
-
-        lbuffer_status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-        if (lbuffer_status != GL_FRAMEBUFFER_COMPLETE)
-        {
-            tglDebugMessage(GL_DEBUG_SEVERITY_HIGH, "lbuffer not complete");
-        }
-
-        GLenum buffers[] = { GL_COLOR_ATTACHMENT0 };
-        glDrawBuffers(1, buffers);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        DeleteVertexArray(loadedMeshes[i].vao);
+        DeleteVertexArray(loadedMeshes[i].packedVAO);
+        DeleteBuffer(loadedMeshes[i].instanceVBO);
     }
+    DeleteVertexArray(lightMesh.vao);
+    DeleteBuffer(lightMesh.instanceVBO);
+    DeleteVertexArray(globalLightMesh.vao);
+    DeleteBuffer(globalLightMesh.instanceVBO);
+
+    DeleteBuffer(vertexVBO);
+    DeleteBuffer(elementVBO);
+    DeleteBuffer(bufferMaterials);
+    DeleteBuffer(bufferRender);
+    viewBatch.deleteTargets();
+
+    firstPassProgram.deleteProgram();
+    visibilityProgram.deleteProgram();
+    backgroundProgram.deleteProgram();
+    globalLightPrograms.deleteProgram();
+    lightPrograms.deleteProgram();
+    lightDownsamplePrograms.deleteProgram();
+    lightUpsamplePrograms.deleteProgram();
+    batchGeometryProgram.deleteProgram();
+    batchGlobalLightPrograms.deleteProgram();
+    batchLightPrograms.deleteProgram();
+    edgeClassifyProgram.deleteProgram();
+    meshletCullProgram.deleteProgram();
+    postProcessProgram.deleteProgram();
+    shadowProgram.deleteProgram();
+    paraboloidProgram.deleteProgram();
+
+    // anything still registered here was created without a matching delete above
+    GpuMemory::reportLeaks(std::cerr);
+}
 
-	{
-		// pbuffer colour buffer
-		glBindRenderbuffer(GL_RENDERBUFFER, postProcessColourRBO);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGB32F, width, height);
-		glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-		GLenum pbuffer_status = 0;
-		glBindFramebuffer(GL_FRAMEBUFFER, postProcessFBO);
+void MyView::
+windowViewRender(std::shared_ptr<tygra::Window> window)
+{
+    assert(simulation_ != nullptr);
 
-		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, postProcessColourRBO); // attach colour buffer
+    AllocationTracker::beginFrame();
+    frameArena.reset();
 
-		pbuffer_status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-		if (pbuffer_status != GL_FRAMEBUFFER_COMPLETE)
-		{
-			tglDebugMessage(GL_DEBUG_SEVERITY_HIGH, "pbuffer not complete");
-		}
+    gpuTimer.beginFrame();
+    if (TraceCapture::beginFrame())
+    {
+        TraceCapture::setGpuClock(gpuTimer.measureClockOffset(), gpuTimer.getCurrentFrame());
+    }
+    TraceCapture::recordGpuPasses(gpuTimer);
+    TRACE_SCOPE("render");
 
-		GLenum buffers[] = { GL_COLOR_ATTACHMENT0 };
-		glDrawBuffers(1, buffers);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	}
-}
+    // whatever the simulation finished last, it wont change under us while we draw
+    {
+        TRACE_SCOPE("acquire_snapshot");
+        snapshot = &simulation_->acquireSnapshot();
+        frameCameraTick = snapshot->tick;
+        frameLatched = false;
 
-void MyView::
-windowViewDidStop(std::shared_ptr<tygra::Window> window)
-{
+        if (snapshot->instanceVersion != appliedInstanceVersion)
+        {
+            ApplySnapshotInstances();
+        }
 
-    glDeleteFramebuffers(1, &gbufferFBO);
-    glDeleteRenderbuffers(1, &depthStencilRBO);
-    glDeleteTextures(3, gbufferTO);
+        // needs the snapshot's camera, and rebuilds the instances when meshes arrive
+        if (!streamingLoader.isComplete())
+        {
+            StreamGeometry();
+        }
 
-    glDeleteFramebuffers(1, &lbufferFBO);
-	glDeleteTextures(1, &lbufferTO);
+        if (stressDirty)
+        {
+            ApplyStressScene();
+        }
+    }
 
-	glDeleteFramebuffers(1, &postProcessFBO);
-	glDeleteRenderbuffers(1, &postProcessColourRBO);
+    const bool msaa = msaaEnabled && msaaSamples > 1;
+    const bool visibility = visibilityBufferEnabled && visibilityBufferFits && !msaa && streamingLoader.isComplete();
+    const bool halfLights = halfResolutionLights && !msaa;
+    if (captureEnabled && !frameCapture.isRunning())
+    {
+        frameCapture.start(kCapturePrefix);
+    }
+    if (graphDirty || msaa != graphMsaa || visibility != graphVisibility || halfLights != graphHalfLights
+        || captureEnabled != graphCapture || incrementalRendering != graphIncremental)
+    {
+        BuildFrameGraph(msaa, visibility, halfLights, captureEnabled, incrementalRendering);
+    }
 
-}
+    GatherLights(snapshot->lights, stressScene.getLights(), stressScene.getConfig().replaceSceneLights, allLights);
+    const FrameKind frameKind = ClassifyFrame();
 
-void MyView::
-windowViewRender(std::shared_ptr<tygra::Window> window)
-{
-    assert(scene_ != nullptr);
     GLint viewport_size[4];
     glGetIntegerv(GL_VIEWPORT, viewport_size);
 
-    glm::mat4 projectionMatrix = glm::perspective(75.f, aspectRatio, 1.f, 1000.f);
-    glm::mat4 viewMatrix = glm::lookAt(scene_->getCamera().getPosition(), scene_->getCamera().getDirection() + scene_->getCamera().getPosition(), glm::vec3(0, 1, 0));
-    glm::mat4 projectionViewMatrix = projectionMatrix * viewMatrix;
-
-    SetBuffer(projectionViewMatrix, scene_->getCamera().getPosition());
-
-    // set up the depth and stencil buffers, we are not writing to the onscreen framebuffer, we are filling the relevant data for the light render
+    if (frameKind == kFrameSkipped)
     {
-        firstPassProgram.useProgram();
-        glBindFramebuffer(GL_FRAMEBUFFER, gbufferFBO);
+        // only the present and the capture, from what the last frame left in the post process target
+        frameGraph.execute(gpuTimer, kPassGroupGeometry | kPassGroupLighting);
+    }
+    else
+    {
+        glm::mat4 projectionMatrix = glm::perspective(kFieldOfView, aspectRatio, kNearPlane, kFarPlane);
+        glm::mat4 viewMatrix = glm::lookAt(snapshot->cameraPosition, snapshot->cameraDirection + snapshot->cameraPosition, glm::vec3(0, 1, 0));
+        glm::mat4 projectionViewMatrix = projectionMatrix * viewMatrix;
+
+        SetBuffer(projectionViewMatrix, snapshot->cameraPosition);
 
-		glClearColor(0.f, 0.f, 0.25f, 0.f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT); // clear all 3 buffers
+        packedInstances.clear();
+        packedInstancesUploaded = 0;
 
-        glEnable(GL_DEPTH_TEST);
-        glDepthMask(GL_TRUE);
+        // kicked off first so the culler's threads run alongside the shadow passes, only the gbuffer finishes it.
+        // the gbuffer may be drawn with a newer camera than this, so the frustum is a little wider than what is drawn
+        if (frameKind == kFrameFull)
+        {
+            if (lateLatchEnabled)
+            {
+                const glm::mat4 cullProjection = glm::perspective(kFieldOfView + kLateLatchCullMargin, aspectRatio, kNearPlane, kFarPlane);
+                CullInstances(cullProjection * viewMatrix);
+            }
+            else
+            {
+                CullInstances(projectionViewMatrix);
+            }
+        }
 
-        // not using these so disable them
-        glDisable(GL_BLEND);
+        if (shadowsEnabled)
+        {
+            gpuTimer.beginPass("shadows");
+            RenderShadows(viewMatrix);
+            gpuTimer.endPass();
+        }
 
-        glEnable(GL_STENCIL_TEST);
-        glStencilFunc(GL_ALWAYS, 127, ~0); // we are writing 1 to all pixels that the geometry draws into
-        glStencilOp(GL_ZERO, GL_KEEP, GL_REPLACE);
+        // fills in the light data (and draws any point shadow maps) ahead of the gbuffer, the light pass only draws
+        UpdateLights(projectionMatrix, projectionViewMatrix, snapshot->cameraPosition, static_cast<float>(viewport_size[3]));
+        glViewport(viewport_size[0], viewport_size[1], viewport_size[2], viewport_size[3]);
 
-        // the lights are tagged onto the end of the meshes
-        for (unsigned int i = 0; i < loadedMeshes.size(); ++i)
+        if (visibility && frameKind == kFrameFull)
         {
-            glBindVertexArray(loadedMeshes[i].vao);
-            glDrawElementsInstancedBaseVertex(GL_TRIANGLES,
-                loadedMeshes[i].element_count,
-                GL_UNSIGNED_INT,
-                TGL_BUFFER_OFFSET(loadedMeshes[i].startElementIndex * sizeof(int)),
-                instanceData[i].size(),
-                loadedMeshes[i].startVerticeIndex);
+            // the visibility buffer draws every instance, the culler still has to be finished before the next frame
+            visibleInstances.clear();
+            occlusionCuller.finish(visibleInstances);
         }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        frameProjectionView = projectionViewMatrix;
+        frameCameraPosition = snapshot->cameraPosition;
+        frameGraph.execute(gpuTimer, frameKind == kFrameLighting ? kPassGroupGeometry : 0);
     }
 
-	// shade background as scool of computing purple
-	{
-		backgroundProgram.useProgram();
-		glBindFramebuffer(GL_FRAMEBUFFER, lbufferFBO);
+    // hands the readbacks that have landed to the capture's threads, and takes back the ones they have written
+    frameCapture.update();
 
-		glClearColor(0.f, 0.f, 0.25f, 0.f);
-		glClear(GL_COLOR_BUFFER_BIT); // clear all 3 buffers
+    // the benchmark asks for its probes before they are drawn, and picks up their times from earlier frames
+    UpdateViewBatchBenchmark();
+    if (batchRequested)
+    {
+        batchRequested = false;
+        gpuTimer.beginPass("view_batch");
+        RenderViewBatch();
+        gpuTimer.endPass();
+        glViewport(viewport_size[0], viewport_size[1], viewport_size[2], viewport_size[3]);
+    }
 
-		glDisable(GL_DEPTH_TEST); // disable depth test snce we are drawing a full screen quad
-		glDisable(GL_BLEND);
+    // the input the frame shows for the first time, asked for every frame so none of it is left to go stale
+    latencyMeter.endFrame(simulation_->takeInputTime(frameCameraTick));
 
-		glEnable(GL_STENCIL_TEST);
-		glStencilFunc(GL_EQUAL, 0, ~0); // equal to background
-		glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    gpuTimer.endFrame();
+    streamingLoader.frameRendered();
 
-		// draw directional light
-		glBindVertexArray(globalLightMesh.vao);
-		glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-	}
+    frameAllocations = AllocationTracker::getFrameCounts();
+    TraceCapture::endFrame();
 
-	// global lights
-	{
-        globalLightProgram.useProgram();
-        glBindFramebuffer(GL_FRAMEBUFFER, lbufferFBO);
+}
 
-        glDisable(GL_DEPTH_TEST); // disable depth test snce we are drawing a full screen quad
-        glDisable(GL_BLEND);
+void MyView::SetBuffer(glm::mat4 projectMat_, glm::vec3 camPos_)
+{
+    TRACE_SCOPE("set_buffer");
+    PackRenderBuffer(projectMat_, camPos_, bufferRender, frameArena, uploadSink);
+}
 
-        glEnable(GL_STENCIL_TEST);
-        glStencilFunc(GL_NOTEQUAL, 0, ~0);
-        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+GLuint MyView::SetupMeshVAO(GLuint instanceVBO_)
+{
+    GLuint vao;
+    unsigned int offset = 0;
 
-		// could remove the glGetUniformLocation, but again, being lazy and fps is still around 100 - 105
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_RECTANGLE, gbufferTO[0]);
-        glUniform1i(glGetUniformLocation(globalLightProgram.getProgramID(), "sampler_world_position"), 0);
+    glGenVertexArrays(1, &vao);
+    GpuMemory::track(GpuMemory::kVertexArray, vao, GpuMemory::kObjects, "mesh");
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexVBO);
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_RECTANGLE, gbufferTO[1]);
-        glUniform1i(glGetUniformLocation(globalLightProgram.getProgramID(), "sampler_world_normal"), 1);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
+        sizeof(Vertex), TGL_BUFFER_OFFSET(offset));
+    offset += sizeof(glm::vec3);
 
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_RECTANGLE, gbufferTO[2]);
-        glUniform1i(glGetUniformLocation(globalLightProgram.getProgramID(), "sampler_world_mat"), 2);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
+        sizeof(Vertex), TGL_BUFFER_OFFSET(offset));
+    offset += sizeof(glm::vec3);
 
-		// since there are only 2 vecs to pass, im being lazy and doing it this way
-        glUniform3fv(glGetUniformLocation(globalLightProgram.getProgramID(), "directional_light"), 1, glm::value_ptr(scene_->getGlobalLightDirection()));
-        glUniform3fv(glGetUniformLocation(globalLightProgram.getProgramID(), "light_intensity"), 1, glm::value_ptr(scene_->getGlobalLightIntensity()));
+    unsigned int instanceOffset = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO_);
 
-        // draw directional light
-        glBindVertexArray(globalLightMesh.vao);
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-	}
+    for (int a = 2; a < 6; ++a)
+    {
+        glEnableVertexAttribArray(a);
+        glVertexAttribPointer(a, 3, GL_FLOAT, GL_FALSE,
+            sizeof(InstanceData), TGL_BUFFER_OFFSET(instanceOffset));
+        glVertexAttribDivisor(a, 1);
+        instanceOffset += sizeof(glm::vec3);
+    }
+
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE,
+        sizeof(InstanceData), TGL_BUFFER_OFFSET(instanceOffset));
+    glVertexAttribDivisor(6, 1);
+    instanceOffset += sizeof(GLint);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(0);
 
-    // lets draw the lights
+    return vao;
+}
+
+void MyView::StreamGeometry()
+{
+    TRACE_SCOPE("stream_geometry");
+
+    // whichever meshes have an instance nearest the camera are decoded and copied first
+    for (unsigned int i = 0; i < sceneInstanceData.size(); ++i)
     {
-        lightProgram.useProgram();
-        
-		// additive blending
-		glEnable(GL_BLEND);
-        glBlendEquation(GL_FUNC_ADD);
-        glBlendFunc(GL_ONE, GL_ONE);
+        float nearest = FLT_MAX;
+        for (unsigned int j = 0; j < sceneInstanceData[i].size(); ++j)
+        {
+            nearest = std::min(nearest, glm::distance(sceneInstanceData[i][j].positionData[3], snapshot->cameraPosition));
+        }
+        meshPriorities[i] = nearest;
+    }
+    streamingLoader.setPriorities(meshPriorities);
 
-        glEnable(GL_DEPTH_TEST);// enable the depth test for use with lights
-        glDepthMask(GL_FALSE);// disable depth writes since we dont want the lights to mess with the depth buffer
-        glDepthFunc(GL_GREATER);// set the depth test to check for in front of the back fragments so that we can light correctly
+    arrivedMeshes.clear();
+    streamingLoader.beginFrame();
+    while (streamingLoader.hasBudget())
+    {
+        if (streamingMesh == nullptr)
+        {
+            streamingMesh = streamingLoader.takeMesh();
+            if (streamingMesh == nullptr)
+            {
+                break;
+            }
+            if (ShareStreamedMesh(*streamingMesh))
+            {
+                // its instances are drawn as the owner's
+                arrivedMeshes.push_back(meshShape[streamingMesh->mesh]);
+                streamingLoader.skip(*streamingMesh);
+                streamingLoader.releaseMesh(*streamingMesh);
+                streamingMesh = nullptr;
+                continue;
+            }
+            PlaceStreamedMesh(*streamingMesh);
+        }
 
-        glEnable(GL_CULL_FACE); // enable the culling (not on by default)
-        glCullFace(GL_FRONT); // set to cull forward facing fragments
+        Mesh& mesh = loadedMeshes[streamingMesh->mesh];
+        if (!streamingLoader.upload(*streamingMesh,
+            vertexVBO, mesh.startVerticeIndex * sizeof(Vertex),
+            elementVBO, mesh.startElementIndex * sizeof(unsigned int)))
+        {
+            break;
+        }
 
-        glEnable(GL_STENCIL_TEST);
-        glStencilFunc(GL_NOTEQUAL, 0, ~0); // background is set to 0, we want the geometry pixels
-        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        // the copies go in at the end of the loop, before anything this frame draws with them
+        mesh.boundsMin = streamingMesh->boundsMin;
+        mesh.boundsMax = streamingMesh->boundsMax;
+        mesh.resident = true;
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_RECTANGLE, gbufferTO[0]);
-        glUniform1i(glGetUniformLocation(lightProgram.getProgramID(), "sampler_world_position"), 0);
+        mesh.firstMeshlet = meshlets.size();
+        mesh.meshletCount = streamingMesh->meshlets.size();
+        for (unsigned int m = 0; m < streamingMesh->meshlets.size(); ++m)
+        {
+            meshlets.push_back(streamingMesh->meshlets[m]);
+            meshlets.back().firstElement += mesh.startElementIndex;
+        }
+        occlusionCuller.addMesh(streamingMesh->mesh, streamingMesh->vertices, streamingMesh->elements);
+        shapeOwners.insert(std::make_pair(streamingMesh->topologyHash, streamingMesh->mesh));
+        shapeVertices[streamingMesh->mesh] = streamingMesh->vertices;
+        shapeElements[streamingMesh->mesh] = streamingMesh->elements;
+        arrivedMeshes.push_back(streamingMesh->mesh);
+        streamingLoader.releaseMesh(*streamingMesh);
+        streamingMesh = nullptr;
+    }
+    streamingLoader.endFrame();
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_RECTANGLE, gbufferTO[1]);
-        glUniform1i(glGetUniformLocation(lightProgram.getProgramID(), "sampler_world_normal"), 1);
+    if (arrivedMeshes.empty())
+    {
+        return;
+    }
 
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_RECTANGLE, gbufferTO[2]);
-        glUniform1i(glGetUniformLocation(lightProgram.getProgramID(), "sampler_world_mat"), 2);
+    meshletCuller.setMeshlets(meshlets);
 
-		UpdateLights();
+    if (streamingLoader.isComplete())
+    {
+        SetupVisibilityMeshes();
+
+        // the stress scene spreads its copies over the real bounds of the scene, not its instances' origins
+        instanceData = sceneInstanceData;
+        CollapseSharedMeshes(instanceData);
+        RebuildInstances();
+        sceneSourceMin = sceneMin;
+        sceneSourceMax = sceneMax;
+
+        // nothing else can arrive to be matched against them
+        shapeOwners.clear();
+        std::vector< std::vector< Vertex > >().swap(shapeVertices);
+        std::vector< std::vector< unsigned int > >().swap(shapeElements);
+
+        const StreamingLoader::Stats& streamingStats = streamingLoader.getStats();
+        std::cout << "scene fully resident after " << streamingStats.residentMilliseconds << "ms"
+            << ", first frame was after " << streamingStats.firstFrameMilliseconds << "ms" << std::endl;
+        std::cout << "geometry dedup: " << dedupWeldedVertices << " vertices welded, "
+            << dedupSharedMeshes << " meshes share another's geometry"
+            << ", saved " << (dedupWeldedVertices * sizeof(Vertex) + dedupSharedBytes) / 1024 << "KB"
+            << ", draws " << dedupDrawsBefore << " -> " << dedupDrawsAfter << std::endl;
+
+        // once, now the bounds are final. the stress scene is laid out again and every cached shadow drawn again
+        stressDirty = true;
+        return;
+    }
 
-        // instance draw the lights woop woop
-        glBindVertexArray(lightMesh.vao);
-        glDrawElementsInstancedBaseVertex(GL_TRIANGLES,
-            lightMesh.element_count,
-            GL_UNSIGNED_INT,
-            TGL_BUFFER_OFFSET(lightMesh.startElementIndex * sizeof(int)),
-            lights.size(),
-            lightMesh.startVerticeIndex);
+    // the instances of the new meshes have real bounds now. the stress lights stay where they are until streaming
+    // finishes, and only the shadows that reach the new instances are drawn again
+    BuildInstanceData();
+    RebuildInstances();
+    for (unsigned int a = 0; a < arrivedMeshes.size(); ++a)
+    {
+        const unsigned int mesh = arrivedMeshes[a];
+        for (unsigned int instance = instanceBase[mesh]; instance < instanceBase[mesh + 1]; ++instance)
+        {
+            const InstanceBounds& bounds = instanceBounds[instance];
+            shadowCascades.markDynamicBox(bounds.min, bounds.max);
+            pointShadowAtlas.invalidateSphere(bounds.centre, bounds.radius);
+        }
+    }
+    fullFrameNeeded = true;
+}
 
-        glDisable(GL_STENCIL_TEST);
-        glDepthMask(GL_TRUE);
-        glDepthFunc(GL_LEQUAL);
+void MyView::PlaceStreamedMesh(const StreamingLoader::DecodedMesh& decoded_)
+{
+    const unsigned int vertexCount = decoded_.vertices.size();
+    const unsigned int elementCount = decoded_.elements.size();
 
-        glDisable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
+    // doubling keeps the number of times the buffers are copied down to a handful
+    if (geometryVertexCount + vertexCount > geometryVertexCapacity)
+    {
+        const unsigned int capacity = std::max(geometryVertexCount + vertexCount, geometryVertexCapacity * 2);
+        GrowBuffer(vertexVBO, geometryVertexCount * sizeof(Vertex), capacity * sizeof(Vertex));
+        geometryVertexCapacity = capacity;
+    }
+    if (geometryElementCount + elementCount > geometryElementCapacity)
+    {
+        const unsigned int capacity = std::max(geometryElementCount + elementCount, geometryElementCapacity * 2);
+        GrowBuffer(elementVBO, geometryElementCount * sizeof(unsigned int), capacity * sizeof(unsigned int));
+        geometryElementCapacity = capacity;
     }
 
-	// post process shenanigans
-	{
-		postProcessProgram.useProgram();
-		glBindFramebuffer(GL_FRAMEBUFFER, postProcessFBO);
+    // same layout AssembleGeometry gives
+    Mesh& mesh = loadedMeshes[decoded_.mesh];
+    mesh.startVerticeIndex = geometryVertexCount;
+    mesh.startElementIndex = geometryElementCount;
+    mesh.endVerticeIndex = mesh.startVerticeIndex + vertexCount - 1;
+    mesh.endElementIndex = mesh.startElementIndex + elementCount - 1;
+    mesh.verticeCount = mesh.endVerticeIndex - mesh.startVerticeIndex;
+    mesh.element_count = elementCount;
+
+    geometryVertexCount += vertexCount;
+    geometryElementCount += elementCount;
+}
 
-		glClearColor(0.f, 0.f, 0.25f, 0.f);
-		glClear(GL_COLOR_BUFFER_BIT); // clear all 3 buffers
+bool MyView::ShareStreamedMesh(const StreamingLoader::DecodedMesh& decoded_)
+{
+    TRACE_SCOPE("share_streamed_mesh");
 
-		glDisable(GL_BLEND); // disable blending
+    dedupWeldedVertices += decoded_.weldedVertices;
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_RECTANGLE, lbufferTO);
-		glUniform1i(glGetUniformLocation(postProcessProgram.getProgramID(), "sampler_world_position"), 0);
+    // the hash only finds the candidates, their elements have to be the same and then the vertices decide it
+    auto owners = shapeOwners.equal_range(decoded_.topologyHash);
+    for (auto owner = owners.first; owner != owners.second; ++owner)
+    {
+        const std::vector< unsigned int >& elements = shapeElements[owner->second];
+        if (elements.size() != decoded_.elements.size()
+            || (!elements.empty() && std::memcmp(&elements[0], &decoded_.elements[0], elements.size() * sizeof(unsigned int)) != 0))
+        {
+            continue;
+        }
 
-		glBindVertexArray(globalLightMesh.vao);
-		glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-	}
-    
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, postProcessFBO);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-    glBlitFramebuffer(0, 0, viewport_size[2], viewport_size[3], 0, 0, viewport_size[2], viewport_size[3], GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glm::mat4 transform;
+        if (!MatchMeshGeometry(shapeVertices[owner->second], decoded_.vertices, transform))
+        {
+            continue;
+        }
+
+        // its own bounds are only kept for the instances it had, they all draw through the owner's now
+        const Mesh& source = loadedMeshes[owner->second];
+        Mesh& mesh = loadedMeshes[decoded_.mesh];
+        mesh.startVerticeIndex = source.startVerticeIndex;
+        mesh.endVerticeIndex = source.endVerticeIndex;
+        mesh.verticeCount = source.verticeCount;
+        mesh.startElementIndex = source.startElementIndex;
+        mesh.endElementIndex = source.endElementIndex;
+        mesh.element_count = source.element_count;
+        mesh.firstMeshlet = source.firstMeshlet;
+        mesh.meshletCount = source.meshletCount;
+        mesh.boundsMin = decoded_.boundsMin;
+        mesh.boundsMax = decoded_.boundsMax;
+        mesh.resident = true;
+
+        meshShape[decoded_.mesh] = owner->second;
+        meshShapeTransform[decoded_.mesh] = transform;
+        ++dedupSharedMeshes;
+        dedupSharedBytes += decoded_.vertices.size() * sizeof(Vertex)
+            + decoded_.elements.size() * sizeof(unsigned int)
+            + decoded_.meshlets.size() * sizeof(Meshlet);
+        return true;
+    }
+    return false;
+}
+
+void MyView::CollapseSharedMeshes(std::vector< std::vector< InstanceData > >& instances_)
+{
+    dedupDrawsBefore = 0;
+    dedupDrawsAfter = 0;
+    for (unsigned int i = 0; i < instances_.size(); ++i)
+    {
+        dedupDrawsBefore += instances_[i].empty() ? 0 : 1;
+    }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0); // unbind the framebuffers
+    // an instance of a shared mesh is an instance of its owner with the shared mesh's transform on the inside
+    for (unsigned int i = 0; i < instances_.size(); ++i)
+    {
+        if (meshShape[i] == i || instances_[i].empty())
+        {
+            continue;
+        }
+        std::vector< InstanceData >& owner = instances_[meshShape[i]];
+        for (unsigned int j = 0; j < instances_[i].size(); ++j)
+        {
+            InstanceData instance = instances_[i][j];
+            instance.positionData = glm::mat4x3(glm::mat4(instance.positionData) * meshShapeTransform[i]);
+            owner.push_back(instance);
+        }
+        instances_[i].clear();
+    }
 
+    for (unsigned int i = 0; i < instances_.size(); ++i)
+    {
+        dedupDrawsAfter += instances_[i].empty() ? 0 : 1;
+    }
 }
 
-void MyView::SetBuffer(glm::mat4 projectMat_, glm::vec3 camPos_)
+void MyView::SetupVisibilityMeshes()
+{
+    // the visibility ids have to hold the biggest mesh's triangle count, whatever is left over is for the instance
+    unsigned int maxTriangles = 1;
+    std::vector<glm::ivec4> meshInfo(loadedMeshes.size());
+    for (unsigned int i = 0; i < loadedMeshes.size(); ++i)
+    {
+        maxTriangles = std::max(maxTriangles, static_cast<unsigned int>(loadedMeshes[i].element_count / 3));
+        meshInfo[i] = glm::ivec4(loadedMeshes[i].startElementIndex, loadedMeshes[i].startVerticeIndex, 0, 0);
+    }
+    visibilityTriangleBits = 1;
+    while ((1u << visibilityTriangleBits) < maxTriangles)
+    {
+        ++visibilityTriangleBits;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityMeshSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, meshInfo.size() * sizeof(glm::ivec4), meshInfo.data(), GL_STATIC_DRAW);
+    GpuMemory::bufferStorage(visibilityMeshSSBO, meshInfo.size() * sizeof(glm::ivec4));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void MyView::CullInstances(const glm::mat4& projectViewMat_)
 {
-    // so since glMapBufferRange does not work, i am going to create a temporary buffer for the per model data, and then copy the full buffer straight into the shaders buffer
-    unsigned int bufferSize = sizeof(projectMat_)+sizeof(camPos_);
-    char* buffer = new char[bufferSize];
-    unsigned int index = 0;
+    TRACE_SCOPE("cull_instances");
+    glm::vec4 planes[6];
+    InstanceBvh::extractFrustumPlanes(projectViewMat_, planes);
+    cameraInstances.clear();
+    instanceBvh.queryFrustum(planes, 6, cameraInstances);
+
+    occluders.clear();
+    if (occlusionEnabled)
+    {
+        SelectOccluders();
+    }
+    occlusionCuller.cull(projectViewMat_, occluders, instanceBounds, cameraInstances);
+}
 
-    //projection matrix first!
-    memcpy(buffer + index, glm::value_ptr(projectMat_), sizeof(glm::mat4));
-    index += sizeof(projectMat_);
+void MyView::SelectOccluders()
+{
+    occluderScores.clear();
+    for (unsigned int i = 0; i < cameraInstances.size(); ++i)
+    {
+        const unsigned int instance = cameraInstances[i];
+        const unsigned int mesh = std::upper_bound(instanceBase.begin(), instanceBase.end(), instance) - instanceBase.begin() - 1;
+        if (!occlusionCuller.isOccluderMesh(mesh))
+        {
+            continue;
+        }
 
-    // camera position next!
-    memcpy(buffer + index, glm::value_ptr(camPos_), sizeof(camPos_));
+        const InstanceBounds& bounds = instanceBounds[instance];
+        const float distance = std::max(glm::distance(bounds.centre, snapshot->cameraPosition), kNearPlane);
+        const float size = bounds.radius / distance;
+        if (size >= kMinOccluderSize)
+        {
+            occluderScores.push_back(std::make_pair(size, instance));
+        }
+    }
 
-    // update the render buffer, so get the pointer!
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferRender);
-    GLvoid* p = glMapBuffer(GL_SHADER_STORAGE_BUFFER, GL_WRITE_ONLY);
-    memcpy(p, buffer, bufferSize);
-    //done
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    // biggest first until the budget runs out
+    std::sort(occluderScores.begin(), occluderScores.end(), std::greater< std::pair<float, unsigned int> >());
+    unsigned int triangles = 0;
+    for (unsigned int i = 0; i < occluderScores.size(); ++i)
+    {
+        const unsigned int instance = occluderScores[i].second;
+        const unsigned int mesh = std::upper_bound(instanceBase.begin(), instanceBase.end(), instance) - instanceBase.begin() - 1;
+        triangles += occlusionCuller.getTriangleCount(mesh);
+        if (triangles > kOccluderTriangleBudget && !occluders.empty())
+        {
+            break;
+        }
 
-    delete[] buffer;
+        OcclusionCuller::Occluder occluder;
+        occluder.mesh = mesh;
+        occluder.transform = instanceData[mesh][instance - instanceBase[mesh]].positionData;
+        occluders.push_back(occluder);
+    }
 }
 
-void MyView::UpdateLights()
+void MyView::BuildFrameGraph(bool msaa_, bool visibility_, bool halfLights_, bool capture_, bool incremental_)
 {
-	std::vector<SceneModel::Light> sceneLights = scene_->getAllLights();
-	lights.resize(sceneLights.size());
-	for (unsigned int i = 0; i < scene_->getAllLights().size(); ++i)
-	{
-		LightData light;
-		light.position = sceneLights[i].getPosition();
-		light.range = sceneLights[i].getRange();
-		lights[i] = light;
-	}
+    TRACE_SCOPE("build_frame_graph");
+    graphMsaa = msaa_;
+    graphVisibility = visibility_;
+    graphHalfLights = halfLights_;
+    graphCapture = capture_;
+    graphIncremental = incremental_;
+    graphDirty = false;
+
+    // the targets can have moved to other textures, nothing in them can be reused
+    fullFrameNeeded = true;
+
+    const int width = graphWidth;
+    const int height = graphHeight;
+    frameGraph.reset();
+
+    // the msaa targets use the same formats as the single sample ones so they can be resolved straight into them
+    const GLenum gbufferFormats[3] = { GL_RGB32F, GL_RGB32F, GL_RGBA32F };
+    gbufferTargets[0] = frameGraph.createTarget("gbuffer_position", gbufferFormats[0], width, height);
+    gbufferTargets[1] = frameGraph.createTarget("gbuffer_normal", gbufferFormats[1], width, height);
+    gbufferTargets[2] = frameGraph.createTarget("gbuffer_material", gbufferFormats[2], width, height);
+    depthStencilTarget = frameGraph.createTarget("depth_stencil", GL_DEPTH24_STENCIL8, width, height);
+    lbufferTarget = frameGraph.createTarget("lbuffer_colour", GL_RGBA32F, width, height);
+    postProcessTarget = frameGraph.createTarget("postprocess_colour", GL_RGB32F, width, height);
+    visibilityTarget = frameGraph.createTarget("visibility_ids", GL_R32UI, width, height);
+    backbufferTarget = frameGraph.importBackbuffer(width, height);
+
+    msaaGbufferTargets[0] = msaaGbufferTargets[1] = msaaGbufferTargets[2] = FrameGraph::kNone;
+    msaaDepthStencilTarget = msaaLbufferTarget = FrameGraph::kNone;
+    if (msaa_)
+    {
+        msaaGbufferTargets[0] = frameGraph.createTarget("msaa_gbuffer_position", gbufferFormats[0], width, height, msaaSamples);
+        msaaGbufferTargets[1] = frameGraph.createTarget("msaa_gbuffer_normal", gbufferFormats[1], width, height, msaaSamples);
+        msaaGbufferTargets[2] = frameGraph.createTarget("msaa_gbuffer_material", gbufferFormats[2], width, height, msaaSamples);
+        msaaDepthStencilTarget = frameGraph.createTarget("msaa_depth_stencil", GL_DEPTH24_STENCIL8, width, height, msaaSamples);
+        msaaLbufferTarget = frameGraph.createTarget("msaa_lbuffer", GL_RGBA32F, width, height, msaaSamples);
+    }
+
+    halfGbufferTargets[0] = halfGbufferTargets[1] = halfGbufferTargets[2] = FrameGraph::kNone;
+    halfDepthStencilTarget = halfLbufferTarget = FrameGraph::kNone;
+    if (halfLights_)
+    {
+        const int halfWidth = (width + 1) / 2;
+        const int halfHeight = (height + 1) / 2;
+        halfGbufferTargets[0] = frameGraph.createTarget("half_gbuffer_position", GL_RGB32F, halfWidth, halfHeight);
+        halfGbufferTargets[1] = frameGraph.createTarget("half_gbuffer_normal", GL_RGBA16F, halfWidth, halfHeight);
+        halfGbufferTargets[2] = halfGbufferTargets[1];
+        halfDepthStencilTarget = frameGraph.createTarget("half_depth_stencil", GL_DEPTH24_STENCIL8, halfWidth, halfHeight);
+        halfLbufferTarget = frameGraph.createTarget("half_lbuffer", GL_RGBA16F, halfWidth, halfHeight);
+    }
+
+    // what the lighting reads the surface from, the visibility buffer mode has no gbuffer targets in the graph at all
+    // so they are never given textures
+    const FrameGraph::Handle* surfaceTargets = visibility_ ? &visibilityTarget : gbufferTargets;
+    const int surfaceTargetCount = visibility_ ? 1 : 3;
+
+    // whatever the geometry passes leave for the lighting, and the post process for the frames that only present
+    if (incremental_)
+    {
+        for (int i = 0; i < surfaceTargetCount; ++i)
+        {
+            frameGraph.persist(surfaceTargets[i]);
+        }
+        for (int i = 0; msaa_ && i < 3; ++i)
+        {
+            frameGraph.persist(msaaGbufferTargets[i]);
+        }
+        frameGraph.persist(depthStencilTarget);
+        if (msaa_)
+        {
+            frameGraph.persist(msaaDepthStencilTarget);
+        }
+        frameGraph.persist(postProcessTarget);
+    }
+
+    // with msaa the lighting is drawn multisampled, once per pixel from the resolved gbuffer where every sample is the
+    // same and again per sample on the edges
+    const FrameGraph::Handle* geometryTargets = msaa_ ? msaaGbufferTargets : gbufferTargets;
+    const FrameGraph::Handle geometryDepth = msaa_ ? msaaDepthStencilTarget : depthStencilTarget;
+    const FrameGraph::Handle lightTarget = msaa_ ? msaaLbufferTarget : lbufferTarget;
+
+    // the gbuffer writes kStencilGeometry wherever there is geometry, everything after masks with it
+    FrameGraph::State geometryState;
+    geometryState.depthTest = true;
+    geometryState.stencilTest = true;
+    geometryState.stencilFunc = GL_ALWAYS;
+    geometryState.stencilRef = kStencilGeometry;
+    geometryState.stencilFail = GL_ZERO;
+    geometryState.stencilPass = GL_REPLACE;
+    geometryCullsBackFaces = geometryState.cullFace && geometryState.cullMode == GL_BACK;
+
+    int pass = 0;
+    if (visibility_)
+    {
+        // only the ids go out here, 4 bytes a pixel however much overdraw there is. nothing is resolved out of them,
+        // the lighting passes read them and rebuild the surface themselves
+        pass = frameGraph.addPass("visibility", geometryState, [this]() { RenderVisibilityIds(); });
+        frameGraph.setGroups(pass, kPassGroupGeometry);
+        frameGraph.write(pass, visibilityTarget, FrameGraph::kDontCare);
+        frameGraph.write(pass, depthStencilTarget, FrameGraph::kClear);
+    }
+    else
+    {
+        pass = frameGraph.addPass(msaa_ ? "msaa_gbuffer" : "gbuffer", geometryState, [this]() { RenderGBuffer(); });
+        frameGraph.setGroups(pass, kPassGroupGeometry);
+        for (int i = 0; i < 3; ++i)
+        {
+            frameGraph.write(pass, geometryTargets[i], FrameGraph::kClear);
+        }
+        frameGraph.write(pass, geometryDepth, FrameGraph::kClear);
+    }
+
+    if (msaa_)
+    {
+        // the per pixel lighting reads the resolved gbuffer, where an average is as good as any sample away from the edges
+        pass = frameGraph.addPass("msaa_gbuffer_resolve", FrameGraph::State(), [this]() { ResolveMsaaGBuffer(); });
+        frameGraph.setGroups(pass, kPassGroupGeometry);
+        for (int i = 0; i < 3; ++i)
+        {
+            frameGraph.write(pass, gbufferTargets[i], FrameGraph::kDontCare);
+            frameGraph.read(pass, msaaGbufferTargets[i]);
+        }
+
+        // only the edge bit is written, and only on samples that have geometry under them
+        FrameGraph::State classifyState;
+        classifyState.colourWrite = false;
+        classifyState.stencilTest = true;
+        classifyState.stencilFunc = GL_NOTEQUAL;
+        classifyState.stencilRef = kStencilEdge;
+        classifyState.stencilReadMask = kStencilGeometry;
+        classifyState.stencilWriteMask = kStencilEdge;
+        classifyState.stencilPass = GL_REPLACE;
+        pass = frameGraph.addPass("msaa_classify", classifyState, [this]() { ClassifyEdges(); });
+        frameGraph.setGroups(pass, kPassGroupGeometry);
+        frameGraph.write(pass, msaaDepthStencilTarget);
+        for (int i = 0; i < 3; ++i)
+        {
+            frameGraph.read(pass, msaaGbufferTargets[i]);
+        }
+    }
+
+    // shade background as scool of computing purple, equal to background whether or not it is on an edge
+    FrameGraph::State backgroundState;
+    backgroundState.stencilTest = true;
+    backgroundState.stencilFunc = GL_EQUAL;
+    backgroundState.stencilReadMask = kStencilGeometry;
+    pass = frameGraph.addPass("background", backgroundState, [this]()
+    {
+        backgroundProgram.useProgram();
+        glBindVertexArray(globalLightMesh.vao);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    });
+    frameGraph.setGroups(pass, kPassGroupLighting);
+    frameGraph.write(pass, lightTarget, FrameGraph::kClear);
+    frameGraph.write(pass, geometryDepth);
+
+    FrameGraph::State globalLightState;
+    globalLightState.stencilTest = true;
+    globalLightState.stencilFunc = GL_EQUAL;
+    globalLightState.stencilRef = kStencilGeometry;
+    globalLightState.stencilReadMask = kStencilGeometry | kStencilEdge;
+    pass = frameGraph.addPass("global_light", globalLightState, [this]()
+    {
+        GLuint gbuffer[3];
+        const unsigned int features = (graphVisibility ? kFeatureVisibility : 0) | (shadowsEnabled ? kFeatureShadows : 0);
+        RenderGlobalLight(globalLightPrograms.getVariant(features), GL_TEXTURE_RECTANGLE, graphVisibility ? nullptr : GraphTextures(gbufferTargets, gbuffer));
+    });
+    frameGraph.setGroups(pass, kPassGroupLighting);
+    frameGraph.write(pass, lightTarget);
+    frameGraph.write(pass, geometryDepth);
+    for (int i = 0; i < surfaceTargetCount; ++i)
+    {
+        frameGraph.read(pass, surfaceTargets[i]);
+    }
+
+    if (msaa_)
+    {
+        globalLightState.stencilRef = kStencilGeometry | kStencilEdge;
+        pass = frameGraph.addPass("global_light_samples", globalLightState, [this]()
+        {
+            GLuint gbuffer[3];
+            RenderGlobalLight(globalLightPrograms.getVariant(kFeatureMsaa | (shadowsEnabled ? kFeatureShadows : 0)), GL_TEXTURE_2D_MULTISAMPLE, GraphTextures(msaaGbufferTargets, gbuffer));
+        });
+        frameGraph.setGroups(pass, kPassGroupLighting);
+        frameGraph.write(pass, lightTarget);
+        frameGraph.write(pass, geometryDepth);
+        for (int i = 0; i < 3; ++i)
+        {
+            frameGraph.read(pass, msaaGbufferTargets[i]);
+        }
+    }
+
+    // additive, testing for the geometry in front of the back faces of the proxies without writing depth
+    FrameGraph::State lightState;
+    lightState.blend = true;
+    lightState.blendSource = GL_ONE;
+    lightState.blendDestination = GL_ONE;
+    lightState.depthTest = true;
+    lightState.depthWrite = false;
+    lightState.depthFunc = GL_GREATER;
+    lightState.cullFace = true;
+    lightState.cullMode = GL_FRONT;
+    lightState.stencilTest = true;
+    lightState.stencilFunc = GL_EQUAL; // background is 0, this picks out the geometry or just its edges
+    lightState.stencilRef = kStencilGeometry; // RenderPointLights adds the specular bit for each bucket
+    if (halfLights_)
+    {
+        // the stencil is marked where any of the four pixels had geometry, from the depth the shader writes
+        FrameGraph::State downsampleState;
+        downsampleState.depthTest = true;
+        downsampleState.depthFunc = GL_ALWAYS;
+        downsampleState.stencilTest = true;
+        downsampleState.stencilFunc = GL_ALWAYS;
+        downsampleState.stencilRef = kStencilGeometry;
+        downsampleState.stencilPass = GL_REPLACE;
+        pass = frameGraph.addPass("light_downsample", downsampleState, [this]() { DownsampleLightGBuffer(); });
+        frameGraph.setGroups(pass, kPassGroupLighting);
+        frameGraph.write(pass, halfGbufferTargets[0], FrameGraph::kClear);
+        frameGraph.write(pass, halfGbufferTargets[1], FrameGraph::kClear);
+        frameGraph.write(pass, halfDepthStencilTarget, FrameGraph::kClear);
+        frameGraph.setClearColour(pass, 0.f, 0.f, 0.f, 0.f); // no normal, the upsample ignores those texels
+        frameGraph.read(pass, depthStencilTarget);
+        for (int i = 0; i < surfaceTargetCount; ++i)
+        {
+            frameGraph.read(pass, surfaceTargets[i]);
+        }
+
+        pass = frameGraph.addPass("lights_half", lightState, [this]()
+        {
+            GLuint gbuffer[3];
+            // the half depth stencil only marks geometry, so every pixel gets the same permutation
+            RenderPointLights(lightPrograms, kFeatureGBufferCompact | (pointShadowsEnabled ? kFeatureShadows : 0), GL_TEXTURE_RECTANGLE, GraphTextures(halfGbufferTargets, gbuffer), lightCulling, -1);
+        });
+        frameGraph.setGroups(pass, kPassGroupLighting);
+        frameGraph.write(pass, halfLbufferTarget, FrameGraph::kClear);
+        frameGraph.setClearColour(pass, 0.f, 0.f, 0.f, 0.f);
+        frameGraph.write(pass, halfDepthStencilTarget);
+        frameGraph.read(pass, halfGbufferTargets[0]);
+        frameGraph.read(pass, halfGbufferTargets[1]);
+
+        FrameGraph::State upsampleState;
+        upsampleState.blend = true;
+        upsampleState.blendSource = GL_ONE;
+        upsampleState.blendDestination = GL_ONE;
+        upsampleState.stencilTest = true;
+        upsampleState.stencilFunc = GL_EQUAL;
+        upsampleState.stencilRef = kStencilGeometry;
+        upsampleState.stencilReadMask = kStencilGeometry | kStencilEdge;
+        pass = frameGraph.addPass("light_upsample", upsampleState, [this]() { UpsampleLights(); });
+        frameGraph.setGroups(pass, kPassGroupLighting);
+        frameGraph.write(pass, lbufferTarget);
+        frameGraph.write(pass, depthStencilTarget);
+        frameGraph.read(pass, halfLbufferTarget);
+        frameGraph.read(pass, halfGbufferTargets[0]);
+        frameGraph.read(pass, halfGbufferTargets[1]);
+        for (int i = 0; i < surfaceTargetCount; ++i)
+        {
+            frameGraph.read(pass, surfaceTargets[i]);
+        }
+    }
+    else
+    {
+        pass = frameGraph.addPass("lights", lightState, [this]()
+        {
+            GLuint gbuffer[3];
+            const unsigned int features = (graphVisibility ? kFeatureVisibility : 0) | (pointShadowsEnabled ? kFeatureShadows : 0);
+            RenderPointLights(lightPrograms, features, GL_TEXTURE_RECTANGLE, graphVisibility ? nullptr : GraphTextures(gbufferTargets, gbuffer), lightCulling, kStencilGeometry);
+        });
+        frameGraph.setGroups(pass, kPassGroupLighting);
+        frameGraph.write(pass, lightTarget);
+        frameGraph.write(pass, geometryDepth);
+        for (int i = 0; i < surfaceTargetCount; ++i)
+        {
+            frameGraph.read(pass, surfaceTargets[i]);
+        }
+    }
+
+    if (msaa_)
+    {
+        lightState.stencilRef = kStencilGeometry | kStencilEdge;
+        pass = frameGraph.addPass("light_samples", lightState, [this]()
+        {
+            GLuint gbuffer[3];
+            RenderPointLights(lightPrograms, kFeatureMsaa | (pointShadowsEnabled ? kFeatureShadows : 0), GL_TEXTURE_2D_MULTISAMPLE, GraphTextures(msaaGbufferTargets, gbuffer), lightCulling, kStencilGeometry | kStencilEdge);
+        });
+        frameGraph.setGroups(pass, kPassGroupLighting);
+        frameGraph.write(pass, lightTarget);
+        frameGraph.write(pass, geometryDepth);
+        for (int i = 0; i < 3; ++i)
+        {
+            frameGraph.read(pass, msaaGbufferTargets[i]);
+        }
+
+        pass = frameGraph.addPass("msaa_resolve", FrameGraph::State(), [this]()
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, frameGraph.getFramebuffer(&msaaLbufferTarget, 1, msaaDepthStencilTarget));
+            glBlitFramebuffer(0, 0, graphWidth, graphHeight, 0, 0, graphWidth, graphHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        });
+        frameGraph.setGroups(pass, kPassGroupLighting);
+        frameGraph.write(pass, lbufferTarget, FrameGraph::kDontCare);
+        frameGraph.read(pass, msaaLbufferTarget);
+    }
+
+	// post process shenanigans
+    pass = frameGraph.addPass("postprocess", FrameGraph::State(), [this]()
+    {
+		postProcessProgram.useProgram();
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_RECTANGLE, frameGraph.getTexture(lbufferTarget));
+		glUniform1i(glGetUniformLocation(postProcessProgram.getProgramID(), "sampler_world_position"), 0);
+
+		glBindVertexArray(globalLightMesh.vao);
+		glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    });
+    frameGraph.setGroups(pass, kPassGroupLighting);
+    frameGraph.write(pass, postProcessTarget, FrameGraph::kClear);
+    frameGraph.read(pass, lbufferTarget);
+
+    pass = frameGraph.addPass("present", FrameGraph::State(), [this]()
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, frameGraph.getFramebuffer(&postProcessTarget, 1, FrameGraph::kNone));
+        glBlitFramebuffer(0, 0, graphWidth, graphHeight, 0, 0, graphWidth, graphHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    });
+    frameGraph.write(pass, backbufferTarget, FrameGraph::kDontCare);
+    frameGraph.read(pass, postProcessTarget);
+
+    if (capture_)
+    {
+        // only queues the copy into a pixel buffer, nothing reads what it writes so it has to be kept
+        pass = frameGraph.addPass("capture", FrameGraph::State(), [this]()
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, frameGraph.getFramebuffer(&postProcessTarget, 1, FrameGraph::kNone));
+            frameCapture.capture(graphWidth, graphHeight);
+        });
+        frameGraph.read(pass, postProcessTarget);
+        frameGraph.keep(pass);
+    }
+
+    frameGraph.compile();
+}
+
+void MyView::RenderGBuffer()
+{
+    {
+        TRACE_SCOPE("pack_instances");
+        // waits for the culler if it hasnt finished behind the shadows
+        visibleInstances.clear();
+        occlusionCuller.finish(visibleInstances);
+
+        // as late as it can go with the instances still to pick, nothing has read the camera yet
+        LatchCamera();
+
+        // the occlusion buffer was drawn from where the frame started, once the camera has moved away from there
+        // things hidden from the old position can be in view from the new one. turning is covered by the wider
+        // frustum, moving isnt, so the frame keeps only the frustum culling rather than have them pop in
+        if (glm::distance(frameCameraPosition, snapshot->cameraPosition) > kLateLatchOcclusionSlack)
+        {
+            visibleInstances.assign(cameraInstances.begin(), cameraInstances.end());
+            ++latchOcclusionSkips;
+        }
+
+        // bucketed by the lighting permutation they need, the shiny ones go last
+        specularInstances.clear();
+        unsigned int diffuse = 0;
+        for (unsigned int v = 0; v < visibleInstances.size(); ++v)
+        {
+            if (instanceSpecular[visibleInstances[v]])
+            {
+                specularInstances.push_back(visibleInstances[v]);
+            }
+            else
+            {
+                visibleInstances[diffuse++] = visibleInstances[v];
+            }
+        }
+        visibleInstances.resize(diffuse);
+        gbufferBucketInstances[0] = visibleInstances.size();
+        gbufferBucketInstances[1] = specularInstances.size();
+
+        gbufferDraws.clear();
+        PackVisibleInstances(visibleInstances, gbufferDraws);
+        gbufferSpecularDraw = gbufferDraws.size();
+        PackVisibleInstances(specularInstances, gbufferDraws);
+    }
+    UploadPackedInstances();
+
+    if (meshletCullingEnabled && meshletCuller.hasMeshlets())
+    {
+        RenderGBufferMeshlets();
+        return;
+    }
+
+    firstPassProgram.useProgram();
+
+    for (unsigned int d = 0; d < gbufferDraws.size(); ++d)
+    {
+        // the shiny materials mark their pixels, the point lights are drawn with specular only there
+        if (d == gbufferSpecularDraw)
+        {
+            glStencilFunc(GL_ALWAYS, kStencilGeometry | kStencilSpecular, ~0u);
+        }
+
+        const PackedDraw& draw = gbufferDraws[d];
+        const Mesh& mesh = loadedMeshes[draw.meshIndex];
+
+        glBindVertexArray(mesh.packedVAO);
+        glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES,
+            mesh.element_count,
+            GL_UNSIGNED_INT,
+            TGL_BUFFER_OFFSET(mesh.startElementIndex * sizeof(int)),
+            draw.instanceCount,
+            mesh.startVerticeIndex,
+            draw.firstInstance);
+    }
+
+    // back to what the pass was declared with
+    glStencilFunc(GL_ALWAYS, kStencilGeometry, ~0u);
+}
+
+void MyView::LatchCamera()
+{
+    if (frameLatched || !lateLatchEnabled)
+    {
+        return;
+    }
+    frameLatched = true;
+    TRACE_SCOPE("latch_camera");
+
+    const SceneSimulation::CameraSample camera = simulation_->latestCamera();
+    if (camera.tick <= frameCameraTick)
+    {
+        return;
+    }
+    latchTicksAhead += camera.tick - frameCameraTick;
+    frameCameraTick = camera.tick;
+
+    const glm::mat4 projectionMatrix = glm::perspective(kFieldOfView, aspectRatio, kNearPlane, kFarPlane);
+    frameProjectionView = projectionMatrix * glm::lookAt(camera.position, camera.direction + camera.position, glm::vec3(0, 1, 0));
+    frameCameraPosition = camera.position;
+    cameraLatch.latch(frameProjectionView, frameCameraPosition, bufferRender);
+
+    // this is what ends up on screen, the next frame has only moved if it moves on from here
+    drawnCameraPosition = camera.position;
+    drawnCameraDirection = camera.direction;
+}
+
+void MyView::RenderGBufferMeshlets()
+{
+    {
+        TRACE_SCOPE("cull_meshlets");
+        meshletCuller.beginFrame();
+        for (unsigned int d = 0; d < gbufferDraws.size(); ++d)
+        {
+            const PackedDraw& draw = gbufferDraws[d];
+            meshletCuller.addDraw(d < gbufferSpecularDraw ? 0 : 1, loadedMeshes[draw.meshIndex], draw.firstInstance, draw.instanceCount);
+        }
+
+        glm::vec4 planes[6];
+        InstanceBvh::extractFrustumPlanes(frameProjectionView, planes);
+        meshletCullProgram.useProgram();
+        glUniform4fv(glGetUniformLocation(meshletCullProgram.getProgramID(), "frustum_planes"), 6, glm::value_ptr(planes[0]));
+        glUniform3fv(glGetUniformLocation(meshletCullProgram.getProgramID(), "camera_position"), 1, glm::value_ptr(frameCameraPosition));
+        glUniform1i(glGetUniformLocation(meshletCullProgram.getProgramID(), "cone_culling"), geometryCullsBackFaces ? 1 : 0);
+        meshletCuller.cull(packedInstanceVBO);
+    }
+
+    firstPassProgram.useProgram();
+    glBindVertexArray(meshletVAO);
+    meshletCuller.draw(0);
+
+    // the same buckets as the instance draws
+    glStencilFunc(GL_ALWAYS, kStencilGeometry | kStencilSpecular, ~0u);
+    meshletCuller.draw(1);
+    glStencilFunc(GL_ALWAYS, kStencilGeometry, ~0u);
+}
+
+void MyView::ResolveMsaaGBuffer()
+{
+    // one attachment at a time, a blit only reads the one read buffer
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, frameGraph.getFramebuffer(msaaGbufferTargets, 3, msaaDepthStencilTarget));
+    for (int i = 0; i < 3; ++i)
+    {
+        glReadBuffer(GL_COLOR_ATTACHMENT0 + i);
+        GLenum buffer = GL_COLOR_ATTACHMENT0 + i;
+        glDrawBuffers(1, &buffer);
+        glBlitFramebuffer(0, 0, graphWidth, graphHeight, 0, 0, graphWidth, graphHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    GLenum gbufferBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, gbufferBuffers);
+}
+
+void MyView::ClassifyEdges()
+{
+    // last frame's edge count if it has come back, never waits on the gpu
+    GLuint available = 0;
+    if (msaaEdgeQueryIssued)
+    {
+        glGetQueryObjectuiv(msaaEdgeQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            glGetQueryObjectuiv(msaaEdgeQuery, GL_QUERY_RESULT, &msaaEdgeSamples);
+        }
+    }
+
+    edgeClassifyProgram.useProgram();
+
+    for (int i = 0; i < 3; ++i)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, frameGraph.getTexture(msaaGbufferTargets[i]));
+    }
+    glUniform1i(glGetUniformLocation(edgeClassifyProgram.getProgramID(), "sampler_world_position"), 0);
+    glUniform1i(glGetUniformLocation(edgeClassifyProgram.getProgramID(), "sampler_world_normal"), 1);
+    glUniform1i(glGetUniformLocation(edgeClassifyProgram.getProgramID(), "sampler_world_mat"), 2);
+    glUniform1i(glGetUniformLocation(edgeClassifyProgram.getProgramID(), "sample_count"), msaaSamples);
+
+    if (!msaaEdgeQueryIssued || available)
+    {
+        glBeginQuery(GL_SAMPLES_PASSED, msaaEdgeQuery);
+        glBindVertexArray(globalLightMesh.vao);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        glEndQuery(GL_SAMPLES_PASSED);
+        msaaEdgeQueryIssued = true;
+    }
+    else
+    {
+        glBindVertexArray(globalLightMesh.vao);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    }
+}
+
+void MyView::RenderVisibilityIds()
+{
+    LatchCamera();
+
+    visibilityProgram.useProgram();
+
+    glUniform1ui(glGetUniformLocation(visibilityProgram.getProgramID(), "triangle_bits"), visibilityTriangleBits);
+    GLint baseLocation = glGetUniformLocation(visibilityProgram.getProgramID(), "instance_base");
+
+    // every instance of a mesh goes in one draw so they cant be bucketed, if anything is shiny it all gets the specular
+    gbufferBucketInstances[0] = sceneHasSpecular ? 0 : instanceBase.back();
+    gbufferBucketInstances[1] = sceneHasSpecular ? instanceBase.back() : 0;
+    glStencilFunc(GL_ALWAYS, kStencilGeometry | (sceneHasSpecular ? kStencilSpecular : 0), ~0u);
+
+    for (unsigned int i = 0; i < loadedMeshes.size(); ++i)
+    {
+        glUniform1ui(baseLocation, instanceBase[i]);
+        glBindVertexArray(loadedMeshes[i].vao);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES,
+            loadedMeshes[i].element_count,
+            GL_UNSIGNED_INT,
+            TGL_BUFFER_OFFSET(loadedMeshes[i].startElementIndex * sizeof(int)),
+            instanceData[i].size(),
+            loadedMeshes[i].startVerticeIndex);
+    }
+
+    glStencilFunc(GL_ALWAYS, kStencilGeometry, ~0u);
+}
+
+void MyView::BindVisibilityBuffer(ShaderProgram& program_)
+{
+    // the ids and everything they index, the material table is already bound for the whole run
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visibilityInstanceSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, visibilityMeshSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, vertexVBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, elementVBO);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_RECTANGLE, frameGraph.getTexture(visibilityTarget));
+    glUniform1i(glGetUniformLocation(program_.getProgramID(), "sampler_visibility"), 0);
+    glUniform1ui(glGetUniformLocation(program_.getProgramID(), "triangle_bits"), visibilityTriangleBits);
+    // whatever camera the ids were drawn with, the late latched one on a full frame
+    glUniformMatrix4fv(glGetUniformLocation(program_.getProgramID(), "inverse_projection_view"), 1, GL_FALSE, glm::value_ptr(glm::inverse(frameProjectionView)));
+    glUniform2f(glGetUniformLocation(program_.getProgramID(), "viewport_size"), static_cast<float>(graphWidth), static_cast<float>(graphHeight));
+}
+
+const GLuint* MyView::GraphTextures(const FrameGraph::Handle* targets_, GLuint* textures_) const
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        textures_[i] = frameGraph.getTexture(targets_[i]);
+    }
+    return textures_;
+}
+
+void MyView::RenderGlobalLight(ShaderProgram& program_, GLenum gbufferTarget_, const GLuint* gbuffer_)
+{
+    program_.useProgram();
+
+	// could remove the glGetUniformLocation, but again, being lazy and fps is still around 100 - 105
+    if (gbuffer_ == nullptr)
+    {
+        BindVisibilityBuffer(program_);
+    }
+    else
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(gbufferTarget_, gbuffer_[0]);
+        glUniform1i(glGetUniformLocation(program_.getProgramID(), "sampler_world_position"), 0);
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(gbufferTarget_, gbuffer_[1]);
+        glUniform1i(glGetUniformLocation(program_.getProgramID(), "sampler_world_normal"), 1);
+
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(gbufferTarget_, gbuffer_[2]);
+        glUniform1i(glGetUniformLocation(program_.getProgramID(), "sampler_world_mat"), 2);
+    }
+
+	// since there are only 2 vecs to pass, im being lazy and doing it this way
+    glUniform3fv(glGetUniformLocation(program_.getProgramID(), "directional_light"), 1, glm::value_ptr(snapshot->globalLightDirection));
+    glUniform3fv(glGetUniformLocation(program_.getProgramID(), "light_intensity"), 1, glm::value_ptr(snapshot->globalLightIntensity));
+
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadowCascades.getDepthTexture());
+    glUniform1i(glGetUniformLocation(program_.getProgramID(), "sampler_shadow"), 3);
+    glUniformMatrix4fv(glGetUniformLocation(program_.getProgramID(), "cascade_matrices"), ShadowCascades::kCascadeCount, GL_FALSE, shadowCascades.getCascadeMatrixPtr());
+    glUniform1fv(glGetUniformLocation(program_.getProgramID(), "cascade_splits"), ShadowCascades::kCascadeCount, shadowCascades.getCascadeSplits());
+    glUniform3fv(glGetUniformLocation(program_.getProgramID(), "camera_position"), 1, glm::value_ptr(cascadeCameraPosition));
+    glUniform3fv(glGetUniformLocation(program_.getProgramID(), "camera_direction"), 1, glm::value_ptr(cascadeCameraDirection));
+
+    // draw directional light
+    glBindVertexArray(globalLightMesh.vao);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+}
+
+void MyView::RenderPointLights(ShaderProgram& programs_, unsigned int features_, GLenum gbufferTarget_, const GLuint* gbuffer_, const LightCulling& culling_, GLint stencilRef_)
+{
+    if (stencilRef_ < 0)
+    {
+        DrawPointLights(programs_.getVariant(features_ | (sceneHasSpecular ? kFeatureSpecular : 0)), gbufferTarget_, gbuffer_, culling_);
+        return;
+    }
+
+    // once for the pixels without the specular bit and once for those with it, each with the permutation it needs.
+    // the proxies go down twice but every pixel is only lit by one of them
+    for (int bucket = 0; bucket < 2; ++bucket)
+    {
+        if (gbufferBucketInstances[bucket] == 0)
+        {
+            continue;
+        }
+        glStencilFunc(GL_EQUAL, stencilRef_ | (bucket == 1 ? kStencilSpecular : 0), ~0u);
+        DrawPointLights(programs_.getVariant(features_ | (bucket == 1 ? kFeatureSpecular : 0)), gbufferTarget_, gbuffer_, culling_);
+    }
+    glStencilFunc(GL_EQUAL, stencilRef_, ~0u);
+}
+
+void MyView::DrawPointLights(ShaderProgram& program_, GLenum gbufferTarget_, const GLuint* gbuffer_, const LightCulling& culling_)
+{
+    program_.useProgram();
+
+    if (gbuffer_ == nullptr)
+    {
+        BindVisibilityBuffer(program_);
+    }
+    else
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(gbufferTarget_, gbuffer_[0]);
+        glUniform1i(glGetUniformLocation(program_.getProgramID(), "sampler_world_position"), 0);
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(gbufferTarget_, gbuffer_[1]);
+        glUniform1i(glGetUniformLocation(program_.getProgramID(), "sampler_world_normal"), 1);
+
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(gbufferTarget_, gbuffer_[2]);
+        glUniform1i(glGetUniformLocation(program_.getProgramID(), "sampler_world_mat"), 2);
+    }
+
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, pointShadowAtlas.getDepthTexture());
+    glUniform1i(glGetUniformLocation(program_.getProgramID(), "sampler_point_shadow"), 4);
+    glUniform1f(glGetUniformLocation(program_.getProgramID(), "point_shadow_atlas_size"), static_cast<float>(PointShadowAtlas::kAtlasSize));
+
+    // instance draw the lights woop woop, one draw per proxy
+    glBindVertexArray(lightMesh.vao);
+    for (int p = 0; p < LightCulling::kProxyCount; ++p)
+    {
+        const LightCulling::ProxyBatch& batch = culling_.getProxyBatch(p);
+        if (batch.count == 0)
+        {
+            continue;
+        }
+
+        if (p == LightCulling::kProxyQuad)
+        {
+            // the quad sits in front of the whole light, anything in front of the quad is out of range
+            glDisable(GL_CULL_FACE);
+            glDepthFunc(GL_LEQUAL);
+        }
+        else if (p == LightCulling::kProxyFullscreen)
+        {
+            // the quad is pushed back to the far side of the light, anything behind that is out of range
+            glDisable(GL_CULL_FACE);
+            glDepthFunc(GL_GREATER);
+        }
+        else
+        {
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            glDepthFunc(GL_GREATER);
+        }
+
+        glUniform1i(glGetUniformLocation(program_.getProgramID(), "proxy_type"), p);
+        glUniform1f(glGetUniformLocation(program_.getProgramID(), "proxy_scale"), lightProxyScales[p]);
+
+        const Mesh& proxy = lightProxyMeshes[p];
+        glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES,
+            proxy.element_count,
+            GL_UNSIGNED_INT,
+            TGL_BUFFER_OFFSET(proxy.startElementIndex * sizeof(int)),
+            batch.count,
+            proxy.startVerticeIndex,
+            batch.first);
+    }
+
+    // back to what the pass was declared with
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+    glDepthFunc(GL_GREATER);
+}
+
+MyView::FrameKind MyView::ClassifyFrame()
+{
+    const bool cameraChanged = snapshot->cameraPosition != drawnCameraPosition || snapshot->cameraDirection != drawnCameraDirection;
+    // LightData has no padding, the bytes are the values
+    const bool lightsChanged = lightingFrameNeeded
+        || snapshot->globalLightDirection != drawnGlobalLightDirection
+        || snapshot->globalLightIntensity != drawnGlobalLightIntensity
+        || allLights.size() != drawnLights.size()
+        || (!allLights.empty() && std::memcmp(&allLights[0], &drawnLights[0], allLights.size() * sizeof(LightData)) != 0)
+        // maps that went over last frame's budget are still waiting for a lighting frame to draw them
+        || (pointShadowsEnabled && pointShadowAtlas.getFrameStats().mapsPending > 0);
+
+    FrameKind kind = kFrameSkipped;
+    if (!incrementalRendering || fullFrameNeeded || cameraChanged)
+    {
+        kind = kFrameFull;
+        ++incrementalStats.fullFrames;
+    }
+    else if (lightsChanged)
+    {
+        kind = kFrameLighting;
+        ++incrementalStats.lightingFrames;
+    }
+    else
+    {
+        ++incrementalStats.skippedFrames;
+    }
+
+    if (kind != kFrameSkipped)
+    {
+        drawnCameraPosition = snapshot->cameraPosition;
+        drawnCameraDirection = snapshot->cameraDirection;
+        drawnGlobalLightDirection = snapshot->globalLightDirection;
+        drawnGlobalLightIntensity = snapshot->globalLightIntensity;
+        drawnLights.assign(allLights.begin(), allLights.end());
+        fullFrameNeeded = false;
+        lightingFrameNeeded = false;
+    }
+    return kind;
+}
+
+void MyView::RenderViewBatch()
+{
+    TRACE_SCOPE("view_batch");
+    const int viewCount = static_cast<int>(batchViews.size());
+    viewBatch.createTargets(batchWidth, batchHeight, viewCount);
+
+    const float aspect = static_cast<float>(batchWidth) / static_cast<float>(batchHeight);
+    glm::mat4* projections = frameArena.allocateArray<glm::mat4>(viewCount);
+    glm::mat4* projectionViews = frameArena.allocateArray<glm::mat4>(viewCount);
+    glm::vec3* positions = frameArena.allocateArray<glm::vec3>(viewCount);
+    for (int v = 0; v < viewCount; ++v)
+    {
+        const ViewBatch::View& view = batchViews[v];
+        // looking straight up or down the usual up is no use
+        const glm::vec3 up = std::abs(view.direction.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+        projections[v] = glm::perspective(view.fieldOfView, aspect, kNearPlane, kFarPlane);
+        projectionViews[v] = projections[v] * glm::lookAt(view.position, view.position + view.direction, up);
+        positions[v] = view.position;
+    }
+    PackRenderViews(projectionViews, positions, viewCount, ViewBatch::kViewStride, bufferRender, frameArena, uploadSink);
+
+    viewBatch.beginTiming(viewCount, batchOneAtATime);
+
+    const GLuint* gbuffer = viewBatch.getGBufferTextures();
+    batchLightCulling.setMinScreenRadius(lightCulling.getMinScreenRadius());
+
+    // one layered pass for every view, or a pass a view with its lighting straight after like a loop over cameras
+    const int geometryPasses = batchOneAtATime ? viewCount : 1;
+    for (int g = 0; g < geometryPasses; ++g)
+    {
+        {
+            TRACE_SCOPE("batch_gbuffer");
+            if (batchOneAtATime)
+            {
+                viewBatch.bindGeometryLayer(g);
+            }
+            else
+            {
+                viewBatch.bindLayered();
+            }
+
+            // clears every attached layer
+            glDepthMask(GL_TRUE);
+            glStencilMask(~0u);
+            glClearColor(0.f, 0.f, 0.f, 0.f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+            glEnable(GL_DEPTH_TEST);
+            glDepthFunc(GL_LEQUAL);
+            glEnable(GL_STENCIL_TEST);
+            glStencilFunc(GL_ALWAYS, kStencilGeometry, ~0u);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+
+            batchGeometryProgram.useProgram();
+            glUniform1i(glGetUniformLocation(batchGeometryProgram.getProgramID(), "first_view"), batchOneAtATime ? g : 0);
+            glUniform1i(glGetUniformLocation(batchGeometryProgram.getProgramID(), "view_count"), batchOneAtATime ? 1 : viewCount);
+
+            // every instance, the geometry shader drops the triangles each view cant see
+            for (unsigned int i = 0; i < loadedMeshes.size(); ++i)
+            {
+                const Mesh& mesh = loadedMeshes[i];
+                if (!mesh.resident || mesh.element_count == 0 || instanceData[i].empty())
+                {
+                    continue;
+                }
+
+                glBindVertexArray(mesh.vao);
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES,
+                    mesh.element_count,
+                    GL_UNSIGNED_INT,
+                    TGL_BUFFER_OFFSET(mesh.startElementIndex * sizeof(int)),
+                    static_cast<GLsizei>(instanceData[i].size()),
+                    mesh.startVerticeIndex);
+            }
+        }
+
+        const int firstLayer = batchOneAtATime ? g : 0;
+        const int lastLayer = batchOneAtATime ? g + 1 : viewCount;
+        for (int l = firstLayer; l < lastLayer; ++l)
+        {
+            TRACE_SCOPE("batch_lighting");
+            batchLightCulling.cullLights(allLights, projectionViews[l], projections[l], positions[l], static_cast<float>(batchHeight));
+            const std::vector<unsigned int>& visibleLights = batchLightCulling.getVisibleLights();
+            LightData* lights = GatherVisibleLights(allLights, visibleLights, frameArena);
+            uploadSink.replaceBuffer(GL_ARRAY_BUFFER, lightMesh.instanceVBO, lights, visibleLights.size() * sizeof(LightData), GL_STATIC_DRAW);
+
+            // the lighting shaders only know about one camera, they get this view's
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, bufferRender, l * ViewBatch::kViewStride, ViewBatch::kViewStride);
+
+            viewBatch.bindLightingLayer(l);
+            glClearColor(0.f, 0.f, 0.25f, 0.f);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            glDisable(GL_DEPTH_TEST);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+            glStencilFunc(GL_EQUAL, 0, kStencilGeometry);
+            backgroundProgram.useProgram();
+            glBindVertexArray(globalLightMesh.vao);
+            glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+            glStencilFunc(GL_EQUAL, kStencilGeometry, ~0u);
+            ShaderProgram& globalLight = batchGlobalLightPrograms.getVariant(0);
+            globalLight.useProgram();
+            glUniform1i(glGetUniformLocation(globalLight.getProgramID(), "gbuffer_layer"), l);
+            RenderGlobalLight(globalLight, GL_TEXTURE_2D_ARRAY, gbuffer);
+
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+            glEnable(GL_DEPTH_TEST);
+            glDepthMask(GL_FALSE);
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            glDepthFunc(GL_GREATER);
+            // the batch's stencil only marks geometry, every pixel gets the specular if anything is shiny
+            ShaderProgram& light = batchLightPrograms.getVariant(sceneHasSpecular ? kFeatureSpecular : 0);
+            light.useProgram();
+            glUniform1i(glGetUniformLocation(light.getProgramID(), "gbuffer_layer"), l);
+            DrawPointLights(light, GL_TEXTURE_2D_ARRAY, gbuffer, batchLightCulling);
+
+            glDisable(GL_BLEND);
+            glDisable(GL_CULL_FACE);
+            glDepthMask(GL_TRUE);
+        }
+    }
+
+    viewBatch.endTiming();
+
+    // back to how the frame graph leaves things
+    glDisable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+    glDisable(GL_STENCIL_TEST);
+    glStencilFunc(GL_ALWAYS, 0, ~0u);
+    glCullFace(GL_BACK);
+    glBlendFunc(GL_ONE, GL_ZERO);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufferRender);
+}
+
+void MyView::UpdateViewBatchBenchmark()
+{
+    const ViewBatch::Stats& stats = viewBatch.getStats();
+    if (stats.batchesTimed != batchBenchmarkSeen)
+    {
+        batchBenchmarkSeen = stats.batchesTimed;
+        const int mode = stats.oneAtATime ? 1 : 0;
+        if (++batchBenchmarkTimed[mode] > kViewBatchWarmup)
+        {
+            batchBenchmarkMilliseconds[mode] += stats.gpuMilliseconds;
+            batchBenchmarkViews[mode] += stats.views;
+        }
+    }
+
+    if (batchBenchmarkFrames == 0)
+    {
+        return;
+    }
+
+    // the probes sit on the camera and look along the axes and two diagonals
+    const glm::vec3 directions[ViewBatch::kMaxViews] = {
+        glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0),
+        glm::vec3(0, 1, 0), glm::vec3(0, -1, 0),
+        glm::vec3(0, 0, 1), glm::vec3(0, 0, -1),
+        glm::normalize(glm::vec3(1, 0, 1)), glm::normalize(glm::vec3(-1, 0, -1))
+    };
+    batchViews.resize(ViewBatch::kMaxViews);
+    for (int v = 0; v < ViewBatch::kMaxViews; ++v)
+    {
+        batchViews[v].position = snapshot->cameraPosition;
+        batchViews[v].direction = directions[v];
+        batchViews[v].fieldOfView = kViewBatchProbeFieldOfView;
+    }
+    batchWidth = kViewBatchProbeSize;
+    batchHeight = kViewBatchProbeSize;
+    batchOneAtATime = batchBenchmarkFrames <= kViewBatchBenchmarkFrames / 2;
+    batchRequested = true;
+
+    if (--batchBenchmarkFrames > 0)
+    {
+        return;
+    }
+
+    // the last couple of batches are still out, there are plenty without them
+    double viewsPerSecond[2] = { 0.0, 0.0 };
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        if (batchBenchmarkMilliseconds[mode] > 0.0)
+        {
+            viewsPerSecond[mode] = batchBenchmarkViews[mode] * 1000.0 / batchBenchmarkMilliseconds[mode];
+        }
+    }
+    std::cout << "view batch benchmark: layered " << viewsPerSecond[0] << " views/s"
+        << ", one at a time " << viewsPerSecond[1] << " views/s";
+    if (viewsPerSecond[1] > 0.0)
+    {
+        std::cout << ", " << viewsPerSecond[0] / viewsPerSecond[1] << "x";
+    }
+    std::cout << std::endl;
+}
+
+void MyView::DownsampleLightGBuffer()
+{
+    ShaderProgram& program = lightDownsamplePrograms.getVariant(graphVisibility ? kFeatureVisibility : 0);
+    program.useProgram();
+
+    if (graphVisibility)
+    {
+        BindVisibilityBuffer(program);
+    }
+    else
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_RECTANGLE, frameGraph.getTexture(gbufferTargets[i]));
+        }
+        glUniform1i(glGetUniformLocation(program.getProgramID(), "sampler_world_position"), 0);
+        glUniform1i(glGetUniformLocation(program.getProgramID(), "sampler_world_normal"), 1);
+        glUniform1i(glGetUniformLocation(program.getProgramID(), "sampler_world_mat"), 2);
+    }
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_RECTANGLE, frameGraph.getTexture(depthStencilTarget));
+    glUniform1i(glGetUniformLocation(program.getProgramID(), "sampler_depth"), 3);
+
+    glBindVertexArray(globalLightMesh.vao);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+}
+
+void MyView::UpsampleLights()
+{
+    ShaderProgram& program = lightUpsamplePrograms.getVariant(graphVisibility ? kFeatureVisibility : 0);
+    program.useProgram();
+
+    if (graphVisibility)
+    {
+        BindVisibilityBuffer(program);
+    }
+    else
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_RECTANGLE, frameGraph.getTexture(gbufferTargets[i]));
+        }
+        glUniform1i(glGetUniformLocation(program.getProgramID(), "sampler_world_position"), 0);
+        glUniform1i(glGetUniformLocation(program.getProgramID(), "sampler_world_normal"), 1);
+        glUniform1i(glGetUniformLocation(program.getProgramID(), "sampler_world_mat"), 2);
+    }
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_RECTANGLE, frameGraph.getTexture(halfLbufferTarget));
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_RECTANGLE, frameGraph.getTexture(halfGbufferTargets[0]));
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_RECTANGLE, frameGraph.getTexture(halfGbufferTargets[1]));
+    glUniform1i(glGetUniformLocation(program.getProgramID(), "sampler_half_light"), 3);
+    glUniform1i(glGetUniformLocation(program.getProgramID(), "sampler_half_position"), 4);
+    glUniform1i(glGetUniformLocation(program.getProgramID(), "sampler_half_normal"), 5);
+
+    glBindVertexArray(globalLightMesh.vao);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+}
+
+void MyView::RenderShadows(const glm::mat4& viewMatrix_)
+{
+    TRACE_SCOPE("shadows");
+    cascadeCameraPosition = snapshot->cameraPosition;
+    cascadeCameraDirection = snapshot->cameraDirection;
+    shadowCascades.update(viewMatrix_,
+        kFieldOfView,
+        aspectRatio,
+        kNearPlane,
+        kFarPlane,
+        snapshot->globalLightDirection,
+        sceneMin,
+        sceneMax);
+
+    // cull every cascade that needs drawing first so the packed instances go up in one upload
+    for (int c = 0; c < ShadowCascades::kCascadeCount; ++c)
+    {
+        shadowDraws[c].clear();
+        if (!shadowCascades.cascadeNeedsRender(c))
+        {
+            continue;
+        }
+
+        glm::vec4 planes[4];
+        shadowCascades.getCascadePlanes(c, planes);
+        visibleInstances.clear();
+        instanceBvh.queryFrustum(planes, 4, visibleInstances);
+        const bool containsDynamic = PackVisibleInstances(visibleInstances, shadowDraws[c]);
+
+        if (containsDynamic && c >= ShadowCascades::kFirstCachedCascade)
+        {
+            shadowCascades.markDynamic(c);
+        }
+    }
+
+    UploadPackedInstances();
+
+    shadowProgram.useProgram();
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LEQUAL);
+    glDisable(GL_BLEND);
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_CULL_FACE); // sponza has plenty of single sided geometry that still has to cast
+
+    // slope scaled bias when writing, the lookup also offsets along the normal
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.f, 4.f);
+
+    GLint lightMatrixLocation = glGetUniformLocation(shadowProgram.getProgramID(), "light_matrix");
+
+    for (int c = 0; c < ShadowCascades::kCascadeCount; ++c)
+    {
+        if (!shadowCascades.cascadeNeedsRender(c))
+        {
+            continue;
+        }
+
+        // bound and cleared even when nothing lands in it, a cached cascade would otherwise keep shadows from
+        // instances that have since been culled or removed until something is drawn into it again
+        shadowCascades.beginCascade(c);
+        if (shadowDraws[c].empty())
+        {
+            continue;
+        }
+        glUniformMatrix4fv(lightMatrixLocation, 1, GL_FALSE, glm::value_ptr(shadowCascades.getCascadeMatrix(c)));
+
+        for (unsigned int d = 0; d < shadowDraws[c].size(); ++d)
+        {
+            const PackedDraw& draw = shadowDraws[c][d];
+            const Mesh& mesh = loadedMeshes[draw.meshIndex];
+
+            glBindVertexArray(mesh.packedVAO);
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES,
+                mesh.element_count,
+                GL_UNSIGNED_INT,
+                TGL_BUFFER_OFFSET(mesh.startElementIndex * sizeof(int)),
+                draw.instanceCount,
+                mesh.startVerticeIndex,
+                draw.firstInstance);
+        }
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    shadowCascades.endCascades();
+}
+
+void MyView::RebuildInstances(bool instancesMoved_)
+{
+    TRACE_SCOPE("rebuild_instances");
+
+    // the bvh can be refit as long as every mesh still has the same number of instances, so each one keeps its index
+    bool sameLayout = instanceBase.size() == loadedMeshes.size() + 1;
+    for (unsigned int i = 0; sameLayout && i < loadedMeshes.size(); ++i)
+    {
+        sameLayout = instanceBase[i + 1] - instanceBase[i] == instanceData[i].size();
+    }
+
+    instanceBase.resize(loadedMeshes.size() + 1);
+    instanceBase[0] = 0;
+    for (unsigned int i = 0; i < loadedMeshes.size(); ++i)
+    {
+        instanceBase[i + 1] = instanceBase[i] + instanceData[i].size();
+    }
+
+    // world space bounds of every instance, for culling
+    sceneMin = glm::vec3(FLT_MAX);
+    sceneMax = glm::vec3(-FLT_MAX);
+    instanceBounds.resize(instanceBase.back());
+    instanceSpecular.resize(instanceBase.back());
+    sceneHasSpecular = false;
+    changedInstances.clear();
+    dynamicInstances.clear();
+    for (unsigned int i = 0; i < loadedMeshes.size(); ++i)
+    {
+        const Mesh& mesh = loadedMeshes[i];
+        for (unsigned int j = 0; j < instanceData[i].size(); ++j)
+        {
+            const glm::mat4x3& transform = instanceData[i][j].positionData;
+
+            InstanceBounds bounds;
+            bounds.min = glm::vec3(FLT_MAX);
+            bounds.max = glm::vec3(-FLT_MAX);
+            for (int c = 0; c < 8; ++c)
+            {
+                glm::vec3 corner((c & 1) ? mesh.boundsMax.x : mesh.boundsMin.x,
+                    (c & 2) ? mesh.boundsMax.y : mesh.boundsMin.y,
+                    (c & 4) ? mesh.boundsMax.z : mesh.boundsMin.z);
+                glm::vec3 world = transform * glm::vec4(corner, 1.f);
+                bounds.min = glm::min(bounds.min, world);
+                bounds.max = glm::max(bounds.max, world);
+            }
+            bounds.centre = (bounds.min + bounds.max) * 0.5f;
+            bounds.radius = glm::length(bounds.max - bounds.centre);
+
+            // once the simulation has moved an instance it counts as moving until the instances are laid out again
+            const unsigned int instance = instanceBase[i] + j;
+            const bool changed = sameLayout
+                && (bounds.min != instanceBounds[instance].min || bounds.max != instanceBounds[instance].max);
+            bounds.isStatic = !sameLayout || (instanceBounds[instance].isStatic && !(instancesMoved_ && changed));
+            if (changed)
+            {
+                changedInstances.push_back(instance);
+            }
+            if (changed && instancesMoved_)
+            {
+                // the shadows it was drawn into where it was, and the ones it lands in
+                const InstanceBounds& previous = instanceBounds[instance];
+                shadowCascades.markDynamicBox(previous.min, previous.max);
+                shadowCascades.markDynamicBox(bounds.min, bounds.max);
+                pointShadowAtlas.invalidateSphere(previous.centre, previous.radius);
+                pointShadowAtlas.invalidateSphere(bounds.centre, bounds.radius);
+            }
+            instanceBounds[instance] = bounds;
+            const bool specular = materials[instanceData[i][j].materialDataIndex].shininess > 0.f;
+            instanceSpecular[instance] = specular ? 1 : 0;
+            sceneHasSpecular |= specular;
+            if (!bounds.isStatic)
+            {
+                dynamicInstances.push_back(instance);
+            }
+
+            sceneMin = glm::min(sceneMin, bounds.min);
+            sceneMax = glm::max(sceneMax, bounds.max);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, loadedMeshes[i].instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER,
+            instanceData[i].size() * sizeof(InstanceData),
+            instanceData[i].data(),
+            GL_STATIC_DRAW);
+        GpuMemory::bufferStorage(loadedMeshes[i].instanceVBO, instanceData[i].size() * sizeof(InstanceData));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    if (sameLayout)
+    {
+        TRACE_SCOPE("bvh_refit");
+        instanceBvh.refit(instanceBounds, changedInstances);
+        // instances that wander a long way leave big overlapping boxes behind them, rebuild just those parts
+        bvhSubtreesRebuilt += instanceBvh.rebuildDegraded(kBvhRebuildGrowth);
+    }
+    else
+    {
+        TRACE_SCOPE("bvh_build");
+        instanceBvh.build(instanceBounds);
+        bvhSubtreesRebuilt = 0;
+    }
+
+    // the visibility buffer looks instances up by a single index, so lay every mesh's instances out end to end
+    visibilityInstances.resize(instanceBase.back());
+    for (unsigned int i = 0; i < loadedMeshes.size(); ++i)
+    {
+        for (unsigned int j = 0; j < instanceData[i].size(); ++j)
+        {
+            VisibilityInstance& instance = visibilityInstances[instanceBase[i] + j];
+            instance.transform = glm::mat4(instanceData[i][j].positionData);
+            instance.materialIndex = instanceData[i][j].materialDataIndex;
+            instance.meshIndex = i;
+            instance.padding[0] = instance.padding[1] = 0;
+        }
+    }
+    visibilityBufferFits = visibilityInstances.size() <= (1ull << (32 - visibilityTriangleBits));
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityInstanceSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+        visibilityInstances.size() * sizeof(VisibilityInstance),
+        visibilityInstances.data(),
+        GL_STATIC_DRAW);
+    GpuMemory::bufferStorage(visibilityInstanceSSBO, visibilityInstances.size() * sizeof(VisibilityInstance));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void MyView::BuildInstanceData()
+{
+    if (stressScene.getConfig().instanceCount > 0)
+    {
+        stressScene.replicateInstances(sceneInstanceData, sceneSourceMin, sceneSourceMax, instanceData);
+    }
+    else
+    {
+        instanceData = sceneInstanceData;
+    }
+    CollapseSharedMeshes(instanceData);
+}
+
+void MyView::ApplySnapshotInstances()
+{
+    TRACE_SCOPE("apply_instances");
+    appliedInstanceVersion = snapshot->instanceVersion;
+
+    unsigned int flat = 0;
+    for (unsigned int i = 0; i < sceneInstanceData.size(); ++i)
+    {
+        for (unsigned int j = 0; j < sceneInstanceData[i].size(); ++j)
+        {
+            assert(flat < snapshot->instanceTransforms.size());
+            sceneInstanceData[i][j].positionData = snapshot->instanceTransforms[flat++];
+        }
+    }
+
+    // laid out the same as before so the rebuild only refits, and leaves the stress lights and untouched shadows be
+    BuildInstanceData();
+    RebuildInstances(true);
+    fullFrameNeeded = true;
+}
+
+void MyView::ApplyStressScene()
+{
+    stressDirty = false;
+
+    BuildInstanceData();
+    RebuildInstances();
+
+    // the lights are spread over whatever the instances now cover
+    stressScene.generateLights(sceneMin, sceneMax);
+
+    // nothing cached was drawn with this geometry
+    shadowCascades.invalidate();
+    pointShadowAtlas.invalidateMaps();
+    fullFrameNeeded = true;
+}
+
+void MyView::UploadPackedInstances()
+{
+    TRACE_SCOPE("upload_instances");
+    if (packedInstances.size() == packedInstancesUploaded)
+    {
+        return;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, packedInstanceVBO);
+    if (packedInstances.size() > packedInstanceCapacity)
+    {
+        // growing throws away what is already up there, so start the frame's upload again from the beginning
+        packedInstanceCapacity = packedInstances.size() + packedInstances.size() / 2;
+        packedInstancesUploaded = 0;
+    }
+    if (packedInstancesUploaded == 0)
+    {
+        // orphan the old storage on the first upload of the frame so we dont wait on last frame's draws still reading it
+        glBufferData(GL_ARRAY_BUFFER, packedInstanceCapacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+        GpuMemory::bufferStorage(packedInstanceVBO, packedInstanceCapacity * sizeof(InstanceData));
+    }
+    glBufferSubData(GL_ARRAY_BUFFER,
+        packedInstancesUploaded * sizeof(InstanceData),
+        (packedInstances.size() - packedInstancesUploaded) * sizeof(InstanceData),
+        packedInstances.data() + packedInstancesUploaded);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    packedInstancesUploaded = packedInstances.size();
+}
+
+bool MyView::PackVisibleInstances(std::vector<unsigned int>& visible_, std::vector<PackedDraw>& draws_)
+{
+    // instances are numbered one mesh after another, so once sorted each mesh's instances are a single draw
+    std::sort(visible_.begin(), visible_.end());
+
+    bool containsDynamic = false;
+    unsigned int mesh = 0;
+    unsigned int drawMesh = ~0u;
+    for (unsigned int v = 0; v < visible_.size(); ++v)
+    {
+        const unsigned int instance = visible_[v];
+        while (instance >= instanceBase[mesh + 1])
+        {
+            ++mesh;
+        }
+        if (!loadedMeshes[mesh].resident)
+        {
+            continue;
+        }
+
+        if (mesh != drawMesh)
+        {
+            drawMesh = mesh;
+
+            PackedDraw draw;
+            draw.meshIndex = mesh;
+            draw.firstInstance = packedInstances.size();
+            draw.instanceCount = 0;
+            draws_.push_back(draw);
+        }
+
+        packedInstances.push_back(instanceData[mesh][instance - instanceBase[mesh]]);
+        ++draws_.back().instanceCount;
+        containsDynamic |= !instanceBounds[instance].isStatic;
+    }
+    return containsDynamic;
+}
+
+void MyView::RenderPointShadows()
+{
+    TRACE_SCOPE("point_shadows");
+    // slots go by screen coverage, culled lights have none so they give theirs up
+    pointShadowAtlas.allocateSlots(lightCulling.getCoverage());
+
+    // the atlas tracks every light in the scene by its index in allLights, not just the visible ones
+    for (unsigned int i = 0; i < allLights.size(); ++i)
+    {
+        bool containsDynamic = false;
+        for (unsigned int d = 0; d < dynamicInstances.size(); ++d)
+        {
+            const InstanceBounds& bounds = instanceBounds[dynamicInstances[d]];
+            if (glm::distance(bounds.centre, allLights[i].position) < bounds.radius + allLights[i].range)
+            {
+                containsDynamic = true;
+                break;
+            }
+        }
+        pointShadowAtlas.updateLight(i, allLights[i].position, allLights[i].range, containsDynamic);
+    }
+
+    const std::vector<int>& updates = pointShadowAtlas.selectUpdates(kPointShadowBudget);
+    if (updates.empty())
+    {
+        return;
+    }
+
+    // everything inside each light's range goes into the packed instances, both hemispheres draw the same set
+    unsigned int firstDraw = 0;
+    std::vector< PackedDraw >& draws = pointShadowDraws;
+    std::vector< unsigned int >& drawCounts = pointShadowDrawCounts;
+    draws.clear();
+    drawCounts.resize(updates.size());
+    for (unsigned int u = 0; u < updates.size(); ++u)
+    {
+        const LightData& light = allLights[updates[u]];
+        visibleInstances.clear();
+        instanceBvh.querySphere(light.position, light.range, visibleInstances);
+        PackVisibleInstances(visibleInstances, draws);
+        drawCounts[u] = draws.size() - firstDraw;
+        firstDraw = draws.size();
+    }
+
+    UploadPackedInstances();
+
+    paraboloidProgram.useProgram();
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LEQUAL);
+    glDisable(GL_BLEND);
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_CLIP_DISTANCE0);
+
+    GLint positionLocation = glGetUniformLocation(paraboloidProgram.getProgramID(), "light_position");
+    GLint rangeLocation = glGetUniformLocation(paraboloidProgram.getProgramID(), "light_range");
+    GLint hemisphereLocation = glGetUniformLocation(paraboloidProgram.getProgramID(), "hemisphere");
+
+    firstDraw = 0;
+    for (unsigned int u = 0; u < updates.size(); ++u)
+    {
+        const LightData& light = allLights[updates[u]];
+        glUniform3fv(positionLocation, 1, glm::value_ptr(light.position));
+        glUniform1f(rangeLocation, light.range);
+
+        for (int hemisphere = 0; hemisphere < 2; ++hemisphere)
+        {
+            pointShadowAtlas.beginHemisphere(updates[u], hemisphere);
+            glUniform1f(hemisphereLocation, hemisphere == 0 ? 1.f : -1.f);
+
+            for (unsigned int d = firstDraw; d < firstDraw + drawCounts[u]; ++d)
+            {
+                const PackedDraw& draw = draws[d];
+                const Mesh& mesh = loadedMeshes[draw.meshIndex];
+
+                glBindVertexArray(mesh.packedVAO);
+                glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES,
+                    mesh.element_count,
+                    GL_UNSIGNED_INT,
+                    TGL_BUFFER_OFFSET(mesh.startElementIndex * sizeof(int)),
+                    draw.instanceCount,
+                    mesh.startVerticeIndex,
+                    draw.firstInstance);
+            }
+        }
+
+        pointShadowAtlas.lightRendered(updates[u]);
+        firstDraw += drawCounts[u];
+    }
+
+    glDisable(GL_CLIP_DISTANCE0);
+    pointShadowAtlas.endUpdates();
+}
+
+void MyView::UpdateLights(const glm::mat4& projectMat_, const glm::mat4& projectViewMat_, const glm::vec3& camPos_, float viewportHeight_)
+{
+	TRACE_SCOPE("update_lights");
+	lightCulling.cullLights(allLights, projectViewMat_, projectMat_, camPos_, viewportHeight_, &jobs);
+
+	// timed on their own, the culling above is all cpu and the upload below gets its own pass
+	if (pointShadowsEnabled)
+	{
+		gpuTimer.beginPass("point_shadows");
+		RenderPointShadows();
+		gpuTimer.endPass();
+	}
+
+	// only the visible lights go up, biggest first
+	const std::vector<unsigned int>& visibleLights = lightCulling.getVisibleLights();
+	visibleLightCount = visibleLights.size();
+	LightData* lights = frameArena.allocateArray<LightData>(visibleLightCount);
+	jobs.parallelFor(0, visibleLightCount, kLightsPerJob, [&](unsigned int begin_, unsigned int end_)
+	{
+		for (unsigned int i = begin_; i < end_; ++i)
+		{
+			lights[i] = allLights[visibleLights[i]];
+			if (pointShadowsEnabled)
+			{
+				lights[i].shadowSlot = pointShadowAtlas.getShadowSlot(visibleLights[i]);
+			}
+		}
+	});
 
-	glBindBuffer(GL_ARRAY_BUFFER, lightMesh.instanceVBO);
-	glBufferData(GL_ARRAY_BUFFER,
-		lights.size() * sizeof(LightData),
-		lights.data(),
-		GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	gpuTimer.beginPass("light_upload");
+	uploadSink.replaceBuffer(GL_ARRAY_BUFFER, lightMesh.instanceVBO, lights, visibleLightCount * sizeof(LightData), GL_STATIC_DRAW);
+	gpuTimer.endPass();
 }
 
 // method fixes damn inconsistencies of this so called 'legacy code'
@@ -5,9 +5,30 @@
 #include <tgl/tgl.h>
 #include <glm/glm.hpp>
 #include <vector>
+#include <map>
 #include <memory>
 
 #include "ShaderProgram.hpp"
+#include "RenderTypes.hpp"
+#include "ShadowCascades.hpp"
+#include "InstanceBvh.hpp"
+#include "OcclusionCuller.hpp"
+#include "MeshletCuller.hpp"
+#include "StreamingLoader.hpp"
+#include "FrameGraph.hpp"
+#include "ViewBatch.hpp"
+#include "FrameCapture.hpp"
+#include "CameraLatch.hpp"
+#include "LatencyMeter.hpp"
+#include "JobSystem.hpp"
+#include "PointShadowAtlas.hpp"
+#include "LightCulling.hpp"
+#include "StressScene.hpp"
+#include "GpuTimer.hpp"
+#include "SceneSimulation.hpp"
+#include "FrameArena.hpp"
+#include "AllocationTracker.hpp"
+#include "UploadSink.hpp"
 
 class MyView : public tygra::WindowViewDelegate
 {
@@ -20,6 +41,87 @@ public:
     void
     setScene(std::shared_ptr<const SceneModel::Context> scene);
 
+    // per frame state comes from the simulation's snapshots, the context is only read at start
+    void
+    setSimulation(std::shared_ptr<SceneSimulation> simulation);
+
+    void toggleShadows();
+
+    void togglePointShadows();
+
+    // swaps the gbuffer pass for the visibility buffer and its resolve
+    void toggleVisibilityBuffer();
+
+    // multisampled gbuffer, lit per pixel except on the edges which are lit per sample
+    void toggleMsaa();
+
+    // point lights drawn into a half resolution light buffer from a downsampled gbuffer and upsampled to full
+    // resolution with depth and normal weights, the global light stays full resolution. it can change every frame so
+    // a governor can turn it on under load, with msaa on the lights stay full resolution
+    void setHalfResolutionLights(bool enabled);
+    bool getHalfResolutionLights() const;
+    void toggleHalfResolutionLights();
+
+    // draws the views once, after the next frame, into the layers of the batch's colour array. one at a time draws
+    // each view's gbuffer on its own instead of all of them in a single layered pass, for comparing the two
+    void requestViewBatch(const std::vector<ViewBatch::View>& views, int width, int height, bool oneAtATime);
+    const ViewBatch::Stats& getViewBatchStats() const;
+    // GL_TEXTURE_2D_ARRAY, 0 until a batch has been drawn
+    GLuint getViewBatchTexture() const;
+
+    // draws probe views around the camera every frame, half the frames batched and half one at a time, then prints
+    // the views per second of each
+    void startViewBatchBenchmark();
+
+    // writes every frame to disk as a png from after the post process, without the frame waiting on the readback or
+    // the encode. frames are dropped rather than waited for if the writers fall too far behind
+    void toggleCapture();
+
+    // frames whose camera, lights and instances are the same as the last one drawn present its image again, and
+    // frames where only the lights changed keep the gbuffer and only light it again. on by default, benchmarks that
+    // time the gpu turn it off
+    void setIncrementalRendering(bool enabled);
+    bool getIncrementalRendering() const;
+
+    struct IncrementalStats
+    {
+        unsigned int fullFrames;
+        unsigned int lightingFrames; // the gbuffer was kept
+        unsigned int skippedFrames; // the last image was presented again
+    };
+    const IncrementalStats& getIncrementalStats() const;
+
+    // does nothing on cpus without avx2, where the culler always reports everything visible
+    void toggleOcclusionCulling();
+
+    // culls the gbuffer's instances again a meshlet at a time on the gpu, off draws every instance whole
+    void toggleMeshletCulling();
+
+    // draws the gbuffer with the newest camera the simulation has rather than the one the frame started with
+    void toggleLateLatch();
+
+    // times input events against the first present to show them, stopping prints what was measured
+    void toggleLatencyMeasurement();
+
+    // prints the per frame counters of the renderer to the console
+    void reportStats() const;
+
+    // prints every gl object the renderer owns, with its size and format
+    void reportGpuMemory() const;
+
+    const LightCulling::FrameStats& getLightStats() const;
+
+    // swaps in synthetic lights and instances, takes effect at the start of the next frame
+    void setStressConfig(const StressScene::Config& config);
+    const StressScene::Config& getStressConfig() const;
+    unsigned int getInstanceCount() const;
+
+    // per pass gpu times from a few frames ago
+    const GpuTimer& getGpuTimer() const;
+
+    // heap allocations made by the last windowViewRender, should be zero once the scene has settled
+    const AllocationTracker::Counts& getFrameAllocations() const;
+
 private:
 
     void
@@ -37,72 +139,255 @@ private:
     windowViewRender(std::shared_ptr<tygra::Window> window) override;
 
     std::shared_ptr<const SceneModel::Context> scene_;
+    std::shared_ptr<SceneSimulation> simulation_;
+
+    // the snapshot being drawn, stays valid until the next frame acquires a new one
+    const SceneSnapshot* snapshot;
+    unsigned int appliedInstanceVersion;
 
     float aspectRatio;
 
-    struct Vertex
-    {
-        Vertex(){};
-        Vertex(glm::vec3 pos_, glm::vec3 norm_) : position(pos_), normal(norm_) {}
-        glm::vec3 position, normal;
-    };
     GLuint vertexVBO; // VertexBufferObject for the vertex positions
     GLuint elementVBO; // VertexBufferObject for the elements (indices)
 
-    struct Mesh
-    {
-        GLuint vao;// VertexArrayObject for the shape's vertex array settings
-        GLuint instanceVBO;
-        int startVerticeIndex, endVerticeIndex, verticeCount;
-        int startElementIndex, endElementIndex, element_count; // Needed for when we draw using the vertex arrays
-
-        Mesh() : startVerticeIndex(0),
-            endVerticeIndex(0),
-            verticeCount(0),
-            startElementIndex(0),
-            endElementIndex(0),
-            element_count(0) {}
-    };
     std::vector< Mesh > loadedMeshes;
 
-    struct MaterialData
-    {
-        glm::vec3 colour;
-        float shininess;
-    };
+    // the scene's meshes are decoded on the loader's threads and copied in a budget's worth a frame, anything drawn
+    // skips the meshes that are not resident yet. the vertex and element buffers grow as they fill
+    StreamingLoader streamingLoader;
+    std::vector< float > meshPriorities;
+    std::vector< unsigned int > arrivedMeshes; // scratch, the meshes whose instances got their geometry this frame
+    const StreamingLoader::DecodedMesh* streamingMesh; // the one being copied, it already has its place in the buffers
+    unsigned int geometryVertexCount, geometryVertexCapacity;
+    unsigned int geometryElementCount, geometryElementCapacity;
+
+    // a mesh whose geometry another already has, moved and scaled or not, draws with that one's and its instances are
+    // folded into that one's draws. they are matched as they stream in, whichever of them arrives first keeps its own
+    std::vector< unsigned int > meshShape; // the mesh each one draws with, itself unless it was matched
+    std::vector< glm::mat4 > meshShapeTransform; // from that mesh's space into this one's
+    std::multimap< unsigned long long, unsigned int > shapeOwners; // the resident meshes with their own geometry, by topology hash
+    std::vector< std::vector< Vertex > > shapeVertices; // theirs, kept to match against until streaming finishes
+    std::vector< std::vector< unsigned int > > shapeElements;
+    unsigned int dedupWeldedVertices, dedupSharedMeshes;
+    unsigned long long dedupSharedBytes;
+    unsigned int dedupDrawsBefore, dedupDrawsAfter; // meshes with instances, the draws with everything in view
+
     std::vector< MaterialData > materials;
     GLuint bufferMaterials;
 
-    struct InstanceData
-    {
-        glm::mat4x3 positionData;
-        GLint materialDataIndex;
-    };
     std::vector< std::vector< InstanceData > > instanceData;
+    std::vector< std::vector< InstanceData > > sceneInstanceData; // what the scene itself provides, instanceData is built from this
+    glm::vec3 sceneSourceMin, sceneSourceMax;
+    std::vector< InstanceBounds > instanceBounds; // every instance, one mesh after another
+    std::vector< unsigned int > instanceBase; // first entry of each mesh in instanceBounds and visibilityInstanceSSBO, plus the total
+    glm::vec3 sceneMin, sceneMax;
+
+    // culling goes through this rather than looping over instanceBounds, it is refit when instances move and
+    // rebuilt when the set of instances changes
+    InstanceBvh instanceBvh;
+    std::vector< unsigned int > changedInstances;
+    std::vector< unsigned int > visibleInstances; // scratch for the queries
+    unsigned int bvhSubtreesRebuilt;
+
+    // the instances in the camera's frustum are tested against a few big occluders on the culler's threads while the
+    // shadows and point shadows are drawn, the gbuffer picks up what is left
+    OcclusionCuller occlusionCuller;
+    // read by the culler until the gbuffer finishes it, and drawn as they are if the latched camera moves too far
+    std::vector< unsigned int > cameraInstances;
+    std::vector< OcclusionCuller::Occluder > occluders;
+    std::vector< std::pair<float, unsigned int> > occluderScores;
+    bool occlusionEnabled;
+
+    // what is left goes to the gpu for the gbuffer, split into the meshlets the meshes were given as they were decoded.
+    // the cull shader leaves indirect draws of the meshlets in view, drawn through one vao since they carry their own
+    // base vertex
+    MeshletCuller meshletCuller;
+    ShaderProgram meshletCullProgram;
+    std::vector< Meshlet > meshlets; // every resident mesh's, in the order they arrived
+    GLuint meshletVAO;
+    bool meshletCullingEnabled;
+    bool geometryCullsBackFaces; // the cone test only drops meshlets the gbuffer would have culled anyway
 
-    // cant get access to the MyScene::Light since we are only declaring MyScene as a class (no direct reference)
-    struct LightData
+    // instances that survive culling for a pass are packed in here each frame and drawn with a base instance offset
+    struct PackedDraw
     {
-        glm::vec3 position;
-        float range;
+        unsigned int meshIndex;
+        unsigned int firstInstance;
+        unsigned int instanceCount;
     };
-    std::vector<LightData> lights;
+    std::vector< InstanceData > packedInstances;
+    std::vector< PackedDraw > gbufferDraws;
+    std::vector< PackedDraw > shadowDraws[ShadowCascades::kCascadeCount];
+    std::vector< PackedDraw > pointShadowDraws;
+    std::vector< unsigned int > pointShadowDrawCounts; // how many of pointShadowDraws belong to each light drawn this frame
+    GLuint packedInstanceVBO;
+    unsigned int packedInstanceCapacity;
+    unsigned int packedInstancesUploaded;
+
+    // instances that can move, point shadow maps that contain one have to be redrawn
+    std::vector< unsigned int > dynamicInstances;
+
+    std::vector<LightData> allLights; // every light in the scene this frame
+    unsigned int visibleLightCount; // the ones that survived culling, uploaded biggest first
+    LightCulling lightCulling;
     GLuint bufferRender;
-    Mesh lightMesh, globalLightMesh;
+    Mesh lightMesh, globalLightMesh; // lightMesh only owns the light vao and instances, the proxies are drawn through it
+    Mesh lightProxyMeshes[LightCulling::kProxyCount];
+    float lightProxyScales[LightCulling::kProxyCount];
+
+    ShaderProgram firstPassProgram, backgroundProgram, postProcessProgram, shadowProgram, paraboloidProgram;
 
-    ShaderProgram lightProgram, firstPassProgram, globalLightProgram, backgroundProgram, postProcessProgram;
+    // the lighting's permutations, each pass asks for the variant its features need. the gbuffer draws the shiny
+    // instances last with kStencilSpecular set and the point lights are drawn once per bucket, so the pixels without a
+    // specular material never run the specular
+    ShaderProgram globalLightPrograms, lightPrograms;
+    std::vector< unsigned char > instanceSpecular; // every instance like instanceBounds, 1 where the material has a shininess
+    std::vector< unsigned int > specularInstances; // scratch for the gbuffer's buckets
+    unsigned int gbufferSpecularDraw; // the first of gbufferDraws in the specular bucket
+    unsigned int gbufferBucketInstances[2]; // diffuse then specular, as last drawn into the gbuffer
+    bool sceneHasSpecular;
 
-    GLuint gbufferFBO;
-    GLuint gbufferTO[3];
-    GLuint depthStencilRBO;
+    ShadowCascades shadowCascades;
+    bool shadowsEnabled;
+    // the camera the cascades were fit to, the lookups pick their cascade by it even when the gbuffer was latched
+    glm::vec3 cascadeCameraPosition, cascadeCameraDirection;
+
+    PointShadowAtlas pointShadowAtlas;
+    bool pointShadowsEnabled;
+
+    StressScene stressScene;
+    bool stressDirty;
+
+    GpuTimer gpuTimer;
+
+    // the render thread's helpers, it runs jobs itself while it waits on them
+    JobSystem jobs;
+
+    // scratch for anything that only lives for the frame, reset at the top of windowViewRender
+    FrameArena frameArena;
+    GLUploadSink uploadSink;
+    AllocationTracker::Counts frameAllocations;
+
+    // visibility buffer mode, the geometry pass writes one packed instance and triangle id per pixel and there is no
+    // gbuffer, the lighting rebuilds the surface it needs from the ids and the vertex and element buffers
+    ShaderProgram visibilityProgram;
+    GLuint visibilityInstanceSSBO;
+    std::vector< VisibilityInstance > visibilityInstances; // what goes up into it, kept so a rebuild doesnt allocate
+    GLuint visibilityMeshSSBO;
+    unsigned int visibilityTriangleBits;
+    bool visibilityBufferEnabled;
+    bool visibilityBufferFits; // false when there are too many instances to pack into the bits left over
+
+    // msaa mode, the gbuffer is drawn multisampled and resolved into the normal one for the per pixel lighting. a
+    // classify pass marks the pixels whose samples differ in the stencil and only those are lit again per sample
+    ShaderProgram edgeClassifyProgram;
+    GLuint msaaEdgeQuery;
+    int msaaSamples; // what the driver allows, up to what was asked for
+    GLuint msaaEdgeSamples; // samples lit per sample, from the last classify the query has come back for
+    bool msaaEdgeQueryIssued;
+    bool msaaEnabled;
+
+    // half resolution lights, the gbuffer is downsampled keeping the nearest of each four pixels, the point lights are
+    // drawn at that size and the upsample weights the four nearest by how alike their surfaces are to the pixel's
+    ShaderProgram lightDownsamplePrograms, lightUpsamplePrograms; // a permutation for each way of reading the gbuffer
+    bool halfResolutionLights;
+
+    // the screen sized passes and their targets, built again when the window size or the mode changes. the msaa
+    // targets are only in the graph while it is on, they are four times the size of everything else
+    FrameGraph frameGraph;
+    FrameGraph::Handle gbufferTargets[3], depthStencilTarget, lbufferTarget, postProcessTarget, visibilityTarget;
+    FrameGraph::Handle msaaGbufferTargets[3], msaaDepthStencilTarget, msaaLbufferTarget, backbufferTarget;
+    FrameGraph::Handle halfGbufferTargets[3], halfDepthStencilTarget, halfLbufferTarget; // the half gbuffer's material is its normal, with the shininess in the alpha
+    int graphWidth, graphHeight;
+    bool graphMsaa, graphVisibility, graphHalfLights, graphCapture, graphIncremental;
+    bool graphDirty;
+    glm::mat4 frameProjectionView; // for the passes, which the graph calls after windowViewRender has worked it out
+    glm::vec3 frameCameraPosition;
+
+    // the first geometry pass of a full frame swaps in the simulation's newest camera if it has moved on from the
+    // snapshot's. the cpu culls with a wider field of view while it is on, to cover what the camera turns through,
+    // and drops the occlusion results for a frame whose camera has moved too far from where they were worked out
+    CameraLatch cameraLatch;
+    bool lateLatchEnabled;
+    bool frameLatched; // by whichever geometry pass ran first
+    unsigned int frameCameraTick; // the simulation tick whose camera the frame shows
+    unsigned long long latchTicksAhead; // summed over the frames whose latched camera was newer than their snapshot's
+    unsigned int latchOcclusionSkips;
+    LatencyMeter latencyMeter;
+
+    // incremental rendering, what the last frame drawn was drawn with. the geometry passes keep their targets and
+    // anything that changes what they would draw asks for a full frame, settings that only change the lighting ask for
+    // a lighting frame
+    enum FrameKind
+    {
+        kFrameFull,
+        kFrameLighting,
+        kFrameSkipped
+    };
+    bool incrementalRendering;
+    bool fullFrameNeeded;
+    bool lightingFrameNeeded;
+    glm::vec3 drawnCameraPosition, drawnCameraDirection;
+    glm::vec3 drawnGlobalLightDirection, drawnGlobalLightIntensity;
+    std::vector<LightData> drawnLights;
+    IncrementalStats incrementalStats;
 
-    GLuint lbufferFBO;
-	GLuint lbufferTO;
-    GLuint lbufferColourRBO;
+    // frame capture, a kept pass after the post process reads the frame back and the capture's threads write it out
+    FrameCapture frameCapture;
+    bool captureEnabled;
 
-	GLuint postProcessFBO;
-	GLuint postProcessColourRBO;
+    // several views of the scene drawn after the frame into layered targets, lit without the cascaded shadows since
+    // those only cover the main camera. the lights are culled again for every view, by a culler of their own so the
+    // frame's stats are left alone
+    ViewBatch viewBatch;
+    ShaderProgram batchGeometryProgram, batchGlobalLightPrograms, batchLightPrograms;
+    LightCulling batchLightCulling;
+    std::vector< ViewBatch::View > batchViews;
+    int batchWidth, batchHeight;
+    bool batchOneAtATime;
+    bool batchRequested;
+    int batchBenchmarkFrames; // left to draw, 0 when the benchmark isnt running
+    unsigned int batchBenchmarkSeen; // the stats' batchesTimed when they were last looked at
+    unsigned int batchBenchmarkTimed[2]; // batched then one at a time
+    double batchBenchmarkMilliseconds[2];
+    unsigned int batchBenchmarkViews[2];
 
     void SetBuffer(glm::mat4 projectMat_, glm::vec3 camPos_);
-	void UpdateLights();
+	void UpdateLights(const glm::mat4& projectMat_, const glm::mat4& projectViewMat_, const glm::vec3& camPos_, float viewportHeight_);
+    GLuint SetupMeshVAO(GLuint instanceVBO_);
+    void StreamGeometry();
+    void PlaceStreamedMesh(const StreamingLoader::DecodedMesh& decoded_);
+    bool ShareStreamedMesh(const StreamingLoader::DecodedMesh& decoded_);
+    void CollapseSharedMeshes(std::vector< std::vector< InstanceData > >& instances_);
+    void SetupVisibilityMeshes();
+    void RebuildInstances(bool instancesMoved_ = false);
+    void BuildInstanceData(); // the stress scene's copies of the scene instances, or just them
+    void ApplySnapshotInstances();
+    void ApplyStressScene();
+    void UploadPackedInstances();
+    bool PackVisibleInstances(std::vector<unsigned int>& visible_, std::vector<PackedDraw>& draws_);
+    void RenderShadows(const glm::mat4& viewMatrix_);
+    void RenderPointShadows();
+    void CullInstances(const glm::mat4& projectViewMat_);
+    void SelectOccluders();
+    void BuildFrameGraph(bool msaa_, bool visibility_, bool halfLights_, bool capture_, bool incremental_);
+    void RenderGBuffer();
+    void RenderGBufferMeshlets();
+    void LatchCamera();
+    void ResolveMsaaGBuffer();
+    void ClassifyEdges();
+    const GLuint* GraphTextures(const FrameGraph::Handle* targets_, GLuint* textures_) const; // the three gbuffer targets' textures
+    // the lighting functions take a null gbuffer_ to read the visibility buffer instead, through this
+    void BindVisibilityBuffer(ShaderProgram& program_);
+    void RenderGlobalLight(ShaderProgram& program_, GLenum gbufferTarget_, const GLuint* gbuffer_);
+    // stencilRef_ is what the pass tests for, the lights are drawn once per specular bucket on top of it. a negative
+    // one means the stencil has no specular bit and every pixel gets the same permutation
+    void RenderPointLights(ShaderProgram& programs_, unsigned int features_, GLenum gbufferTarget_, const GLuint* gbuffer_, const LightCulling& culling_, GLint stencilRef_);
+    void DrawPointLights(ShaderProgram& program_, GLenum gbufferTarget_, const GLuint* gbuffer_, const LightCulling& culling_);
+    FrameKind ClassifyFrame();
+    void RenderViewBatch();
+    void UpdateViewBatchBenchmark();
+    void DownsampleLightGBuffer();
+    void UpsampleLights();
+    void RenderVisibilityIds();
 };
@@ -0,0 +1,646 @@
+#include "OcclusionCuller.hpp"
+#include "CpuTimer.hpp"
+#include "TraceCapture.hpp"
+
+#include <immintrin.h>
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+    // the working layer's depth when nothing has been merged into it, nearer than anything real
+    const float kEmptyLayer = FLT_MAX;
+
+    const char* const kThreadNames[OcclusionCuller::kMaxThreads] =
+    {
+        "occlusion 0", "occlusion 1", "occlusion 2", "occlusion 3",
+        "occlusion 4", "occlusion 5", "occlusion 6", "occlusion 7"
+    };
+
+    // sutherland hodgman against the near plane (z + w >= 0), a triangle comes out as up to four vertices
+    int ClipNear(const glm::vec4* in_, glm::vec4* out_)
+    {
+        int count = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            const glm::vec4& a = in_[i];
+            const glm::vec4& b = in_[(i + 1) % 3];
+            const float da = a.z + a.w;
+            const float db = b.z + b.w;
+            if (da >= 0.f)
+            {
+                out_[count++] = a;
+            }
+            if ((da >= 0.f) != (db >= 0.f))
+            {
+                const float t = da / (da - db);
+                out_[count++] = a + (b - a) * t;
+            }
+        }
+        return count;
+    }
+}
+
+OcclusionCuller::OcclusionCuller() : occluders(nullptr),
+    bounds(nullptr),
+    candidates(nullptr),
+    threadCount(0),
+    supported(false),
+    generation(0),
+    finished(0),
+    quitting(false),
+    pending(false),
+    startTime(0),
+    finishTime(0),
+    barrierCount(0),
+    barrierGeneration(0)
+{
+    stats.occluders = 0;
+    stats.triangles = 0;
+    stats.tested = 0;
+    stats.culled = 0;
+    stats.milliseconds = 0;
+    stats.waitMilliseconds = 0;
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+    stop();
+}
+
+bool OcclusionCuller::isSupported()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+
+    // the os has to save the ymm registers as well as the cpu having them
+    __cpuid(info, 1);
+    const int osxsaveAndAvx = (1 << 27) | (1 << 28);
+    if ((info[2] & osxsaveAndAvx) != osxsaveAndAvx || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+void OcclusionCuller::start(unsigned int threadCount_)
+{
+    stop();
+
+    supported = isSupported();
+    if (threadCount_ == 0)
+    {
+        const unsigned int hardware = std::thread::hardware_concurrency();
+        threadCount_ = hardware > 3 ? std::min(hardware - 2, 4u) : 1;
+    }
+    threadCount = std::min(threadCount_, static_cast<unsigned int>(kMaxThreads));
+
+    tileFar.assign(kTilesX * kTilesY, 0.f);
+    tileWorkingFar.assign(kTilesX * kTilesY, kEmptyLayer);
+    tileMask.assign(kTilesX * kTilesY, 0);
+
+    if (!supported)
+    {
+        return;
+    }
+
+    // the new threads start out having seen generation 0
+    quitting = false;
+    generation = 0;
+    for (unsigned int t = 0; t < threadCount; ++t)
+    {
+        threads.push_back(std::thread(&OcclusionCuller::run, this, t));
+    }
+}
+
+void OcclusionCuller::stop()
+{
+    if (threads.empty())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quitting = true;
+    }
+    wake.notify_all();
+    for (unsigned int t = 0; t < threads.size(); ++t)
+    {
+        threads[t].join();
+    }
+    threads.clear();
+    pending = false;
+}
+
+void OcclusionCuller::setGeometry(const std::vector<Vertex>& vertices_, const std::vector<unsigned int>& elements_, const std::vector<Mesh>& meshes_)
+{
+    assert(!pending);
+    meshes.resize(meshes_.size());
+    positions.clear();
+    indices.clear();
+    for (unsigned int i = 0; i < meshes_.size(); ++i)
+    {
+        const Mesh& mesh = meshes_[i];
+        if (mesh.element_count == 0)
+        {
+            meshes[i].triangleCount = 0;
+            continue;
+        }
+        appendMesh(i, &vertices_[mesh.startVerticeIndex], mesh.endVerticeIndex - mesh.startVerticeIndex + 1,
+            &elements_[mesh.startElementIndex], mesh.element_count);
+    }
+}
+
+void OcclusionCuller::addMesh(unsigned int mesh_, const std::vector<Vertex>& vertices_, const std::vector<unsigned int>& elements_)
+{
+    assert(!pending);
+    if (mesh_ >= meshes.size())
+    {
+        MeshGeometry empty = { 0, 0, 0 };
+        meshes.resize(mesh_ + 1, empty);
+    }
+    if (elements_.empty())
+    {
+        meshes[mesh_].triangleCount = 0;
+        return;
+    }
+    appendMesh(mesh_, vertices_.data(), vertices_.size(), elements_.data(), elements_.size());
+}
+
+void OcclusionCuller::appendMesh(unsigned int mesh_, const Vertex* vertices_, unsigned int vertexCount_, const unsigned int* elements_, unsigned int elementCount_)
+{
+    MeshGeometry& geometry = meshes[mesh_];
+    geometry.firstPosition = positions.size();
+    geometry.firstIndex = indices.size();
+    geometry.triangleCount = elementCount_ / 3;
+    if (geometry.triangleCount == 0 || geometry.triangleCount > static_cast<unsigned int>(kMaxOccluderTriangles))
+    {
+        geometry.triangleCount = 0;
+        return;
+    }
+
+    for (unsigned int v = 0; v < vertexCount_; ++v)
+    {
+        positions.push_back(vertices_[v].position);
+    }
+    // the elements are already relative to the mesh's first vertex, they are drawn with a base vertex
+    indices.insert(indices.end(), elements_, elements_ + elementCount_);
+}
+
+bool OcclusionCuller::isOccluderMesh(unsigned int mesh_) const
+{
+    return mesh_ < meshes.size() && meshes[mesh_].triangleCount > 0;
+}
+
+unsigned int OcclusionCuller::getTriangleCount(unsigned int mesh_) const
+{
+    return mesh_ < meshes.size() ? meshes[mesh_].triangleCount : 0;
+}
+
+void OcclusionCuller::cull(const glm::mat4& projectionView_,
+    const std::vector<Occluder>& occluders_,
+    const std::vector<InstanceBounds>& bounds_,
+    const std::vector<unsigned int>& candidates_)
+{
+    assert(!pending);
+    projectionView = projectionView_;
+    occluders = &occluders_;
+    bounds = &bounds_;
+    candidates = &candidates_;
+    occluded.assign(candidates_.size(), 0);
+
+    stats.occluders = occluders_.size();
+    stats.tested = candidates_.size();
+    stats.triangles = 0;
+    stats.culled = 0;
+    stats.milliseconds = 0;
+    stats.waitMilliseconds = 0;
+
+    if (threads.empty())
+    {
+        return;
+    }
+
+    startTime = CpuTimeSeconds();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = 0;
+        ++generation;
+        pending = true;
+    }
+    wake.notify_all();
+}
+
+void OcclusionCuller::finish(std::vector<unsigned int>& visible_)
+{
+    if (pending)
+    {
+        TRACE_SCOPE("occlusion_wait");
+        const double begin = CpuTimeSeconds();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (finished < threadCount)
+            {
+                done.wait(lock);
+            }
+            pending = false;
+        }
+        stats.waitMilliseconds = (CpuTimeSeconds() - begin) * 1000.0;
+        stats.milliseconds = (finishTime - startTime) * 1000.0;
+
+        for (unsigned int t = 0; t < threadCount; ++t)
+        {
+            stats.triangles += triangles[t].size();
+        }
+    }
+
+    for (unsigned int i = 0; i < occluded.size(); ++i)
+    {
+        if (occluded[i])
+        {
+            ++stats.culled;
+        }
+        else
+        {
+            visible_.push_back((*candidates)[i]);
+        }
+    }
+}
+
+const OcclusionCuller::FrameStats& OcclusionCuller::getFrameStats() const
+{
+    return stats;
+}
+
+void OcclusionCuller::run(unsigned int thread_)
+{
+    TraceCapture::nameCurrentThread(kThreadNames[thread_]);
+
+    unsigned int seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!quitting && generation == seen)
+            {
+                wake.wait(lock);
+            }
+            if (quitting)
+            {
+                return;
+            }
+            seen = generation;
+        }
+
+        {
+            TRACE_SCOPE("occlusion_setup");
+            setupTriangles(thread_);
+        }
+        barrier();
+        {
+            TRACE_SCOPE("occlusion_raster");
+            rasteriseBand(thread_);
+        }
+        barrier();
+        {
+            TRACE_SCOPE("occlusion_test");
+            testCandidates(thread_);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++finished == threadCount)
+        {
+            finishTime = CpuTimeSeconds();
+            done.notify_all();
+        }
+    }
+}
+
+void OcclusionCuller::barrier()
+{
+    std::unique_lock<std::mutex> lock(barrierMutex);
+    const unsigned int arrived = barrierGeneration;
+    if (++barrierCount == threadCount)
+    {
+        barrierCount = 0;
+        ++barrierGeneration;
+        barrierCondition.notify_all();
+        return;
+    }
+    while (arrived == barrierGeneration)
+    {
+        barrierCondition.wait(lock);
+    }
+}
+
+void OcclusionCuller::setupTriangles(unsigned int thread_)
+{
+    std::vector<ScreenTriangle>& out = triangles[thread_];
+    out.clear();
+
+    const unsigned int begin = occluders->size() * thread_ / threadCount;
+    const unsigned int end = occluders->size() * (thread_ + 1) / threadCount;
+    for (unsigned int o = begin; o < end; ++o)
+    {
+        const Occluder& occluder = (*occluders)[o];
+        const MeshGeometry& geometry = meshes[occluder.mesh];
+        const glm::mat4 transform = projectionView * glm::mat4(occluder.transform);
+        const glm::vec3* meshPositions = positions.data() + geometry.firstPosition;
+        const unsigned int* meshIndices = indices.data() + geometry.firstIndex;
+
+        for (unsigned int t = 0; t < geometry.triangleCount; ++t)
+        {
+            glm::vec4 clip[3];
+            for (int v = 0; v < 3; ++v)
+            {
+                clip[v] = transform * glm::vec4(meshPositions[meshIndices[t * 3 + v]], 1.f);
+            }
+
+            // all three off the same side of the view, nothing to draw
+            if ((clip[0].x > clip[0].w && clip[1].x > clip[1].w && clip[2].x > clip[2].w) ||
+                (clip[0].x < -clip[0].w && clip[1].x < -clip[1].w && clip[2].x < -clip[2].w) ||
+                (clip[0].y > clip[0].w && clip[1].y > clip[1].w && clip[2].y > clip[2].w) ||
+                (clip[0].y < -clip[0].w && clip[1].y < -clip[1].w && clip[2].y < -clip[2].w))
+            {
+                continue;
+            }
+
+            glm::vec4 clipped[4];
+            const int count = ClipNear(clip, clipped);
+            if (count < 3)
+            {
+                continue;
+            }
+
+            ScreenTriangle screen[2];
+            float x[4], y[4], depth[4];
+            for (int v = 0; v < count; ++v)
+            {
+                const float inverseW = 1.f / clipped[v].w;
+                x[v] = (clipped[v].x * inverseW * 0.5f + 0.5f) * kWidth;
+                y[v] = (clipped[v].y * inverseW * 0.5f + 0.5f) * kHeight;
+                depth[v] = inverseW;
+            }
+            // a quad out of the clipper is fanned into two
+            for (int f = 0; f + 2 < count; ++f)
+            {
+                const int corners[3] = { 0, f + 1, f + 2 };
+                for (int v = 0; v < 3; ++v)
+                {
+                    screen[f].x[v] = x[corners[v]];
+                    screen[f].y[v] = y[corners[v]];
+                    screen[f].depth[v] = depth[corners[v]];
+                }
+                out.push_back(screen[f]);
+            }
+        }
+    }
+}
+
+void OcclusionCuller::rasteriseBand(unsigned int thread_)
+{
+    const int firstRow = kTilesY * thread_ / threadCount;
+    const int endRow = kTilesY * (thread_ + 1) / threadCount;
+
+    std::fill(tileFar.begin() + firstRow * kTilesX, tileFar.begin() + endRow * kTilesX, 0.f);
+    std::fill(tileWorkingFar.begin() + firstRow * kTilesX, tileWorkingFar.begin() + endRow * kTilesX, kEmptyLayer);
+    std::fill(tileMask.begin() + firstRow * kTilesX, tileMask.begin() + endRow * kTilesX, 0u);
+
+    // every thread's triangles, in the order they were set up
+    for (unsigned int t = 0; t < threadCount; ++t)
+    {
+        const std::vector<ScreenTriangle>& list = triangles[t];
+        for (unsigned int i = 0; i < list.size(); ++i)
+        {
+            rasteriseTriangle(list[i], firstRow, endRow);
+        }
+    }
+}
+
+void OcclusionCuller::rasteriseTriangle(const ScreenTriangle& triangle_, int firstRow_, int endRow_)
+{
+    const float* x = triangle_.x;
+    const float* y = triangle_.y;
+    const float* d = triangle_.depth;
+
+    const float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (std::abs(area) < 1e-4f)
+    {
+        return;
+    }
+
+    const float minX = std::min(x[0], std::min(x[1], x[2]));
+    const float maxX = std::max(x[0], std::max(x[1], x[2]));
+    const float minY = std::min(y[0], std::min(y[1], y[2]));
+    const float maxY = std::max(y[0], std::max(y[1], y[2]));
+    if (maxX < 0.f || minX >= kWidth || maxY < 0.f || minY >= kHeight)
+    {
+        return;
+    }
+
+    const int firstTileX = std::max(0, static_cast<int>(minX) / kTileWidth);
+    const int lastTileX = std::min(kTilesX - 1, static_cast<int>(maxX) / kTileWidth);
+    const int firstTileY = std::max(firstRow_, static_cast<int>(std::max(minY, 0.f)) / kTileHeight);
+    const int endTileY = std::min(endRow_, static_cast<int>(maxY) / kTileHeight + 1);
+    if (firstTileY >= endTileY)
+    {
+        return;
+    }
+
+    // edge i runs from vertex i to the next, a x + b y + c >= 0 inside whichever way round the triangle is
+    const float sign = area > 0.f ? 1.f : -1.f;
+    float edgeA[3], edgeB[3], edgeC[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        const int j = (i + 1) % 3;
+        edgeA[i] = (y[i] - y[j]) * sign;
+        edgeB[i] = (x[j] - x[i]) * sign;
+        edgeC[i] = (x[i] * y[j] - x[j] * y[i]) * sign;
+    }
+
+    // 1 / w is a plane across the screen, the farthest it gets over a tile is at one of the tile's corners
+    const float depthA = ((d[1] - d[0]) * (y[2] - y[0]) - (d[2] - d[0]) * (y[1] - y[0])) / area;
+    const float depthB = ((d[2] - d[0]) * (x[1] - x[0]) - (d[1] - d[0]) * (x[2] - x[0])) / area;
+    const float depthC = d[0] - depthA * x[0] - depthB * y[0];
+    const float minDepth = std::min(d[0], std::min(d[1], d[2]));
+
+    const __m256i laneOffsets = _mm256_setr_epi32(0, 8, 16, 24, 32, 40, 48, 56);
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i eight = _mm256_set1_epi32(kTileWidth);
+    const __m256 emptyLayer = _mm256_set1_ps(kEmptyLayer);
+    const __m256 cornerX = _mm256_set1_ps(depthA > 0.f ? 0.f : static_cast<float>(kTileWidth));
+    const __m256 depthSlopeX = _mm256_set1_ps(depthA);
+    const __m256 clampDepth = _mm256_set1_ps(minDepth);
+
+    for (int tileY = firstTileY; tileY < endTileY; ++tileY)
+    {
+        // the span of each pixel row in the tile row, sampled at pixel centres
+        int spanFirst[kTileHeight], spanEnd[kTileHeight];
+        for (int r = 0; r < kTileHeight; ++r)
+        {
+            const float centreY = tileY * kTileHeight + r + 0.5f;
+            float left = -1.f;
+            float right = kWidth + 1.f;
+            for (int e = 0; e < 3; ++e)
+            {
+                const float k = edgeB[e] * centreY + edgeC[e];
+                if (edgeA[e] > 0.f)
+                {
+                    left = std::max(left, -k / edgeA[e]);
+                }
+                else if (edgeA[e] < 0.f)
+                {
+                    right = std::min(right, -k / edgeA[e]);
+                }
+                else if (k < 0.f)
+                {
+                    right = -1.f;
+                }
+            }
+            spanFirst[r] = static_cast<int>(std::ceil(left - 0.5f));
+            spanEnd[r] = right >= left ? static_cast<int>(std::floor(right - 0.5f)) + 1 : spanFirst[r];
+        }
+
+        const float tileTop = static_cast<float>(tileY * kTileHeight) + (depthB > 0.f ? 0.f : static_cast<float>(kTileHeight));
+        const __m256 rowDepth = _mm256_set1_ps(depthB * tileTop + depthC);
+
+        for (int group = firstTileX & ~7; group <= lastTileX; group += 8)
+        {
+            const __m256i tileX = _mm256_add_epi32(_mm256_set1_epi32(group * kTileWidth), laneOffsets);
+
+            // eight tiles of coverage at once, each row's span shifted into its byte of the mask
+            __m256i coverage = zero;
+            for (int r = 0; r < kTileHeight; ++r)
+            {
+                const __m256i first = _mm256_min_epi32(_mm256_max_epi32(_mm256_sub_epi32(_mm256_set1_epi32(spanFirst[r]), tileX), zero), eight);
+                const __m256i end = _mm256_min_epi32(_mm256_max_epi32(_mm256_sub_epi32(_mm256_set1_epi32(spanEnd[r]), tileX), zero), eight);
+                const __m256i bits = _mm256_and_si256(_mm256_sllv_epi32(byteMask, first), _mm256_srlv_epi32(byteMask, _mm256_sub_epi32(eight, end)));
+                coverage = _mm256_or_si256(coverage, _mm256_sllv_epi32(_mm256_and_si256(bits, byteMask), _mm256_set1_epi32(r * 8)));
+            }
+
+            const __m256 covered = _mm256_castsi256_ps(_mm256_xor_si256(_mm256_cmpeq_epi32(coverage, zero), _mm256_set1_epi32(-1)));
+            if (_mm256_movemask_ps(covered) == 0)
+            {
+                continue;
+            }
+
+            // the farthest the triangle gets over each tile, never past its farthest vertex
+            const __m256 tileLeft = _mm256_add_ps(_mm256_cvtepi32_ps(tileX), cornerX);
+            const __m256 triangleFar = _mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(depthSlopeX, tileLeft), rowDepth), clampDepth);
+
+            const int index = tileY * kTilesX + group;
+            __m256 far0 = _mm256_loadu_ps(&tileFar[index]);
+            __m256 far1 = _mm256_loadu_ps(&tileWorkingFar[index]);
+            __m256i mask = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&tileMask[index]));
+
+            // a triangle well in front of the working layer, compared to the gap between the layers, starts it again
+            const __m256 restart = _mm256_cmp_ps(_mm256_sub_ps(triangleFar, far1), _mm256_sub_ps(far1, far0), _CMP_GT_OQ);
+            __m256 newFar1 = _mm256_blendv_ps(far1, emptyLayer, restart);
+            __m256i newMask = _mm256_andnot_si256(_mm256_castps_si256(restart), mask);
+
+            newFar1 = _mm256_min_ps(newFar1, triangleFar);
+            newMask = _mm256_or_si256(newMask, coverage);
+
+            // once the working layer covers the whole tile it becomes what everything else is tested against
+            const __m256 full = _mm256_castsi256_ps(_mm256_cmpeq_epi32(newMask, _mm256_set1_epi32(-1)));
+            const __m256 newFar0 = _mm256_blendv_ps(far0, _mm256_max_ps(far0, newFar1), full);
+            newFar1 = _mm256_blendv_ps(newFar1, emptyLayer, full);
+            newMask = _mm256_andnot_si256(_mm256_castps_si256(full), newMask);
+
+            far0 = _mm256_blendv_ps(far0, newFar0, covered);
+            far1 = _mm256_blendv_ps(far1, newFar1, covered);
+            mask = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(mask), _mm256_castsi256_ps(newMask), covered));
+
+            _mm256_storeu_ps(&tileFar[index], far0);
+            _mm256_storeu_ps(&tileWorkingFar[index], far1);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&tileMask[index]), mask);
+        }
+    }
+}
+
+void OcclusionCuller::testCandidates(unsigned int thread_)
+{
+    const unsigned int begin = candidates->size() * thread_ / threadCount;
+    const unsigned int end = candidates->size() * (thread_ + 1) / threadCount;
+    for (unsigned int i = begin; i < end; ++i)
+    {
+        occluded[i] = isOccluded((*bounds)[(*candidates)[i]]) ? 1 : 0;
+    }
+}
+
+bool OcclusionCuller::isOccluded(const InstanceBounds& bounds_) const
+{
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float nearest = 0.f;
+    for (int c = 0; c < 8; ++c)
+    {
+        const glm::vec3 corner((c & 1) ? bounds_.max.x : bounds_.min.x,
+            (c & 2) ? bounds_.max.y : bounds_.min.y,
+            (c & 4) ? bounds_.max.z : bounds_.min.z);
+        const glm::vec4 clip = projectionView * glm::vec4(corner, 1.f);
+
+        // crossing the near plane, the camera could be inside it
+        if (clip.z + clip.w < 0.f)
+        {
+            return false;
+        }
+
+        const float inverseW = 1.f / clip.w;
+        const float x = (clip.x * inverseW * 0.5f + 0.5f) * kWidth;
+        const float y = (clip.y * inverseW * 0.5f + 0.5f) * kHeight;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::max(nearest, inverseW);
+    }
+
+    if (maxX < 0.f || minX >= kWidth || maxY < 0.f || minY >= kHeight)
+    {
+        return true;
+    }
+
+    const int firstTileX = std::max(0, static_cast<int>(std::max(minX, 0.f)) / kTileWidth);
+    const int lastTileX = std::min(kTilesX - 1, static_cast<int>(maxX) / kTileWidth);
+    const int firstTileY = std::max(0, static_cast<int>(std::max(minY, 0.f)) / kTileHeight);
+    const int lastTileY = std::min(kTilesY - 1, static_cast<int>(maxY) / kTileHeight);
+
+    // visible as soon as one tile's far depth isnt in front of the box's nearest point
+    const __m256 boxNearest = _mm256_set1_ps(nearest);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (int tileY = firstTileY; tileY <= lastTileY; ++tileY)
+    {
+        for (int group = firstTileX & ~7; group <= lastTileX; group += 8)
+        {
+            const __m256i tileX = _mm256_add_epi32(_mm256_set1_epi32(group), lanes);
+            const __m256i inRange = _mm256_andnot_si256(
+                _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(firstTileX), tileX), _mm256_cmpgt_epi32(tileX, _mm256_set1_epi32(lastTileX))),
+                _mm256_set1_epi32(-1));
+            const __m256 far0 = _mm256_loadu_ps(&tileFar[tileY * kTilesX + group]);
+            const __m256 visible = _mm256_and_ps(_mm256_cmp_ps(far0, boxNearest, _CMP_LE_OQ), _mm256_castsi256_ps(inRange));
+            if (_mm256_movemask_ps(visible) != 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,159 @@
+#pragma once
+#ifndef OCCLUSION_CULLER_HPP
+#define OCCLUSION_CULLER_HPP
+
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "RenderTypes.hpp"
+
+/*
+software occlusion culling on the cpu, after masked occlusion culling (hasselgren, magnusson and munkberg).
+
+a few big occluders are rasterised into a low resolution buffer of 8x4 pixel tiles. each tile keeps a coverage
+mask and two depths instead of a depth per pixel, the far depth of everything that has covered the whole tile and
+a working layer that triangles are merged into until their masks fill the tile. the spans of each pixel row are
+turned into masks for eight tiles at once with avx2, and the boxes of the instances left after frustum culling are
+tested against the tiles the same way.
+
+depths are 1 / w so they interpolate linearly across the screen, bigger is nearer.
+
+the work runs on its own threads, cull hands a frame over and returns, and finish waits for it. the threads split
+the occluders to set up the triangles, split the screen into bands to rasterise, then split the instances to test.
+without avx2 everything is reported visible.
+*/
+class OcclusionCuller
+{
+public:
+
+    static const int kWidth = 320;
+    static const int kHeight = 180;
+    static const int kTileWidth = 8;
+    static const int kTileHeight = 4;
+    static const int kTilesX = kWidth / kTileWidth;
+    static const int kTilesY = kHeight / kTileHeight;
+    static const int kMaxThreads = 8;
+
+    // meshes with more triangles than this are never occluders, they are rarely big flat walls
+    static const int kMaxOccluderTriangles = 4096;
+
+    struct Occluder
+    {
+        unsigned int mesh;
+        glm::mat4x3 transform;
+    };
+
+    struct FrameStats
+    {
+        unsigned int occluders;
+        unsigned int triangles; // after near plane clipping
+        unsigned int tested;
+        unsigned int culled;
+        double milliseconds; // from the frame being handed over to the last thread finishing
+        double waitMilliseconds; // how long finish blocked the render thread
+    };
+
+    OcclusionCuller();
+    ~OcclusionCuller();
+
+    // true when the cpu and os support avx2
+    static bool isSupported();
+
+    // threadCount_ of 0 picks a few less than the hardware has, leaving room for the render and simulation threads
+    void start(unsigned int threadCount_ = 0);
+    void stop();
+
+    // copies the positions and triangles of every mesh small enough to be an occluder
+    void setGeometry(const std::vector<Vertex>& vertices_, const std::vector<unsigned int>& elements_, const std::vector<Mesh>& meshes_);
+
+    // for a mesh that turns up after setGeometry, its elements relative to vertices_. not while a cull is running
+    void addMesh(unsigned int mesh_, const std::vector<Vertex>& vertices_, const std::vector<unsigned int>& elements_);
+    bool isOccluderMesh(unsigned int mesh_) const;
+    unsigned int getTriangleCount(unsigned int mesh_) const;
+
+    // hands the frame to the threads and returns, nothing passed in may change until finish has been called and
+    // every cull has to be finished before the next
+    void cull(const glm::mat4& projectionView_,
+        const std::vector<Occluder>& occluders_,
+        const std::vector<InstanceBounds>& bounds_,
+        const std::vector<unsigned int>& candidates_);
+
+    // waits for the frame and appends the candidates that were not occluded
+    void finish(std::vector<unsigned int>& visible_);
+
+    const FrameStats& getFrameStats() const;
+
+protected:
+
+    struct MeshGeometry
+    {
+        unsigned int firstPosition;
+        unsigned int firstIndex;
+        unsigned int triangleCount; // 0 for meshes that are not occluders
+    };
+
+    // a triangle after clipping, in pixels
+    struct ScreenTriangle
+    {
+        float x[3], y[3];
+        float depth[3];
+    };
+
+    std::vector<MeshGeometry> meshes;
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices; // relative to the mesh's first position
+
+    // the tiles, structure of arrays a row at a time
+    std::vector<float> tileFar; // everything behind this is hidden by something covering the whole tile
+    std::vector<float> tileWorkingFar;
+    std::vector<unsigned int> tileMask;
+
+    // the frame being worked on
+    glm::mat4 projectionView;
+    const std::vector<Occluder>* occluders;
+    const std::vector<InstanceBounds>* bounds;
+    const std::vector<unsigned int>* candidates;
+    std::vector<unsigned char> occluded;
+    std::vector<ScreenTriangle> triangles[kMaxThreads];
+
+    std::vector<std::thread> threads;
+    unsigned int threadCount;
+    bool supported;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned int generation;
+    unsigned int finished;
+    bool quitting;
+    bool pending;
+    double startTime;
+    double finishTime;
+
+    // every thread waits here between the phases
+    std::mutex barrierMutex;
+    std::condition_variable barrierCondition;
+    unsigned int barrierCount;
+    unsigned int barrierGeneration;
+
+    FrameStats stats;
+
+    void appendMesh(unsigned int mesh_, const Vertex* vertices_, unsigned int vertexCount_, const unsigned int* elements_, unsigned int elementCount_);
+    void run(unsigned int thread_);
+    void barrier();
+    void setupTriangles(unsigned int thread_);
+    void rasteriseBand(unsigned int thread_);
+    void rasteriseTriangle(const ScreenTriangle& triangle_, int firstRow_, int endRow_);
+    void testCandidates(unsigned int thread_);
+    bool isOccluded(const InstanceBounds& bounds_) const;
+
+private:
+
+    OcclusionCuller(const OcclusionCuller&);
+    OcclusionCuller& operator=(const OcclusionCuller&);
+};
+
+#endif //OCCLUSION_CULLER_HPP
@@ -0,0 +1,312 @@
+#include "PointShadowAtlas.hpp"
+#include "GpuMemory.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+// hemisphere size and how much of the atlas height each tier gets, the slots are two hemispheres wide
+static const int kTierSizes[PointShadowAtlas::kTierCount] = { 512, 256, 128 };
+static const int kTierHeights[PointShadowAtlas::kTierCount] = { 2048, 1024, 1024 };
+
+PointShadowAtlas::PointShadowAtlas() : depthTexture(0), fbo(0), created(false)
+{
+    int y = 0;
+    for (int t = 0; t < kTierCount; ++t)
+    {
+        const int size = kTierSizes[t];
+        for (int row = 0; row < kTierHeights[t] / size; ++row)
+        {
+            for (int column = 0; column < kAtlasSize / (size * 2); ++column)
+            {
+                Slot slot;
+                slot.x = column * size * 2;
+                slot.y = y + row * size;
+                slot.size = size;
+                slot.tier = t;
+                slots.push_back(slot);
+            }
+        }
+        y += kTierHeights[t];
+    }
+
+    // hand out from the front of each tier first, purely so its easier to read in a debugger
+    for (int i = static_cast<int>(slots.size()) - 1; i >= 0; --i)
+    {
+        freeSlots[slots[i].tier].push_back(i);
+    }
+
+    stats.slotsInUse = 0;
+    stats.mapsRendered = 0;
+    stats.mapsReused = 0;
+    stats.mapsPending = 0;
+}
+
+PointShadowAtlas::~PointShadowAtlas()
+{
+
+}
+
+void PointShadowAtlas::createAtlas()
+{
+    glGenTextures(1, &depthTexture);
+    GpuMemory::track(GpuMemory::kTexture, depthTexture, GpuMemory::kShadowMaps, "point_shadow_atlas");
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexImage2D(GL_TEXTURE_2D,
+        0,
+        GL_DEPTH_COMPONENT32F,
+        kAtlasSize,
+        kAtlasSize,
+        0,
+        GL_DEPTH_COMPONENT,
+        GL_FLOAT,
+        NULL);
+    GpuMemory::textureStorage(depthTexture, GL_DEPTH_COMPONENT32F, kAtlasSize, kAtlasSize);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &fbo);
+    GpuMemory::track(GpuMemory::kFramebuffer, fbo, GpuMemory::kObjects, "point_shadow_atlas");
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        tglDebugMessage(GL_DEBUG_SEVERITY_HIGH, "point shadow atlas not complete");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // nothing in the new texture is valid yet
+    for (unsigned int i = 0; i < lightStates.size(); ++i)
+    {
+        lightStates[i].rendered = false;
+    }
+    created = true;
+}
+
+void PointShadowAtlas::deleteAtlas()
+{
+    if (!created)
+    {
+        return;
+    }
+    created = false;
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &depthTexture);
+    GpuMemory::release(GpuMemory::kFramebuffer, fbo);
+    GpuMemory::release(GpuMemory::kTexture, depthTexture);
+}
+
+void PointShadowAtlas::releaseSlot(LightState& light_)
+{
+    if (light_.slot >= 0)
+    {
+        freeSlots[slots[light_.slot].tier].push_back(light_.slot);
+    }
+    light_.slot = -1;
+    light_.tier = -1;
+    light_.rendered = false;
+}
+
+void PointShadowAtlas::allocateSlots(const std::vector<float>& importance_)
+{
+    // lights that went away give their slots back before anything else is handed out
+    for (unsigned int i = importance_.size(); i < lightStates.size(); ++i)
+    {
+        releaseSlot(lightStates[i]);
+    }
+    if (lightStates.size() != importance_.size())
+    {
+        LightState blank;
+        blank.slot = -1;
+        blank.tier = -1;
+        blank.range = 0;
+        blank.rendered = false;
+        blank.dirty = false;
+        lightStates.resize(importance_.size(), blank);
+    }
+
+    rankedLights.resize(importance_.size());
+    for (unsigned int i = 0; i < rankedLights.size(); ++i)
+    {
+        rankedLights[i] = i;
+    }
+    std::sort(rankedLights.begin(), rankedLights.end(), [&importance_](int a, int b)
+    {
+        return importance_[a] > importance_[b];
+    });
+
+    // walk down the ranking filling each tier in turn, anyone who ends up in a different tier loses their slot
+    int tier = 0;
+    int tierRemaining = static_cast<int>(kTierHeights[0] / kTierSizes[0]) * (kAtlasSize / (kTierSizes[0] * 2));
+    for (unsigned int r = 0; r < rankedLights.size(); ++r)
+    {
+        while (tier < kTierCount && tierRemaining == 0)
+        {
+            ++tier;
+            if (tier < kTierCount)
+            {
+                tierRemaining = (kTierHeights[tier] / kTierSizes[tier]) * (kAtlasSize / (kTierSizes[tier] * 2));
+            }
+        }
+
+        LightState& light = lightStates[rankedLights[r]];
+        int desiredTier = (tier < kTierCount && importance_[rankedLights[r]] > 0) ? tier : -1;
+        if (desiredTier >= 0)
+        {
+            --tierRemaining;
+        }
+
+        if (light.tier != desiredTier)
+        {
+            releaseSlot(light);
+            light.tier = desiredTier;
+        }
+    }
+
+    stats.slotsInUse = 0;
+    for (unsigned int i = 0; i < lightStates.size(); ++i)
+    {
+        LightState& light = lightStates[i];
+        if (light.tier >= 0 && light.slot < 0)
+        {
+            assert(!freeSlots[light.tier].empty());
+            light.slot = freeSlots[light.tier].back();
+            freeSlots[light.tier].pop_back();
+            light.rendered = false;
+        }
+        if (light.slot >= 0)
+        {
+            ++stats.slotsInUse;
+        }
+    }
+}
+
+void PointShadowAtlas::updateLight(int light_, const glm::vec3& position_, float range_, bool containsDynamic_)
+{
+    LightState& light = lightStates[light_];
+    if (light.position != position_ || light.range != range_ || containsDynamic_)
+    {
+        light.dirty = true;
+    }
+    light.position = position_;
+    light.range = range_;
+}
+
+const std::vector<int>& PointShadowAtlas::selectUpdates(int budget_)
+{
+    updates.clear();
+    stats.mapsRendered = 0;
+    stats.mapsReused = 0;
+    stats.mapsPending = 0;
+
+    // maps that have never been drawn at their current slot come first, they are unshadowed until then.
+    // after that the ones that have gone stale, both in order of importance
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (unsigned int r = 0; r < rankedLights.size(); ++r)
+        {
+            const int index = rankedLights[r];
+            const LightState& light = lightStates[index];
+            if (light.slot < 0)
+            {
+                continue;
+            }
+
+            bool wanted = (pass == 0) ? !light.rendered : (light.rendered && light.dirty);
+            if (!wanted)
+            {
+                continue;
+            }
+
+            if (static_cast<int>(updates.size()) < budget_)
+            {
+                updates.push_back(index);
+            }
+            else
+            {
+                ++stats.mapsPending;
+            }
+        }
+    }
+
+    stats.mapsRendered = updates.size();
+    stats.mapsReused = stats.slotsInUse - stats.mapsRendered - stats.mapsPending;
+    return updates;
+}
+
+void PointShadowAtlas::beginHemisphere(int light_, int hemisphere_)
+{
+    const Slot& slot = slots[lightStates[light_].slot];
+    const int x = slot.x + hemisphere_ * slot.size;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(x, slot.y, slot.size, slot.size);
+
+    // only clear our own tile, the rest of the atlas is still in use
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x, slot.y, slot.size, slot.size);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+void PointShadowAtlas::lightRendered(int light_)
+{
+    lightStates[light_].rendered = true;
+    lightStates[light_].dirty = false;
+}
+
+void PointShadowAtlas::endUpdates()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void PointShadowAtlas::invalidateMaps()
+{
+    for (unsigned int i = 0; i < lightStates.size(); ++i)
+    {
+        lightStates[i].rendered = false;
+    }
+}
+
+void PointShadowAtlas::invalidateSphere(const glm::vec3& centre_, float radius_)
+{
+    for (unsigned int i = 0; i < lightStates.size(); ++i)
+    {
+        if (glm::distance(lightStates[i].position, centre_) < lightStates[i].range + radius_)
+        {
+            lightStates[i].dirty = true;
+        }
+    }
+}
+
+glm::vec4 PointShadowAtlas::getShadowSlot(int light_) const
+{
+    const LightState& light = lightStates[light_];
+    if (light.slot < 0)
+    {
+        return glm::vec4(0, 0, 0, 0);
+    }
+
+    const Slot& slot = slots[light.slot];
+    return glm::vec4(static_cast<float>(slot.x),
+        static_cast<float>(slot.y),
+        static_cast<float>(slot.size),
+        light.rendered ? 1.f : 0.f);
+}
+
+GLuint PointShadowAtlas::getDepthTexture() const
+{
+    return depthTexture;
+}
+
+const PointShadowAtlas::FrameStats& PointShadowAtlas::getFrameStats() const
+{
+    return stats;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#ifndef POINT_SHADOW_ATLAS_HPP
+#define POINT_SHADOW_ATLAS_HPP
+
+#include <tgl/tgl.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+/*
+dual paraboloid shadow maps for the point lights, packed into one depth texture.
+
+the atlas is carved up into three tiers of slots (512, 256 and 128 texels per hemisphere), each slot holds the two
+hemispheres side by side. lights are given slots by how much of the screen they cover, and only a budgeted number of
+maps are drawn each frame. a light keeps its map until it moves, changes slot, or something that can move is inside it.
+*/
+class PointShadowAtlas
+{
+public:
+
+    static const int kAtlasSize = 4096;
+    static const int kTierCount = 3;
+
+    struct FrameStats
+    {
+        int slotsInUse;
+        int mapsRendered;
+        int mapsReused;
+        int mapsPending; // wanted a render but went over the budget
+    };
+
+    PointShadowAtlas();
+    ~PointShadowAtlas();
+
+    void createAtlas();
+    void deleteAtlas();
+
+    // hands out slots by importance (bigger is more important, 0 means off screen and gets no slot)
+    void allocateSlots(const std::vector<float>& importance_);
+
+    // tells the atlas where each light is this frame so it can spot the ones that moved
+    void updateLight(int light_, const glm::vec3& position_, float range_, bool containsDynamic_);
+
+    // the lights to draw this frame, most urgent first and no more than the budget
+    const std::vector<int>& selectUpdates(int budget_);
+
+    // binds the atlas and sets the viewport to one hemisphere of the light's slot, hemisphere is 0 for +z and 1 for -z
+    void beginHemisphere(int light_, int hemisphere_);
+    void lightRendered(int light_);
+    void endUpdates();
+
+    // every map has to be drawn again, for when the geometry changes under them
+    void invalidateMaps();
+    // only the maps of lights that reach the sphere, for when something in them moved
+    void invalidateSphere(const glm::vec3& centre_, float radius_);
+
+    // x, y and size of the slot in texels, w is 1 when the map is ready to sample
+    glm::vec4 getShadowSlot(int light_) const;
+    GLuint getDepthTexture() const;
+
+    const FrameStats& getFrameStats() const;
+
+protected:
+
+    struct Slot
+    {
+        int x, y, size;
+        int tier;
+    };
+
+    struct LightState
+    {
+        int slot;
+        int tier;
+        glm::vec3 position;
+        float range;
+        bool rendered;
+        bool dirty;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<int> freeSlots[kTierCount];
+    std::vector<LightState> lightStates;
+
+    // scratch, kept around so a frame doesnt allocate
+    std::vector<int> rankedLights;
+    std::vector<int> updates;
+
+    GLuint depthTexture;
+    GLuint fbo;
+    bool created;
+
+    FrameStats stats;
+
+    void releaseSlot(LightState& light_);
+};
+
+#endif //POINT_SHADOW_ATLAS_HPP
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef RENDER_TYPES_HPP
+#define RENDER_TYPES_HPP
+
+#include <tgl/tgl.h>
+#include <glm/glm.hpp>
+
+/*
+the data layouts shared between MyView and the helper classes that draw parts of the scene.
+anything in here that ends up in a buffer object must keep its layout in step with the shaders
+*/
+
+struct Vertex
+{
+    Vertex(){};
+    Vertex(glm::vec3 pos_, glm::vec3 norm_) : position(pos_), normal(norm_) {}
+    glm::vec3 position, normal;
+};
+
+struct Mesh
+{
+    GLuint vao;// VertexArrayObject for the shape's vertex array settings
+    GLuint instanceVBO;
+    GLuint packedVAO; // same vertex layout but reads its instances from MyView's per frame packed instance buffer
+    int startVerticeIndex, endVerticeIndex, verticeCount;
+    int startElementIndex, endElementIndex, element_count; // Needed for when we draw using the vertex arrays
+
+    // local space bounds of the vertices, used to build the per instance bounds
+    glm::vec3 boundsMin, boundsMax;
+
+    // where its meshlets are in MyView's meshlet buffer
+    int firstMeshlet, meshletCount;
+
+    // false until every one of its vertices and elements are in the buffers, anything not resident is skipped
+    bool resident;
+
+    Mesh() : vao(0),
+        instanceVBO(0),
+        packedVAO(0),
+        startVerticeIndex(0),
+        endVerticeIndex(0),
+        verticeCount(0),
+        startElementIndex(0),
+        endElementIndex(0),
+        element_count(0),
+        firstMeshlet(0),
+        meshletCount(0),
+        resident(false) {}
+};
+
+// a piece of a mesh culled on its own by the meshlet cull shader, its triangles are a contiguous run of elements. the
+// sphere and cone are in the mesh's space
+struct Meshlet
+{
+    glm::vec4 sphere; // centre and radius
+    glm::vec4 cone; // axis and cutoff, a cutoff of 1 is never back facing
+    GLuint firstElement;
+    GLuint triangleCount;
+    GLuint vertexCount;
+    GLuint padding;
+};
+
+struct MaterialData
+{
+    glm::vec3 colour;
+    float shininess;
+};
+
+struct InstanceData
+{
+    glm::mat4x3 positionData;
+    GLint materialDataIndex;
+};
+
+// one per instance in the visibility buffer's instance SSBO, mat4 rather than mat4x3 so the std430 layout is obvious
+struct VisibilityInstance
+{
+    glm::mat4 transform;
+    GLint materialIndex;
+    GLint meshIndex;
+    GLint padding[2];
+};
+
+// world space bounds of a single instance, kept alongside (not inside) InstanceData so the instance VBO layout is untouched
+struct InstanceBounds
+{
+    glm::vec3 min, max;
+    glm::vec3 centre;
+    float radius;
+    bool isStatic; // cleared once the simulation moves it, the shadow caches dont keep anything that has moved
+};
+
+// cant get access to the MyScene::Light since we are only declaring MyScene as a class (no direct reference)
+struct LightData
+{
+    glm::vec3 position;
+    float range;
+    glm::vec4 shadowSlot; // where the light's paraboloid maps are in the point shadow atlas, w is 0 when it has none
+};
+
+#endif //RENDER_TYPES_HPP
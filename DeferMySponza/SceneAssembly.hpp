@@ -0,0 +1,85 @@
+#pragma once
+#ifndef SCENE_ASSEMBLY_HPP
+#define SCENE_ASSEMBLY_HPP
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+#include "RenderTypes.hpp"
+
+/*
+the cpu side of loading the scene, turning the scene's meshes and materials into the flat arrays that get uploaded.
+
+these are templates over the mesh and material types so they work on the SceneModel classes in the demo and on the
+synthetic ones in the benchmarks, anything with the same getters will do. nothing in here touches gl.
+*/
+
+// appends a single mesh's vertices and elements, the elements stay relative to its first vertex. also gives its local bounds
+template<typename MeshType>
+void DecodeMesh(const MeshType& mesh_,
+    std::vector<Vertex>& vertices_,
+    std::vector<unsigned int>& elements_,
+    glm::vec3& boundsMin_,
+    glm::vec3& boundsMax_)
+{
+    // i store these temporarily since getPositionArray() will likely end up copying the whole array rather than passing the original
+    const std::vector<glm::vec3> positionArray = mesh_.getPositionArray();
+    const std::vector<glm::vec3> normalArray = mesh_.getNormalArray();
+
+    boundsMin_ = glm::vec3(FLT_MAX);
+    boundsMax_ = glm::vec3(-FLT_MAX);
+    vertices_.reserve(vertices_.size() + positionArray.size());
+    for (unsigned int j = 0; j < positionArray.size(); ++j)
+    {
+        vertices_.push_back(Vertex(positionArray[j], normalArray[j]));
+        boundsMin_ = glm::min(boundsMin_, positionArray[j]);
+        boundsMax_ = glm::max(boundsMax_, positionArray[j]);
+    }
+
+    const std::vector<unsigned int> elementArray = mesh_.getElementArray();
+    elements_.insert(elements_.end(), elementArray.begin(), elementArray.end());
+}
+
+// appends every mesh's vertices and elements to the shared arrays, and a Mesh describing where each one landed
+template<typename MeshList>
+void AssembleGeometry(const MeshList& meshes_,
+    std::vector<Vertex>& vertices_,
+    std::vector<unsigned int>& elements_,
+    std::vector<Mesh>& loadedMeshes_)
+{
+    for (unsigned int i = 0; i < meshes_.size(); ++i)
+    {
+        Mesh mesh;
+        mesh.startVerticeIndex = vertices_.size();
+        mesh.startElementIndex = elements_.size();
+
+        DecodeMesh(meshes_[i], vertices_, elements_, mesh.boundsMin, mesh.boundsMax);
+
+        mesh.endVerticeIndex = vertices_.size() - 1;
+        mesh.endElementIndex = elements_.size() - 1;
+        mesh.verticeCount = mesh.endVerticeIndex - mesh.startVerticeIndex;
+        mesh.element_count = mesh.endElementIndex - mesh.startElementIndex + 1;
+        mesh.resident = true; // it all goes up in one go
+        loadedMeshes_.push_back(mesh);
+    }
+}
+
+// packs the materials for the BufferMaterials SSBO, indexById_ maps the scene's material ids to where they ended up
+template<typename MaterialList, typename IdMap>
+void BuildMaterialTable(const MaterialList& materials_, IdMap& indexById_, std::vector<MaterialData>& table_)
+{
+    table_.reserve(table_.size() + materials_.size());
+    for (unsigned int i = 0; i < materials_.size(); ++i)
+    {
+        indexById_[materials_[i].getId()] = table_.size();
+
+        MaterialData data;
+        data.colour = materials_[i].getColour();
+        data.shininess = materials_[i].getShininess();
+        table_.push_back(data);
+    }
+}
+
+#endif //SCENE_ASSEMBLY_HPP
@@ -0,0 +1,288 @@
+#include "SceneSimulation.hpp"
+#include "CpuTimer.hpp"
+#include "TraceCapture.hpp"
+
+#include <SceneModel/SceneModel.hpp>
+#include <chrono>
+#include <cassert>
+
+SceneSimulation::SceneSimulation(std::shared_ptr<SceneModel::Context> scene_) : scene(scene_),
+    writeSlot(2),
+    readSlot(0),
+    readySlot(1),
+    instanceVersion(0),
+    rotationApplied(false),
+    running(false),
+    tickInterval(0),
+    tickCount(0)
+{
+    pendingInput.linearVelocity = glm::vec3(0, 0, 0);
+    pendingInput.rotationalVelocity = glm::vec2(0, 0);
+    pendingInput.rotation = glm::vec2(0, 0);
+    pendingInput.linearChanged = false;
+    pendingInput.rotationalChanged = false;
+    pendingInput.animationToggles = 0;
+    pendingInput.time = 0;
+    heldRotationalVelocity = glm::vec2(0, 0);
+
+    camera.position = glm::vec3(0, 0, 0);
+    camera.direction = glm::vec3(0, 0, -1);
+    camera.tick = 0;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        snapshots[i].instanceVersion = 0;
+        snapshots[i].tick = 0;
+        snapshots[i].tickMilliseconds = 0;
+    }
+}
+
+SceneSimulation::~SceneSimulation()
+{
+    stop();
+}
+
+void SceneSimulation::trackInstances(const std::vector<SceneModel::InstanceId>& ids_)
+{
+    assert(!running);
+    trackedInstances = ids_;
+}
+
+void SceneSimulation::start(double ticksPerSecond_)
+{
+    if (running)
+    {
+        return;
+    }
+    tickInterval = 1.0 / ticksPerSecond_;
+
+    // one snapshot up front so the renderer has something to draw before the thread gets going
+    fillSnapshot(snapshots[readSlot], 0.0);
+    camera.position = snapshots[readSlot].cameraPosition;
+    camera.direction = snapshots[readSlot].cameraDirection;
+    camera.tick = snapshots[readSlot].tick;
+
+    running = true;
+    thread = std::thread(&SceneSimulation::run, this);
+}
+
+void SceneSimulation::stop()
+{
+    if (!running)
+    {
+        return;
+    }
+    running = false;
+    thread.join();
+}
+
+bool SceneSimulation::isRunning() const
+{
+    return running;
+}
+
+void SceneSimulation::setCameraLinearVelocity(const glm::vec3& velocity_, long long inputTime_)
+{
+    std::lock_guard<std::mutex> lock(inputMutex);
+    pendingInput.linearVelocity = velocity_;
+    pendingInput.linearChanged = true;
+    if (pendingInput.time == 0)
+    {
+        pendingInput.time = inputTime_;
+    }
+}
+
+void SceneSimulation::setCameraRotationalVelocity(const glm::vec2& velocity_, long long inputTime_)
+{
+    std::lock_guard<std::mutex> lock(inputMutex);
+    pendingInput.rotationalVelocity = velocity_;
+    pendingInput.rotationalChanged = true;
+    if (pendingInput.time == 0)
+    {
+        pendingInput.time = inputTime_;
+    }
+}
+
+void SceneSimulation::addCameraRotation(const glm::vec2& rotation_, long long inputTime_)
+{
+    std::lock_guard<std::mutex> lock(inputMutex);
+    pendingInput.rotation = pendingInput.rotation + rotation_;
+    if (pendingInput.time == 0)
+    {
+        pendingInput.time = inputTime_;
+    }
+}
+
+void SceneSimulation::toggleCameraAnimation(long long inputTime_)
+{
+    std::lock_guard<std::mutex> lock(inputMutex);
+    ++pendingInput.animationToggles;
+    if (pendingInput.time == 0)
+    {
+        pendingInput.time = inputTime_;
+    }
+}
+
+const SceneSnapshot& SceneSimulation::acquireSnapshot()
+{
+    // only swap if there is something new, otherwise we would hand back the slot we gave the simulation last time
+    if (readySlot.load() & kReadyFlag)
+    {
+        readSlot = readySlot.exchange(readSlot) & 3;
+    }
+    return snapshots[readSlot];
+}
+
+SceneSimulation::CameraSample SceneSimulation::latestCamera()
+{
+    std::lock_guard<std::mutex> lock(cameraMutex);
+    return camera;
+}
+
+long long SceneSimulation::takeInputTime(unsigned int tick_)
+{
+    std::lock_guard<std::mutex> lock(cameraMutex);
+    long long time = 0;
+    while (!inputTicks.empty() && inputTicks.front().first <= tick_)
+    {
+        time = time == 0 ? inputTicks.front().second : time;
+        inputTicks.pop_front();
+    }
+    return time;
+}
+
+void SceneSimulation::run()
+{
+    TraceCapture::nameCurrentThread("simulation");
+
+    double nextTick = CpuTimeSeconds();
+    while (running)
+    {
+        tick();
+
+        // fixed rate, but if a tick overruns we carry on from now rather than trying to catch up
+        nextTick += tickInterval;
+        const double now = CpuTimeSeconds();
+        if (nextTick > now)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(static_cast<long long>((nextTick - now) * 1000000.0)));
+        }
+        else
+        {
+            nextTick = now;
+        }
+    }
+}
+
+void SceneSimulation::tick()
+{
+    TRACE_SCOPE("simulation_tick");
+    const double begin = CpuTimeSeconds();
+
+    const long long inputTime = applyInput();
+    {
+        TRACE_SCOPE("scene_update");
+        scene->update();
+    }
+    SceneSnapshot& snapshot = snapshots[writeSlot];
+    fillSnapshot(snapshot, (CpuTimeSeconds() - begin) * 1000.0);
+    CameraSample sample;
+    sample.position = snapshot.cameraPosition;
+    sample.direction = snapshot.cameraDirection;
+    sample.tick = snapshot.tick;
+    publish();
+
+    // after the snapshot, so the renderer never latches a camera newer than the next snapshot it can acquire
+    std::lock_guard<std::mutex> lock(cameraMutex);
+    camera = sample;
+    if (inputTime != 0)
+    {
+        if (inputTicks.size() == kMaxInputTicks)
+        {
+            inputTicks.pop_front();
+        }
+        inputTicks.push_back(std::make_pair(sample.tick, inputTime));
+    }
+}
+
+long long SceneSimulation::applyInput()
+{
+    Input input;
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        input = pendingInput;
+        pendingInput.linearChanged = false;
+        pendingInput.rotationalChanged = false;
+        pendingInput.rotation = glm::vec2(0, 0);
+        pendingInput.animationToggles = 0;
+        pendingInput.time = 0;
+    }
+
+    if (input.linearChanged)
+    {
+        scene->getCamera().setLinearVelocity(input.linearVelocity);
+    }
+    if (input.rotationalChanged)
+    {
+        heldRotationalVelocity = input.rotationalVelocity;
+    }
+    // a rotation only lasts the one update, the tick after it puts the held velocity back
+    const bool rotating = input.rotation != glm::vec2(0, 0);
+    if (input.rotationalChanged || rotating || rotationApplied)
+    {
+        scene->getCamera().setRotationalVelocity(heldRotationalVelocity + input.rotation);
+    }
+    rotationApplied = rotating;
+    for (int i = 0; i < input.animationToggles; ++i)
+    {
+        scene->toggleCameraAnimation();
+    }
+    return input.time;
+}
+
+void SceneSimulation::fillSnapshot(SceneSnapshot& snapshot_, double tickMilliseconds_)
+{
+    const SceneModel::Camera& camera = scene->getCamera();
+    snapshot_.cameraPosition = camera.getPosition();
+    snapshot_.cameraDirection = camera.getDirection();
+    snapshot_.globalLightDirection = scene->getGlobalLightDirection();
+    snapshot_.globalLightIntensity = scene->getGlobalLightIntensity();
+
+    // the slot keeps its capacity between ticks so after the first few this doesnt allocate
+    std::vector<SceneModel::Light> sceneLights = scene->getAllLights();
+    snapshot_.lights.resize(sceneLights.size());
+    for (unsigned int i = 0; i < sceneLights.size(); ++i)
+    {
+        snapshot_.lights[i].position = sceneLights[i].getPosition();
+        snapshot_.lights[i].range = sceneLights[i].getRange();
+        snapshot_.lights[i].shadowSlot = glm::vec4(0, 0, 0, 0);
+    }
+
+    // the first fill is the baseline, only changes after that count
+    const bool firstFill = lastTransforms.empty();
+    bool instancesChanged = false;
+    lastTransforms.resize(trackedInstances.size());
+    for (unsigned int i = 0; i < trackedInstances.size(); ++i)
+    {
+        glm::mat4x3 transform = scene->getInstanceById(trackedInstances[i]).getTransformationMatrix();
+        if (!firstFill && lastTransforms[i] != transform)
+        {
+            instancesChanged = true;
+        }
+        lastTransforms[i] = transform;
+    }
+    if (instancesChanged)
+    {
+        ++instanceVersion;
+    }
+    snapshot_.instanceTransforms = lastTransforms;
+    snapshot_.instanceVersion = instanceVersion;
+
+    snapshot_.tick = tickCount++;
+    snapshot_.tickMilliseconds = tickMilliseconds_;
+}
+
+void SceneSimulation::publish()
+{
+    writeSlot = readySlot.exchange(writeSlot | kReadyFlag) & 3;
+}
@@ -0,0 +1,140 @@
+#pragma once
+#ifndef SCENE_SIMULATION_HPP
+#define SCENE_SIMULATION_HPP
+
+#include <SceneModel/SceneModel_fwd.hpp>
+#include <glm/glm.hpp>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "RenderTypes.hpp"
+
+/*
+everything the renderer needs from the scene for one frame, copied out at the end of a simulation tick so it never
+changes while it is being drawn
+*/
+struct SceneSnapshot
+{
+    glm::vec3 cameraPosition;
+    glm::vec3 cameraDirection;
+
+    glm::vec3 globalLightDirection;
+    glm::vec3 globalLightIntensity;
+
+    std::vector<LightData> lights;
+
+    // transforms of the tracked instances, in the order they were handed to trackInstances
+    std::vector<glm::mat4x3> instanceTransforms;
+    // bumped whenever any of the transforms changed, so the renderer only rebuilds when it has to
+    unsigned int instanceVersion;
+
+    unsigned int tick;
+    double tickMilliseconds; // how long the tick that produced this took
+};
+
+/*
+runs SceneModel::Context::update on its own thread and publishes a SceneSnapshot after every tick.
+
+the snapshots live in a triple buffer, the simulation always has a slot to write into and the renderer always has
+a complete one to read, so neither side ever waits on the other. the renderer just sees the newest finished tick.
+once the thread is running nothing else may touch the context, input goes through the set/toggle calls below and
+is applied at the start of the next tick.
+
+the newest tick's camera is also kept on its own, for the renderer to latch as late as it can, along with which
+ticks applied input and when that input arrived.
+*/
+class SceneSimulation
+{
+public:
+
+    struct CameraSample
+    {
+        glm::vec3 position;
+        glm::vec3 direction;
+        unsigned int tick;
+    };
+
+    SceneSimulation(std::shared_ptr<SceneModel::Context> scene_);
+    ~SceneSimulation();
+
+    // instances whose transforms get copied into every snapshot, has to be called before start
+    void trackInstances(const std::vector<SceneModel::InstanceId>& ids_);
+
+    void start(double ticksPerSecond_);
+    void stop();
+    bool isRunning() const;
+
+    // inputTime_ is the CpuTimeNanoseconds of the event behind the call, 0 when it wasnt one
+    void setCameraLinearVelocity(const glm::vec3& velocity_, long long inputTime_ = 0);
+    void setCameraRotationalVelocity(const glm::vec2& velocity_, long long inputTime_ = 0);
+    // mouse look, summed until the next tick which turns by it for that one update on top of the velocity above
+    void addCameraRotation(const glm::vec2& rotation_, long long inputTime_ = 0);
+    void toggleCameraAnimation(long long inputTime_ = 0);
+
+    // the newest finished snapshot, stays valid until the next call
+    const SceneSnapshot& acquireSnapshot();
+
+    // the camera of the newest finished tick, which can be newer than the snapshot being drawn by the time the
+    // renderer gets to its gbuffer
+    CameraSample latestCamera();
+
+    // the CpuTimeNanoseconds of the earliest input that a tick up to tick_ applied and that hasnt been asked about
+    // yet, 0 if there wasnt any. the renderer asks with the tick each frame shows to line inputs up with presents
+    long long takeInputTime(unsigned int tick_);
+
+protected:
+
+    static const int kReadyFlag = 4;
+    static const unsigned int kMaxInputTicks = 256; // when nothing asks for them the oldest are dropped
+
+    struct Input
+    {
+        glm::vec3 linearVelocity;
+        glm::vec2 rotationalVelocity;
+        glm::vec2 rotation; // summed since the last tick took it
+        bool linearChanged;
+        bool rotationalChanged;
+        int animationToggles;
+        long long time; // of the first of these, 0 if there were none
+    };
+
+    std::shared_ptr<SceneModel::Context> scene;
+    std::vector<SceneModel::InstanceId> trackedInstances;
+
+    SceneSnapshot snapshots[3];
+    int writeSlot; // only touched by the simulation thread
+    int readSlot; // only touched by the renderer
+    std::atomic<int> readySlot; // the slot in the middle, with kReadyFlag set if it holds a tick the renderer hasnt seen
+
+    std::mutex inputMutex;
+    Input pendingInput;
+    // only touched by the simulation thread, the velocity the camera goes back to once a tick's rotation is done
+    glm::vec2 heldRotationalVelocity;
+    bool rotationApplied;
+
+    // published alongside the snapshots, the camera on its own so it can be read without taking a slot
+    std::mutex cameraMutex;
+    CameraSample camera;
+    std::deque< std::pair<unsigned int, long long> > inputTicks; // the ticks that applied input, and when it came
+
+    // what the last published tick saw, the slot being written is a couple of ticks stale so it cant be diffed against
+    std::vector<glm::mat4x3> lastTransforms;
+    unsigned int instanceVersion;
+
+    std::thread thread;
+    std::atomic<bool> running;
+    double tickInterval;
+    unsigned int tickCount;
+
+    void run();
+    void tick();
+    long long applyInput();
+    void fillSnapshot(SceneSnapshot& snapshot_, double tickMilliseconds_);
+    void publish();
+};
+
+#endif //SCENE_SIMULATION_HPP
@@ -12,7 +12,7 @@ Shader::~Shader()
 
 }
 
-bool Shader::loadShader(std::string file_, int type_)
+bool Shader::loadShader(std::string file_, int type_, const std::string& defines_)
 {
 #pragma warning(disable:4996)
     FILE* fp = fopen(file_.c_str(), "rt");
@@ -29,6 +29,12 @@ bool Shader::loadShader(std::string file_, int type_)
     while (fgets(line, 255, fp))
     {
         lines.push_back(line);
+
+        // nothing but comments can come before the version, so the defines go after it
+        if (!defines_.empty() && lines.back().compare(0, 8, "#version") == 0)
+        {
+            lines.push_back(defines_);
+        }
     }
     fclose(fp);
 
@@ -18,7 +18,8 @@ public:
     Shader();
     ~Shader();
 
-    bool loadShader(std::string file_, int type_);
+    // defines_ goes in straight after the #version line, one #define per line, for compiling a permutation
+    bool loadShader(std::string file_, int type_, const std::string& defines_ = std::string());
     void deleteShader();
 
     bool isLoaded();
@@ -1,8 +1,15 @@
 #include <stdlib.h>
 #include <tgl/tgl.h>
 #include "ShaderProgram.hpp"
+#include "GpuMemory.hpp"
+#include "CpuTimer.hpp"
 
-ShaderProgram::ShaderProgram() : linked(false)
+namespace
+{
+    ShaderProgram::VariantStats variantStats = { 0, 0, 0.0 };
+}
+
+ShaderProgram::ShaderProgram() : programID(0), linked(false)
 {
 
 }
@@ -15,6 +22,7 @@ ShaderProgram::~ShaderProgram()
 void ShaderProgram::createProgram()
 {
     programID = glCreateProgram();
+    GpuMemory::track(GpuMemory::kProgram, programID, GpuMemory::kObjects, "program");
 }
 
 bool ShaderProgram::addShaderToProgram(Shader* shader_)
@@ -54,12 +62,21 @@ bool ShaderProgram::linkProgram()
 
 void ShaderProgram::deleteProgram()
 {
-    if (!linked)
+    for (auto it = variants.begin(); it != variants.end(); ++it)
+    {
+        it->second->deleteProgram();
+    }
+    variants.clear();
+
+    // a program that failed to link still has to go
+    if (programID == 0)
     {
         return;
     }
     linked = false;
     glDeleteProgram(programID);
+    GpuMemory::release(GpuMemory::kProgram, programID);
+    programID = 0;
 }
 
 void ShaderProgram::useProgram()
@@ -74,3 +91,73 @@ GLuint ShaderProgram::getProgramID()
 {
     return programID;
 }
+
+void ShaderProgram::setFeatures(const char* const* names_, int count_)
+{
+    featureNames.assign(names_, names_ + count_);
+}
+
+void ShaderProgram::addVariantSource(const std::string& file_, int type_)
+{
+    Source source;
+    source.file = file_;
+    source.type = type_;
+    sources.push_back(source);
+}
+
+ShaderProgram& ShaderProgram::getVariant(unsigned int key_)
+{
+    auto found = variants.find(key_);
+    if (found != variants.end())
+    {
+        return *found->second;
+    }
+
+    const double begin = CpuTimeSeconds();
+
+    std::string defines;
+    for (unsigned int i = 0; i < featureNames.size(); ++i)
+    {
+        if (key_ & (1u << i))
+        {
+            defines += "#define " + featureNames[i] + "\n";
+        }
+    }
+
+    std::shared_ptr<ShaderProgram> variant = std::make_shared<ShaderProgram>();
+    variant->createProgram();
+
+    // the shaders are only needed until the link
+    std::vector<Shader> shaders(sources.size());
+    bool compiled = true;
+    for (unsigned int i = 0; i < sources.size(); ++i)
+    {
+        compiled &= shaders[i].loadShader(sources[i].file, sources[i].type, defines);
+        compiled &= variant->addShaderToProgram(&shaders[i]);
+    }
+    if (compiled)
+    {
+        variant->linkProgram();
+    }
+    for (unsigned int i = 0; i < shaders.size(); ++i)
+    {
+        shaders[i].deleteShader();
+    }
+
+    ++variantStats.variants;
+    variantStats.failed += variant->linked ? 0 : 1;
+    variantStats.compileMilliseconds += (CpuTimeSeconds() - begin) * 1000.0;
+
+    variants[key_] = variant;
+    return *variant;
+}
+
+unsigned int ShaderProgram::getVariantCount() const
+{
+    return variants.size();
+}
+
+const ShaderProgram::VariantStats& ShaderProgram::getVariantStats()
+{
+    return variantStats;
+}
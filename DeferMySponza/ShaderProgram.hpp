@@ -3,12 +3,21 @@
 #define SHADER_PROGRAM_HPP
 
 #include <stdlib.h>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "Shader.hpp"
 
 
+/*
+a linked program, or a set of sources that are compiled into a program for each combination of features asked for.
+
+the features are bits of a key and each one names a #define, getVariant compiles every source with the defines for
+the bits that are set the first time a key is asked for and hands back the same program from then on. the passes
+pick a key for what they need, so the shaders can leave out whole paths with #ifdef instead of branching on a uniform
+*/
 class ShaderProgram
 {
 
@@ -17,8 +26,24 @@ protected:
     GLuint programID;
     bool linked;
 
+    struct Source
+    {
+        std::string file;
+        int type;
+    };
+    std::vector<Source> sources;
+    std::vector<std::string> featureNames;
+    std::map< unsigned int, std::shared_ptr<ShaderProgram> > variants;
+
 public:
 
+    struct VariantStats
+    {
+        unsigned int variants; // every program's, compiled so far
+        unsigned int failed;
+        double compileMilliseconds; // all of them, compile and link
+    };
+
     ShaderProgram();
     ~ShaderProgram();
 
@@ -32,6 +57,16 @@ public:
 
     GLuint getProgramID();
 
+    // bit i of a variant's key defines names_[i]
+    void setFeatures(const char* const* names_, int count_);
+    void addVariantSource(const std::string& file_, int type_);
+
+    // compiled the first time the key is asked for, a variant that fails is still handed back but never used
+    ShaderProgram& getVariant(unsigned int key_);
+    unsigned int getVariantCount() const;
+
+    static const VariantStats& getVariantStats();
+
 };
 
 
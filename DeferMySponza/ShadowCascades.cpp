@@ -0,0 +1,324 @@
+#include "ShadowCascades.hpp"
+#include "GpuMemory.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+
+// how much of the split is logarithmic vs linear, 1 is fully logarithmic
+static const float kSplitLambda = 0.75f;
+// the cached cascades are drawn this much larger than their slice so the camera can wander before they go stale
+static const float kCachePadding = 1.5f;
+
+ShadowCascades::ShadowCascades() : depthTexture(0), fbo(0), resolution(0), created(false)
+{
+    for (int i = 0; i < kCascadeCount; ++i)
+    {
+        cascades[i].valid = false;
+        cascades[i].needsRender = true;
+        cascades[i].containsDynamic = false;
+        cascades[i].radius = 0;
+        cascadeSplits[i] = 0;
+    }
+    stats.cascadesRendered = 0;
+    stats.cascadesReused = 0;
+}
+
+ShadowCascades::~ShadowCascades()
+{
+
+}
+
+void ShadowCascades::createCascades(int resolution_)
+{
+    resolution = resolution_;
+
+    glGenTextures(1, &depthTexture);
+    GpuMemory::track(GpuMemory::kTexture, depthTexture, GpuMemory::kShadowMaps, "shadow_cascades");
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY,
+        0,
+        GL_DEPTH_COMPONENT32F,
+        resolution,
+        resolution,
+        kCascadeCount,
+        0,
+        GL_DEPTH_COMPONENT,
+        GL_FLOAT,
+        NULL);
+    GpuMemory::textureStorage(depthTexture, GL_DEPTH_COMPONENT32F, resolution, resolution, kCascadeCount);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    // anything outside of the cascade is lit
+    const float border[] = { 1.f, 1.f, 1.f, 1.f };
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+    // hardware pcf, lets the shader use sampler2DArrayShadow
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &fbo);
+    GpuMemory::track(GpuMemory::kFramebuffer, fbo, GpuMemory::kObjects, "shadow_cascades");
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        tglDebugMessage(GL_DEBUG_SEVERITY_HIGH, "shadow cascade framebuffer not complete");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    for (int i = 0; i < kCascadeCount; ++i)
+    {
+        cascades[i].valid = false;
+    }
+    created = true;
+}
+
+void ShadowCascades::deleteCascades()
+{
+    if (!created)
+    {
+        return;
+    }
+    created = false;
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &depthTexture);
+    GpuMemory::release(GpuMemory::kFramebuffer, fbo);
+    GpuMemory::release(GpuMemory::kTexture, depthTexture);
+}
+
+void ShadowCascades::update(const glm::mat4& viewMatrix_,
+    float fovy_,
+    float aspectRatio_,
+    float near_,
+    float far_,
+    const glm::vec3& lightDirection_,
+    const glm::vec3& sceneMin_,
+    const glm::vec3& sceneMax_)
+{
+    stats.cascadesRendered = 0;
+    stats.cascadesReused = 0;
+
+    const glm::vec3 lightDirection = glm::normalize(lightDirection_);
+    const bool lightChanged = glm::dot(lightDirection, cachedLightDirection) < 0.99999f;
+    cachedLightDirection = lightDirection;
+
+    // rotation only, the translation for each cascade is added once it is fitted
+    glm::vec3 up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+    glm::mat4 lightRotation = glm::lookAt(glm::vec3(0, 0, 0), lightDirection, up);
+
+    float sliceNear = near_;
+    for (int i = 0; i < kCascadeCount; ++i)
+    {
+        float t = static_cast<float>(i + 1) / kCascadeCount;
+        float logSplit = near_ * std::pow(far_ / near_, t);
+        float linearSplit = near_ + (far_ - near_) * t;
+        float sliceFar = kSplitLambda * logSplit + (1.f - kSplitLambda) * linearSplit;
+        cascadeSplits[i] = sliceFar;
+
+        // corners of the slice in world space
+        glm::mat4 inverseSlice = glm::inverse(glm::perspective(fovy_, aspectRatio_, sliceNear, sliceFar) * viewMatrix_);
+        glm::vec3 corners[8];
+        glm::vec3 centre(0, 0, 0);
+        for (int c = 0; c < 8; ++c)
+        {
+            glm::vec4 ndc((c & 1) ? 1.f : -1.f, (c & 2) ? 1.f : -1.f, (c & 4) ? 1.f : -1.f, 1.f);
+            glm::vec4 world = inverseSlice * ndc;
+            corners[c] = glm::vec3(world) / world.w;
+            centre += corners[c];
+        }
+        centre /= 8.f;
+
+        // bounding sphere rather than a tight box, so the size doesnt change as the camera turns and the edges dont shimmer
+        float radius = 0;
+        for (int c = 0; c < 8; ++c)
+        {
+            radius = std::max(radius, glm::length(corners[c] - centre));
+        }
+        radius = std::ceil(radius * 16.f) / 16.f;
+
+        Cascade& cascade = cascades[i];
+
+        if (i < kFirstCachedCascade)
+        {
+            fitCascade(cascade, lightRotation, centre, radius, sceneMin_, sceneMax_);
+            cascade.needsRender = true;
+        }
+        else
+        {
+            glm::vec3 centreLS = glm::vec3(lightRotation * glm::vec4(centre, 1.f));
+            bool fits = cascade.valid
+                && !lightChanged
+                && !cascade.containsDynamic
+                && glm::length(glm::vec2(centreLS.x, centreLS.y) - cascade.centreLS) + radius <= cascade.radius;
+
+            if (fits)
+            {
+                cascade.needsRender = false;
+            }
+            else
+            {
+                fitCascade(cascade, lightRotation, centre, radius * kCachePadding, sceneMin_, sceneMax_);
+                cascade.needsRender = true;
+                cascade.containsDynamic = false;
+            }
+        }
+
+        cascade.valid = true;
+        cascadeMatrices[i] = cascade.lightMatrix;
+
+        if (cascade.needsRender)
+        {
+            ++stats.cascadesRendered;
+        }
+        else
+        {
+            ++stats.cascadesReused;
+        }
+
+        sliceNear = sliceFar;
+    }
+}
+
+void ShadowCascades::fitCascade(Cascade& cascade_,
+    const glm::mat4& lightRotation_,
+    const glm::vec3& centre_,
+    float radius_,
+    const glm::vec3& sceneMin_,
+    const glm::vec3& sceneMax_)
+{
+    glm::vec3 centreLS = glm::vec3(lightRotation_ * glm::vec4(centre_, 1.f));
+
+    // snap to whole texels so the cascade doesnt swim as the camera moves
+    float texelSize = (radius_ * 2.f) / resolution;
+    centreLS.x = std::floor(centreLS.x / texelSize) * texelSize;
+    centreLS.y = std::floor(centreLS.y / texelSize) * texelSize;
+
+    cascade_.centreLS = glm::vec2(centreLS.x, centreLS.y);
+    cascade_.radius = radius_;
+    cascade_.lightView = glm::translate(glm::mat4(1.f), glm::vec3(-centreLS.x, -centreLS.y, 0.f)) * lightRotation_;
+
+    // depth range has to cover every caster in the scene, not just the slice, or things out of view lose their shadows
+    float minZ = FLT_MAX, maxZ = -FLT_MAX;
+    for (int c = 0; c < 8; ++c)
+    {
+        glm::vec3 corner((c & 1) ? sceneMax_.x : sceneMin_.x,
+            (c & 2) ? sceneMax_.y : sceneMin_.y,
+            (c & 4) ? sceneMax_.z : sceneMin_.z);
+        float z = (cascade_.lightView * glm::vec4(corner, 1.f)).z;
+        minZ = std::min(minZ, z);
+        maxZ = std::max(maxZ, z);
+    }
+
+    glm::mat4 projection = glm::ortho(-radius_, radius_, -radius_, radius_, -maxZ - 1.f, -minZ + 1.f);
+    cascade_.lightMatrix = projection * cascade_.lightView;
+}
+
+bool ShadowCascades::cascadeNeedsRender(int cascade_) const
+{
+    assert(cascade_ >= 0 && cascade_ < kCascadeCount);
+    return cascades[cascade_].needsRender;
+}
+
+void ShadowCascades::getCascadePlanes(int cascade_, glm::vec4 planes_[4]) const
+{
+    const Cascade& cascade = cascades[cascade_];
+
+    // -radius <= x <= radius and the same for y in light view space, rows of the view matrix are the axes
+    for (int axis = 0; axis < 2; ++axis)
+    {
+        const glm::vec4 row(cascade.lightView[0][axis], cascade.lightView[1][axis], cascade.lightView[2][axis], cascade.lightView[3][axis]);
+        planes_[axis * 2 + 0] = row + glm::vec4(0.f, 0.f, 0.f, cascade.radius);
+        planes_[axis * 2 + 1] = glm::vec4(0.f, 0.f, 0.f, cascade.radius) - row;
+    }
+}
+
+void ShadowCascades::markDynamic(int cascade_)
+{
+    cascades[cascade_].containsDynamic = true;
+}
+
+void ShadowCascades::markDynamicBox(const glm::vec3& min_, const glm::vec3& max_)
+{
+    for (int i = 0; i < kCascadeCount; ++i)
+    {
+        if (!cascades[i].valid || cascades[i].containsDynamic)
+        {
+            continue;
+        }
+
+        // the box is outside if its corner furthest along a plane's normal is still behind it
+        glm::vec4 planes[4];
+        getCascadePlanes(i, planes);
+        bool inside = true;
+        for (int p = 0; inside && p < 4; ++p)
+        {
+            const glm::vec3 corner(planes[p].x >= 0.f ? max_.x : min_.x,
+                planes[p].y >= 0.f ? max_.y : min_.y,
+                planes[p].z >= 0.f ? max_.z : min_.z);
+            inside = glm::dot(glm::vec3(planes[p]), corner) + planes[p].w >= 0.f;
+        }
+        if (inside)
+        {
+            cascades[i].containsDynamic = true;
+        }
+    }
+}
+
+void ShadowCascades::invalidate()
+{
+    for (int i = 0; i < kCascadeCount; ++i)
+    {
+        cascades[i].valid = false;
+    }
+}
+
+void ShadowCascades::beginCascade(int cascade_)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, cascade_);
+    glViewport(0, 0, resolution, resolution);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void ShadowCascades::endCascades()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+const glm::mat4& ShadowCascades::getCascadeMatrix(int cascade_) const
+{
+    return cascadeMatrices[cascade_];
+}
+
+const float* ShadowCascades::getCascadeMatrixPtr() const
+{
+    return glm::value_ptr(cascadeMatrices[0]);
+}
+
+const float* ShadowCascades::getCascadeSplits() const
+{
+    return cascadeSplits;
+}
+
+GLuint ShadowCascades::getDepthTexture() const
+{
+    return depthTexture;
+}
+
+int ShadowCascades::getResolution() const
+{
+    return resolution;
+}
+
+const ShadowCascades::FrameStats& ShadowCascades::getFrameStats() const
+{
+    return stats;
+}
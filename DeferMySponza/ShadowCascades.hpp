@@ -0,0 +1,107 @@
+#pragma once
+#ifndef SHADOW_CASCADES_HPP
+#define SHADOW_CASCADES_HPP
+
+#include <tgl/tgl.h>
+#include <glm/glm.hpp>
+
+#include "RenderTypes.hpp"
+
+/*
+cascaded shadow maps for the global directional light.
+
+the view frustum is split into kCascadeCount slices, each one gets an orthographic light projection that is fitted
+around the slice and rendered into a layer of a single depth texture array.
+the near cascades are re-rendered every frame, the far ones (kFirstCachedCascade and up) only cover static geometry
+so they are rendered with some padding around the slice and then reused until the light turns or the camera moves
+far enough that the slice no longer fits inside what was rendered.
+*/
+class ShadowCascades
+{
+public:
+
+    static const int kCascadeCount = 4;
+    static const int kFirstCachedCascade = 2;
+
+    struct FrameStats
+    {
+        int cascadesRendered;
+        int cascadesReused;
+    };
+
+    ShadowCascades();
+    ~ShadowCascades();
+
+    void createCascades(int resolution_);
+    void deleteCascades();
+
+    // works out the matrices for this frame and which cascades have to be drawn again
+    void update(const glm::mat4& viewMatrix_,
+        float fovy_,
+        float aspectRatio_,
+        float near_,
+        float far_,
+        const glm::vec3& lightDirection_,
+        const glm::vec3& sceneMin_,
+        const glm::vec3& sceneMax_);
+
+    bool cascadeNeedsRender(int cascade_) const;
+    // world space planes around the sides of the cascade, pointing in, for culling the casters. the depth range is
+    // already the whole scene so there are only four
+    void getCascadePlanes(int cascade_, glm::vec4 planes_[4]) const;
+
+    // a cached cascade that ended up drawing something that can move has to be redrawn next frame
+    void markDynamic(int cascade_);
+    // a cached cascade that covers the box has to be redrawn next frame, for when something in it moved
+    void markDynamicBox(const glm::vec3& min_, const glm::vec3& max_);
+
+    // throws away the cached cascades, for when the geometry they were drawn from changes
+    void invalidate();
+
+    // binds the fbo for the cascade and clears it, the caller draws the casters
+    void beginCascade(int cascade_);
+    void endCascades();
+
+    const glm::mat4& getCascadeMatrix(int cascade_) const;
+    const float* getCascadeMatrixPtr() const;
+    const float* getCascadeSplits() const;
+    GLuint getDepthTexture() const;
+    int getResolution() const;
+
+    const FrameStats& getFrameStats() const;
+
+protected:
+
+    struct Cascade
+    {
+        glm::mat4 lightView;
+        glm::mat4 lightMatrix; // projection * view, what the shaders use
+        glm::vec2 centreLS; // centre of the rendered region in light space
+        float radius; // half the width of the rendered region
+        bool valid;
+        bool needsRender;
+        bool containsDynamic;
+    };
+
+    Cascade cascades[kCascadeCount];
+    glm::mat4 cascadeMatrices[kCascadeCount];
+    float cascadeSplits[kCascadeCount];
+
+    glm::vec3 cachedLightDirection;
+
+    GLuint depthTexture;
+    GLuint fbo;
+    int resolution;
+    bool created;
+
+    FrameStats stats;
+
+    void fitCascade(Cascade& cascade_,
+        const glm::mat4& lightRotation_,
+        const glm::vec3& centre_,
+        float radius_,
+        const glm::vec3& sceneMin_,
+        const glm::vec3& sceneMax_);
+};
+
+#endif //SHADOW_CASCADES_HPP
@@ -0,0 +1,398 @@
+#include "StreamingLoader.hpp"
+#include "CpuTimer.hpp"
+#include "TraceCapture.hpp"
+#include "GpuMemory.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+    const char* const kThreadNames[StreamingLoader::kMaxThreads] =
+    {
+        "streaming 0", "streaming 1", "streaming 2", "streaming 3"
+    };
+}
+
+StreamingLoader::StreamingLoader() : stagingBuffer(0),
+    stagingMemory(nullptr),
+    budget(0),
+    region(0),
+    frameBytes(0),
+    regionAvailable(false),
+    persistent(false),
+    meshBytesUploaded(0),
+    decodedCount(0),
+    quitting(false),
+    startTime(0)
+{
+    for (int i = 0; i < kFramesInFlight; ++i)
+    {
+        fences[i] = 0;
+    }
+
+    stats.meshCount = 0;
+    stats.meshesDecoded = 0;
+    stats.meshesResident = 0;
+    stats.bytesUploaded = 0;
+    stats.frameBytes = 0;
+    stats.framesSkipped = 0;
+    stats.persistentlyMapped = false;
+    stats.firstFrameMilliseconds = -1.0;
+    stats.residentMilliseconds = -1.0;
+}
+
+StreamingLoader::~StreamingLoader()
+{
+    stop();
+}
+
+void StreamingLoader::createStaging(unsigned int budget_)
+{
+    deleteStaging();
+
+    budget = budget_;
+    const GLsizeiptr bytes = static_cast<GLsizeiptr>(budget) * kFramesInFlight;
+
+    glGenBuffers(1, &stagingBuffer);
+    GpuMemory::track(GpuMemory::kBuffer, stagingBuffer, GpuMemory::kGeometry, "geometry_staging");
+    glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffer);
+
+    persistent = false;
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+    if (GpuMemory::hasBufferStorage())
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_READ_BUFFER, bytes, NULL, flags);
+        stagingMemory = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, bytes, flags));
+        persistent = stagingMemory != nullptr;
+    }
+#endif
+    if (!persistent)
+    {
+        glBufferData(GL_COPY_READ_BUFFER, bytes, NULL, GL_STREAM_COPY);
+    }
+    GpuMemory::bufferStorage(stagingBuffer, bytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    stats.persistentlyMapped = persistent;
+    region = 0;
+}
+
+void StreamingLoader::deleteStaging()
+{
+    for (int i = 0; i < kFramesInFlight; ++i)
+    {
+        if (fences[i] != 0)
+        {
+            glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+    }
+
+    if (stagingBuffer != 0)
+    {
+        // deleting it unmaps it as well
+        glDeleteBuffers(1, &stagingBuffer);
+        GpuMemory::release(GpuMemory::kBuffer, stagingBuffer);
+        stagingBuffer = 0;
+    }
+    stagingMemory = nullptr;
+    persistent = false;
+    copies.clear();
+}
+
+void StreamingLoader::start(unsigned int meshCount_, const DecodeFunction& decode_, double startTime_, unsigned int threadCount_)
+{
+    stop();
+
+    decode = decode_;
+    meshes.assign(meshCount_, DecodedMesh());
+    states.assign(meshCount_, kQueued);
+    priorities.assign(meshCount_, 0.f);
+    decodedCount = 0;
+    meshBytesUploaded = 0;
+    quitting = false;
+
+    startTime = startTime_;
+    stats.meshCount = meshCount_;
+    stats.meshesDecoded = 0;
+    stats.meshesResident = 0;
+    stats.bytesUploaded = 0;
+    stats.frameBytes = 0;
+    stats.framesSkipped = 0;
+    stats.firstFrameMilliseconds = -1.0;
+    stats.residentMilliseconds = meshCount_ == 0 ? (CpuTimeSeconds() - startTime) * 1000.0 : -1.0;
+
+    if (threadCount_ == 0)
+    {
+        const unsigned int hardware = std::thread::hardware_concurrency();
+        threadCount_ = hardware > 3 ? hardware - 2 : 1;
+    }
+    threadCount_ = std::min(std::min(threadCount_, static_cast<unsigned int>(kMaxThreads)), meshCount_);
+    for (unsigned int t = 0; t < threadCount_; ++t)
+    {
+        threads.push_back(std::thread(&StreamingLoader::run, this, t));
+    }
+}
+
+void StreamingLoader::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quitting = true;
+    }
+    for (unsigned int t = 0; t < threads.size(); ++t)
+    {
+        threads[t].join();
+    }
+    threads.clear();
+
+    // lets go of whatever the decode function holds on to as well
+    decode = DecodeFunction();
+    meshes.clear();
+    states.clear();
+}
+
+void StreamingLoader::setPriorities(const std::vector<float>& priorities_)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    assert(priorities_.size() == priorities.size());
+    priorities = priorities_;
+}
+
+void StreamingLoader::beginFrame()
+{
+    frameBytes = 0;
+    regionAvailable = stagingBuffer != 0;
+
+    // never wait on the gpu here, if it is still copying out of the region the frame just goes without
+    if (regionAvailable && fences[region] != 0)
+    {
+        const GLenum result = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            regionAvailable = false;
+            ++stats.framesSkipped;
+        }
+        else
+        {
+            glDeleteSync(fences[region]);
+            fences[region] = 0;
+        }
+    }
+}
+
+const StreamingLoader::DecodedMesh* StreamingLoader::takeMesh()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.meshesDecoded = decodedCount;
+
+    int best = -1;
+    for (unsigned int m = 0; m < states.size(); ++m)
+    {
+        if (states[m] == kDecoded && (best < 0 || priorities[m] < priorities[best]))
+        {
+            best = m;
+        }
+    }
+    if (best < 0)
+    {
+        return nullptr;
+    }
+
+    states[best] = kUploading;
+    return &meshes[best];
+}
+
+bool StreamingLoader::upload(const DecodedMesh& mesh_, GLuint vertexBuffer_, GLintptr vertexOffset_, GLuint elementBuffer_, GLintptr elementOffset_)
+{
+    const unsigned int vertexBytes = mesh_.vertices.size() * sizeof(Vertex);
+    const unsigned int elementBytes = mesh_.elements.size() * sizeof(unsigned int);
+
+    // the vertices go first, then the elements
+    if (meshBytesUploaded < vertexBytes)
+    {
+        meshBytesUploaded += stage(reinterpret_cast<const unsigned char*>(mesh_.vertices.data()) + meshBytesUploaded,
+            vertexBytes - meshBytesUploaded,
+            vertexBuffer_,
+            vertexOffset_ + meshBytesUploaded);
+    }
+    if (meshBytesUploaded >= vertexBytes)
+    {
+        const unsigned int elementsDone = meshBytesUploaded - vertexBytes;
+        meshBytesUploaded += stage(reinterpret_cast<const unsigned char*>(mesh_.elements.data()) + elementsDone,
+            elementBytes - elementsDone,
+            elementBuffer_,
+            elementOffset_ + elementsDone);
+    }
+
+    if (meshBytesUploaded < vertexBytes + elementBytes)
+    {
+        return false;
+    }
+
+    meshBytesUploaded = 0;
+    countResident();
+    return true;
+}
+
+void StreamingLoader::skip(const DecodedMesh& mesh_)
+{
+    assert(meshBytesUploaded == 0);
+    countResident();
+}
+
+void StreamingLoader::countResident()
+{
+    if (++stats.meshesResident == stats.meshCount)
+    {
+        stats.residentMilliseconds = (CpuTimeSeconds() - startTime) * 1000.0;
+    }
+}
+
+void StreamingLoader::releaseMesh(const DecodedMesh& mesh_)
+{
+    DecodedMesh& mesh = meshes[mesh_.mesh];
+    std::vector<Vertex>().swap(mesh.vertices);
+    std::vector<unsigned int>().swap(mesh.elements);
+    std::vector<Meshlet>().swap(mesh.meshlets);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    states[mesh_.mesh] = kResident;
+}
+
+void StreamingLoader::endFrame()
+{
+    if (!persistent && stagingMemory != nullptr)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffer);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        stagingMemory = nullptr;
+    }
+
+    // the copies wait until now so the buffers can still be grown while the frame's meshes are being placed
+    if (!copies.empty())
+    {
+        TRACE_SCOPE("staging_copies");
+        glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffer);
+        for (unsigned int c = 0; c < copies.size(); ++c)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, copies[c].buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, copies[c].stagingOffset, copies[c].offset, copies[c].bytes);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        copies.clear();
+    }
+
+    stats.frameBytes = frameBytes;
+    stats.bytesUploaded += frameBytes;
+    region = (region + 1) % kFramesInFlight;
+}
+
+void StreamingLoader::frameRendered()
+{
+    if (stats.firstFrameMilliseconds < 0.0)
+    {
+        stats.firstFrameMilliseconds = (CpuTimeSeconds() - startTime) * 1000.0;
+    }
+}
+
+bool StreamingLoader::hasBudget() const
+{
+    return regionAvailable && frameBytes < budget;
+}
+
+bool StreamingLoader::isComplete() const
+{
+    return stats.meshesResident == stats.meshCount;
+}
+
+const StreamingLoader::Stats& StreamingLoader::getStats() const
+{
+    return stats;
+}
+
+void StreamingLoader::run(unsigned int thread_)
+{
+    TraceCapture::nameCurrentThread(kThreadNames[thread_]);
+
+    for (;;)
+    {
+        // the best of what is left, the thread is done once nothing is
+        int mesh = -1;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (quitting)
+            {
+                return;
+            }
+            for (unsigned int m = 0; m < states.size(); ++m)
+            {
+                if (states[m] == kQueued && (mesh < 0 || priorities[m] < priorities[mesh]))
+                {
+                    mesh = m;
+                }
+            }
+            if (mesh < 0)
+            {
+                return;
+            }
+            states[mesh] = kDecoding;
+        }
+
+        // nothing else touches this mesh's entry until it is marked decoded
+        {
+            TRACE_SCOPE("decode_mesh");
+            DecodedMesh& decoded = meshes[mesh];
+            decode(mesh, decoded);
+            decoded.mesh = mesh;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        states[mesh] = kDecoded;
+        ++decodedCount;
+    }
+}
+
+unsigned int StreamingLoader::stage(const void* data_, unsigned int bytes_, GLuint buffer_, GLintptr offset_)
+{
+    bytes_ = std::min(bytes_, budget - frameBytes);
+    if (!regionAvailable || bytes_ == 0)
+    {
+        return 0;
+    }
+
+    const GLintptr regionOffset = static_cast<GLintptr>(region) * budget;
+    if (stagingMemory == nullptr)
+    {
+        // the fence has already said the gpu is done with the region, so there is nothing to synchronise
+        glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffer);
+        stagingMemory = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_READ_BUFFER, regionOffset, budget,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        if (stagingMemory == nullptr)
+        {
+            regionAvailable = false;
+            return 0;
+        }
+    }
+
+    unsigned char* destination = persistent ? stagingMemory + regionOffset + frameBytes : stagingMemory + frameBytes;
+    std::memcpy(destination, data_, bytes_);
+
+    Copy copy;
+    copy.buffer = buffer_;
+    copy.stagingOffset = regionOffset + frameBytes;
+    copy.offset = offset_;
+    copy.bytes = bytes_;
+    copies.push_back(copy);
+
+    frameBytes += bytes_;
+    return bytes_;
+}
@@ -0,0 +1,153 @@
+#pragma once
+#ifndef STREAMING_LOADER_HPP
+#define STREAMING_LOADER_HPP
+
+#include <tgl/tgl.h>
+#include <glm/glm.hpp>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "RenderTypes.hpp"
+
+/*
+brings the scene's meshes in after the first frame instead of making the first frame wait for all of them.
+
+worker threads decode the meshes, whichever is nearest the camera first, and every frame the render thread copies
+what has been decoded into the real vertex and element buffers through a staging buffer. the staging buffer is split
+into a region for each frame in flight with a fence on each, and no more than the budget goes through it a frame so
+a big mesh gets spread over a few. a mesh can be drawn once the last of it has been copied.
+
+the staging buffer stays mapped with buffer storage (gl 4.4 or ARB_buffer_storage), without it the frame's region is
+mapped unsynchronised while it is filled, the fences make that safe either way.
+*/
+class StreamingLoader
+{
+public:
+
+    static const int kMaxThreads = 4;
+    static const int kFramesInFlight = 3;
+
+    struct DecodedMesh
+    {
+        unsigned int mesh;
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> elements; // relative to the mesh's first vertex, it is drawn with a base vertex
+        std::vector<Meshlet> meshlets; // their first elements are relative to the mesh's too
+        unsigned long long topologyHash; // of the welded elements before the meshlets reordered them
+        unsigned int weldedVertices; // how many the weld removed
+        glm::vec3 boundsMin, boundsMax;
+    };
+
+    // fills in everything but the mesh index, called on the worker threads so it can only read shared data
+    typedef std::function<void(unsigned int mesh_, DecodedMesh& decoded_)> DecodeFunction;
+
+    struct Stats
+    {
+        unsigned int meshCount;
+        unsigned int meshesDecoded;
+        unsigned int meshesResident;
+        unsigned long long bytesUploaded;
+        unsigned int frameBytes; // copied by the last frame
+        unsigned int framesSkipped; // the gpu was still reading the frame's staging region, so nothing was copied
+        bool persistentlyMapped;
+        double firstFrameMilliseconds; // negative until the first frame has been submitted
+        double residentMilliseconds; // negative until the last mesh is resident
+    };
+
+    StreamingLoader();
+    ~StreamingLoader();
+
+    // budget_ bytes can go through the staging buffer a frame
+    void createStaging(unsigned int budget_);
+    void deleteStaging();
+
+    // the times are measured from startTime_, CpuTimeSeconds from whenever loading really began. threadCount_ of 0
+    // leaves a couple of the hardware's threads for the render and simulation threads
+    void start(unsigned int meshCount_, const DecodeFunction& decode_, double startTime_, unsigned int threadCount_ = 0);
+    void stop();
+
+    // one per mesh, lower is loaded sooner. the workers look at them whenever they start on another mesh
+    void setPriorities(const std::vector<float>& priorities_);
+
+    // takes the frame's staging region, if the gpu has finished with it
+    void beginFrame();
+
+    // the decoded mesh with the best priority, or null if none are waiting. it stays valid until it is released
+    const DecodedMesh* takeMesh();
+
+    // copies as much of the mesh as the frame's budget has left into the buffers at the byte offsets, true once the
+    // last of it has gone. one mesh has to be finished before the next one is started
+    bool upload(const DecodedMesh& mesh_, GLuint vertexBuffer_, GLintptr vertexOffset_, GLuint elementBuffer_, GLintptr elementOffset_);
+    // for a mesh that draws with geometry already in the buffers, it is counted resident without copying anything
+    void skip(const DecodedMesh& mesh_);
+    void releaseMesh(const DecodedMesh& mesh_);
+
+    // issues the frame's copies and fences its staging region
+    void endFrame();
+
+    // after the frame has been submitted, only the first one is recorded
+    void frameRendered();
+
+    bool hasBudget() const;
+    bool isComplete() const;
+    const Stats& getStats() const;
+
+protected:
+
+    enum State
+    {
+        kQueued,
+        kDecoding,
+        kDecoded,
+        kUploading,
+        kResident
+    };
+
+    struct Copy
+    {
+        GLuint buffer;
+        GLintptr stagingOffset;
+        GLintptr offset;
+        GLsizeiptr bytes;
+    };
+
+    // staging
+    GLuint stagingBuffer;
+    unsigned char* stagingMemory; // the whole buffer when persistently mapped, otherwise the frame's region while it is
+    GLsync fences[kFramesInFlight];
+    unsigned int budget;
+    unsigned int region;
+    unsigned int frameBytes;
+    bool regionAvailable;
+    bool persistent;
+    std::vector<Copy> copies;
+    unsigned int meshBytesUploaded; // of the mesh being uploaded
+
+    // shared with the workers
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    DecodeFunction decode;
+    std::vector<DecodedMesh> meshes;
+    std::vector<State> states;
+    std::vector<float> priorities;
+    unsigned int decodedCount;
+    bool quitting;
+
+    double startTime;
+    Stats stats;
+
+    void run(unsigned int thread_);
+    void countResident();
+
+    // returns how many of the bytes fitted in what is left of the budget
+    unsigned int stage(const void* data_, unsigned int bytes_, GLuint buffer_, GLintptr offset_);
+
+private:
+
+    StreamingLoader(const StreamingLoader&);
+    StreamingLoader& operator=(const StreamingLoader&);
+};
+
+#endif //STREAMING_LOADER_HPP
@@ -0,0 +1,264 @@
+#include "StressBenchmark.hpp"
+#include "MyView.hpp"
+#include "CpuTimer.hpp"
+
+#include <fstream>
+#include <iostream>
+
+// the scene and the gpu timer need a few frames to settle after every change
+static const int kWarmUpFrames = 30;
+static const int kMeasuredFrames = 120;
+
+static const unsigned int kLightSteps[] = { 1, 10, 100, 1000, 10000, 100000 };
+static const unsigned int kInstanceSteps[] = { 1000, 10000, 100000, 1000000 };
+
+// coarser, every light count is run against every instance count
+static const unsigned int kGridLightSteps[] = { 10, 1000, 100000 };
+static const unsigned int kGridInstanceSteps[] = { 1000, 100000, 1000000 };
+
+StressBenchmark::StressBenchmark() : outputPath("stress_results.csv"),
+    currentStep(0),
+    frameInStep(0),
+    lastFrameTime(0),
+    running(false),
+    finished(false),
+    failed(false),
+    incrementalRendering(false),
+    frameSum(0),
+    gpuSum(0),
+    visibleSum(0),
+    gpuSamples(0),
+    allocationSum(0),
+    allocationBytesSum(0)
+{
+    // lights on their own, the scene's lights are swapped out so the counts are exact
+    for (unsigned int i = 0; i < sizeof(kLightSteps) / sizeof(kLightSteps[0]); ++i)
+    {
+        Step step;
+        step.dimension = "lights";
+        step.config.lightCount = kLightSteps[i];
+        step.config.replaceSceneLights = true;
+        steps.push_back(step);
+    }
+
+    // instances on their own, with the scene's lights left as they are
+    for (unsigned int i = 0; i < sizeof(kInstanceSteps) / sizeof(kInstanceSteps[0]); ++i)
+    {
+        Step step;
+        step.dimension = "instances";
+        step.config.instanceCount = kInstanceSteps[i];
+        steps.push_back(step);
+    }
+
+    // both together, the sweeps above only ever move one with the other at the scene's own
+    for (unsigned int i = 0; i < sizeof(kGridInstanceSteps) / sizeof(kGridInstanceSteps[0]); ++i)
+    {
+        for (unsigned int l = 0; l < sizeof(kGridLightSteps) / sizeof(kGridLightSteps[0]); ++l)
+        {
+            Step step;
+            step.dimension = "grid";
+            step.config.lightCount = kGridLightSteps[l];
+            step.config.replaceSceneLights = true;
+            step.config.instanceCount = kGridInstanceSteps[i];
+            steps.push_back(step);
+        }
+    }
+}
+
+StressBenchmark::~StressBenchmark()
+{
+
+}
+
+void StressBenchmark::setOutputPath(const std::string& path_)
+{
+    outputPath = path_;
+}
+
+void StressBenchmark::start(MyView& view_)
+{
+    results.clear();
+    passNames.clear();
+    currentStep = 0;
+    running = true;
+    finished = false;
+    failed = false;
+    // a frame with nothing new to draw would be skipped and time nothing
+    incrementalRendering = view_.getIncrementalRendering();
+    view_.setIncrementalRendering(false);
+    std::cout << "stress benchmark: " << steps.size() << " steps" << std::endl;
+    beginStep(view_);
+}
+
+bool StressBenchmark::isRunning() const
+{
+    return running;
+}
+
+bool StressBenchmark::isFinished() const
+{
+    return finished;
+}
+
+bool StressBenchmark::hasFailed() const
+{
+    return failed;
+}
+
+void StressBenchmark::beginStep(MyView& view_)
+{
+    view_.setStressConfig(steps[currentStep].config);
+    frameInStep = 0;
+    frameSum = 0;
+    gpuSum = 0;
+    visibleSum = 0;
+    gpuSamples = 0;
+    allocationSum = 0;
+    allocationBytesSum = 0;
+    passSums.assign(passNames.size(), 0.0);
+    lastFrameTime = CpuTimeSeconds();
+}
+
+int StressBenchmark::findPass(const char* name_)
+{
+    for (unsigned int i = 0; i < passNames.size(); ++i)
+    {
+        if (passNames[i] == name_)
+        {
+            return i;
+        }
+    }
+    passNames.push_back(name_);
+    passSums.push_back(0.0);
+    return passNames.size() - 1;
+}
+
+void StressBenchmark::update(MyView& view_)
+{
+    if (!running)
+    {
+        return;
+    }
+
+    // the time between two calls covers a whole frame including the swap
+    const double now = CpuTimeSeconds();
+    const double frameMs = (now - lastFrameTime) * 1000.0;
+    lastFrameTime = now;
+
+    ++frameInStep;
+    if (frameInStep <= kWarmUpFrames)
+    {
+        return;
+    }
+
+    frameSum += frameMs;
+    visibleSum += view_.getLightStats().visibleLights;
+
+    // the view's counts are for the frame before this one, which the warm up has already covered
+    const AllocationTracker::Counts& allocations = view_.getFrameAllocations();
+    allocationSum += allocations.allocations;
+    allocationBytesSum += allocations.bytes;
+
+    const GpuTimer& timer = view_.getGpuTimer();
+    if (timer.hasResults())
+    {
+        gpuSum += timer.getFrameMilliseconds();
+        for (int i = 0; i < timer.getPassCount(); ++i)
+        {
+            passSums[findPass(timer.getPassName(i))] += timer.getPassMilliseconds(i);
+        }
+        ++gpuSamples;
+    }
+
+    if (frameInStep == kWarmUpFrames + kMeasuredFrames)
+    {
+        finishStep(view_);
+    }
+}
+
+void StressBenchmark::finishStep(MyView& view_)
+{
+    const Step& step = steps[currentStep];
+
+    Result result;
+    result.dimension = step.dimension;
+    result.lightCount = step.config.lightCount;
+    result.instanceCount = view_.getInstanceCount();
+    result.visibleLights = visibleSum / kMeasuredFrames;
+    result.frameMs = frameSum / kMeasuredFrames;
+    result.gpuMs = gpuSamples > 0 ? gpuSum / gpuSamples : 0.0;
+    result.allocationsPerFrame = static_cast<double>(allocationSum) / kMeasuredFrames;
+    result.bytesPerFrame = static_cast<double>(allocationBytesSum) / kMeasuredFrames;
+    for (unsigned int i = 0; i < passSums.size(); ++i)
+    {
+        result.passMs.push_back(gpuSamples > 0 ? passSums[i] / gpuSamples : 0.0);
+    }
+    results.push_back(result);
+
+    std::cout << "  " << result.dimension
+        << " lights " << result.lightCount
+        << " instances " << result.instanceCount
+        << ": frame " << result.frameMs << "ms"
+        << ", gpu " << result.gpuMs << "ms"
+        << ", allocations " << result.allocationsPerFrame << "/frame" << std::endl;
+
+    if (allocationSum > 0)
+    {
+        std::cerr << "  FAILED: " << allocationSum << " heap allocations (" << allocationBytesSum
+            << " bytes) in steady state frames" << std::endl;
+        failed = true;
+    }
+
+    ++currentStep;
+    if (currentStep < static_cast<int>(steps.size()))
+    {
+        beginStep(view_);
+        return;
+    }
+
+    // put the scene back the way it was
+    running = false;
+    finished = true;
+    view_.setStressConfig(StressScene::Config());
+    view_.setIncrementalRendering(incrementalRendering);
+    writeResults();
+    std::cout << "stress benchmark: " << (failed ? "FAILED" : "passed") << std::endl;
+}
+
+void StressBenchmark::writeResults() const
+{
+    std::ofstream file(outputPath.c_str());
+    if (!file)
+    {
+        std::cerr << "stress benchmark: couldnt open " << outputPath << std::endl;
+        return;
+    }
+
+    file << "dimension,lights,instances,visible_lights,frame_ms,gpu_ms,allocations_per_frame,allocated_bytes_per_frame";
+    for (unsigned int i = 0; i < passNames.size(); ++i)
+    {
+        file << "," << passNames[i] << "_ms";
+    }
+    file << "\n";
+
+    for (unsigned int r = 0; r < results.size(); ++r)
+    {
+        const Result& result = results[r];
+        file << result.dimension << ","
+            << result.lightCount << ","
+            << result.instanceCount << ","
+            << result.visibleLights << ","
+            << result.frameMs << ","
+            << result.gpuMs << ","
+            << result.allocationsPerFrame << ","
+            << result.bytesPerFrame;
+        // passes that only showed up in later steps read as 0 for the earlier ones
+        for (unsigned int i = 0; i < passNames.size(); ++i)
+        {
+            file << "," << (i < result.passMs.size() ? result.passMs[i] : 0.0);
+        }
+        file << "\n";
+    }
+
+    std::cout << "stress benchmark: wrote " << results.size() << " rows to " << outputPath << std::endl;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#ifndef STRESS_BENCHMARK_HPP
+#define STRESS_BENCHMARK_HPP
+
+#include <string>
+#include <vector>
+
+#include "StressScene.hpp"
+
+class MyView;
+
+/*
+steps the stress scene through a list of light counts, then a list of instance counts, then a coarse grid of both
+together, timing a run of frames at each step so we get a curve for each dimension and how the two interact rather
+than a single number.
+
+it is driven from the controller once per frame, after a few warm up frames at each step it records the cpu frame
+interval and the per pass gpu times, then writes everything out as csv when the sweep is done.
+the measured frames are steady state, so any heap allocation the view makes during them fails the run.
+*/
+class StressBenchmark
+{
+public:
+
+    StressBenchmark();
+    ~StressBenchmark();
+
+    void start(MyView& view_);
+    bool isRunning() const;
+    // true once a sweep has run to the end
+    bool isFinished() const;
+    // a measured frame allocated, see AllocationTracker
+    bool hasFailed() const;
+
+    // call once per frame before the view renders
+    void update(MyView& view_);
+
+    void setOutputPath(const std::string& path_);
+
+protected:
+
+    struct Step
+    {
+        const char* dimension;
+        StressScene::Config config;
+    };
+
+    struct Result
+    {
+        const char* dimension;
+        unsigned int lightCount;
+        unsigned int instanceCount;
+        double visibleLights;
+        double frameMs;
+        double gpuMs;
+        double allocationsPerFrame;
+        double bytesPerFrame;
+        std::vector<double> passMs; // indexed the same as passNames
+    };
+
+    std::vector<Step> steps;
+    std::vector<Result> results;
+    std::vector<std::string> passNames;
+    std::string outputPath;
+
+    int currentStep;
+    int frameInStep;
+    double lastFrameTime;
+    bool running;
+    bool finished;
+    bool failed;
+    bool incrementalRendering; // the view's setting before the run, it is off while the sweep runs
+
+    // sums over the measured frames of the current step
+    double frameSum;
+    double gpuSum;
+    double visibleSum;
+    int gpuSamples;
+    unsigned long long allocationSum;
+    unsigned long long allocationBytesSum;
+    std::vector<double> passSums;
+
+    void beginStep(MyView& view_);
+    void finishStep(MyView& view_);
+    int findPass(const char* name_);
+    void writeResults() const;
+};
+
+#endif //STRESS_BENCHMARK_HPP
@@ -0,0 +1,134 @@
+#include "StressScene.hpp"
+
+#include <cmath>
+
+// small deterministic generator, the standard distributions arent guaranteed to match between library versions
+static float NextRandom(unsigned int& state_)
+{
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return (state_ & 0xFFFFFF) / static_cast<float>(0x1000000);
+}
+
+StressScene::Config::Config() : lightCount(0),
+    minLightRange(20.f),
+    maxLightRange(200.f),
+    replaceSceneLights(false),
+    instanceCount(0),
+    seed(1)
+{
+
+}
+
+bool StressScene::Config::operator==(const Config& other_) const
+{
+    return lightCount == other_.lightCount
+        && minLightRange == other_.minLightRange
+        && maxLightRange == other_.maxLightRange
+        && replaceSceneLights == other_.replaceSceneLights
+        && instanceCount == other_.instanceCount
+        && seed == other_.seed;
+}
+
+bool StressScene::Config::operator!=(const Config& other_) const
+{
+    return !(*this == other_);
+}
+
+StressScene::StressScene()
+{
+
+}
+
+StressScene::~StressScene()
+{
+
+}
+
+void StressScene::setConfig(const Config& config_)
+{
+    config = config_;
+}
+
+const StressScene::Config& StressScene::getConfig() const
+{
+    return config;
+}
+
+bool StressScene::isActive() const
+{
+    return config.lightCount > 0 || config.replaceSceneLights || config.instanceCount > 0;
+}
+
+void StressScene::generateLights(const glm::vec3& sceneMin_, const glm::vec3& sceneMax_)
+{
+    unsigned int state = config.seed != 0 ? config.seed : 1;
+
+    lights.resize(config.lightCount);
+    const glm::vec3 extent = sceneMax_ - sceneMin_;
+    for (unsigned int i = 0; i < config.lightCount; ++i)
+    {
+        LightData& light = lights[i];
+        light.position = sceneMin_ + glm::vec3(NextRandom(state) * extent.x,
+            NextRandom(state) * extent.y,
+            NextRandom(state) * extent.z);
+        light.range = config.minLightRange + NextRandom(state) * (config.maxLightRange - config.minLightRange);
+        light.shadowSlot = glm::vec4(0, 0, 0, 0);
+    }
+}
+
+const std::vector<LightData>& StressScene::getLights() const
+{
+    return lights;
+}
+
+void StressScene::replicateInstances(const std::vector< std::vector< InstanceData > >& source_,
+    const glm::vec3& sceneMin_,
+    const glm::vec3& sceneMax_,
+    std::vector< std::vector< InstanceData > >& out_) const
+{
+    unsigned int sourceCount = 0;
+    for (unsigned int i = 0; i < source_.size(); ++i)
+    {
+        sourceCount += source_[i].size();
+    }
+
+    out_.resize(source_.size());
+    for (unsigned int i = 0; i < out_.size(); ++i)
+    {
+        out_[i].clear();
+    }
+
+    if (sourceCount == 0 || config.instanceCount == 0)
+    {
+        out_ = source_;
+        return;
+    }
+
+    // whole copies of the scene on a square grid, with a gap between them so they read as separate blocks
+    const unsigned int copies = (config.instanceCount + sourceCount - 1) / sourceCount;
+    const unsigned int side = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<double>(copies))));
+    const glm::vec3 stride = (sceneMax_ - sceneMin_) * 1.1f;
+
+    for (unsigned int i = 0; i < out_.size(); ++i)
+    {
+        out_[i].reserve(source_[i].size() * copies);
+    }
+
+    unsigned int produced = 0;
+    for (unsigned int copy = 0; copy < copies && produced < config.instanceCount; ++copy)
+    {
+        const glm::vec3 offset(stride.x * (copy % side), 0.f, stride.z * (copy / side));
+        for (unsigned int i = 0; i < source_.size() && produced < config.instanceCount; ++i)
+        {
+            for (unsigned int j = 0; j < source_[i].size() && produced < config.instanceCount; ++j)
+            {
+                InstanceData instance = source_[i][j];
+                instance.positionData[3] += offset;
+                out_[i].push_back(instance);
+                ++produced;
+            }
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef STRESS_SCENE_HPP
+#define STRESS_SCENE_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "RenderTypes.hpp"
+
+/*
+synthetic load on top of (or in place of) what the SceneModel::Context provides, so we can see how the renderer scales.
+
+lights are scattered through the scene bounds with a random range, instances are made by tiling copies of the whole
+scene out along x and z until there are enough of them. everything is seeded so runs can be compared.
+*/
+class StressScene
+{
+public:
+
+    struct Config
+    {
+        unsigned int lightCount;
+        float minLightRange, maxLightRange;
+        bool replaceSceneLights; // otherwise the generated lights are added to the scene's own
+
+        unsigned int instanceCount; // total instances to draw, 0 leaves the scene's instances alone
+
+        unsigned int seed;
+
+        Config();
+
+        bool operator==(const Config& other_) const;
+        bool operator!=(const Config& other_) const;
+    };
+
+    StressScene();
+    ~StressScene();
+
+    void setConfig(const Config& config_);
+    const Config& getConfig() const;
+
+    // true if the config asks for anything other than the plain scene
+    bool isActive() const;
+
+    void generateLights(const glm::vec3& sceneMin_, const glm::vec3& sceneMax_);
+    const std::vector<LightData>& getLights() const;
+
+    // fills out_ with copies of source_ (one vector of instances per mesh) until there are instanceCount instances
+    void replicateInstances(const std::vector< std::vector< InstanceData > >& source_,
+        const glm::vec3& sceneMin_,
+        const glm::vec3& sceneMax_,
+        std::vector< std::vector< InstanceData > >& out_) const;
+
+protected:
+
+    Config config;
+    std::vector<LightData> lights;
+};
+
+#endif //STRESS_SCENE_HPP
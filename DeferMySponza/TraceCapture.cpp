@@ -0,0 +1,287 @@
+#include "TraceCapture.hpp"
+#include "GpuTimer.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+std::atomic<bool> TraceCapture::recording(false);
+
+namespace
+{
+    // track used for the gpu passes, cpu threads are numbered from 0
+    const int kGpuTrack = -1;
+    const int kMaxThreads = 16;
+
+    enum CaptureState
+    {
+        kIdle,
+        kRequested,
+        kCapturing,
+        kDraining // cpu side is done, waiting for the last frames' gpu results
+    };
+
+    struct Event
+    {
+        const char* name;
+        long long begin;
+        long long end;
+        int track;
+    };
+
+    struct ThreadTrack
+    {
+        std::thread::id id;
+        const char* name;
+    };
+
+    // everything is behind the one mutex, it is only taken while a capture is running
+    struct CaptureData
+    {
+        std::mutex mutex;
+        std::vector<Event> events;
+        std::vector<ThreadTrack> threads;
+        CaptureState state;
+        std::string path;
+        int framesRequested;
+        int framesLeft;
+        long long captureBegin;
+        long long captureEnd;
+        long long gpuOffset;
+        unsigned int firstGpuFrame;
+        unsigned int lastGpuFrame;
+        unsigned int dropped;
+
+        CaptureData() : state(kIdle),
+            framesRequested(0),
+            framesLeft(0),
+            captureBegin(0),
+            captureEnd(0),
+            gpuOffset(0),
+            firstGpuFrame(0),
+            lastGpuFrame(0),
+            dropped(0)
+        {
+        }
+    };
+
+    CaptureData& Data()
+    {
+        static CaptureData data;
+        return data;
+    }
+
+    int FindTrack(CaptureData& data_, std::thread::id id_)
+    {
+        for (unsigned int i = 0; i < data_.threads.size(); ++i)
+        {
+            if (data_.threads[i].id == id_)
+            {
+                return i;
+            }
+        }
+        if (data_.threads.size() == kMaxThreads)
+        {
+            return kMaxThreads - 1;
+        }
+        ThreadTrack track;
+        track.id = id_;
+        track.name = nullptr;
+        data_.threads.push_back(track);
+        return data_.threads.size() - 1;
+    }
+
+    void PushEvent(CaptureData& data_, const char* name_, long long begin_, long long end_, int track_)
+    {
+        if (data_.events.size() == TraceCapture::kMaxEvents)
+        {
+            ++data_.dropped;
+            return;
+        }
+        Event event;
+        event.name = name_;
+        event.begin = begin_;
+        event.end = end_;
+        event.track = track_;
+        data_.events.push_back(event);
+    }
+
+    // chrome wants microseconds, keep the nanoseconds as decimals so short scopes dont collapse to zero
+    void WriteMicroseconds(std::ostream& out_, long long nanoseconds_)
+    {
+        out_ << nanoseconds_ / 1000 << '.' << std::setw(3) << std::setfill('0') << nanoseconds_ % 1000 << std::setfill(' ');
+    }
+
+    bool WriteTrace(const CaptureData& data_)
+    {
+        std::ofstream out(data_.path.c_str());
+        if (!out)
+        {
+            return false;
+        }
+
+        // pid 1 is the cpu and pid 2 the gpu so chrome keeps them in separate groups
+        out << "{\"traceEvents\":[" << std::endl;
+        out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"cpu\"}}," << std::endl;
+        out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"tid\":0,\"args\":{\"name\":\"gpu\"}}," << std::endl;
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":0,\"args\":{\"name\":\"GL_TIMESTAMP\"}}";
+        for (unsigned int i = 0; i < data_.threads.size(); ++i)
+        {
+            out << "," << std::endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i
+                << ",\"args\":{\"name\":\"" << (data_.threads[i].name != nullptr ? data_.threads[i].name : "thread") << "\"}}";
+        }
+
+        for (unsigned int i = 0; i < data_.events.size(); ++i)
+        {
+            const Event& event = data_.events[i];
+            const bool gpu = event.track == kGpuTrack;
+            out << "," << std::endl << "{\"name\":\"" << event.name << "\",\"cat\":\"" << (gpu ? "gpu" : "cpu")
+                << "\",\"ph\":\"X\",\"pid\":" << (gpu ? 2 : 1) << ",\"tid\":" << (gpu ? 0 : event.track) << ",\"ts\":";
+            WriteMicroseconds(out, event.begin - data_.captureBegin);
+            out << ",\"dur\":";
+            WriteMicroseconds(out, event.end - event.begin);
+            out << "}";
+        }
+
+        out << std::endl << "]," << std::endl;
+        out << "\"displayTimeUnit\":\"ms\"," << std::endl;
+        out << "\"otherData\":{\"frames\":" << data_.framesRequested
+            << ",\"gpu_clock_offset_ns\":" << data_.gpuOffset
+            << ",\"dropped_events\":" << data_.dropped << "}" << std::endl;
+        out << "}" << std::endl;
+        return out.good();
+    }
+}
+
+void TraceCapture::requestCapture(int frames_, const char* path_)
+{
+    CaptureData& data = Data();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    if (data.state != kIdle || frames_ <= 0)
+    {
+        return;
+    }
+
+    data.state = kRequested;
+    data.path = path_;
+    data.framesRequested = frames_;
+    data.framesLeft = frames_;
+    data.dropped = 0;
+    data.events.clear();
+    // the buffer is set aside now so recording never allocates in the middle of a frame
+    data.events.reserve(kMaxEvents);
+    data.threads.reserve(kMaxThreads);
+}
+
+void TraceCapture::nameCurrentThread(const char* name_)
+{
+    CaptureData& data = Data();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    data.threads.reserve(kMaxThreads);
+    data.threads[FindTrack(data, std::this_thread::get_id())].name = name_;
+}
+
+bool TraceCapture::beginFrame()
+{
+    CaptureData& data = Data();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    if (data.state != kRequested)
+    {
+        return false;
+    }
+
+    data.state = kCapturing;
+    data.captureBegin = CpuTimeNanoseconds();
+    recording.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void TraceCapture::setGpuClock(long long offset_, unsigned int firstFrame_)
+{
+    CaptureData& data = Data();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    data.gpuOffset = offset_;
+    data.firstGpuFrame = firstFrame_;
+    data.lastGpuFrame = firstFrame_ + data.framesRequested - 1;
+}
+
+void TraceCapture::recordGpuPasses(const GpuTimer& timer_)
+{
+    CaptureData& data = Data();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    if (data.state != kCapturing && data.state != kDraining)
+    {
+        return;
+    }
+
+    // the gpu runs behind, so the first few results after the start are from frames before the capture
+    const unsigned int frame = timer_.getResultFrame();
+    if (!timer_.hasResults() || frame < data.firstGpuFrame || frame > data.lastGpuFrame)
+    {
+        return;
+    }
+    // only take each frame once, the timer holds on to its results until the next read
+    data.firstGpuFrame = frame + 1;
+
+    for (int p = 0; p < timer_.getPassCount(); ++p)
+    {
+        PushEvent(data,
+            timer_.getPassName(p),
+            static_cast<long long>(timer_.getPassBegin(p)) + data.gpuOffset,
+            static_cast<long long>(timer_.getPassEnd(p)) + data.gpuOffset,
+            kGpuTrack);
+    }
+}
+
+void TraceCapture::endFrame()
+{
+    CaptureData& data = Data();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    if (data.state == kCapturing)
+    {
+        if (--data.framesLeft == 0)
+        {
+            recording.store(false, std::memory_order_relaxed);
+            data.captureEnd = CpuTimeNanoseconds();
+            data.state = kDraining;
+            data.framesLeft = GpuTimer::kFrameLatency;
+        }
+    }
+    else if (data.state == kDraining)
+    {
+        if (--data.framesLeft == 0)
+        {
+            if (WriteTrace(data))
+            {
+                std::cout << "trace: " << data.framesRequested << " frames, " << data.events.size() << " events written to "
+                    << data.path;
+                if (data.dropped > 0)
+                {
+                    std::cout << " (" << data.dropped << " dropped)";
+                }
+                std::cout << std::endl;
+            }
+            else
+            {
+                std::cerr << "trace: could not write " << data.path << std::endl;
+            }
+            data.state = kIdle;
+        }
+    }
+}
+
+void TraceCapture::recordScope(const char* name_, long long begin_, long long end_)
+{
+    CaptureData& data = Data();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    // scopes that were already open when the last frame ended (the frame's own scope for one) still belong to it
+    if (data.state != kCapturing && !(data.state == kDraining && begin_ <= data.captureEnd))
+    {
+        return;
+    }
+    PushEvent(data, name_, begin_, end_, FindTrack(data, std::this_thread::get_id()));
+}
@@ -0,0 +1,103 @@
+#pragma once
+#ifndef TRACE_CAPTURE_HPP
+#define TRACE_CAPTURE_HPP
+
+#include <atomic>
+
+#include "CpuTimer.hpp"
+
+class GpuTimer;
+
+/*
+records cpu scopes and gpu passes for a few frames and writes them out as a chrome trace (chrome://tracing or
+ui.perfetto.dev can open it).
+
+scopes are marked with TRACE_SCOPE, which costs one relaxed load when no capture is running, and compiles away
+completely with TRACE_ENABLED set to 0. the gpu passes come from the GpuTimer's timestamp queries, which are moved
+onto the cpu clock with an offset measured when the capture starts. they arrive a few frames late so the capture
+keeps going for GpuTimer::kFrameLatency frames after the last cpu frame before writing the file.
+
+recording is safe from any thread, every thread that records gets its own track.
+*/
+class TraceCapture
+{
+public:
+
+    // drops anything past this, a capture of a busy frame is a few hundred events
+    static const int kMaxEvents = 65536;
+
+    // asks for the next frames_ frames to be captured, the file is written once they and their gpu results are in
+    static void requestCapture(int frames_, const char* path_);
+
+    // the name shown for the calling thread's track, call it once from the thread before anything is recorded
+    static void nameCurrentThread(const char* name_);
+
+    // called by the render thread at the top of the frame, returns true on the frame a capture starts so the gpu
+    // clock can be calibrated
+    static bool beginFrame();
+
+    // offset_ is the nanoseconds to add to a GL_TIMESTAMP to put it on CpuTimeNanoseconds, firstFrame_ the GpuTimer
+    // frame the capture starts on
+    static void setGpuClock(long long offset_, unsigned int firstFrame_);
+
+    // picks up whatever the timer read back this frame, results from frames outside the capture are skipped
+    static void recordGpuPasses(const GpuTimer& timer_);
+
+    // called at the bottom of the frame, writes the file once the capture is done
+    static void endFrame();
+
+    static bool isRecording()
+    {
+        return recording.load(std::memory_order_relaxed);
+    }
+
+    static void recordScope(const char* name_, long long begin_, long long end_);
+
+protected:
+
+    static std::atomic<bool> recording;
+};
+
+// times from construction to the end of the enclosing block, only while a capture is running
+class TraceScope
+{
+public:
+
+    explicit TraceScope(const char* name_) : name(name_), begin(TraceCapture::isRecording() ? CpuTimeNanoseconds() : -1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (begin >= 0)
+        {
+            TraceCapture::recordScope(name, begin, CpuTimeNanoseconds());
+        }
+    }
+
+protected:
+
+    const char* name;
+    long long begin;
+
+private:
+
+    TraceScope(const TraceScope&);
+    TraceScope& operator=(const TraceScope&);
+};
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+#define TRACE_CONCAT_INNER(a_, b_) a_##b_
+#define TRACE_CONCAT(a_, b_) TRACE_CONCAT_INNER(a_, b_)
+
+#if TRACE_ENABLED
+// the name has to be a string literal, or at least outlive the capture
+#define TRACE_SCOPE(name_) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name_)
+#else
+#define TRACE_SCOPE(name_) ((void)0)
+#endif
+
+#endif //TRACE_CAPTURE_HPP
@@ -0,0 +1,21 @@
+#include "UploadSink.hpp"
+#include "GpuMemory.hpp"
+
+#include <cstring>
+
+void GLUploadSink::replaceBuffer(GLenum target_, GLuint buffer_, const void* data_, size_t bytes_, GLenum usage_)
+{
+    glBindBuffer(target_, buffer_);
+    glBufferData(target_, bytes_, data_, usage_);
+    GpuMemory::bufferStorage(buffer_, bytes_);
+    glBindBuffer(target_, 0);
+}
+
+void GLUploadSink::writeBuffer(GLenum target_, GLuint buffer_, const void* data_, size_t bytes_)
+{
+    glBindBuffer(target_, buffer_);
+    GLvoid* p = glMapBuffer(target_, GL_WRITE_ONLY);
+    memcpy(p, data_, bytes_);
+    glUnmapBuffer(target_);
+    glBindBuffer(target_, 0);
+}
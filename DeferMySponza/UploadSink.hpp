@@ -0,0 +1,33 @@
+#pragma once
+#ifndef UPLOAD_SINK_HPP
+#define UPLOAD_SINK_HPP
+
+#include <tgl/tgl.h>
+#include <cstddef>
+
+/*
+where the per frame cpu code sends its buffer uploads. the demo uses GLUploadSink, the benchmarks swap in a stub so
+the same code can be timed without a gl context.
+*/
+class UploadSink
+{
+public:
+
+    virtual ~UploadSink() {}
+
+    // replaces the whole store, like glBufferData
+    virtual void replaceBuffer(GLenum target_, GLuint buffer_, const void* data_, size_t bytes_, GLenum usage_) = 0;
+
+    // overwrites the start of a store that is already big enough
+    virtual void writeBuffer(GLenum target_, GLuint buffer_, const void* data_, size_t bytes_) = 0;
+};
+
+class GLUploadSink : public UploadSink
+{
+public:
+
+    void replaceBuffer(GLenum target_, GLuint buffer_, const void* data_, size_t bytes_, GLenum usage_) override;
+    void writeBuffer(GLenum target_, GLuint buffer_, const void* data_, size_t bytes_) override;
+};
+
+#endif //UPLOAD_SINK_HPP
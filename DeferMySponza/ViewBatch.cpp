@@ -0,0 +1,245 @@
+#include "ViewBatch.hpp"
+#include "GpuMemory.hpp"
+
+#include <cassert>
+
+ViewBatch::ViewBatch() : depthStencilTexture(0),
+    colourTexture(0),
+    layeredFramebuffer(0),
+    width(0),
+    height(0),
+    viewCount(0),
+    timerQuery(0),
+    timerIssued(false),
+    timing(false),
+    timedViews(0),
+    timedOneAtATime(false)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        gbufferTextures[i] = 0;
+    }
+    for (int i = 0; i < kMaxViews; ++i)
+    {
+        geometryFramebuffers[i] = 0;
+        lightingFramebuffers[i] = 0;
+    }
+    stats.views = 0;
+    stats.oneAtATime = false;
+    stats.gpuMilliseconds = 0.0;
+    stats.viewsPerSecond = 0.0;
+    stats.batchesTimed = 0;
+}
+
+ViewBatch::~ViewBatch()
+{
+}
+
+void ViewBatch::createTargets(int width_, int height_, int viewCount_)
+{
+    assert(viewCount_ > 0 && viewCount_ <= kMaxViews);
+    if (width_ == width && height_ == height && viewCount_ == viewCount)
+    {
+        return;
+    }
+    deleteTargets();
+    width = width_;
+    height = height_;
+    viewCount = viewCount_;
+
+    // same formats as the gbuffer and lbuffer, so the same lighting shaders can read and write them
+    const GLenum formats[3] = { GL_RGB32F, GL_RGB32F, GL_RGBA32F };
+    const char* labels[3] = { "batch_gbuffer_position", "batch_gbuffer_normal", "batch_gbuffer_material" };
+    GLuint* textures[5] = { &gbufferTextures[0], &gbufferTextures[1], &gbufferTextures[2], &depthStencilTexture, &colourTexture };
+    const GLenum textureFormats[5] = { formats[0], formats[1], formats[2], GL_DEPTH24_STENCIL8, GL_RGBA32F };
+    const char* textureLabels[5] = { labels[0], labels[1], labels[2], "batch_depth_stencil", "batch_colour" };
+    for (int i = 0; i < 5; ++i)
+    {
+        glGenTextures(1, textures[i]);
+        GpuMemory::track(GpuMemory::kTexture, *textures[i], GpuMemory::kRenderTargets, textureLabels[i]);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, *textures[i]);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, textureFormats[i], width, height, viewCount);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        GpuMemory::textureStorage(*textures[i], textureFormats[i], width, height, viewCount);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    const GLenum gbufferBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+
+    // attaching the whole arrays makes it layered, gl_Layer picks where each triangle goes
+    glGenFramebuffers(1, &layeredFramebuffer);
+    GpuMemory::track(GpuMemory::kFramebuffer, layeredFramebuffer, GpuMemory::kObjects, "batch_gbuffer");
+    glBindFramebuffer(GL_FRAMEBUFFER, layeredFramebuffer);
+    for (int i = 0; i < 3; ++i)
+    {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, gbufferTextures[i], 0);
+    }
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, depthStencilTexture, 0);
+    glDrawBuffers(3, gbufferBuffers);
+    checkFramebuffer("batch gbuffer not complete");
+
+    for (int l = 0; l < viewCount; ++l)
+    {
+        glGenFramebuffers(1, &geometryFramebuffers[l]);
+        GpuMemory::track(GpuMemory::kFramebuffer, geometryFramebuffers[l], GpuMemory::kObjects, "batch_gbuffer_layer");
+        glBindFramebuffer(GL_FRAMEBUFFER, geometryFramebuffers[l]);
+        for (int i = 0; i < 3; ++i)
+        {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, gbufferTextures[i], 0, l);
+        }
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, depthStencilTexture, 0, l);
+        glDrawBuffers(3, gbufferBuffers);
+        checkFramebuffer("batch gbuffer layer not complete");
+
+        glGenFramebuffers(1, &lightingFramebuffers[l]);
+        GpuMemory::track(GpuMemory::kFramebuffer, lightingFramebuffers[l], GpuMemory::kObjects, "batch_lighting_layer");
+        glBindFramebuffer(GL_FRAMEBUFFER, lightingFramebuffers[l]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colourTexture, 0, l);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, depthStencilTexture, 0, l);
+        glDrawBuffers(1, gbufferBuffers);
+        checkFramebuffer("batch lighting layer not complete");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (timerQuery == 0)
+    {
+        glGenQueries(1, &timerQuery);
+    }
+}
+
+void ViewBatch::deleteTargets()
+{
+    if (timerQuery != 0)
+    {
+        // a query cant be deleted while it is active
+        endTiming();
+        glDeleteQueries(1, &timerQuery);
+        timerQuery = 0;
+        timerIssued = false;
+    }
+
+    if (viewCount == 0)
+    {
+        return;
+    }
+
+    glDeleteFramebuffers(1, &layeredFramebuffer);
+    GpuMemory::release(GpuMemory::kFramebuffer, layeredFramebuffer);
+    layeredFramebuffer = 0;
+    for (int l = 0; l < viewCount; ++l)
+    {
+        glDeleteFramebuffers(1, &geometryFramebuffers[l]);
+        GpuMemory::release(GpuMemory::kFramebuffer, geometryFramebuffers[l]);
+        glDeleteFramebuffers(1, &lightingFramebuffers[l]);
+        GpuMemory::release(GpuMemory::kFramebuffer, lightingFramebuffers[l]);
+        geometryFramebuffers[l] = 0;
+        lightingFramebuffers[l] = 0;
+    }
+
+    GLuint* textures[5] = { &gbufferTextures[0], &gbufferTextures[1], &gbufferTextures[2], &depthStencilTexture, &colourTexture };
+    for (int i = 0; i < 5; ++i)
+    {
+        glDeleteTextures(1, textures[i]);
+        GpuMemory::release(GpuMemory::kTexture, *textures[i]);
+        *textures[i] = 0;
+    }
+
+    width = 0;
+    height = 0;
+    viewCount = 0;
+}
+
+void ViewBatch::bindLayered()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, layeredFramebuffer);
+    glViewport(0, 0, width, height);
+}
+
+void ViewBatch::bindGeometryLayer(int layer_)
+{
+    assert(layer_ < viewCount);
+    glBindFramebuffer(GL_FRAMEBUFFER, geometryFramebuffers[layer_]);
+    glViewport(0, 0, width, height);
+}
+
+void ViewBatch::bindLightingLayer(int layer_)
+{
+    assert(layer_ < viewCount);
+    glBindFramebuffer(GL_FRAMEBUFFER, lightingFramebuffers[layer_]);
+    glViewport(0, 0, width, height);
+}
+
+void ViewBatch::beginTiming(unsigned int views_, bool oneAtATime_)
+{
+    if (timerIssued)
+    {
+        GLuint available = 0;
+        glGetQueryObjectuiv(timerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            return;
+        }
+
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &nanoseconds);
+        stats.views = timedViews;
+        stats.oneAtATime = timedOneAtATime;
+        stats.gpuMilliseconds = nanoseconds / 1000000.0;
+        stats.viewsPerSecond = nanoseconds > 0 ? timedViews * 1000000000.0 / nanoseconds : 0.0;
+        ++stats.batchesTimed;
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+    timerIssued = true;
+    timing = true;
+    timedViews = views_;
+    timedOneAtATime = oneAtATime_;
+}
+
+void ViewBatch::endTiming()
+{
+    if (timing)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        timing = false;
+    }
+}
+
+int ViewBatch::getWidth() const
+{
+    return width;
+}
+
+int ViewBatch::getHeight() const
+{
+    return height;
+}
+
+int ViewBatch::getViewCount() const
+{
+    return viewCount;
+}
+
+const GLuint* ViewBatch::getGBufferTextures() const
+{
+    return gbufferTextures;
+}
+
+GLuint ViewBatch::getColourTexture() const
+{
+    return colourTexture;
+}
+
+const ViewBatch::Stats& ViewBatch::getStats() const
+{
+    return stats;
+}
+
+void ViewBatch::checkFramebuffer(const char* message_)
+{
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        tglDebugMessage(GL_DEBUG_SEVERITY_HIGH, message_);
+    }
+}
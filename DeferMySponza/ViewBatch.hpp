@@ -0,0 +1,102 @@
+#pragma once
+#ifndef VIEW_BATCH_HPP
+#define VIEW_BATCH_HPP
+
+#include <tgl/tgl.h>
+#include <glm/glm.hpp>
+
+/*
+layered targets for drawing several views of the scene at once, for offline work like probe captures and camera
+sweeps where a whole window frame per view is mostly overhead.
+
+the gbuffer is a texture array with a layer per view. it is drawn in one pass, a geometry shader runs once per view
+for every triangle and sends it to that view's layer with that view's matrix from BufferRender, dropping it if it is
+outside the view. the lighting then goes a layer at a time into the colour array, which ends up with every view lit.
+
+the views sit kViewStride apart in BufferRender, the largest offset alignment gl allows, so the lighting can bind one
+view's range on its own and the shaders that only know about one camera see that view's.
+
+for comparison the same views can be drawn one at a time, into a layer each through their own framebuffers, which
+is what rendering them in a loop would do without the rest of the frame around it.
+*/
+class ViewBatch
+{
+public:
+
+    static const int kMaxViews = 8; // the invocations in firstpass_layered_gs.glsl
+    static const unsigned int kViewStride = 256;
+
+    struct View
+    {
+        glm::vec3 position;
+        glm::vec3 direction;
+        float fieldOfView; // degrees
+    };
+
+    struct Stats
+    {
+        unsigned int views; // in the last batch the timer came back for
+        bool oneAtATime;
+        double gpuMilliseconds;
+        double viewsPerSecond;
+        unsigned int batchesTimed; // goes up each time a new time comes back
+    };
+
+    ViewBatch();
+    ~ViewBatch();
+
+    // makes the targets unless they already exist at this size and count
+    void createTargets(int width_, int height_, int viewCount_);
+    void deleteTargets();
+
+    // every layer of the gbuffer at once
+    void bindLayered();
+
+    // a single layer of the gbuffer, drawing one view at a time
+    void bindGeometryLayer(int layer_);
+
+    // a single layer of the colour array with its depth and stencil, for lighting
+    void bindLightingLayer(int layer_);
+
+    // the time of the last batch is picked up if it has come back, a batch isnt timed if the one before is still out
+    void beginTiming(unsigned int views_, bool oneAtATime_);
+    void endTiming();
+
+    int getWidth() const;
+    int getHeight() const;
+    int getViewCount() const;
+
+    // GL_TEXTURE_2D_ARRAY, position, normal and material like the gbuffer
+    const GLuint* getGBufferTextures() const;
+
+    // GL_TEXTURE_2D_ARRAY, the lit views
+    GLuint getColourTexture() const;
+
+    const Stats& getStats() const;
+
+protected:
+
+    GLuint gbufferTextures[3];
+    GLuint depthStencilTexture;
+    GLuint colourTexture;
+    GLuint layeredFramebuffer;
+    GLuint geometryFramebuffers[kMaxViews];
+    GLuint lightingFramebuffers[kMaxViews];
+    int width, height, viewCount; // 0 when the targets dont exist
+
+    GLuint timerQuery;
+    bool timerIssued;
+    bool timing;
+    unsigned int timedViews;
+    bool timedOneAtATime;
+    Stats stats;
+
+    static void checkFramebuffer(const char* message_);
+
+private:
+
+    ViewBatch(const ViewBatch&);
+    ViewBatch& operator=(const ViewBatch&);
+};
+
+#endif //VIEW_BATCH_HPP
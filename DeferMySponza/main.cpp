@@ -1,6 +1,7 @@
 #include <crtdbg.h>
 #include <cstdlib>
 #include <iostream>
+#include <cstring>
 
 #include <tygra/Window.hpp>
 #include "MyController.hpp"
@@ -10,31 +11,53 @@ int main(int argc, char *argv[])
     // enable debug memory checks
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 
+    // a --stress run closes itself when the sweep is done and reports through the exit code, so it can be scripted
+    bool stress_run = false;
+    int exit_code = 0;
+
     try {
 
         auto controller = std::make_shared<MyController>();
         auto window = tygra::Window::mainWindow();
         window->setController(controller);
 
+        for (int i = 1; i < argc; ++i) {
+            if (std::strcmp(argv[i], "--stress") == 0) {
+                controller->startStressBenchmark();
+                stress_run = true;
+            }
+        }
+
         const int window_width = 1280;
         const int window_height = 720;
+        // the window is only ever blitted to, msaa (F11) happens in the view's own targets
         const int number_of_samples = 1;
 
         if (window->open(window_width, window_height, number_of_samples, true))
         {
             while (window->isVisible()) {
                 window->update();
+                if (stress_run && controller->stressBenchmarkFinished()) {
+                    break;
+                }
             }
             window->close();
         }
 
+        if (stress_run && controller->stressBenchmarkFailed()) {
+            exit_code = 1;
+        }
+
     }
     catch (std::exception e) {
         std::cerr << "Opps ... something went wrong:" << std::endl;
         std::cerr << e.what() << std::endl;
+        exit_code = 1;
     }
 
     // pause to display any console debug messages
-    system("PAUSE");
-    return 0;
+    if (!stress_run) {
+        system("PAUSE");
+    }
+    return exit_code;
 }
@@ -0,0 +1,119 @@
+#include "Benchmark.hpp"
+#include "CpuTimer.hpp"
+#include "AllocationTracker.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+Benchmark::Benchmark() : minimumTime(0.2), failed(false)
+{
+
+}
+
+Benchmark::~Benchmark()
+{
+
+}
+
+void Benchmark::setMinimumTime(double seconds_)
+{
+    minimumTime = seconds_;
+}
+
+void Benchmark::run(const std::string& name_,
+    const std::string& parameters_,
+    double items_,
+    const std::function<void()>& operation_,
+    bool steadyState_)
+{
+    // first call grows any scratch storage, that isnt what we want to measure
+    operation_();
+
+    unsigned long long iterations = 1;
+    double elapsed = 0;
+    AllocationTracker::Counts before, after;
+    for (;;)
+    {
+        before = AllocationTracker::getTotalCounts();
+        const double begin = CpuTimeSeconds();
+        for (unsigned long long i = 0; i < iterations; ++i)
+        {
+            operation_();
+        }
+        elapsed = CpuTimeSeconds() - begin;
+        after = AllocationTracker::getTotalCounts();
+
+        if (elapsed >= minimumTime || iterations >= (1ull << 40))
+        {
+            break;
+        }
+
+        // aim a little past the minimum so the next batch is very likely the last one
+        const double scale = elapsed > 0 ? (minimumTime * 1.2) / elapsed : 10.0;
+        iterations = static_cast<unsigned long long>(iterations * (scale < 10.0 ? (scale > 1.5 ? scale : 1.5) : 10.0)) + 1;
+    }
+
+    Result result;
+    result.name = name_;
+    result.parameters = parameters_;
+    result.iterations = iterations;
+    result.nsPerOp = elapsed * 1e9 / iterations;
+    result.allocationsPerOp = static_cast<double>(after.allocations - before.allocations) / iterations;
+    result.bytesPerOp = static_cast<double>(after.bytes - before.bytes) / iterations;
+    result.itemsPerSecond = elapsed > 0 ? items_ * iterations / elapsed : 0;
+    result.steadyState = steadyState_;
+    results.push_back(result);
+
+    printf("%-28s %-22s %14.1f ns/op %10.2f allocs/op %12.1f B/op %14.0f items/s\n",
+        name_.c_str(),
+        parameters_.c_str(),
+        result.nsPerOp,
+        result.allocationsPerOp,
+        result.bytesPerOp,
+        result.itemsPerSecond);
+
+    if (steadyState_ && after.allocations != before.allocations)
+    {
+        std::cerr << "  FAILED: " << name_ << " " << parameters_ << " allocated in steady state" << std::endl;
+        failed = true;
+    }
+}
+
+bool Benchmark::hasFailed() const
+{
+    return failed;
+}
+
+const std::vector<Benchmark::Result>& Benchmark::getResults() const
+{
+    return results;
+}
+
+bool Benchmark::writeJson(const std::string& path_) const
+{
+    std::ofstream file(path_.c_str());
+    if (!file)
+    {
+        std::cerr << "couldnt open " << path_ << std::endl;
+        return false;
+    }
+
+    file.precision(10);
+    file << "[\n";
+    for (unsigned int i = 0; i < results.size(); ++i)
+    {
+        const Result& result = results[i];
+        file << "  {\"name\": \"" << result.name << "\""
+            << ", \"parameters\": \"" << result.parameters << "\""
+            << ", \"iterations\": " << result.iterations
+            << ", \"ns_per_op\": " << result.nsPerOp
+            << ", \"allocations_per_op\": " << result.allocationsPerOp
+            << ", \"bytes_per_op\": " << result.bytesPerOp
+            << ", \"items_per_second\": " << result.itemsPerSecond
+            << ", \"steady_state\": " << (result.steadyState ? "true" : "false")
+            << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "]\n";
+    return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+tiny timing harness for the cpu benchmarks.
+
+each benchmark is run once to warm up, then in growing batches until a batch takes long enough to trust the clock,
+and that batch is what gets reported. heap allocations are counted with AllocationTracker over the same batch.
+benchmarks of per frame work are run as steady state, any allocation in them is a failure.
+*/
+class Benchmark
+{
+public:
+
+    struct Result
+    {
+        std::string name;
+        std::string parameters; // "lights=1000" and so on, what the curve is plotted against
+        unsigned long long iterations;
+        double nsPerOp;
+        double allocationsPerOp;
+        double bytesPerOp;
+        double itemsPerSecond; // items_ per op, so the throughput is comparable across parameters
+        bool steadyState;
+    };
+
+    Benchmark();
+    ~Benchmark();
+
+    // how long a batch has to run before it counts
+    void setMinimumTime(double seconds_);
+
+    void run(const std::string& name_,
+        const std::string& parameters_,
+        double items_,
+        const std::function<void()>& operation_,
+        bool steadyState_ = false);
+
+    // a steady state benchmark allocated
+    bool hasFailed() const;
+
+    const std::vector<Result>& getResults() const;
+
+    // one json object per result in an array, meant to be diffed and plotted between commits
+    bool writeJson(const std::string& path_) const;
+
+protected:
+
+    std::vector<Result> results;
+    double minimumTime;
+    bool failed;
+};
+
+#endif //BENCHMARK_HPP
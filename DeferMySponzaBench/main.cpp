@@ -0,0 +1,499 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Benchmark.hpp"
+#include "AllocationTracker.hpp"
+#include "FrameArena.hpp"
+#include "FramePacking.hpp"
+#include "InstanceBvh.hpp"
+#include "JobSystem.hpp"
+#include "LightCulling.hpp"
+#include "MeshDedup.hpp"
+#include "Meshlets.hpp"
+#include "SceneAssembly.hpp"
+#include "StressScene.hpp"
+#include "UploadSink.hpp"
+
+/*
+cpu benchmarks for the renderer, run without a window or a gl context.
+
+everything MyView would upload goes to StubUploadSink instead, which copies the bytes somewhere so the cost of
+touching the data is still there. results are printed and written to bench_results.json (or the path after --out).
+the exit code is 1 if any of the per frame paths allocated.
+*/
+
+// stands in for the driver, copies into a scratch buffer that only grows
+class StubUploadSink : public UploadSink
+{
+public:
+
+    StubUploadSink() : bytesUploaded(0) {}
+
+    void replaceBuffer(GLenum target_, GLuint buffer_, const void* data_, size_t bytes_, GLenum usage_) override
+    {
+        copy(data_, bytes_);
+    }
+
+    void writeBuffer(GLenum target_, GLuint buffer_, const void* data_, size_t bytes_) override
+    {
+        copy(data_, bytes_);
+    }
+
+    unsigned long long bytesUploaded;
+
+private:
+
+    std::vector<char> store;
+
+    void copy(const void* data_, size_t bytes_)
+    {
+        if (store.size() < bytes_)
+        {
+            store.resize(bytes_);
+        }
+        if (bytes_ > 0)
+        {
+            memcpy(store.data(), data_, bytes_);
+        }
+        bytesUploaded += bytes_;
+    }
+};
+
+// same getters as SceneModel::Mesh, a flat grid of quads
+struct BenchMesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<unsigned int> elements;
+
+    std::vector<glm::vec3> getPositionArray() const { return positions; }
+    std::vector<glm::vec3> getNormalArray() const { return normals; }
+    std::vector<unsigned int> getElementArray() const { return elements; }
+};
+
+// same getters as SceneModel::Material
+struct BenchMaterial
+{
+    unsigned int id;
+    glm::vec3 colour;
+    float shininess;
+
+    unsigned int getId() const { return id; }
+    glm::vec3 getColour() const { return colour; }
+    float getShininess() const { return shininess; }
+};
+
+static std::string Parameters(const char* name_, unsigned int value_)
+{
+    std::ostringstream stream;
+    stream << name_ << "=" << value_;
+    return stream.str();
+}
+
+static BenchMesh MakeGridMesh(unsigned int side_)
+{
+    BenchMesh mesh;
+    for (unsigned int z = 0; z <= side_; ++z)
+    {
+        for (unsigned int x = 0; x <= side_; ++x)
+        {
+            mesh.positions.push_back(glm::vec3(static_cast<float>(x), 0.f, static_cast<float>(z)));
+            mesh.normals.push_back(glm::vec3(0.f, 1.f, 0.f));
+        }
+    }
+    for (unsigned int z = 0; z < side_; ++z)
+    {
+        for (unsigned int x = 0; x < side_; ++x)
+        {
+            unsigned int corner = z * (side_ + 1) + x;
+            unsigned int quad[6] = { corner, corner + 1, corner + side_ + 1, corner + 1, corner + side_ + 2, corner + side_ + 1 };
+            mesh.elements.insert(mesh.elements.end(), quad, quad + 6);
+        }
+    }
+    return mesh;
+}
+
+static void BenchGeometryAssembly(Benchmark& bench_)
+{
+    const unsigned int meshCounts[] = { 10, 100, 1000 };
+    for (unsigned int m = 0; m < sizeof(meshCounts) / sizeof(meshCounts[0]); ++m)
+    {
+        // 16x16 quads a mesh, 289 vertices and 512 triangles
+        std::vector<BenchMesh> meshes(meshCounts[m], MakeGridMesh(16));
+        const double vertexCount = static_cast<double>(meshes[0].positions.size()) * meshes.size();
+
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> elements;
+        std::vector<Mesh> loadedMeshes;
+        bench_.run("geometry_assembly", Parameters("meshes", meshCounts[m]), vertexCount, [&]()
+        {
+            vertices.clear();
+            elements.clear();
+            loadedMeshes.clear();
+            AssembleGeometry(meshes, vertices, elements, loadedMeshes);
+        });
+    }
+}
+
+static void BenchMeshlets(Benchmark& bench_)
+{
+    const unsigned int sides[] = { 16, 64, 256 };
+    for (unsigned int s = 0; s < sizeof(sides) / sizeof(sides[0]); ++s)
+    {
+        const BenchMesh grid = MakeGridMesh(sides[s]);
+        std::vector<Vertex> vertices;
+        for (unsigned int v = 0; v < grid.positions.size(); ++v)
+        {
+            vertices.push_back(Vertex(grid.positions[v], grid.normals[v]));
+        }
+
+        std::vector<unsigned int> elements;
+        std::vector<Meshlet> meshlets;
+        const unsigned int triangles = grid.elements.size() / 3;
+        bench_.run("build_meshlets", Parameters("triangles", triangles), static_cast<double>(triangles), [&]()
+        {
+            elements = grid.elements;
+            meshlets.clear();
+            BuildMeshlets(vertices, elements, meshlets);
+        });
+    }
+}
+
+static void BenchGeometryDedup(Benchmark& bench_)
+{
+    const unsigned int sides[] = { 16, 64, 256 };
+    for (unsigned int s = 0; s < sizeof(sides) / sizeof(sides[0]); ++s)
+    {
+        // a triangle soup, every corner its own vertex, which welds back down to the grid
+        const BenchMesh grid = MakeGridMesh(sides[s]);
+        std::vector<Vertex> soup;
+        std::vector<unsigned int> soupElements;
+        for (unsigned int e = 0; e < grid.elements.size(); ++e)
+        {
+            soup.push_back(Vertex(grid.positions[grid.elements[e]], grid.normals[grid.elements[e]]));
+            soupElements.push_back(e);
+        }
+
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> elements;
+        bench_.run("weld_vertices", Parameters("vertices", soup.size()), static_cast<double>(soup.size()), [&]()
+        {
+            vertices = soup;
+            elements = soupElements;
+            WeldVertices(vertices, elements);
+        });
+
+        // the same grid turned, scaled and moved, the worst case as every vertex is transformed and compared
+        const float c = std::cos(0.7f) * 2.f;
+        const float n = std::sin(0.7f) * 2.f;
+        const glm::mat4 transform(glm::vec4(c, 0.f, -n, 0.f),
+            glm::vec4(0.f, 2.f, 0.f, 0.f),
+            glm::vec4(n, 0.f, c, 0.f),
+            glm::vec4(3.f, 1.f, -2.f, 1.f));
+        std::vector<Vertex> moved = vertices;
+        for (unsigned int v = 0; v < moved.size(); ++v)
+        {
+            moved[v].position = glm::vec3(transform * glm::vec4(vertices[v].position, 1.f));
+            moved[v].normal = glm::mat3(transform) * vertices[v].normal / 2.f;
+        }
+        glm::mat4 found;
+        bench_.run("match_mesh_geometry", Parameters("vertices", vertices.size()), static_cast<double>(vertices.size()), [&]()
+        {
+            MatchMeshGeometry(vertices, moved, found);
+        });
+    }
+}
+
+static void BenchMaterialTable(Benchmark& bench_)
+{
+    const unsigned int materialCounts[] = { 10, 100, 1000 };
+    for (unsigned int m = 0; m < sizeof(materialCounts) / sizeof(materialCounts[0]); ++m)
+    {
+        std::vector<BenchMaterial> materials(materialCounts[m]);
+        for (unsigned int i = 0; i < materials.size(); ++i)
+        {
+            materials[i].id = 1000 + i * 7;
+            materials[i].colour = glm::vec3(0.5f, 0.5f, 0.5f);
+            materials[i].shininess = 16.f;
+        }
+
+        std::vector<MaterialData> table;
+        bench_.run("material_table", Parameters("materials", materialCounts[m]), static_cast<double>(materials.size()), [&]()
+        {
+            // a fresh map each time, like windowViewWillStart
+            std::map<unsigned int, unsigned int> indexById;
+            table.clear();
+            BuildMaterialTable(materials, indexById, table);
+        });
+    }
+}
+
+static void BenchRenderBuffer(Benchmark& bench_, StubUploadSink& sink_)
+{
+    FrameArena arena;
+    arena.reserve(4096);
+    const glm::mat4 projectView = glm::perspective(75.f, 16.f / 9.f, 1.f, 1000.f);
+    const glm::vec3 camPos(10.f, 20.f, 30.f);
+    bench_.run("set_buffer", "", 1.0, [&]()
+    {
+        arena.reset();
+        PackRenderBuffer(projectView, camPos, 1, arena, sink_);
+    }, true);
+}
+
+static void BenchLights(Benchmark& bench_, StubUploadSink& sink_)
+{
+    const unsigned int lightCounts[] = { 100, 1000, 10000, 100000 };
+    const glm::vec3 sceneMin(-1500.f, 0.f, -700.f);
+    const glm::vec3 sceneMax(1500.f, 1200.f, 700.f);
+    const glm::mat4 projection = glm::perspective(75.f, 16.f / 9.f, 1.f, 1000.f);
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.f, 200.f, 0.f), glm::vec3(1.f, 200.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+    const glm::mat4 projectView = projection * view;
+    const glm::vec3 camPos(0.f, 200.f, 0.f);
+
+    for (unsigned int l = 0; l < sizeof(lightCounts) / sizeof(lightCounts[0]); ++l)
+    {
+        StressScene stress;
+        StressScene::Config config;
+        config.lightCount = lightCounts[l];
+        config.replaceSceneLights = true;
+        stress.setConfig(config);
+        stress.generateLights(sceneMin, sceneMax);
+
+        const std::vector<LightData> noSceneLights;
+        std::vector<LightData> allLights;
+        LightCulling culling;
+        FrameArena arena;
+        arena.reserve(1024 * 1024);
+        const double count = static_cast<double>(lightCounts[l]);
+        const std::string parameters = Parameters("lights", lightCounts[l]);
+
+        bench_.run("gather_lights", parameters, count, [&]()
+        {
+            GatherLights(noSceneLights, stress.getLights(), true, allLights);
+        }, true);
+
+        bench_.run("cull_lights", parameters, count, [&]()
+        {
+            culling.cullLights(allLights, projectView, projection, camPos, 720.f);
+        }, true);
+
+        // the whole of UpdateLights apart from the point shadows
+        bench_.run("update_lights", parameters, count, [&]()
+        {
+            arena.reset();
+            GatherLights(noSceneLights, stress.getLights(), true, allLights);
+            culling.cullLights(allLights, projectView, projection, camPos, 720.f);
+            const std::vector<unsigned int>& visible = culling.getVisibleLights();
+            LightData* lights = GatherVisibleLights(allLights, visible, arena);
+            sink_.replaceBuffer(GL_ARRAY_BUFFER, 1, lights, visible.size() * sizeof(LightData), GL_STATIC_DRAW);
+        }, true);
+    }
+}
+
+static void BenchInstances(Benchmark& bench_)
+{
+    const unsigned int instanceCounts[] = { 1000, 10000, 100000, 1000000 };
+
+    // roughly sponza shaped, a few hundred instances over a couple of dozen meshes
+    std::vector< std::vector< InstanceData > > source(25);
+    for (unsigned int i = 0; i < source.size(); ++i)
+    {
+        for (unsigned int j = 0; j < 16; ++j)
+        {
+            InstanceData instance;
+            instance.positionData = glm::mat4x3(1.f);
+            instance.positionData[3] = glm::vec3(static_cast<float>(j * 100), 0.f, static_cast<float>(i * 50));
+            instance.materialDataIndex = i;
+            source[i].push_back(instance);
+        }
+    }
+
+    for (unsigned int n = 0; n < sizeof(instanceCounts) / sizeof(instanceCounts[0]); ++n)
+    {
+        StressScene stress;
+        StressScene::Config config;
+        config.instanceCount = instanceCounts[n];
+        stress.setConfig(config);
+
+        std::vector< std::vector< InstanceData > > out;
+        bench_.run("replicate_instances", Parameters("instances", instanceCounts[n]), static_cast<double>(instanceCounts[n]), [&]()
+        {
+            stress.replicateInstances(source, glm::vec3(0.f), glm::vec3(1500.f, 100.f, 1200.f), out);
+        });
+    }
+}
+
+static void BenchInstanceBvh(Benchmark& bench_)
+{
+    const unsigned int instanceCounts[] = { 1000, 10000, 100000 };
+    const glm::mat4 projection = glm::perspective(75.f, 16.f / 9.f, 1.f, 1000.f);
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.f, 200.f, 0.f), glm::vec3(1.f, 200.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+    glm::vec4 planes[6];
+    InstanceBvh::extractFrustumPlanes(projection * view, planes);
+
+    for (unsigned int n = 0; n < sizeof(instanceCounts) / sizeof(instanceCounts[0]); ++n)
+    {
+        // boxes of a few sizes scattered over something the size of the stress scene
+        std::vector<InstanceBounds> bounds(instanceCounts[n]);
+        srand(1);
+        for (unsigned int i = 0; i < bounds.size(); ++i)
+        {
+            const glm::vec3 centre(rand() % 3000 - 1500.f, rand() % 1200 * 1.f, rand() % 1400 - 700.f);
+            const glm::vec3 extent(1.f + rand() % 40);
+            bounds[i].min = centre - extent;
+            bounds[i].max = centre + extent;
+            bounds[i].centre = centre;
+            bounds[i].radius = glm::length(extent);
+            bounds[i].isStatic = true;
+        }
+
+        const double count = static_cast<double>(instanceCounts[n]);
+        const std::string parameters = Parameters("instances", instanceCounts[n]);
+        InstanceBvh bvh;
+
+        bench_.run("bvh_build", parameters, count, [&]()
+        {
+            bvh.build(bounds);
+        });
+        bench_.run("bvh_build_single_thread", parameters, count, [&]()
+        {
+            bvh.build(bounds, 1);
+        });
+
+        // a sixteenth of the instances nudged back and forth
+        std::vector<unsigned int> changed;
+        for (unsigned int i = 0; i < bounds.size(); i += 16)
+        {
+            changed.push_back(i);
+        }
+        float nudge = 1.f;
+        bench_.run("bvh_refit", parameters, static_cast<double>(changed.size()), [&]()
+        {
+            nudge = -nudge;
+            for (unsigned int c = 0; c < changed.size(); ++c)
+            {
+                bounds[changed[c]].min.x += nudge;
+                bounds[changed[c]].max.x += nudge;
+            }
+            bvh.refit(bounds, changed);
+        }, true);
+
+        std::vector<unsigned int> visible;
+        visible.reserve(bounds.size());
+        bench_.run("bvh_frustum_query", parameters, count, [&]()
+        {
+            visible.clear();
+            bvh.queryFrustum(planes, 6, visible);
+        }, true);
+
+        bench_.run("bvh_sphere_query", parameters, count, [&]()
+        {
+            visible.clear();
+            bvh.querySphere(glm::vec3(0.f, 200.f, 0.f), 300.f, visible);
+        }, true);
+    }
+}
+
+// the same work on 1 thread up to every core, the curve is how well the job system scales
+static void BenchJobs(Benchmark& bench_)
+{
+    const glm::vec3 sceneMin(-1500.f, 0.f, -700.f);
+    const glm::vec3 sceneMax(1500.f, 1200.f, 700.f);
+    const glm::mat4 projection = glm::perspective(75.f, 16.f / 9.f, 1.f, 1000.f);
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.f, 200.f, 0.f), glm::vec3(1.f, 200.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+    const glm::mat4 projectView = projection * view;
+    const glm::vec3 camPos(0.f, 200.f, 0.f);
+
+    StressScene stress;
+    StressScene::Config config;
+    config.lightCount = 100000;
+    config.replaceSceneLights = true;
+    stress.setConfig(config);
+    stress.generateLights(sceneMin, sceneMax);
+    std::vector<LightData> allLights;
+    GatherLights(std::vector<LightData>(), stress.getLights(), true, allLights);
+    LightCulling culling;
+
+    // enough arithmetic per item that the cost is the work and not the memory
+    const unsigned int itemCount = 1 << 16;
+    std::vector<float> items(itemCount);
+    const auto work = [&](unsigned int begin_, unsigned int end_)
+    {
+        for (unsigned int i = begin_; i < end_; ++i)
+        {
+            float x = static_cast<float>(i);
+            for (int k = 0; k < 64; ++k)
+            {
+                x = std::sqrt(x * 1.0001f + 1.f);
+            }
+            items[i] = x;
+        }
+    };
+
+    const unsigned int hardware = std::max(std::thread::hardware_concurrency(), 1u);
+    const unsigned int maxThreads = std::min(hardware, static_cast<unsigned int>(JobSystem::kMaxThreads + 1));
+    for (unsigned int threads = 1; threads <= maxThreads; ++threads)
+    {
+        JobSystem jobs;
+        jobs.start(threads - 1);
+        const std::string parameters = Parameters("threads", threads);
+
+        bench_.run("jobs_parallel_for", parameters, static_cast<double>(itemCount), [&]()
+        {
+            jobs.parallelFor(0, itemCount, 256, work);
+        }, true);
+
+        bench_.run("cull_lights_jobs", parameters, static_cast<double>(allLights.size()), [&]()
+        {
+            culling.cullLights(allLights, projectView, projection, camPos, 720.f, &jobs);
+        }, true);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string outputPath = "bench_results.json";
+    Benchmark bench;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            outputPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--quick") == 0)
+        {
+            bench.setMinimumTime(0.02);
+        }
+    }
+
+    AllocationTracker::trackCurrentThread();
+
+    StubUploadSink sink;
+    BenchGeometryAssembly(bench);
+    BenchMeshlets(bench);
+    BenchGeometryDedup(bench);
+    BenchMaterialTable(bench);
+    BenchRenderBuffer(bench, sink);
+    BenchLights(bench, sink);
+    BenchInstances(bench);
+    BenchInstanceBvh(bench);
+    BenchJobs(bench);
+
+    if (!bench.writeJson(outputPath))
+    {
+        return 1;
+    }
+    std::cout << "wrote " << bench.getResults().size() << " results to " << outputPath << std::endl;
+    return bench.hasFailed() ? 1 : 0;
+}
@@ -0,0 +1,41 @@
+#version 430
+
+layout(std140, binding = 0) buffer BufferRender
+{
+    mat4 projectionViewMat;
+    vec3 camPosition;
+};
+
+// anything that gets past the discard is an edge, the stencil marks it to be lit again per sample
+uniform sampler2DMS sampler_world_position;
+uniform sampler2DMS sampler_world_normal;
+uniform sampler2DMS sampler_world_mat;
+uniform int sample_count;
+
+void main(void)
+{
+    ivec2 pixelCoord = ivec2(gl_FragCoord.xy);
+    vec3 position = texelFetch(sampler_world_position, pixelCoord, 0).xyz;
+    vec3 normal = texelFetch(sampler_world_normal, pixelCoord, 0).xyz;
+    vec4 mat = texelFetch(sampler_world_mat, pixelCoord, 0);
+
+    // samples on the same surface only slide along it, so measure how far off its plane the others are
+    float tolerance = 0.002 * distance(position, camPosition) + 0.01;
+
+    bool edge = false;
+    for (int i = 1; i < sample_count && !edge; ++i)
+    {
+        vec3 samplePosition = texelFetch(sampler_world_position, pixelCoord, i).xyz;
+        vec3 sampleNormal = texelFetch(sampler_world_normal, pixelCoord, i).xyz;
+        vec4 sampleMat = texelFetch(sampler_world_mat, pixelCoord, i);
+
+        edge = abs(dot(samplePosition - position, normal)) > tolerance
+            || dot(sampleNormal, normal) < 0.95
+            || any(notEqual(sampleMat, mat));
+    }
+
+    if (!edge)
+    {
+        discard;
+    }
+}
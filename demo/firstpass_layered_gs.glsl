@@ -0,0 +1,76 @@
+#version 430
+
+// ViewBatch::kViewStride apart, the start of each one looks like the BufferRender the other shaders use
+struct View
+{
+    mat4 projectionViewMat;
+    vec4 camPosition;
+    vec4 padding[11];
+};
+
+layout(std140, binding = 0) buffer BufferRender
+{
+    View views[];
+};
+
+// ViewBatch::kMaxViews, the invocations past view_count do nothing
+layout(triangles, invocations = 8) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+uniform int first_view;
+uniform int view_count;
+
+in vec3 world_pos[];
+in vec3 world_normal[];
+flat in int world_matIndex[];
+
+// what firstpass_fs.glsl reads
+out vec3 vs_pos;
+out vec3 vs_normal;
+
+flat out int vs_matIndex;
+
+// all three corners past the same clip plane
+bool Outside(vec4 a_, vec4 b_, vec4 c_)
+{
+    return (a_.x < -a_.w && b_.x < -b_.w && c_.x < -c_.w)
+        || (a_.x > a_.w && b_.x > b_.w && c_.x > c_.w)
+        || (a_.y < -a_.w && b_.y < -b_.w && c_.y < -c_.w)
+        || (a_.y > a_.w && b_.y > b_.w && c_.y > c_.w)
+        || (a_.z < -a_.w && b_.z < -b_.w && c_.z < -c_.w)
+        || (a_.z > a_.w && b_.z > b_.w && c_.z > c_.w);
+}
+
+void main(void)
+{
+    if (gl_InvocationID >= view_count)
+    {
+        return;
+    }
+
+    int view = first_view + gl_InvocationID;
+    mat4 projectionView = views[view].projectionViewMat;
+
+    vec4 clip[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        clip[i] = projectionView * vec4(world_pos[i], 1.0);
+    }
+
+    // most of the triangles miss most of the views, there is no point sending them on to be clipped
+    if (Outside(clip[0], clip[1], clip[2]))
+    {
+        return;
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        gl_Position = clip[i];
+        gl_Layer = view; // ignored when only one layer is attached
+        vs_pos = world_pos[i];
+        vs_normal = world_normal[i];
+        vs_matIndex = world_matIndex[i];
+        EmitVertex();
+    }
+    EndPrimitive();
+}
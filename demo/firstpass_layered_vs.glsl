@@ -0,0 +1,19 @@
+#version 430
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in mat4x3 instanceMat;
+layout (location = 6) in int matIndex;
+
+// world space only, firstpass_layered_gs.glsl projects it once for each view
+out vec3 world_pos;
+out vec3 world_normal;
+
+flat out int world_matIndex;
+
+void main(void)
+{
+	world_matIndex = matIndex;
+	world_pos = instanceMat * vec4(position, 1);
+	world_normal = normalize(mat3(instanceMat) * normal);
+}
@@ -0,0 +1,146 @@
+#version 430
+
+// the lighting passes read the gbuffer through this, linked in alongside them. MSAA reads the multisampled gbuffer a
+// sample at a time, and reading gl_SampleID makes every pass linked with it run per sample. GBUFFER_COMPACT is the
+// half resolution lights' downsampled gbuffer, the material colour is left out so only the light comes back and the
+// upsample multiplies it by the full resolution colour. VISIBILITY_BUFFER has no gbuffer at all, the surface is built
+// again from the instance and triangle ids every time a pixel is fetched
+#if defined(MSAA)
+uniform sampler2DMS sampler_world_position;
+uniform sampler2DMS sampler_world_normal;
+uniform sampler2DMS sampler_world_mat;
+#elif defined(GBUFFER_COMPACT)
+uniform sampler2DRect sampler_world_position;
+uniform sampler2DRect sampler_world_normal; // the shininess is in the alpha
+#elif defined(VISIBILITY_BUFFER)
+struct Material
+{
+    vec3 colour;
+    float shininess;
+};
+
+layout(std140, binding = 1) buffer BufferMaterials
+{
+    Material materials[];
+};
+
+struct VisibilityInstance
+{
+    mat4 transform;
+    ivec4 info; // x is the material, y is the mesh
+};
+
+layout(std430, binding = 2) buffer BufferVisibilityInstances
+{
+    VisibilityInstance instances[];
+};
+
+// x is the first element of the mesh, y is its base vertex
+layout(std430, binding = 3) buffer BufferVisibilityMeshes
+{
+    ivec4 meshes[];
+};
+
+// the same buffers the geometry is drawn from, a vertex is a position then a normal
+layout(std430, binding = 4) buffer BufferVertices
+{
+    float vertexData[];
+};
+
+layout(std430, binding = 5) buffer BufferElements
+{
+    uint elements[];
+};
+
+uniform usampler2DRect sampler_visibility;
+uniform uint triangle_bits;
+uniform mat4 inverse_projection_view;
+uniform vec2 viewport_size;
+#else
+uniform sampler2DRect sampler_world_position;
+uniform sampler2DRect sampler_world_normal;
+uniform sampler2DRect sampler_world_mat;
+#endif
+
+#if defined(VISIBILITY_BUFFER)
+vec3 FetchPosition(uint vertex_)
+{
+    uint offset = vertex_ * 6;
+    return vec3(vertexData[offset], vertexData[offset + 1], vertexData[offset + 2]);
+}
+
+vec3 FetchNormal(uint vertex_)
+{
+    uint offset = vertex_ * 6 + 3;
+    return vec3(vertexData[offset], vertexData[offset + 1], vertexData[offset + 2]);
+}
+#endif
+
+#if !defined(MSAA)
+// the single sample gbuffers can be read at any pixel, not only the one being shaded
+void FetchGBufferTexel(ivec2 pixelCoord_, out vec3 position_, out vec3 normal_, out vec4 material_)
+{
+#if defined(GBUFFER_COMPACT)
+    vec4 normalShininess = texelFetch(sampler_world_normal, pixelCoord_);
+    position_ = texelFetch(sampler_world_position, pixelCoord_).xyz;
+    normal_ = normalShininess.xyz;
+    material_ = vec4(1.0, 1.0, 1.0, normalShininess.w);
+#elif defined(VISIBILITY_BUFFER)
+    uint visibility = texelFetch(sampler_visibility, pixelCoord_).r;
+    uint instanceIndex = visibility >> triangle_bits;
+    uint triangle = visibility & ((1u << triangle_bits) - 1u);
+
+    VisibilityInstance instance = instances[instanceIndex];
+    ivec4 mesh = meshes[instance.info.y];
+
+    uint firstElement = uint(mesh.x) + triangle * 3;
+    uint v0 = elements[firstElement] + uint(mesh.y);
+    uint v1 = elements[firstElement + 1] + uint(mesh.y);
+    uint v2 = elements[firstElement + 2] + uint(mesh.y);
+
+    vec3 p0 = vec3(instance.transform * vec4(FetchPosition(v0), 1));
+    vec3 p1 = vec3(instance.transform * vec4(FetchPosition(v1), 1));
+    vec3 p2 = vec3(instance.transform * vec4(FetchPosition(v2), 1));
+
+    // ray through the pixel centre, from the near plane to the far plane
+    vec2 ndc = ((vec2(pixelCoord_) + 0.5) / viewport_size) * 2.0 - 1.0;
+    vec4 nearPoint = inverse_projection_view * vec4(ndc, -1, 1);
+    vec4 farPoint = inverse_projection_view * vec4(ndc, 1, 1);
+    vec3 origin = nearPoint.xyz / nearPoint.w;
+    vec3 direction = farPoint.xyz / farPoint.w - origin;
+
+    // barycentrics of where the ray meets the triangle's plane, the same weights the rasteriser would have used
+    vec3 edge1 = p1 - p0;
+    vec3 edge2 = p2 - p0;
+    vec3 pvec = cross(direction, edge2);
+    float inverseDet = 1.0 / dot(edge1, pvec);
+    vec3 tvec = origin - p0;
+    vec3 qvec = cross(tvec, edge1);
+    float u = dot(tvec, pvec) * inverseDet;
+    float v = dot(direction, qvec) * inverseDet;
+    float w = 1.0 - u - v;
+
+    vec3 localNormal = w * FetchNormal(v0) + u * FetchNormal(v1) + v * FetchNormal(v2);
+
+    position_ = w * p0 + u * p1 + v * p2;
+    normal_ = normalize(mat3(instance.transform) * localNormal);
+    material_ = vec4(materials[instance.info.x].colour, materials[instance.info.x].shininess);
+#else
+    position_ = texelFetch(sampler_world_position, pixelCoord_).xyz;
+    normal_ = texelFetch(sampler_world_normal, pixelCoord_).xyz;
+    material_ = texelFetch(sampler_world_mat, pixelCoord_);
+#endif
+}
+#endif
+
+void FetchGBuffer(out vec3 position_, out vec3 normal_, out vec4 material_)
+{
+    ivec2 pixelCoord = ivec2(gl_FragCoord.xy);
+#if defined(MSAA)
+    position_ = texelFetch(sampler_world_position, pixelCoord, gl_SampleID).xyz;
+    normal_ = texelFetch(sampler_world_normal, pixelCoord, gl_SampleID).xyz;
+    material_ = texelFetch(sampler_world_mat, pixelCoord, gl_SampleID);
+#else
+    FetchGBufferTexel(pixelCoord, position_, normal_, material_);
+#endif
+}
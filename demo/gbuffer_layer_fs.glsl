@@ -0,0 +1,15 @@
+#version 430
+
+// the view batch's lighting reads one layer of its gbuffer arrays through this
+uniform sampler2DArray sampler_world_position;
+uniform sampler2DArray sampler_world_normal;
+uniform sampler2DArray sampler_world_mat;
+uniform int gbuffer_layer;
+
+void FetchGBuffer(out vec3 position_, out vec3 normal_, out vec4 material_)
+{
+    ivec3 texelCoord = ivec3(ivec2(gl_FragCoord.xy), gbuffer_layer);
+    position_ = texelFetch(sampler_world_position, texelCoord, 0).xyz;
+    normal_ = texelFetch(sampler_world_normal, texelCoord, 0).xyz;
+    material_ = texelFetch(sampler_world_mat, texelCoord, 0);
+}
@@ -1,25 +1,39 @@
 #version 430
 
-uniform sampler2DRect sampler_world_position;
-uniform sampler2DRect sampler_world_normal;
-uniform sampler2DRect sampler_world_mat;
+#define CASCADE_COUNT 4
+
+uniform sampler2DArrayShadow sampler_shadow;
 
 uniform vec3 directional_light;
 uniform vec3 light_intensity;
 
+// shadow cascades, split distances are measured along the camera direction. only looked up when compiled with SHADOWS
+uniform mat4 cascade_matrices[CASCADE_COUNT];
+uniform float cascade_splits[CASCADE_COUNT];
+uniform vec3 camera_position;
+uniform vec3 camera_direction;
+
 out vec3 reflected_light;
 
+// from gbuffer_fs.glsl or gbuffer_layer_fs.glsl, whichever is linked in
+void FetchGBuffer(out vec3 position_, out vec3 normal_, out vec4 material_);
 vec3 AddDirectionalLight(vec3 direction_, vec3 intensity_, vec3 normal_);
+float ShadowFactor(vec3 position_, vec3 normal_);
 
 void main(void)
 {
-    ivec2 pixelCoord = ivec2(gl_FragCoord.xy);
-    vec3 normal = texelFetch(sampler_world_normal, pixelCoord).xyz;
-    vec3 mat = texelFetch(sampler_world_mat, pixelCoord).xyz;
+    vec3 position, normal;
+    vec4 material;
+    FetchGBuffer(position, normal, material);
+    vec3 mat = material.xyz;
 
     vec3 directionalLightColour = vec3(0, 0, 0);
     directionalLightColour = AddDirectionalLight(-directional_light, light_intensity, normal);
 
+#ifdef SHADOWS
+    directionalLightColour *= ShadowFactor(position, normal);
+#endif
+
     reflected_light = directionalLightColour * mat;
 }
 
@@ -28,4 +42,37 @@ vec3 AddDirectionalLight(vec3 direction_, vec3 intensity_, vec3 normal_)
     vec3 L = normalize(direction_);
 
     return vec3(1) * max(dot(L, normal_), 0) * intensity_;
-}
\ No newline at end of file
+}
+
+float ShadowFactor(vec3 position_, vec3 normal_)
+{
+    float viewDepth = dot(position_ - camera_position, camera_direction);
+
+    int cascade = CASCADE_COUNT - 1;
+    for (int i = 0; i < CASCADE_COUNT; ++i)
+    {
+        if (viewDepth < cascade_splits[i])
+        {
+            cascade = i;
+            break;
+        }
+    }
+
+    // push the lookup off the surface a little to stop acne on surfaces facing away from the light
+    vec3 offsetPosition = position_ + normal_ * (0.5 + float(cascade) * 0.5);
+    vec4 lightSpace = cascade_matrices[cascade] * vec4(offsetPosition, 1);
+    vec3 coord = lightSpace.xyz / lightSpace.w * 0.5 + 0.5;
+
+    // 3x3 pcf on top of the hardware compare
+    vec2 texelSize = 1.0 / vec2(textureSize(sampler_shadow, 0).xy);
+    float lit = 0;
+    for (int x = -1; x <= 1; ++x)
+    {
+        for (int y = -1; y <= 1; ++y)
+        {
+            lit += texture(sampler_shadow, vec4(coord.xy + vec2(x, y) * texelSize, float(cascade), coord.z));
+        }
+    }
+
+    return lit / 9.0;
+}
@@ -0,0 +1,43 @@
+#version 430
+
+// from gbuffer_fs.glsl, the full resolution gbuffer or visibility buffer being downsampled
+void FetchGBufferTexel(ivec2 pixelCoord_, out vec3 position_, out vec3 normal_, out vec4 material_);
+
+uniform sampler2DRect sampler_depth;
+
+layout(location = 0) out vec3 half_position;
+layout(location = 1) out vec4 half_normal;
+
+// each half resolution pixel keeps the nearest of the four it covers, so the light proxies depth test against the
+// front most surface and nothing that one of the four should have been lit by gets missed
+void main(void)
+{
+    ivec2 fullCoord = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 fullMax = textureSize(sampler_depth) - 1;
+
+    float nearest = 1.0;
+    ivec2 nearestCoord = fullCoord;
+    for (int i = 0; i < 4; ++i)
+    {
+        ivec2 coord = min(fullCoord + ivec2(i & 1, i >> 1), fullMax);
+        float depth = texelFetch(sampler_depth, coord).r;
+        if (depth < nearest)
+        {
+            nearest = depth;
+            nearestCoord = coord;
+        }
+    }
+
+    // all background, the stencil stays clear and no light is drawn here
+    if (nearest >= 1.0)
+    {
+        discard;
+    }
+
+    vec3 position, normal;
+    vec4 material;
+    FetchGBufferTexel(nearestCoord, position, normal, material);
+    half_position = position;
+    half_normal = vec4(normal, material.a);
+    gl_FragDepth = nearest;
+}
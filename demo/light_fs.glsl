@@ -13,26 +13,40 @@ layout(std140, binding = 0) buffer BufferRender
 };
 
 vec3 calculateColour(vec3 lightPos_, float lightRange_, vec3 fragPos_, vec3 fragNorm_, vec3 V_, float shininess_);
+float shadowFactor(vec3 lightPos_, float lightRange_, vec3 fragPos_, vec4 slot_);
 
-uniform sampler2DRect sampler_world_position;
-uniform sampler2DRect sampler_world_normal;
-uniform sampler2DRect sampler_world_mat;
+// from gbuffer_fs.glsl or gbuffer_layer_fs.glsl, whichever is linked in
+void FetchGBuffer(out vec3 position_, out vec3 normal_, out vec4 material_);
+
+// HAS_SPECULAR is only compiled in for the pixels the gbuffer marked as having a shiny material, SHADOWS when the
+// point shadows are on
+
+// dual paraboloid shadow atlas, the slot is x, y and size in texels with w set when the map is ready
+uniform sampler2DShadow sampler_point_shadow;
+uniform float point_shadow_atlas_size;
 
 in Light vs_light;
+flat in vec4 vs_shadowSlot;
 
 out vec3 reflected_light;
 
 void main(void)
 {
-    ivec2 pixelCoord = ivec2(gl_FragCoord.xy);
-    vec3 position = texelFetch(sampler_world_position, pixelCoord).xyz;
-    vec3 normal = texelFetch(sampler_world_normal, pixelCoord).xyz;
-	vec4 matColour = texelFetch(sampler_world_mat, pixelCoord).rgba; // the alpha value is the shininess of the material
+    vec3 position, normal;
+    vec4 matColour; // the alpha value is the shininess of the material
+    FetchGBuffer(position, normal, matColour);
 
     vec3 V = normalize(camPosition - position);
 
     vec3 col = calculateColour(vs_light.position, vs_light.range, position, normal, V, matColour.a);
 
+#ifdef SHADOWS
+    if (vs_shadowSlot.w > 0)
+    {
+        col *= shadowFactor(vs_light.position, vs_light.range, position + normal * 0.5, vs_shadowSlot);
+    }
+#endif
+
 	reflected_light = col * matColour.rgb;
 }
 
@@ -41,8 +55,6 @@ vec3 calculateColour(vec3 lightPos_, float lightRange_, vec3 fragPos_, vec3 frag
 	
 	vec3 L = normalize(lightPos_ - fragPos_);
 
-	vec3 R = normalize(reflect(-L, fragNorm_));
-
 	float distance = distance(fragPos_, lightPos_);
 
     vec3 attenuatedDistance = vec3(1.0, 1.0, 1.0) * smoothstep(lightRange_, 1, distance);
@@ -52,10 +64,32 @@ vec3 calculateColour(vec3 lightPos_, float lightRange_, vec3 fragPos_, vec3 frag
 	vec3 Id = max(dot(L, fragNorm_), 0) * attenuatedLight;
 
 	vec3 Is = vec3(0, 0, 0);
+#ifdef HAS_SPECULAR
+	// still checked, the view batch and the half resolution lights cant tell the shiny pixels apart
 	if (dot(L, fragNorm_) > 0 && shininess_ > 0)
 	{
+		vec3 R = normalize(reflect(-L, fragNorm_));
 		Is = vec3(1, 1, 1) * pow(max(0, dot(R, V_)), shininess_) * attenuatedLight;
 	}
+#endif
 
 	return Id + Is;
-}
\ No newline at end of file
+}
+
+float shadowFactor(vec3 lightPos_, float lightRange_, vec3 fragPos_, vec4 slot_)
+{
+	vec3 offset = fragPos_ - lightPos_;
+	float hemisphere = offset.z >= 0 ? 1.0 : -1.0;
+	offset.z *= hemisphere;
+
+	float len = length(offset);
+	vec3 dir = offset / len;
+	vec2 uv = dir.xy / (1.0 + dir.z) * 0.5 + 0.5;
+
+	// -z hemisphere sits to the right of the +z one, keep half a texel in from the edge so we dont read the neighbour
+	float size = slot_.z;
+	vec2 texel = clamp(uv * size, vec2(0.5), vec2(size - 0.5));
+	texel += slot_.xy + vec2(hemisphere > 0 ? 0 : size, 0);
+
+	return texture(sampler_point_shadow, vec3(texel / point_shadow_atlas_size, len / lightRange_ - 0.002));
+}
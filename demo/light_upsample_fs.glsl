@@ -0,0 +1,71 @@
+#version 430
+
+layout(std140, binding = 0) buffer BufferRender
+{
+    mat4 projectionViewMat;
+    vec3 camPosition;
+};
+
+// from gbuffer_fs.glsl, the full resolution surface being lit
+void FetchGBuffer(out vec3 position_, out vec3 normal_, out vec4 material_);
+
+uniform sampler2DRect sampler_half_light;
+uniform sampler2DRect sampler_half_position;
+uniform sampler2DRect sampler_half_normal;
+
+// how fast a half resolution texel stops counting as it moves off the pixel's plane or its normal turns away
+const float kPlaneSharpness = 1.0;
+const float kNormalPower = 16.0;
+
+out vec3 reflected_light;
+
+void main(void)
+{
+    vec3 position, normal;
+    vec4 matColour;
+    FetchGBuffer(position, normal, matColour);
+
+    // the same tolerance the msaa edge classify uses for samples on one surface
+    float tolerance = 0.002 * distance(position, camPosition) + 0.01;
+
+    // the four half resolution texels around the pixel, weighted as bilinear would and then by how alike the
+    // surfaces are so light doesnt bleed across edges. the cleared background texels have no normal and count for
+    // nothing
+    vec2 halfCoord = gl_FragCoord.xy * 0.5 - 0.5;
+    ivec2 base = ivec2(floor(halfCoord));
+    vec2 f = halfCoord - vec2(base);
+    ivec2 halfMax = textureSize(sampler_half_light) - 1;
+
+    vec3 light = vec3(0.0);
+    float total = 0.0;
+    vec3 bestLight = vec3(0.0);
+    float best = -1.0;
+    for (int i = 0; i < 4; ++i)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 coord = clamp(base + offset, ivec2(0), halfMax);
+        vec3 halfPosition = texelFetch(sampler_half_position, coord).xyz;
+        vec3 halfNormal = texelFetch(sampler_half_normal, coord).xyz;
+        vec3 halfLight = texelFetch(sampler_half_light, coord).rgb;
+
+        float plane = abs(dot(halfPosition - position, normal)) / tolerance * kPlaneSharpness;
+        float similarity = exp(-plane * plane) * pow(max(dot(halfNormal, normal), 0.0), kNormalPower);
+        float bilinear = mix(1.0 - f.x, f.x, float(offset.x)) * mix(1.0 - f.y, f.y, float(offset.y));
+
+        float weight = (bilinear + 0.001) * similarity;
+        light += halfLight * weight;
+        total += weight;
+
+        if (similarity > best)
+        {
+            best = similarity;
+            bestLight = halfLight;
+        }
+    }
+
+    // nothing around it is the same surface, usually something thin the downsample kept the other side of, the
+    // closest match is better than a blend of the wrong ones
+    vec3 upsampled = total > 0.0001 ? light / total : bestLight;
+
+	reflected_light = upsampled * matColour.rgb;
+}
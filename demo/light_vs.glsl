@@ -16,8 +16,17 @@ layout (location = 0) in vec3 vertexPosition;
 layout (location = 1) in vec3 vertexNormal;
 layout (location = 2) in vec3 lightPosition;
 layout (location = 3) in float lightRange;
+layout (location = 4) in vec4 lightShadowSlot;
+
+// LightCulling::Proxy, the three spheres all take the same path
+const int kProxyFullscreen = 0;
+const int kProxyQuad = 4;
+
+uniform int proxy_type;
+uniform float proxy_scale; // pushes the sphere's faces out past the light's range
 
 out Light vs_light;
+flat out vec4 vs_shadowSlot;
 
 void main(void)
 {
@@ -25,6 +34,31 @@ void main(void)
     light.position = lightPosition;
     light.range = lightRange;
 	vs_light = light;
+	vs_shadowSlot = lightShadowSlot;
 
-	gl_Position = projectionViewMat * vec4((vertexPosition * lightRange) + lightPosition, 1.0);
+    if (proxy_type == kProxyFullscreen)
+    {
+        // the camera is inside, anything in front of the far side of the light along the view direction might be lit
+        vec3 forward = normalize(vec3(projectionViewMat[0][3], projectionViewMat[1][3], projectionViewMat[2][3]));
+        vec4 farSide = projectionViewMat * vec4(lightPosition + forward * lightRange, 1.0);
+        float depth = farSide.w > 0.0 ? min(farSide.z / farSide.w, 1.0) : 1.0;
+        gl_Position = vec4(vertexPosition.xy, depth, 1.0);
+    }
+    else if (proxy_type == kProxyQuad)
+    {
+        // a square facing the camera that touches the front of the light and covers its silhouette
+        vec3 toLight = lightPosition - camPosition;
+        float lightDistance = length(toLight);
+        vec3 direction = toLight / lightDistance;
+        vec3 right = normalize(cross(direction, abs(direction.y) < 0.99 ? vec3(0, 1, 0) : vec3(1, 0, 0)));
+        vec3 up = cross(right, direction);
+        float front = lightDistance - lightRange;
+        float halfSize = front * lightRange / sqrt(max(lightDistance * lightDistance - lightRange * lightRange, 1e-4));
+        vec3 corner = lightPosition - direction * lightRange + (right * vertexPosition.x + up * vertexPosition.y) * halfSize;
+        gl_Position = projectionViewMat * vec4(corner, 1.0);
+    }
+    else
+    {
+        gl_Position = projectionViewMat * vec4((vertexPosition * lightRange * proxy_scale) + lightPosition, 1.0);
+    }
 }
@@ -0,0 +1,117 @@
+#version 430 core
+
+// one invocation per meshlet of a chunk, MeshletCuller::kGroupSize
+layout(local_size_x = 64) in;
+
+struct Meshlet
+{
+    vec4 sphere; // centre and radius in the mesh's space
+    vec4 cone; // axis and cutoff, a cutoff of 1 is never back facing
+    uint firstElement;
+    uint triangleCount;
+    uint vertexCount;
+    uint padding;
+};
+
+layout(std430, binding = 6) readonly buffer BufferMeshlets
+{
+    Meshlet meshlets[];
+};
+
+// the frame's packed instances, InstanceData is a mat4x3 then the material index
+layout(std430, binding = 7) readonly buffer BufferPackedInstances
+{
+    float instanceData[];
+};
+
+// x is the packed instance, y the first meshlet, z the meshlet count with the bucket above the low 16 bits and w the
+// mesh's base vertex
+layout(std430, binding = 8) readonly buffer BufferMeshletChunks
+{
+    uvec4 chunks[];
+};
+
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    uint baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 9) writeonly buffer BufferMeshletCommands
+{
+    DrawCommand commands[];
+};
+
+layout(std430, binding = 10) buffer BufferMeshletCounters
+{
+    uint commandBase[2];
+    uint commandCount[2];
+    uint trianglesInView[2];
+};
+
+uniform vec4 frustum_planes[6];
+uniform vec3 camera_position;
+// only while the gbuffer culls back faces, without that a meshlet facing away is still drawn from behind
+uniform bool cone_culling;
+
+const uint kInstanceFloats = 13;
+
+void main(void)
+{
+    uint chunkIndex = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    if (chunkIndex >= uint(chunks.length()))
+    {
+        return;
+    }
+    uvec4 chunk = chunks[chunkIndex];
+    if (gl_LocalInvocationID.x >= (chunk.z & 0xFFFFu))
+    {
+        return;
+    }
+    uint bucket = chunk.z >> 16;
+    Meshlet meshlet = meshlets[chunk.y + gl_LocalInvocationID.x];
+
+    uint base = chunk.x * kInstanceFloats;
+    mat4x3 transform = mat4x3(
+        instanceData[base + 0], instanceData[base + 1], instanceData[base + 2],
+        instanceData[base + 3], instanceData[base + 4], instanceData[base + 5],
+        instanceData[base + 6], instanceData[base + 7], instanceData[base + 8],
+        instanceData[base + 9], instanceData[base + 10], instanceData[base + 11]);
+
+    vec3 scales = vec3(length(transform[0]), length(transform[1]), length(transform[2]));
+    float maxScale = max(scales.x, max(scales.y, scales.z));
+    vec3 centre = transform * vec4(meshlet.sphere.xyz, 1.0);
+    float radius = meshlet.sphere.w * maxScale;
+
+    for (int p = 0; p < 6; ++p)
+    {
+        if (dot(frustum_planes[p].xyz, centre) + frustum_planes[p].w < -radius)
+        {
+            return;
+        }
+    }
+
+    // the cone only holds up under rotation and uniform scale, a mirrored instance winds the other way
+    float minScale = min(scales.x, min(scales.y, scales.z));
+    if (cone_culling && meshlet.cone.w < 1.0 && maxScale - minScale <= maxScale * 0.001)
+    {
+        mat3 basis = mat3(transform);
+        vec3 axis = normalize(basis * meshlet.cone.xyz) * sign(determinant(basis));
+        vec3 toCentre = centre - camera_position;
+        if (dot(toCentre, axis) >= meshlet.cone.w * length(toCentre) + radius)
+        {
+            return;
+        }
+    }
+
+    uint slot = commandBase[bucket] + atomicAdd(commandCount[bucket], 1u);
+    commands[slot].count = meshlet.triangleCount * 3u;
+    commands[slot].instanceCount = 1u;
+    commands[slot].firstIndex = meshlet.firstElement;
+    commands[slot].baseVertex = chunk.w;
+    commands[slot].baseInstance = chunk.x;
+    atomicAdd(trianglesInView[bucket], meshlet.triangleCount);
+}
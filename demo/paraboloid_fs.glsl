@@ -0,0 +1,11 @@
+#version 430
+
+uniform float light_range;
+
+in vec3 vs_offset;
+
+void main(void)
+{
+	// the projection is non linear so the interpolated depth is off between vertices, write the real distance instead
+	gl_FragDepth = length(vs_offset) / light_range;
+}
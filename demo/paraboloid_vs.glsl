@@ -0,0 +1,27 @@
+#version 430
+
+// one hemisphere of a dual paraboloid shadow map, hemisphere is 1 for the +z half and -1 for the -z half
+uniform vec3 light_position;
+uniform float light_range;
+uniform float hemisphere;
+
+layout (location = 0) in vec3 position;
+layout (location = 2) in mat4x3 instanceMat;
+
+out vec3 vs_offset;
+
+void main(void)
+{
+	vec3 pos = instanceMat * vec4(position, 1);
+	vec3 offset = pos - light_position;
+	offset.z *= hemisphere;
+	vs_offset = offset;
+
+	float len = length(offset);
+	vec3 dir = offset / len;
+
+	// anything behind the paraboloid belongs to the other hemisphere
+	gl_ClipDistance[0] = dir.z;
+
+	gl_Position = vec4(dir.xy / (1.0 + dir.z), len / light_range * 2.0 - 1.0, 1.0);
+}
@@ -0,0 +1,6 @@
+#version 430
+
+// depth only, nothing to write
+void main(void)
+{
+}
@@ -0,0 +1,13 @@
+#version 430
+
+uniform mat4 light_matrix;
+
+layout (location = 0) in vec3 position;
+layout (location = 2) in mat4x3 instanceMat;
+
+void main(void)
+{
+	vec4 pos = vec4(instanceMat * vec4(position, 1), 1);
+
+	gl_Position = light_matrix * pos;
+}
@@ -0,0 +1,13 @@
+#version 430
+
+// the low triangle_bits hold the triangle within the mesh, the rest hold the instance
+uniform uint triangle_bits;
+
+flat in uint vs_instance;
+
+out uint visibility;
+
+void main(void)
+{
+    visibility = (vs_instance << triangle_bits) | uint(gl_PrimitiveID);
+}
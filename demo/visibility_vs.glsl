@@ -0,0 +1,21 @@
+#version 430
+
+layout(std140, binding = 0) buffer BufferRender
+{
+    mat4 projectionViewMat;
+    vec3 camPosition;
+};
+
+layout (location = 0) in vec3 position;
+layout (location = 2) in mat4x3 instanceMat;
+
+// where this mesh's instances start in BufferVisibilityInstances
+uniform uint instance_base;
+
+flat out uint vs_instance;
+
+void main(void)
+{
+    vs_instance = instance_base + uint(gl_InstanceID);
+    gl_Position = projectionViewMat * vec4(instanceMat * vec4(position, 1), 1);
+}